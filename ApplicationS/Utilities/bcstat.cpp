@@ -0,0 +1,260 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 17.10.2026 09:00
+
+#include "bcstat.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <argparse/argparse.hpp>
+
+#include <PadOS/Time.h>
+#include <System/AppDefinition.h>
+#include <Threads/Threads.h>
+
+#include "FileUtilityHelpers.h"
+
+
+namespace shutil_bcstat
+{
+
+static constexpr size_t MAX_DEVICES       = 16;
+static constexpr int    HEADER_LINE_COUNT = 20; // Lines between repeated headers.
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+CmdBCStat::~CmdBCStat()
+{
+    if (m_StatsDevice != -1) {
+        close(m_StatsDevice);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+int CmdBCStat::Run(int argc, char* argv[])
+{
+    argparse::ArgumentParser program(
+        argv[0],
+        "1.0",
+        argparse::default_arguments::none);
+
+    program.add_description("Report block cache activity per device. Rates are per second over each interval.");
+    program.add_argument("--help")
+        .help("Print argument help.")
+        .flag();
+    program.add_argument("-d", "--device")
+        .help("Only report the device with file descriptor DEVICE.")
+        .metavar("DEVICE")
+        .scan<'i', int>();
+    program.add_argument("interval")
+        .help("Seconds between reports.")
+        .metavar("INTERVAL")
+        .default_value(1.0)
+        .scan<'g', double>();
+    program.add_argument("count")
+        .help("Number of reports. Runs until interrupted if omitted.")
+        .metavar("COUNT")
+        .default_value(0)
+        .scan<'i', int>();
+
+    try
+    {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::exception& exception)
+    {
+        shutil::WriteAll(
+            STDERR_FILENO,
+            PString::format_string("{}\n", exception.what()));
+        shutil::WriteAll(STDERR_FILENO, program.help().str());
+        return 1;
+    }
+
+    if (program.get<bool>("--help"))
+    {
+        shutil::WriteAll(STDOUT_FILENO, program.help().str());
+        return 0;
+    }
+
+    m_CommandName = argv[0];
+    if (program.is_used("--device")) {
+        m_DeviceFilter = program.get<int>("--device");
+    }
+    const TimeValNanos interval    = TimeValNanos::FromSeconds(std::max(program.get<double>("interval"), 0.1));
+    const int          reportCount = program.get<int>("count");
+
+    m_StatsDevice = open("/dev/bcache/stats", O_RDONLY);
+    if (m_StatsDevice == -1)
+    {
+        shutil::WriteAll(
+            STDERR_FILENO,
+            PString::format_string("{}: failed to open /dev/bcache/stats: {}\n", m_CommandName, strerror(errno)));
+        return 1;
+    }
+
+    std::vector<PBlockCacheStats> stats;
+    if (!ReadStats(stats)) {
+        return 1;
+    }
+    for (const PBlockCacheStats& device : stats) {
+        m_PreviousStats[device.Device] = device;
+    }
+    TimeValNanos previousTime = get_monotonic_time();
+
+    int lineCount = 0;
+    for (int report = 0; reportCount == 0 || report < reportCount; ++report)
+    {
+        snooze(interval);
+
+        if (!ReadStats(stats)) {
+            return 1;
+        }
+        const TimeValNanos curTime        = get_monotonic_time();
+        const double       elapsedSeconds = (curTime - previousTime).AsSeconds();
+        previousTime = curTime;
+
+        for (const PBlockCacheStats& device : stats)
+        {
+            if (m_DeviceFilter != -1 && device.Device != m_DeviceFilter) {
+                continue;
+            }
+            if (lineCount++ % HEADER_LINE_COUNT == 0) {
+                PrintHeader();
+            }
+            // Devices registered since the last report are measured from zero.
+            auto previous = m_PreviousStats.find(device.Device);
+            PrintDevice(device, (previous != m_PreviousStats.end()) ? previous->second : PBlockCacheStats{ .Device = device.Device }, elapsedSeconds);
+        }
+        m_PreviousStats.clear();
+        for (const PBlockCacheStats& device : stats) {
+            m_PreviousStats[device.Device] = device;
+        }
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool CmdBCStat::ReadStats(std::vector<PBlockCacheStats>& outStats)
+{
+    try
+    {
+        PBlockCacheStatsControl control(m_StatsDevice);
+
+        outStats.resize(MAX_DEVICES);
+        const size_t deviceCount = control.GetDeviceStats(outStats.data(), outStats.size());
+        outStats.resize(std::min(deviceCount, MAX_DEVICES));
+        return true;
+    }
+    catch (const std::exception& exception)
+    {
+        shutil::WriteAll(
+            STDERR_FILENO,
+            PString::format_string("{}: failed to read block cache statistics: {}\n", m_CommandName, exception.what()));
+        return false;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void CmdBCStat::PrintHeader()
+{
+    shutil::WriteAll(
+        STDOUT_FILENO,
+        PString::format_string(
+            "{:>3} {:>6} | {:>7} {:>5} {:>6} {:>6} {:>4} | {:>6} {:>6} | {:>5} {:>6} | {:>5} {:>6} {:>4} {:>6} {:>6} {:>6}\n",
+            "dev", "cached", "look/s", "hit%", "load/s", "evic/s", "ra%", "dird/s", "diwr/s",
+            "dirty", "oldest", "wr/s", "wbuf/s", "amp", "age", "lat", "maxlat"));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Print one line with the rates between two samples of a device. Ages and
+/// latencies are averages over the interval, except "maxlat" which is the
+/// longest write since boot.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void CmdBCStat::PrintDevice(const PBlockCacheStats& current, const PBlockCacheStats& previous, double elapsedSeconds)
+{
+    // The counters wrap, so unsigned differences are correct across a wrap.
+    const uint32_t lookups          = current.Lookups - previous.Lookups;
+    const uint32_t hits             = current.Hits - previous.Hits;
+    const uint32_t readAheadBlocks  = current.ReadAheadBlocks - previous.ReadAheadBlocks;
+    const uint32_t readAheadHits    = current.ReadAheadHits - previous.ReadAheadHits;
+    const uint32_t flushWrites      = current.FlushWrites - previous.FlushWrites;
+    const uint32_t flushedBuffers   = current.FlushedBuffers - previous.FlushedBuffers;
+    const uint32_t flushedDirty     = current.FlushedDirtyBuffers - previous.FlushedDirtyBuffers;
+    const uint32_t flushedDirtyAge  = current.FlushedDirtyAge - previous.FlushedDirtyAge;
+    const uint32_t flushTime        = current.FlushTime - previous.FlushTime;
+
+    auto rate    = [elapsedSeconds](uint32_t count) { return (elapsedSeconds > 0.0) ? double(count) / elapsedSeconds : 0.0; };
+    auto percent = [](uint32_t count, uint32_t total) { return (total != 0) ? double(count) * 100.0 / double(total) : 0.0; };
+    auto ratio   = [](uint32_t count, uint32_t total) { return (total != 0) ? double(count) / double(total) : 0.0; };
+
+    shutil::WriteAll(
+        STDOUT_FILENO,
+        PString::format_string(
+            "{:>3} {:>6} | {:>7.0f} {:>5.1f} {:>6.0f} {:>6.0f} {:>4.0f} | {:>6.0f} {:>6.0f} | {:>5} {:>6} | {:>5.0f} {:>6.0f} {:>4.2f} {:>6} {:>6} {:>6}\n",
+            current.Device,
+            current.CachedBuffers,
+            rate(lookups),
+            percent(hits, lookups),
+            rate(current.LoadedBuffers - previous.LoadedBuffers),
+            rate(current.Evictions - previous.Evictions),
+            percent(readAheadHits, readAheadBlocks),
+            rate(current.DirectReadBlocks - previous.DirectReadBlocks),
+            rate(current.DirectWriteBlocks - previous.DirectWriteBlocks),
+            current.DirtyBlocks,
+            PString::format_time_period(TimeValNanos::FromMilliseconds(current.OldestDirtyAge), true),
+            rate(flushWrites),
+            rate(flushedBuffers),
+            ratio(flushedBuffers, flushedDirty),
+            PString::format_time_period(TimeValNanos::FromMilliseconds(int64_t(ratio(flushedDirtyAge, flushedDirty))), true),
+            PString::format_time_period(TimeValNanos::FromMicroseconds(int64_t(ratio(flushTime, flushWrites))), true),
+            PString::format_time_period(TimeValNanos::FromMicroseconds(current.MaxFlushTime), true)));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+int bcstat_main(int argc, char* argv[])
+{
+    CmdBCStat command;
+    return command.Run(argc, argv);
+}
+
+static PAppDefinition g_BCStatAppDef(
+    "bcstat",
+    "Report block cache statistics per device once per interval.",
+    bcstat_main);
+
+} // namespace shutil_bcstat
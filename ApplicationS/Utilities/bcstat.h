@@ -0,0 +1,53 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 17.10.2026 09:00
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include <DeviceControl/BlockCacheStats.h>
+#include <System/TimeValue.h>
+#include <Utils/String.h>
+
+
+namespace shutil_bcstat
+{
+
+class CmdBCStat
+{
+public:
+    ~CmdBCStat();
+
+    int Run(int argc, char* argv[]);
+
+private:
+    bool ReadStats(std::vector<PBlockCacheStats>& outStats);
+    void PrintHeader();
+    void PrintDevice(const PBlockCacheStats& current, const PBlockCacheStats& previous, double elapsedSeconds);
+
+    PString                         m_CommandName;
+    int                             m_StatsDevice = -1;
+    int                             m_DeviceFilter = -1;
+    std::map<int, PBlockCacheStats> m_PreviousStats;
+};
+
+int bcstat_main(int argc, char* argv[]);
+
+} // namespace shutil_bcstat
@@ -37,6 +37,7 @@
 #include <sys/wait.h>
 
 #include <argparse/argparse.hpp>
+#include <DeviceControl/ReadDirectoryPlus.h>
 
 #include <Storage/DirectoryEntry.h>
 #include <Storage/Path.h>
@@ -381,21 +382,20 @@ void CmdFind::VisitPath(
         return;
     }
 
-    std::vector<PString> entries;
+    std::vector<FindDirectoryEntry> entries;
     ReadDirectoryEntries(path, entries);
 
-    for (const PString& entryName : entries)
+    for (FindDirectoryEntry& entry : entries)
     {
-        const PString childPath = MakeChildPath(path, entryName);
-        stat_t childStatBuffer;
+        const PString childPath = MakeChildPath(path, entry.Name);
 
-        if (ReadNodeStat(childPath, childStatBuffer))
+        if (entry.HasStat || ReadNodeStat(childPath, entry.StatBuffer))
         {
             VisitPath(
                 childPath,
-                entryName,
+                entry.Name,
                 depth + 1,
-                childStatBuffer,
+                entry.StatBuffer,
                 traversalDevice);
         }
     }
@@ -443,7 +443,7 @@ bool CmdFind::ReadNodeStat(const PString& path, stat_t& statBuffer)
 
 void CmdFind::ReadDirectoryEntries(
     const PString& path,
-    std::vector<PString>& entries)
+    std::vector<FindDirectoryEntry>& entries)
 {
     const int directoryHandle =
         open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
@@ -462,11 +462,10 @@ void CmdFind::ReadDirectoryEntries(
 
     for (;;)
     {
-        const ssize_t readResult = posix_getdents(
+        const ssize_t readResult = read_directory_plus(
             directoryHandle,
             directoryEntryBuffer.GetBuffer(),
-            directoryEntryBuffer.GetSize(),
-            0);
+            directoryEntryBuffer.GetSize());
 
         if (readResult == 0) {
             break;
@@ -490,9 +489,16 @@ void CmdFind::ReadDirectoryEntries(
                 continue;
             }
 
-            entries.emplace_back(
-                directoryEntry.d_name,
-                directoryEntry.d_namlen);
+            FindDirectoryEntry& entry = entries.emplace_back();
+            entry.Name.assign(directoryEntry.d_name, directoryEntry.d_namlen);
+
+            // Entries without a stat are stat'ed by path when visited.
+            const struct stat* entryStat = PGetDirEntryStat(directoryEntry);
+            if (entryStat != nullptr)
+            {
+                entry.StatBuffer = *entryStat;
+                entry.HasStat = true;
+            }
         }
     }
 
@@ -52,6 +52,14 @@ enum class FindActionType
 };
 
 
+struct FindDirectoryEntry
+{
+    PString Name;
+    stat_t  StatBuffer;
+    bool    HasStat = false;
+};
+
+
 struct FindAction
 {
     FindActionType       Type = FindActionType::Print;
@@ -83,7 +91,7 @@ private:
         dev_t traversalDevice
     );
     bool ReadNodeStat(const PString& path, stat_t& statBuffer);
-    void ReadDirectoryEntries(const PString& path, std::vector<PString>& entries);
+    void ReadDirectoryEntries(const PString& path, std::vector<FindDirectoryEntry>& entries);
     bool Matches(const PString& name, mode_t mode) const;
     bool MatchesFileType(mode_t mode) const;
     void PerformActions(const PString& path);
@@ -28,6 +28,7 @@
 #include <argparse/argparse.hpp>
 
 #include <Kernel/DebugConsole/KConsoleCommand.h>
+#include <DeviceControl/ReadDirectoryPlus.h>
 #include <Storage/DirectoryEntry.h>
 #include <Utils/ANSIEscapeCodeParser.h>
 #include <System/AppDefinition.h>
@@ -223,11 +224,10 @@ void CCmdLS::ListDirectory(const std::string& path)
 
         for (;;)
         {
-            const ssize_t readResult = posix_getdents(
+            const ssize_t readResult = read_directory_plus(
                 directory,
                 directoryEntryBuffer.GetBuffer(),
-                directoryEntryBuffer.GetSize(),
-                0);
+                directoryEntryBuffer.GetSize());
             if (readResult <= 0) {
                 break;
             }
@@ -252,34 +252,38 @@ void CCmdLS::ListDirectory(const std::string& path)
                 }
                 int error = 0;
                 stat_t fileStat;
-                int fd = openat(directory, entry.d_name, O_PATH | O_NOFOLLOW);
-                if (fd != -1)
+                const struct stat* entryStat = PGetDirEntryStat(entry);
+                if (entryStat != nullptr)
                 {
-                    if (fstat(fd, &fileStat) == 0)
+                    fileStat = *entryStat;
+                }
+                else
+                {
+                    // The filesystem could not describe the entry without
+                    // loading it, so stat it the slow way.
+                    const int fd = openat(directory, entry.d_name, O_PATH | O_NOFOLLOW);
+                    if (fd == -1 || fstat(fd, &fileStat) != 0) {
+                        error = errno;
+                    }
+                    if (fd != -1) {
+                        close(fd);
+                    }
+                }
+                if (error == 0)
+                {
+                    PString linkTarget;
+                    if (S_ISLNK(fileStat.st_mode))
                     {
-                        PString linkTarget;
-                        if (S_ISLNK(fileStat.st_mode))
+                        linkTarget.resize(size_t(fileStat.st_size));
+                        if (readlinkat(directory, entry.d_name, linkTarget.data(), linkTarget.size()) < 0)
                         {
-                            linkTarget.resize(size_t(fileStat.st_size));
-                            if (readlinkat(fd, "", linkTarget.data(), linkTarget.size()) < 0)
-                            {
-                                Print("Error: {}/{} - {}", path, entry.d_name, strerror(errno));
-                                linkTarget.clear();
-                            }
+                            Print("Error: {}/{} - {}", path, entry.d_name, strerror(errno));
+                            linkTarget.clear();
                         }
-                        files.push_back(FileEntry{ entry.d_name, linkTarget, fileStat });
-                    }
-                    else
-                    {
-                        error = errno;
                     }
-                    close(fd);
+                    files.push_back(FileEntry{ entry.d_name, linkTarget, fileStat });
                 }
                 else
-                {
-                    error = errno;
-                }
-                if (error != 0)
                 {
                     Print("Error: {}/{} - {}", path, entry.d_name, strerror(error));
                 }
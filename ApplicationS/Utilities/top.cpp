@@ -23,10 +23,14 @@
 #include <algorithm>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
 #include <termios.h>
+#include <unistd.h>
 #include <sys/pados_types.h>
 #include <sys/pados_threads.h>
 
+#include <DeviceControl/ThreadStats.h>
 #include <System/AppDefinition.h>
 
 #include <PadOS/Filesystem.h>
@@ -51,8 +55,30 @@ namespace shutil_top
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-int CmdTop::Run(TimeValNanos period)
+CmdTop::CmdTop()
 {
+    m_ThreadStatsDevice = open("/dev/kernel/threads", O_RDONLY);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+CmdTop::~CmdTop()
+{
+    if (m_ThreadStatsDevice != -1) {
+        close(m_ThreadStatsDevice);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+int CmdTop::Run(TimeValNanos period, bool latencyView)
+{
+    m_LatencyView = latencyView;
+
     printf(ANSI_CLEAR_SCREEN ANSI_CURSOR_TOP_LEFT "Wait for initial update\n");
     update_list();
 
@@ -61,7 +87,11 @@ int CmdTop::Run(TimeValNanos period)
     for (;;)
     {
         update_list();
-        print_list();
+        if (m_LatencyView) {
+            print_latency_list();
+        } else {
+            print_list();
+        }
         snooze(period);
     }
     return 0;
@@ -82,8 +112,10 @@ void CmdTop::insert_thread(ThreadInfo* psInfo)
             m_ThreadList[i]->RunNumber = m_RunNumber;
 
             m_ThreadList[i]->Priority = psInfo->Priority;
+            m_ThreadList[i]->DynamicPriority = psInfo->DynamicPri;
             m_ThreadList[i]->ThreadName = psInfo->ThreadName;
             m_ThreadList[i]->ProcName = psInfo->ProcessName;
+            update_scheduling_stats(*m_ThreadList[i]);
             return;
         }
     }
@@ -94,11 +126,16 @@ void CmdTop::insert_thread(ThreadInfo* psInfo)
     threadInfo->ThisTime    = TimeValNanos::FromNanoseconds(psInfo->UserTimeNano);
     threadInfo->LastTime    = TimeValNanos::FromNanoseconds(psInfo->UserTimeNano);
     threadInfo->Priority    = psInfo->Priority;
+    threadInfo->DynamicPriority = psInfo->DynamicPri;
+    threadInfo->PriorityInversionCount = 0;
+    threadInfo->HasLatencyHistograms = false;
     threadInfo->RunNumber   = m_RunNumber;
 
     threadInfo->ThreadName  = psInfo->ThreadName;
     threadInfo->ProcName    = psInfo->ProcessName;
 
+    update_scheduling_stats(*threadInfo);
+
     m_ThreadList.push_back(threadInfo);
 }
 
@@ -106,6 +143,37 @@ void CmdTop::insert_thread(ThreadInfo* psInfo)
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
+void CmdTop::update_scheduling_stats(TopThreadInfo& info)
+{
+    if (m_ThreadStatsDevice == -1) {
+        return;
+    }
+    try
+    {
+        PThreadStatsControl threadStats(m_ThreadStatsDevice);
+
+        PThreadSchedulingStats stats;
+        threadStats.GetSchedulingStats(info.ThreadID, &stats);
+
+        info.DynamicPriority        = stats.DynamicPriority;
+        info.PriorityInversionCount = stats.PriorityInversionCount;
+
+        if (m_LatencyView)
+        {
+            threadStats.GetLatencyHistograms(info.ThreadID, &info.LatencyHistograms);
+            info.HasLatencyHistograms = true;
+        }
+    }
+    catch (const std::exception&)
+    {
+        // The thread died after it was listed.
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
 void CmdTop::print_list()
 {
     struct winsize winSize;
@@ -129,10 +197,10 @@ void CmdTop::print_list()
         const Ptr<TopThreadInfo>& psInfo = m_ThreadList[i];
         TimeValNanos deltaTime = psInfo->ThisTime - psInfo->LastTime;
 
-        PString text = PString::format_string("{:<15.15} {:<20.20} ({:04}:{:04}) {:4}, {:.3f}ms {:5.1f}%",
+        PString text = PString::format_string("{:<15.15} {:<20.20} ({:04}:{:04}) {:4}/{:<4} {:4}, {:.3f}ms {:5.1f}%",
             psInfo->ProcName, psInfo->ThreadName,
             psInfo->ProcessID, psInfo->ThreadID,
-            psInfo->Priority,
+            psInfo->Priority, psInfo->DynamicPriority, psInfo->PriorityInversionCount,
             deltaTime.AsSeconds() * 0.001, deltaTime.AsSeconds() * 100.0 * totalTimeInverse
         );
         if (text.size() > winSize.ws_col) text.resize(winSize.ws_col);
@@ -152,6 +220,100 @@ void CmdTop::print_list()
     fflush(stdout);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Upper bound of the histogram bucket holding the given percentile.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+static PString format_histogram_percentile(const uint32_t* buckets, double percentile)
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < PTHREAD_LATENCY_HISTOGRAM_BUCKETS; ++i) {
+        total += buckets[i];
+    }
+    if (total == 0) {
+        return "-";
+    }
+    const uint64_t target = std::max<uint64_t>(1, uint64_t(double(total) * percentile + 0.5));
+    uint64_t       count  = 0;
+    size_t         bucket = 0;
+    for (; bucket < PTHREAD_LATENCY_HISTOGRAM_BUCKETS - 1; ++bucket)
+    {
+        count += buckets[bucket];
+        if (count >= target) {
+            break;
+        }
+    }
+    if (bucket == 0) {
+        return "<1us";
+    }
+    if (bucket == PTHREAD_LATENCY_HISTOGRAM_BUCKETS - 1) {
+        return PString::format_string(">{}", PString::format_time_period(TimeValNanos::FromMicroseconds(int64_t(1) << (bucket - 1)), true));
+    }
+    return PString::format_time_period(TimeValNanos::FromMicroseconds(int64_t(1) << bucket), true);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void CmdTop::print_latency_list()
+{
+    struct winsize winSize;
+
+    device_control(0, TIOCGWINSZ, nullptr, 0, &winSize, sizeof(winSize));
+
+    const size_t lineCount = std::min<size_t>(m_ThreadList.size() + 1, winSize.ws_row);
+
+    printf(ANSI_CURSOR_TOP_LEFT);
+
+    for (size_t i = 0; i < lineCount; ++i)
+    {
+        PString text;
+        if (i == 0)
+        {
+            text = PString::format_string("{:<20.20} {:>4} | {:>9} {:>9} {:>9} | {:>9} {:>9} {:>9}",
+                "Thread", "TID", "ready p50", "p99", "max", "slice p50", "p99", "max"
+            );
+        }
+        else
+        {
+            const Ptr<TopThreadInfo>& psInfo = m_ThreadList[i - 1];
+            if (psInfo->HasLatencyHistograms)
+            {
+                const PThreadLatencyHistograms& histograms = psInfo->LatencyHistograms;
+                text = PString::format_string("{:<20.20} {:4} | {:>9} {:>9} {:>9} | {:>9} {:>9} {:>9}",
+                    psInfo->ThreadName, psInfo->ThreadID,
+                    format_histogram_percentile(histograms.ReadyLatency, 0.5),
+                    format_histogram_percentile(histograms.ReadyLatency, 0.99),
+                    format_histogram_percentile(histograms.ReadyLatency, 1.0),
+                    format_histogram_percentile(histograms.RunSlice, 0.5),
+                    format_histogram_percentile(histograms.RunSlice, 0.99),
+                    format_histogram_percentile(histograms.RunSlice, 1.0)
+                );
+            }
+            else
+            {
+                text = PString::format_string("{:<20.20} {:4} | no latency data", psInfo->ThreadName, psInfo->ThreadID);
+            }
+        }
+        if (text.size() > winSize.ws_col) text.resize(winSize.ws_col);
+
+        if (i == 0) {
+            printf("%s", text.c_str());
+        } else {
+            printf("\n%s", text.c_str());
+        }
+        if (text.size() < winSize.ws_col) {
+            printf(ANSI_CLEAR_TO_END_OF_LINE);
+        }
+    }
+    if (lineCount < winSize.ws_row) {
+        printf("\n" ANSI_CLEAR_TO_END_OF_SCREEN);
+    }
+    fflush(stdout);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -188,9 +350,15 @@ void CmdTop::update_list()
 int top_main(int argc, char** argv)
 {
     TimeValNanos period = TimeValNanos::FromSeconds(5.0);
+    bool         latencyView = false;
 
-    if (argc == 2) {
-        period = TimeValNanos::FromSeconds(atof(argv[1]));
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-l") == 0) {
+            latencyView = true;
+        } else {
+            period = TimeValNanos::FromSeconds(atof(argv[i]));
+        }
     }
 
 
@@ -207,7 +375,7 @@ int top_main(int argc, char** argv)
             }
         );
 
-        return top->Run(period);
+        return top->Run(period, latencyView);
     }
     catch(const std::exception& exc)
     {
@@ -215,6 +383,6 @@ int top_main(int argc, char** argv)
     }
 }
 
-static PAppDefinition g_TopAppDef("top", "Show process/thread information.", top_main);
+static PAppDefinition g_TopAppDef("top", "Show process/thread information. Use -l for scheduling latency histograms.", top_main);
 
 } //namespace shutil_top
@@ -24,6 +24,8 @@
 #include <sys/pados_threads.h>
 #include <sys/pados_types.h>
 
+#include <DeviceControl/ThreadStats.h>
+
 #include <Ptr/Ptr.h>
 #include <System/TimeValue.h>
 #include <Utils/String.h>
@@ -41,21 +43,32 @@ struct TopThreadInfo : public PtrTarget
     PString         ThreadName;
     PString         ProcName;
     int             Priority;
+    int             DynamicPriority;
+    uint32_t        PriorityInversionCount;
     uint32_t        RunNumber;
+    bool            HasLatencyHistograms;
+    PThreadLatencyHistograms LatencyHistograms;
 };
 
 class CmdTop : public PtrTarget
 {
 public:
-    int Run(TimeValNanos period);
+    CmdTop();
+    ~CmdTop();
+
+    int Run(TimeValNanos period, bool latencyView);
 
 private:
     void insert_thread(ThreadInfo* threadInfo);
+    void update_scheduling_stats(TopThreadInfo& info);
     void print_list();
+    void print_latency_list();
     void update_list();
 
     std::vector<Ptr<TopThreadInfo>> m_ThreadList;
     uint32_t                        m_RunNumber = 1;
+    int                             m_ThreadStatsDevice = -1;
+    bool                            m_LatencyView = false;
 };
 
 int top_main(int argc, char** argv);
@@ -0,0 +1,79 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 17.10.2026 09:00
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <DeviceControl/DeviceControlInvoker.h>
+
+
+static constexpr int PBlockCacheStatsRequest_GetDeviceStats = 0;
+
+// Per-device block cache statistics. Counters are free-running 32-bit
+// values that wrap, so rates must be computed from the difference between
+// two samples. Gauges and maximums are marked as such.
+struct PBlockCacheStats
+{
+    int32_t     Device;
+    uint32_t    BufferSize;         // Gauge. Cache buffer size used for the device.
+    uint32_t    CachedBuffers;      // Gauge. Buffers currently cached for the device.
+    uint32_t    Lookups;            // Block lookups through the cache.
+    uint32_t    Hits;               // Lookups that found the buffer in the cache.
+    uint32_t    LoadedBuffers;      // Buffers read from the device, including read-ahead.
+    uint32_t    Evictions;          // Buffers evicted to make room for other blocks.
+    uint32_t    ReadAheadWindow;    // Gauge. Current read-ahead window in buffers.
+    uint32_t    ReadAheadBlocks;    // Buffers loaded by read-ahead.
+    uint32_t    ReadAheadHits;      // Read-ahead buffers used before eviction.
+    uint32_t    ReadAheadWasted;    // Read-ahead buffers evicted without being used.
+    uint32_t    DirectReadBlocks;   // Device blocks read past the cache.
+    uint32_t    DirectWriteBlocks;  // Device blocks written past the cache.
+    uint32_t    DirtyBlocks;        // Gauge. Buffers waiting to be written.
+    uint32_t    OldestDirtyAge;     // Gauge. Age of the oldest dirty buffer in milliseconds.
+    uint32_t    FlushWrites;        // Write requests issued by the flusher.
+    uint32_t    FlushedBuffers;     // Buffers written, including clean buffers bridging gaps in a run.
+    uint32_t    FlushedDirtyBuffers;// Dirty buffers written.
+    uint32_t    FlushedDirtyAge;    // Sum of the age of dirty buffers when written, in milliseconds.
+    uint32_t    MaxFlushedDirtyAge; // Maximum. Oldest dirty buffer written, in milliseconds.
+    uint32_t    FlushTime;          // Time spent in flusher writes, in microseconds.
+    uint32_t    MaxFlushTime;       // Maximum. Longest flusher write, in microseconds.
+};
+
+class PBlockCacheStatsControl : public PDeviceControlInterface
+{
+public:
+    PBlockCacheStatsControl()
+        : GetDeviceStats(*this)
+    {
+    }
+
+    explicit PBlockCacheStatsControl(int fileHandle)
+        : PBlockCacheStatsControl()
+    {
+        SetDeviceFD(fileHandle);
+    }
+
+    // Fill in up to "maxCount" entries, and return the number of devices
+    // with a block cache. That can be larger than "maxCount".
+    PDeviceControlInvoker<
+        PBlockCacheStatsRequest_GetDeviceStats,
+        size_t(PBlockCacheStats* outStats, size_t maxCount) const
+    > GetDeviceStats;
+};
@@ -0,0 +1,58 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 22.10.2026 10:00
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <PadOS/Filesystem.h>
+
+// Reserve space without changing the file size. Without it, the file is
+// extended to cover the range, and the new part reads as zeros.
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE 0x01
+#endif
+
+// Device control request accepted by regular files. Handled by the VFS,
+// which passes it on to the filesystem's Allocate().
+static constexpr int PFileRequest_Allocate = 0x46414c43; // 'FALC'
+
+struct PFileAllocateArgs
+{
+    int32_t Mode;   // Zero or FALLOC_FL_KEEP_SIZE.
+    off64_t Offset;
+    off64_t Length;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// Allocate storage for "length" bytes at "offset" in the file, in the
+/// style of Linux fallocate(). A "mode" of zero behaves like
+/// posix_fallocate(). On FAT volumes the space is allocated as one
+/// contiguous run when possible. Space reserved past the end of the file
+/// with FALLOC_FL_KEEP_SIZE is released when the last writable handle to
+/// the file is closed.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+inline PErrorCode file_allocate(int file, int mode, off64_t offset, off64_t length)
+{
+    const PFileAllocateArgs args = { mode, offset, length };
+    return device_control(file, PFileRequest_Allocate, &args, sizeof(args), nullptr, 0);
+}
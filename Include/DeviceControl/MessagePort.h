@@ -0,0 +1,66 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 17.10.2026 10:00
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/pados_types.h>
+
+#include <DeviceControl/DeviceControlInvoker.h>
+
+
+#define PMESSAGE_PORT_CONTROL_PATH "/dev/kernel/message_ports"
+
+static constexpr int PMessagePortRequest_ReceiveMultiple = 0;
+
+// Payloads in a batch are packed in the caller's buffer, each starting at
+// a multiple of PMESSAGE_PORT_BATCH_ALIGNMENT.
+static constexpr size_t PMESSAGE_PORT_BATCH_ALIGNMENT = 8;
+
+struct PMessagePortBatchEntry
+{
+    handler_id  TargetHandler;
+    int32_t     Code;
+    uint32_t    Offset;     // Offset of the payload in the batch buffer.
+    uint32_t    Length;     // Payload length. Truncated if the message did not fit the buffer.
+};
+
+class PMessagePortControl : public PDeviceControlInterface
+{
+public:
+    PMessagePortControl()
+        : ReceiveMultiple(*this)
+    {
+    }
+
+    explicit PMessagePortControl(int fileHandle)
+        : PMessagePortControl()
+    {
+        SetDeviceFD(fileHandle);
+    }
+
+    // Wait until "deadline" for at least one message, then drain up to
+    // "maxCount" messages that fit in the buffer. Returns the number of
+    // messages received, 0 if the deadline passed.
+    PDeviceControlInvoker<
+        PMessagePortRequest_ReceiveMultiple,
+        size_t(port_id port, PMessagePortBatchEntry* entries, size_t maxCount, void* buffer, size_t bufferSize, bigtime_t deadline) const
+    > ReceiveMultiple;
+};
@@ -0,0 +1,62 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 23.10.2026 10:00
+
+#pragma once
+
+#include <errno.h>
+#include <sys/types.h>
+#include <utility>
+
+#include <PadOS/Filesystem.h>
+#include <Storage/DirectoryEntry.h>
+
+// Device control request accepted by directories. Handled by the VFS, which
+// passes it on to the filesystem's ReadDirectoryPlus(). The output buffer
+// receives the records, followed by a zeroed record header if there is
+// room for one.
+static constexpr int PDirRequest_ReadDirectoryPlus = 0x44495250; // 'DIRP'
+
+///////////////////////////////////////////////////////////////////////////////
+/// Read the next batch of entries from "directory" like posix_getdents(),
+/// with a "struct stat" for each entry stored in the same record. Use
+/// PDirEntryIterator to walk the records, and PGetDirEntryStat() to get the
+/// stat of each. Filesystems that store the attributes in the directory
+/// (like FAT) fill them in from the entry being read, which avoids locating
+/// each inode again for a separate stat(). Returns the number of bytes
+/// written, 0 at the end of the directory, or -1 with errno set.
+///
+/// "buffer" must be aligned to P_DIR_ENTRY_PLUS_ALIGNMENT. PDirEntryBuffer
+/// satisfies that.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+inline ssize_t read_directory_plus(int directory, void* buffer, size_t bufferSize)
+{
+    const PErrorCode result = device_control(directory, PDirRequest_ReadDirectoryPlus, nullptr, 0, buffer, bufferSize);
+    if (result != PErrorCode::Success)
+    {
+        errno = std::to_underlying(result);
+        return -1;
+    }
+    size_t bytesRead = 0;
+    for (PDirEntryIterator iterator(buffer, bufferSize); iterator; ++iterator) {
+        bytesRead += iterator->d_reclen;
+    }
+    return ssize_t(bytesRead);
+}
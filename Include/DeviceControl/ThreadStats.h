@@ -0,0 +1,81 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 10:00
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/pados_types.h>
+
+#include <DeviceControl/DeviceControlInvoker.h>
+
+
+static constexpr int PThreadStatsRequest_GetSchedulingStats    = 0;
+static constexpr int PThreadStatsRequest_GetLatencyHistograms   = 1;
+static constexpr int PThreadStatsRequest_ResetLatencyHistograms = 2;
+
+static constexpr size_t PTHREAD_LATENCY_HISTOGRAM_BUCKETS = 24;
+
+struct PThreadSchedulingStats
+{
+    int32_t     Priority;                   // Priority assigned to the thread.
+    int32_t     DynamicPriority;            // Priority including boosts inherited from mutex waiters.
+    int32_t     MaxPriorityBoost;           // Largest boost received since the thread was created.
+    uint32_t    PriorityInversionCount;     // Number of times the thread was boosted above its own priority.
+};
+
+// Bucket 0 count samples below 1us, bucket N count samples in the range
+// [2^(N-1), 2^N) us, and the last bucket also count everything longer.
+struct PThreadLatencyHistograms
+{
+    uint32_t    ReadyLatency[PTHREAD_LATENCY_HISTOGRAM_BUCKETS];    // From becoming ready until running.
+    uint32_t    RunSlice[PTHREAD_LATENCY_HISTOGRAM_BUCKETS];        // From switched in until switched out.
+};
+
+class PThreadStatsControl : public PDeviceControlInterface
+{
+public:
+    PThreadStatsControl()
+        : GetSchedulingStats(*this)
+        , GetLatencyHistograms(*this)
+        , ResetLatencyHistograms(*this)
+    {
+    }
+
+    explicit PThreadStatsControl(int fileHandle)
+        : PThreadStatsControl()
+    {
+        SetDeviceFD(fileHandle);
+    }
+
+    PDeviceControlInvoker<
+        PThreadStatsRequest_GetSchedulingStats,
+        void(thread_id threadID, PThreadSchedulingStats* outStats) const
+    > GetSchedulingStats;
+
+    PDeviceControlInvoker<
+        PThreadStatsRequest_GetLatencyHistograms,
+        void(thread_id threadID, PThreadLatencyHistograms* outHistograms) const
+    > GetLatencyHistograms;
+
+    PDeviceControlInvoker<
+        PThreadStatsRequest_ResetLatencyHistograms,
+        void(thread_id threadID)
+    > ResetLatencyHistograms;
+};
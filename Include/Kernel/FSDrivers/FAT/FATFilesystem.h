@@ -24,13 +24,17 @@
 #include <Kernel/VFS/KFilesystem.h>
 
 class PString;
+class PDirEntryWriter;
 
 namespace kernel
 {
 
 class FATVolume;
 class FATInode;
+struct FATDirectoryNode;
+class FATDirectoryIndex;
 struct FATNewDirEntryInfo;
+struct FATDirectoryEntryInfo;
 
 //#define FAT_VERIFY_FAT_CHAINS
 
@@ -56,6 +60,7 @@ public:
     virtual void                WriteFSStat(Ptr<KFSVolume> volume, const fs_info* fsinfo, uint32_t mask) override;
     
     virtual Ptr<KInode>         LocateInode(Ptr<KFSVolume> volume, Ptr<KInode> parent, const char* name, int nameLength) override;
+    virtual bool                SupportsNameCache() const override;
     virtual void                ReleaseInode(KInode* inode) override;
     virtual Ptr<KFileNode>      OpenFile(Ptr<KFSVolume> volume, Ptr<KInode> node, int openFlags) override;
     virtual Ptr<KFileNode>      CreateFile(Ptr<KFSVolume> volume, Ptr<KInode> parent, const char* name, int nameLength, int openFlags, int permission) override;
@@ -74,6 +79,7 @@ public:
     virtual size_t              Read(Ptr<KFileNode> file, void* buffer, size_t length, off64_t position) override;
     virtual size_t              Write(Ptr<KFileNode> file, const void* buffer, size_t length, off64_t position) override;
     virtual size_t              ReadDirectory(Ptr<KFSVolume> volume, Ptr<KDirectoryNode> directory, void* buffer, size_t bufferSize) override;
+    virtual size_t              ReadDirectoryPlus(Ptr<KFSVolume> volume, Ptr<KDirectoryNode> directory, void* buffer, size_t bufferSize) override;
     virtual void                RewindDirectory(Ptr<KFSVolume> volume, Ptr<KDirectoryNode> dirNode) override;
     virtual size_t              ReadLink(Ptr<KFSVolume> volume, Ptr<KInode> node, char* buffer, size_t bufferSize) override;
 
@@ -82,13 +88,18 @@ public:
     virtual void                ReadStat(Ptr<KFSVolume> volume, Ptr<KInode> inode, struct stat* statBuf) override;
     virtual void                WriteStat(Ptr<KFSVolume> volume, Ptr<KInode> node, const struct stat* stat, uint32_t mask) override;
     virtual void                Sync(Ptr<KFileNode> file) override;
+    virtual void                Allocate(Ptr<KFileNode> file, int mode, off64_t offset, off64_t length) override;
 
     virtual void                DeviceControl(Ptr<KFileNode> file, int request, const void* inData, size_t inDataLength, void* outData, size_t outDataLength) override;
 
     static mode_t DOSAttribsToFileMode(uint8_t dosAttribs);
 private:
     static void CopyVolumeLabelToFSInfo(const FATVolume& volume, fs_info* fsInfo);
+    size_t DoReadDirectory(Ptr<FATVolume> vol, Ptr<FATDirectoryNode> dirNode, Ptr<FATInode> dir, PDirEntryWriter& entryWriter);
+    void ReadEntryStat(Ptr<FATVolume> vol, Ptr<FATInode> dir, ino_t inodeID, const PString& fileName, const FATDirectoryEntryInfo& info, struct stat* statBuf);
     uint32_t CreateVolumeLabel(Ptr<FATVolume> vol, const char* name);
+    FATDirectoryIndex* GetDirectoryIndex(Ptr<FATVolume> volume, Ptr<FATInode> directory);
+    void AddDirectoryIndexEntry(Ptr<FATVolume> volume, Ptr<FATInode> directory, uint32_t startIndex) noexcept;
     bool FindShortName(Ptr<FATVolume> vol, Ptr<FATInode> parent, const char* rawShortName);
     bool FindNameCollision(Ptr<FATVolume> volume, Ptr<FATInode> parent, const PString& name, FATInode* excludedNode);
     Ptr<FATInode> DoLocateInode(Ptr<FATVolume> vol, Ptr<FATInode> dir, const PString& fileName);
@@ -96,14 +107,16 @@ private:
     bool IsDirectoryAncestor(Ptr<FATVolume> volume, Ptr<FATInode> ancestor, Ptr<FATInode> directory);
     void EnsureClusterChainMetadataLoaded(Ptr<FATVolume> volume, Ptr<FATInode> node);
     uint32_t GetFileClusterCount(Ptr<FATVolume> volume, off64_t fileSize);
+    uint32_t GetFileCluster(Ptr<FATVolume> volume, Ptr<FATInode> node, uint32_t clusterIndex);
     void ClearFileRange(Ptr<FATVolume> volume, Ptr<FATInode> node, off64_t startPosition, off64_t endPosition);
+    void TrimPreallocatedClusters(Ptr<FATVolume> volume, Ptr<FATInode> node);
     void ResizeFile(Ptr<FATVolume> volume, Ptr<FATInode> node, off64_t fileSize, bool updateModificationTime);
     void UpdateDirectoryParentEntry(Ptr<FATVolume> volume, Ptr<FATInode> directory, Ptr<FATInode> parent);
     void CreateDirectoryEntry(Ptr<FATVolume> vol, Ptr<FATInode> parent, Ptr<FATInode> node, const PString& name, FATInode* collisionExclusion, uint32_t* startIndex, uint32_t* endIndex);
     void DoCreateDirectoryEntry(Ptr<FATVolume> vol, Ptr<FATInode> dir, FATNewDirEntryInfo* info, const char shortName[11], const wchar16_t* longName, uint32_t longNameLength, uint32_t* startIndex, uint32_t* endIndex);
     void CompactDirectory(Ptr<FATVolume> vol, Ptr<FATInode> dir);
     void CompactDirectoryNoThrow(Ptr<FATVolume> vol, Ptr<FATInode> dir) noexcept;
-    void EraseDirectoryEntry(Ptr<FATVolume> vol, uint32_t parentCluster, uint32_t startIndex, uint32_t endIndex);
+    void EraseDirectoryEntry(Ptr<FATVolume> vol, Ptr<FATInode> dir, uint32_t startIndex, uint32_t endIndex);
     void DoUnlink(Ptr<KFSVolume> volume, Ptr<KInode> parent, const PString& name, bool removeFile);
 
 };
@@ -0,0 +1,57 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 19:30
+
+#pragma once
+
+#include <stddef.h>
+
+#include <System/ErrorCodes.h>
+#include <Kernel/KTLSFPool.h>
+
+namespace kernel
+{
+
+// Multi-pool TLSF heap, replacing newlib malloc when PADOS_OPT_TLSF_HEAP is
+// enabled. Pool 0 ("main") covers the linker heap (_sheap.._eheap) and is
+// created on the first allocation. Board code can add pools for other
+// memories (DTCM, AXI SRAM, ...). Pools added as general purpose are used
+// by malloc() in the order they were added when the earlier pools are full.
+// Other pools are only used through kheap_alloc().
+
+static constexpr int KHEAP_MAX_POOLS     = 4;
+static constexpr int KHEAP_MAIN_POOL     = 0;
+
+struct KHeapPoolInfo
+{
+    const char*     Name;
+    const void*     Start;
+    size_t          Size;
+    bool            GeneralPurpose;
+    KHeapPoolStats  Stats;
+};
+
+PErrorCode  kheap_add_pool(int& outPoolID, const char* name, void* memory, size_t size, bool generalPurpose);
+int         kheap_find_pool(const char* name);
+int         kheap_get_pool_count();
+PErrorCode  kheap_get_pool_info(int poolID, KHeapPoolInfo& outInfo);
+
+void*       kheap_alloc(int poolID, size_t size) noexcept;
+void*       kheap_alloc_aligned(int poolID, size_t alignment, size_t size) noexcept;
+
+} // namespace kernel
@@ -0,0 +1,97 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 14:00
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+namespace kernel
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// Lock/count word shared by the lock-free fast path and the wait-queue slow
+/// path of KMutex and KSemaphore. Bit 0 flag that the wait queue might be
+/// non-empty, the remaining bits hold the signed count. The fast path only
+/// succeeds while the flag is clear, so any thread that enqueued itself
+/// (and set the flag with the scheduler lock held) forces the releasing
+/// thread into the slow path where the waiters are woken.
+///
+/// The slow-path accessors use plain load/store and must only be called
+/// with interrupts disabled. On a single core that is enough to make them
+/// atomic with respect to the fast path, since exception entry clears the
+/// exclusive monitor and makes any interrupted LDREX/STREX sequence retry.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+class KLockWord
+{
+public:
+    static constexpr int32_t WAITERS_FLAG = 0x01;
+    static constexpr int32_t COUNT_SHIFT  = 1;
+    static constexpr int32_t MAX_COUNT    = INT32_MAX >> COUNT_SHIFT;
+    static constexpr int32_t MIN_COUNT    = INT32_MIN >> COUNT_SHIFT;
+
+    explicit KLockWord(int32_t count = 0) noexcept : m_State(ToState(count)) {}
+
+    // Fast path. Change the count from "expectedCount" to "newCount" if
+    // nobody is waiting.
+    bool TryExchange(int32_t expectedCount, int32_t newCount) noexcept
+    {
+        int32_t expected = ToState(expectedCount);
+        return m_State.compare_exchange_strong(expected, ToState(newCount), std::memory_order_acq_rel, std::memory_order_relaxed);
+    }
+
+    // Fast path. Add "delta" to the count if nobody is waiting and the
+    // resulting count is within [minCount, maxCount].
+    bool TryAdd(int32_t delta, int32_t minCount, int32_t maxCount) noexcept
+    {
+        int32_t state = m_State.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            if (state & WAITERS_FLAG) {
+                return false;
+            }
+            const int32_t newCount = FromState(state) + delta;
+            if (newCount < minCount || newCount > maxCount) {
+                return false;
+            }
+            if (m_State.compare_exchange_weak(state, ToState(newCount), std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+    // Slow path, interrupts must be disabled.
+    int32_t GetCount() const noexcept { return FromState(m_State.load(std::memory_order_relaxed)); }
+    void    SetCount(int32_t count) noexcept { m_State.store(ToState(count) | (m_State.load(std::memory_order_relaxed) & WAITERS_FLAG), std::memory_order_release); }
+    void    AddCount(int32_t delta) noexcept { SetCount(GetCount() + delta); }
+
+    bool    HasWaiters() const noexcept { return (m_State.load(std::memory_order_relaxed) & WAITERS_FLAG) != 0; }
+    void    SetWaiters() noexcept   { m_State.store(m_State.load(std::memory_order_relaxed) | WAITERS_FLAG, std::memory_order_relaxed); }
+    void    ClearWaiters() noexcept { m_State.store(m_State.load(std::memory_order_relaxed) & ~WAITERS_FLAG, std::memory_order_relaxed); }
+
+private:
+    static constexpr int32_t ToState(int32_t count) noexcept { return int32_t(uint32_t(count) << COUNT_SHIFT); }
+    static constexpr int32_t FromState(int32_t state) noexcept { return state >> COUNT_SHIFT; }
+
+    std::atomic<int32_t> m_State;
+};
+
+} // namespace kernel
@@ -0,0 +1,70 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 12:00
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <limits>
+
+namespace kernel
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// Fixed size histogram with power-of-two bucket boundaries. Bucket 0 count
+/// zero values, bucket N (N > 0) count values in the range [2^(N-1), 2^N),
+/// and the last bucket also count everything above it. Adding a sample is a
+/// CLZ and an increment, so it can be used from the context switch path.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+template<size_t TBucketCount>
+class KLog2Histogram
+{
+public:
+    static_assert(TBucketCount >= 2 && TBucketCount <= 65);
+
+    static constexpr size_t BucketCount = TBucketCount;
+
+    static constexpr size_t GetBucketIndex(uint64_t value) noexcept
+    {
+        const size_t index = (value != 0) ? size_t(64 - __builtin_clzll(value)) : 0;
+        return std::min(index, TBucketCount - 1);
+    }
+
+    void Add(uint64_t value) noexcept
+    {
+        uint32_t& bucket = m_Buckets[GetBucketIndex(value)];
+        if (bucket != std::numeric_limits<uint32_t>::max()) {
+            bucket++;
+        }
+    }
+
+    void Reset() noexcept { m_Buckets.fill(0); }
+
+    uint32_t GetCount(size_t index) const noexcept { return m_Buckets[index]; }
+    const std::array<uint32_t, TBucketCount>& GetBuckets() const noexcept { return m_Buckets; }
+
+private:
+    std::array<uint32_t, TBucketCount> m_Buckets = {};
+};
+
+} // namespace kernel
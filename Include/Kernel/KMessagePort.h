@@ -24,6 +24,7 @@
 #include "KMutex.h"
 #include "System/Types.h"
 #include "System/System.h"
+#include <DeviceControl/MessagePort.h>
 
 namespace kernel
 {
@@ -50,11 +51,21 @@ public:
     ssize_t ReceiveMessage_trw(handler_id* targetHandler, int32_t* code, void* buffer, size_t bufferSize);
     ssize_t ReceiveMessageTimeout_trw(handler_id* targetHandler, int32_t* code, void* buffer, size_t bufferSize, TimeValNanos timeout);
     ssize_t ReceiveMessageDeadline_trw(handler_id* targetHandler, int32_t* code, void* buffer, size_t bufferSize, TimeValNanos deadline);
-    
+
+    size_t  ReceiveMultipleDeadline_trw(PMessagePortBatchEntry* entries, size_t maxCount, void* buffer, size_t bufferSize, TimeValNanos deadline);
+
+    size_t  GetPooledBufferCount() const;
+
 private:
-    ssize_t DetachMessage_trw(handler_id* targetHandler, int32_t* code, void* buffer, size_t bufferSize);
-    
-    KMutex     m_Mutex;
+    void*       LoanBuffer(size_t length);
+    PErrorCode  CommitBufferDeadline(void* buffer, handler_id targetHandler, int32_t code, size_t length, TimeValNanos deadline);
+    ssize_t     BorrowMessageDeadline_trw(handler_id* targetHandler, int32_t* code, const void** outData, TimeValNanos deadline);
+    void        ReleaseBuffer(const void* buffer);
+
+    KMessagePortMessage* DetachMessage_trw();
+    void                 RecycleMessage(KMessagePortMessage* message);
+
+    mutable KMutex     m_Mutex;
     KConditionVariable m_SendCondition;
     KConditionVariable m_ReceiveCondition;
 
@@ -64,6 +75,9 @@ private:
     KMessagePortMessage* m_FirstMsg = nullptr;
     KMessagePortMessage* m_LastMsg = nullptr;
 
+    KMessagePortMessage* m_FirstFreeBuffer = nullptr;
+    size_t               m_FreeBufferCount = 0;
+
     KMessagePort(const KMessagePort &) = delete;
     KMessagePort& operator=(const KMessagePort &) = delete;
 };
@@ -78,5 +92,7 @@ ssize_t kmessage_port_receive_trw(port_id handle, handler_id* targetHandler, int
 ssize_t kmessage_port_receive_timeout_ns_trw(port_id handle, handler_id* targetHandler, int32_t* code, void* buffer, size_t bufferSize, bigtime_t timeout);
 ssize_t kmessage_port_receive_deadline_ns_trw(port_id handle, handler_id* targetHandler, int32_t* code, void* buffer, size_t bufferSize, bigtime_t deadline);
 
+size_t  kmessage_port_receive_multiple_deadline_ns_trw(port_id handle, PMessagePortBatchEntry* entries, size_t maxCount, void* buffer, size_t bufferSize, bigtime_t deadline);
+
 
 } // namespace
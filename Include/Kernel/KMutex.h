@@ -29,6 +29,7 @@
 
 #include <System/ExceptionHandling.h>
 #include <Kernel/Kernel.h>
+#include <Kernel/KLockWord.h>
 #include <Kernel/KNamedObject.h>
 #include <Kernel/Scheduler.h>
 #include <Threads/Threads.h>
@@ -36,6 +37,16 @@
 namespace kernel
 {
 
+#ifdef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+// Max number of holder->waiter links followed when propagating a boost.
+static constexpr int KMUTEX_MAX_INHERITANCE_DEPTH = 16;
+
+int  kmutex_get_inherited_priority_level(const KThreadCB* thread) noexcept;
+bool kmutex_update_inherited_priority(KThreadCB* thread) noexcept;
+void kmutex_waiter_priority_changed(KThreadCB* thread) noexcept;
+void kmutex_disown_all(KThreadCB* thread) noexcept;
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+
 class KMutex : public KNamedObject
 {
 public:
@@ -59,10 +70,32 @@ public:
     
     bool IsLocked() const;
 private:
-    int                  m_Count = 0;
+    bool TryLockFast(KThreadCB* thread) noexcept;
+    bool TryLockSharedFast() noexcept;
+    bool TryUnlockFast() noexcept;
+
+    void SetExclusiveHolder(KThreadCB* thread) noexcept;
+    bool ClearExclusiveHolder() noexcept;
+    void BeginWait(KThreadCB* thread) noexcept;
+    void EndWait(KThreadCB* thread) noexcept;
+
+#ifdef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    friend int  kmutex_get_inherited_priority_level(const KThreadCB* thread) noexcept;
+    friend bool kmutex_update_inherited_priority(KThreadCB* thread) noexcept;
+    friend void kmutex_waiter_priority_changed(KThreadCB* thread) noexcept;
+    friend void kmutex_disown_all(KThreadCB* thread) noexcept;
+
+    int GetHighestWaiterLevel() const noexcept;
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+
+    KLockWord            m_Count;   // <0: exclusive lock depth, >0: shared lock count.
     PEMutexRecursionMode m_RecursionMode = PEMutexRecursionMode_Recurse;
     clockid_t            m_ClockID = CLOCK_MONOTONIC;
     thread_id            m_Holder = INVALID_HANDLE; // Thread currently holding the mutex.
+#ifdef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    KThreadCB*           m_HolderThread = nullptr;  // Exclusive holder, linked through m_NextOwnedMutex.
+    KMutex*              m_NextOwnedMutex = nullptr;
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
 
     KMutex(const KMutex &) = delete;
     KMutex& operator=(const KMutex &) = delete;
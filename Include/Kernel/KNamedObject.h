@@ -25,6 +25,7 @@
 #include <System/System.h>
 #include <System/ErrorCodes.h>
 #include <Kernel/KWaitableObject.h>
+#include <Kernel/KSlabCache.h>
 #ifdef PADOS_MODULE_POSIX_SIGNALS
 #include <Kernel/KPosixSignals.h>
 #endif // PADOS_MODULE_POSIX_SIGNALS
@@ -55,6 +56,11 @@ public:
     KNamedObject(const char* name, KNamedObjectType type);
     virtual ~KNamedObject();
 
+    // Kernel objects are allocated from the slab size classes. The destructor
+    // is virtual, so the sized delete receive the size of the most derived type.
+    static void* operator new(size_t size) { return kslab_alloc_trw(size); }
+    static void  operator delete(void* object, size_t size) noexcept { kslab_free(object, size); }
+
     bool DebugValidate() const;
 
     KNamedObjectType GetType() const noexcept { return m_Type; }
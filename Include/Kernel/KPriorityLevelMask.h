@@ -0,0 +1,56 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 20:00
+
+#pragma once
+
+#include <stdint.h>
+
+namespace kernel
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// Bitmap with one bit per scheduler priority level. A bit is set while the
+/// ready-list for that level is non-empty, so the highest ready level can
+/// be found with a single CLZ instead of scanning all the lists.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+class KPriorityLevelMask
+{
+public:
+    static constexpr int MAX_LEVELS = 32;
+
+    void SetLevel(int level) noexcept   { m_Mask |= LevelToBit(level); }
+    void ClearLevel(int level) noexcept { m_Mask &= ~LevelToBit(level); }
+
+    bool IsLevelSet(int level) const noexcept { return (m_Mask & LevelToBit(level)) != 0; }
+    bool IsEmpty() const noexcept { return m_Mask == 0; }
+
+    // Returns the highest level with the bit set, or -1 if the mask is empty.
+    int GetHighestLevel() const noexcept { return (m_Mask != 0) ? (MAX_LEVELS - 1 - __builtin_clz(m_Mask)) : -1; }
+
+    uint32_t GetMask() const noexcept { return m_Mask; }
+
+private:
+    static constexpr uint32_t LevelToBit(int level) noexcept { return uint32_t(1) << level; }
+
+    uint32_t m_Mask = 0;
+};
+
+} // namespace kernel
@@ -21,12 +21,15 @@
 
 #include "System/Platform.h"
 
+#include <algorithm>
 #include <atomic>
+#include <limits.h>
 #include <map>
 
 #include <sys/types.h>
 
 #include "Kernel.h"
+#include "KLockWord.h"
 #include "KNamedObject.h"
 #include "Scheduler.h"
 #include "Threads/Threads.h"
@@ -39,6 +42,12 @@ class KSemaphore : public KNamedObject
 public:
     static const KNamedObjectType ObjectType = KNamedObjectType::Semaphore;
 
+    // Highest count a semaphore can hold. The count is kept in a KLockWord,
+    // which has one bit less than an int, so this is lower than
+    // SEM_VALUE_MAX. It is the value reported by sysconf(_SC_SEM_VALUE_MAX),
+    // and semaphores can't be created or set with a higher count.
+    static constexpr int MAX_COUNT = std::min<int>(SEM_VALUE_MAX, KLockWord::MAX_COUNT);
+
     KSemaphore(const char* name, clockid_t clockID, int count);
     ~KSemaphore();
 
@@ -48,10 +57,12 @@ public:
     PErrorCode AcquireClock(clockid_t clockID, TimeValNanos deadline);
     PErrorCode TryAcquire();
     PErrorCode Release();
-    PErrorCode SetCount(int count) { m_Count = count; return PErrorCode::Success; }
-    int  GetCount() const { return m_Count; }
+    PErrorCode SetCount(int count);
+    int  GetCount() const { return m_Count.GetCount(); }
 private:
-    int             m_Count;
+    bool TryAcquireFast(KThreadCB* thread) noexcept;
+
+    KLockWord       m_Count;
     clockid_t       m_ClockID = CLOCK_MONOTONIC_COARSE;
     thread_id       m_Holder = -1; // Thread currently holding the semaphore.
 
@@ -0,0 +1,169 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 16:00
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <utility>
+
+namespace kernel
+{
+
+struct KSlabCacheStats
+{
+    const char* Name;
+    size_t      ObjectSize;
+    size_t      ObjectsPerSlab;
+    size_t      SlabCount;
+    size_t      ObjectsInUse;
+    size_t      MaxObjectsInUse;
+    uint64_t    AllocCount;
+    uint64_t    FreeCount;
+    uint32_t    FailedCount;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// Object cache for fixed size kernel objects. Memory is taken from malloc
+/// one slab (many objects) at a time and handed out from a free list, so
+/// allocating and freeing an object is O(1) and only need the scheduler
+/// lock, not the newlib malloc mutex. Slabs are kept for reuse once
+/// allocated.
+///
+/// The constructor is constexpr so caches can be declared as globals and
+/// used during static initialization. A cache register itself in the global
+/// cache list when it allocates its first slab.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+class KSlabCache
+{
+public:
+    static constexpr size_t OBJECT_ALIGNMENT        = 8;
+    static constexpr size_t DEFAULT_SLAB_SIZE       = 1024;
+    static constexpr size_t MIN_OBJECTS_PER_SLAB    = 4;
+
+    constexpr KSlabCache(const char* name, size_t objectSize, size_t objectsPerSlab = 0) noexcept
+        : m_Name(name)
+        , m_ObjectSize(CalculateObjectSize(objectSize))
+        , m_ObjectsPerSlab((objectsPerSlab != 0) ? objectsPerSlab : CalculateObjectsPerSlab(CalculateObjectSize(objectSize)))
+    {}
+    ~KSlabCache();
+
+    void*   Allocate() noexcept;
+    void*   Allocate_trw();
+    void    Free(void* object) noexcept;
+
+    const char*     GetName() const noexcept        { return m_Name; }
+    size_t          GetObjectSize() const noexcept  { return m_ObjectSize; }
+    KSlabCacheStats GetStats() const noexcept;
+
+    static KSlabCache* GetFirstCache() noexcept;
+    KSlabCache*        GetNextCache() const noexcept { return m_NextCache; }
+
+private:
+    struct FreeObject
+    {
+        FreeObject* Next;
+    };
+    struct Slab
+    {
+        Slab* Next;
+        alignas(OBJECT_ALIGNMENT) uint8_t Objects[];
+    };
+
+    static constexpr size_t CalculateObjectSize(size_t size) noexcept
+    {
+        if (size < sizeof(FreeObject)) size = sizeof(FreeObject);
+        return (size + OBJECT_ALIGNMENT - 1) & ~(OBJECT_ALIGNMENT - 1);
+    }
+    static constexpr size_t CalculateObjectsPerSlab(size_t objectSize) noexcept
+    {
+        const size_t count = DEFAULT_SLAB_SIZE / objectSize;
+        return (count > MIN_OBJECTS_PER_SLAB) ? count : MIN_OBJECTS_PER_SLAB;
+    }
+
+    bool Grow() noexcept;
+
+    const char* m_Name;
+    size_t      m_ObjectSize;
+    size_t      m_ObjectsPerSlab;
+    FreeObject* m_FreeList  = nullptr;
+    Slab*       m_FirstSlab = nullptr;
+    KSlabCache* m_NextCache = nullptr;
+
+    size_t      m_SlabCount       = 0;
+    size_t      m_ObjectsInUse    = 0;
+    size_t      m_MaxObjectsInUse = 0;
+    uint64_t    m_AllocCount      = 0;
+    uint64_t    m_FreeCount       = 0;
+    uint32_t    m_FailedCount     = 0;
+
+    KSlabCache(const KSlabCache&) = delete;
+    KSlabCache& operator=(const KSlabCache&) = delete;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// Typed KSlabCache that construct and destruct the objects.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+template<typename T>
+class KObjectCache : public KSlabCache
+{
+public:
+    static_assert(alignof(T) <= OBJECT_ALIGNMENT);
+
+    constexpr KObjectCache(const char* name, size_t objectsPerSlab = 0) noexcept : KSlabCache(name, sizeof(T), objectsPerSlab) {}
+
+    template<typename... TArgs>
+    T* Construct(TArgs&&... args)
+    {
+        void* memory = Allocate();
+        if (memory == nullptr) {
+            return nullptr;
+        }
+        try {
+            return new (memory) T(std::forward<TArgs>(args)...);
+        } catch (...) {
+            Free(memory);
+            throw;
+        }
+    }
+
+    void Destroy(T* object) noexcept
+    {
+        if (object != nullptr)
+        {
+            object->~T();
+            Free(object);
+        }
+    }
+};
+
+// Size-class allocator for small objects without a dedicated cache.
+// Requests larger than KSLAB_MAX_SIZE_CLASS are forwarded to malloc().
+static constexpr size_t KSLAB_MAX_SIZE_CLASS = 512;
+
+void* kslab_alloc(size_t size) noexcept;
+void* kslab_alloc_trw(size_t size);
+void  kslab_free(void* object, size_t size) noexcept;
+
+} // namespace kernel
@@ -0,0 +1,62 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 21:00
+
+#pragma once
+
+#include <stddef.h>
+#include <Kernel/KThreadWaitNode.h>
+
+namespace kernel
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// Priority queue of KThreadWaitNode objects ordered on m_ResumeTime.
+/// Implemented as a pairing heap with the links embedded in the nodes, so
+/// Insert() is O(1) and Remove() / RemoveFirst() are O(log n) amortized.
+/// A node can be removed from the queue at any time using
+/// KThreadWaitNode::Detatch().
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+class KSleepQueue
+{
+public:
+    KSleepQueue() = default;
+
+    void Insert(KThreadWaitNode* node) noexcept;
+    void Remove(KThreadWaitNode* node) noexcept;
+
+    KThreadWaitNode* GetFirst() const noexcept { return m_Root; }
+    KThreadWaitNode* RemoveFirst() noexcept;
+
+    bool   IsEmpty() const noexcept { return m_Root == nullptr; }
+    size_t GetCount() const noexcept { return m_NodeCount; }
+
+private:
+    static KThreadWaitNode* Merge(KThreadWaitNode* first, KThreadWaitNode* second) noexcept;
+    static KThreadWaitNode* MergePairs(KThreadWaitNode* first) noexcept;
+
+    KThreadWaitNode*    m_Root = nullptr;
+    size_t              m_NodeCount = 0;
+
+    KSleepQueue(const KSleepQueue&) = delete;
+    KSleepQueue& operator=(const KSleepQueue&) = delete;
+};
+
+} // namespace kernel
@@ -0,0 +1,156 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 18:30
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace kernel
+{
+
+struct KHeapPoolStats
+{
+    size_t      TotalSize;          // Bytes available for allocations.
+    size_t      UsedSize;           // Bytes in allocated blocks.
+    size_t      MaxUsedSize;        // High-water mark of UsedSize.
+    size_t      FreeSize;           // Bytes in free blocks.
+    size_t      LargestFreeBlock;   // Largest allocation that currently can succeed.
+    size_t      FreeBlockCount;
+    uint32_t    FragmentationPercent; // 100 * (1 - LargestFreeBlock / FreeSize)
+    uint64_t    AllocCount;
+    uint64_t    FreeCount;
+    uint32_t    FailedCount;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// Two-level segregated fit allocator managing a single contiguous memory
+/// pool. Free blocks are binned by a two-level bitmap index (power-of-two
+/// first level, linear second level), so finding a block and merging
+/// neighbours on free are both bounded O(1) operations.
+///
+/// The control structure is placed at the start of the memory given to
+/// Create(). The pool does no locking; callers must serialize access.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+class KTLSFPool
+{
+public:
+    static constexpr size_t ALIGNMENT = 8;
+
+    static KTLSFPool* Create(void* memory, size_t size) noexcept;
+
+    void*   Allocate(size_t size) noexcept;
+    void*   AllocateAligned(size_t alignment, size_t size) noexcept;
+    void    Free(void* pointer) noexcept;
+    bool    ResizeInPlace(void* pointer, size_t size) noexcept;
+
+    bool    Contains(const void* pointer) const noexcept { return pointer >= m_PoolStart && pointer < m_PoolEnd; }
+
+    static size_t   GetAllocationSize(const void* pointer) noexcept;
+    size_t          GetTotalSize() const noexcept { return m_TotalSize; }
+    size_t          GetUsedSize() const noexcept  { return m_UsedSize; }
+    KHeapPoolStats  GetStats() const noexcept;
+
+private:
+    static constexpr int    SL_INDEX_COUNT_LOG2 = 4;
+    static constexpr int    ALIGN_SIZE_LOG2     = 3;
+    static constexpr int    FL_INDEX_MAX        = 30;
+    static constexpr int    SL_INDEX_COUNT      = 1 << SL_INDEX_COUNT_LOG2;
+    static constexpr int    FL_INDEX_SHIFT      = SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2;
+    static constexpr int    FL_INDEX_COUNT      = FL_INDEX_MAX - FL_INDEX_SHIFT + 1;
+    static constexpr size_t SMALL_BLOCK_SIZE    = size_t(1) << FL_INDEX_SHIFT;
+
+    static_assert(ALIGNMENT == (size_t(1) << ALIGN_SIZE_LOG2));
+
+    // The header of a used block is only the (padded) size field. PrevPhysBlock
+    // overlap the last word of the previous block's payload, and the free list
+    // links overlap the start of the block's own payload.
+    struct BlockHeader
+    {
+        BlockHeader*    PrevPhysBlock;  // Only valid if the previous block is free.
+        union
+        {
+            size_t      Size;           // Size of the payload. Bit 0: free, bit 1: previous block free.
+            uint8_t     SizePadding[ALIGNMENT];
+        };
+        BlockHeader*    NextFree;       // Only valid if the block is free.
+        BlockHeader*    PrevFree;       // Only valid if the block is free.
+    };
+
+    static constexpr size_t BLOCK_FREE_BIT          = 0x01;
+    static constexpr size_t BLOCK_PREV_FREE_BIT     = 0x02;
+    static constexpr size_t SIZE_FIELD_OFFSET       = sizeof(BlockHeader*);
+    static constexpr size_t BLOCK_HEADER_OVERHEAD   = ALIGNMENT;
+    static constexpr size_t BLOCK_START_OFFSET      = SIZE_FIELD_OFFSET + BLOCK_HEADER_OVERHEAD;
+    static constexpr size_t BLOCK_SIZE_MIN          = (3 * sizeof(BlockHeader*) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    static constexpr size_t BLOCK_SIZE_MAX          = size_t(1) << FL_INDEX_MAX;
+    static constexpr size_t GAP_MINIMUM             = BLOCK_HEADER_OVERHEAD + BLOCK_SIZE_MIN;
+
+    KTLSFPool() = default;
+
+    static size_t       GetBlockSize(const BlockHeader* block) noexcept { return block->Size & ~(BLOCK_FREE_BIT | BLOCK_PREV_FREE_BIT); }
+    static void         SetBlockSize(BlockHeader* block, size_t size) noexcept { block->Size = size | (block->Size & (BLOCK_FREE_BIT | BLOCK_PREV_FREE_BIT)); }
+    static bool         IsFree(const BlockHeader* block) noexcept       { return (block->Size & BLOCK_FREE_BIT) != 0; }
+    static bool         IsPrevFree(const BlockHeader* block) noexcept   { return (block->Size & BLOCK_PREV_FREE_BIT) != 0; }
+    static void         SetPrevFree(BlockHeader* block, bool isFree) noexcept;
+    static BlockHeader* BlockFromPointer(const void* pointer) noexcept;
+    static void*        BlockToPointer(BlockHeader* block) noexcept;
+    static BlockHeader* GetNextBlock(const BlockHeader* block) noexcept;
+    static BlockHeader* LinkNext(BlockHeader* block) noexcept;
+    static void         MarkAsFree(BlockHeader* block) noexcept;
+    static void         MarkAsUsed(BlockHeader* block) noexcept;
+    static BlockHeader* Split(BlockHeader* block, size_t size) noexcept;
+    static BlockHeader* Absorb(BlockHeader* prev, BlockHeader* block) noexcept;
+    static bool         CanSplit(const BlockHeader* block, size_t size) noexcept { return GetBlockSize(block) >= size + BLOCK_HEADER_OVERHEAD + BLOCK_SIZE_MIN; }
+    static size_t       AdjustRequestSize(size_t size, size_t alignment) noexcept;
+    static void         MappingInsert(size_t size, int& outFL, int& outSL) noexcept;
+    static void         MappingSearch(size_t size, int& outFL, int& outSL) noexcept;
+
+    BlockHeader*    SearchSuitableBlock(int& inOutFL, int& inOutSL) noexcept;
+    void            InsertFreeBlock(BlockHeader* block) noexcept;
+    void            RemoveFreeBlock(BlockHeader* block) noexcept;
+    void            RemoveFreeBlock(BlockHeader* block, int fl, int sl) noexcept;
+    BlockHeader*    MergePrev(BlockHeader* block) noexcept;
+    BlockHeader*    MergeNext(BlockHeader* block) noexcept;
+    void            TrimFree(BlockHeader* block, size_t size) noexcept;
+    void            TrimUsed(BlockHeader* block, size_t size) noexcept;
+    BlockHeader*    TrimFreeLeading(BlockHeader* block, size_t size) noexcept;
+    BlockHeader*    LocateFree(size_t size) noexcept;
+    void*           PrepareUsed(BlockHeader* block, size_t size) noexcept;
+
+    uint32_t        m_FLBitmap = 0;
+    uint32_t        m_SLBitmap[FL_INDEX_COUNT] = {};
+    BlockHeader*    m_Blocks[FL_INDEX_COUNT][SL_INDEX_COUNT] = {};
+
+    const void*     m_PoolStart = nullptr;
+    const void*     m_PoolEnd   = nullptr;
+
+    size_t          m_TotalSize         = 0;
+    size_t          m_UsedSize          = 0;
+    size_t          m_MaxUsedSize       = 0;
+    size_t          m_FreeSize          = 0;
+    size_t          m_FreeBlockCount    = 0;
+    uint64_t        m_AllocCount        = 0;
+    uint64_t        m_FreeCount         = 0;
+    uint32_t        m_FailedCount       = 0;
+};
+
+} // namespace kernel
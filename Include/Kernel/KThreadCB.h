@@ -25,6 +25,7 @@
 #include <System/TimeValue.h>
 #include <Utils/IntrusiveList.h>
 #include <Threads/Threads.h>
+#include <Kernel/KLog2Histogram.h>
 #include <Kernel/KNamedObject.h>
 #include <Kernel/KSchedulerLock.h>
 
@@ -38,6 +39,7 @@ static constexpr int32_t THREAD_DEFAULT_STACK_SIZE = 1024 * 64;
 namespace kernel
 {
 class KProcess;
+class KMutex;
 
 struct KSignalQueueNode;
 
@@ -46,6 +48,8 @@ static const int KTHREAD_PRIORITY_MIN = -16;
 static const int KTHREAD_PRIORITY_MAX = 15;
 static const int KTHREAD_PRIORITY_LEVELS = KTHREAD_PRIORITY_MAX - KTHREAD_PRIORITY_MIN + 1;
 
+static constexpr size_t KTHREAD_LATENCY_HISTOGRAM_BUCKETS = 24; // 1us to 4s.
+
 class KThreadCB : public KNamedObject, public PIntrusiveListNode<KThreadCB>
 {
 public:
@@ -74,9 +78,11 @@ public:
     void        SetState(ThreadState state) noexcept;
     ThreadState GetState() const noexcept { return m_ThreadState; }
 
-    int SetPriority(int priority) noexcept { m_PriorityLevel = PriToLevel(priority); return 0; }
-    int GetPriority() const noexcept { return LevelToPri(m_PriorityLevel);  }
+    int SetPriority(int priority) noexcept;
+    int GetPriority() const noexcept { return LevelToPri(m_BasePriorityLevel);  }
+    int GetDynamicPriority() const noexcept { return LevelToPri(m_PriorityLevel); }
     int GetPriorityLevel() const noexcept { return m_PriorityLevel; }
+    int GetBasePriorityLevel() const noexcept { return m_BasePriorityLevel; }
 
     static int PriToLevel(int priority) noexcept;
     static int LevelToPri(int level) noexcept;
@@ -114,10 +120,26 @@ private:
     ThreadState               m_ThreadState;
 public:
 
-    int                       m_PriorityLevel;
+    int                       m_PriorityLevel;          // Effective level, including inherited boosts.
+    int                       m_BasePriorityLevel;      // Level assigned through SetPriority().
+
+#ifdef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    KMutex*                   m_FirstOwnedMutex = nullptr;
+    KMutex*                   m_WaitingForMutex = nullptr;
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    int                       m_MaxPriorityBoost = 0;
+    uint32_t                  m_PriorityInversionCount = 0;
+
     TimeValNanos              m_StartTime;
     TimeValNanos              m_RunTime;
 
+#ifdef PADOS_OPT_THREAD_LATENCY_HISTOGRAMS
+    TimeValNanos              m_ReadyTime;      // When the thread last entered the ready list.
+    TimeValNanos              m_SliceStartTime; // When the thread was last switched in.
+    KLog2Histogram<KTHREAD_LATENCY_HISTOGRAM_BUCKETS> m_ReadyLatencyHistogram;
+    KLog2Histogram<KTHREAD_LATENCY_HISTOGRAM_BUCKETS> m_RunSliceHistogram;
+#endif // PADOS_OPT_THREAD_LATENCY_HISTOGRAMS
+
 #ifdef PADOS_MODULE_POSIX_SIGNALS
     PThreadCancelState        m_CancelState = THREAD_CANCEL_ENABLE;
     PThreadCancelType         m_CancelType  = THREAD_CANCEL_DEFERRED;
@@ -0,0 +1,61 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 10:00
+
+#pragma once
+
+#include <DeviceControl/ThreadStats.h>
+#include <Kernel/KThreadCB.h>
+#include <Kernel/VFS/KFilesystem.h>
+#include <Kernel/VFS/KInode.h>
+#include <RPC/RPCDispatcher.h>
+
+
+namespace kernel
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// Device node (/dev/kernel/threads) giving user space access to per-thread
+/// scheduler statistics not covered by ThreadInfo.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+class KThreadStatsInode : public KInode, public KFilesystemFileOps
+{
+public:
+    static void Initialize();
+
+    KThreadStatsInode();
+
+    virtual void ReadStat(Ptr<KFSVolume> volume, Ptr<KInode> inode, struct stat* statBuf) override;
+    virtual void DeviceControl(Ptr<KFileNode> file, int request, const void* inData, size_t inDataLength, void* outData, size_t outDataLength) override;
+
+private:
+    void GetSchedulingStats(thread_id threadID, PThreadSchedulingStats* outStats) const;
+    void GetLatencyHistograms(thread_id threadID, PThreadLatencyHistograms* outHistograms) const;
+    void ResetLatencyHistograms(thread_id threadID);
+
+    static Ptr<KThreadCB> GetThread(thread_id threadID);
+
+    PRPCDispatcher m_DeviceControlDispatcher;
+
+    KThreadStatsInode(const KThreadStatsInode&) = delete;
+    KThreadStatsInode& operator=(const KThreadStatsInode&) = delete;
+};
+
+} // namespace kernel
@@ -25,11 +25,15 @@
 namespace kernel
 {
 class KThreadCB;
+class KSleepQueue;
 
 struct KThreadWaitNode : PIntrusiveListNode<KThreadWaitNode>
 {
     bool Detatch()
     {
+        if (m_SleepQueue != nullptr) {
+            return DetatchFromSleepQueue();
+        }
         PIntrusiveList<KThreadWaitNode>* list = GetList();
         if (list != nullptr)
         {
@@ -41,11 +45,23 @@ struct KThreadWaitNode : PIntrusiveListNode<KThreadWaitNode>
             return false;
         }
     }
+    bool IsSleepQueueMember() const noexcept { return m_SleepQueue != nullptr; }
 
     TimeValNanos                    m_ResumeTime;
     KThreadCB*                      m_Thread = nullptr;
     int                             m_ReturnCode = 0;
     bool                            m_TargetDeleted = false;
+
+private:
+    friend class KSleepQueue;
+
+    bool DetatchFromSleepQueue();
+
+    // Pairing-heap links used while the node is a member of a KSleepQueue.
+    KSleepQueue*                    m_SleepQueue = nullptr;
+    KThreadWaitNode*                m_HeapChild = nullptr;    // First child.
+    KThreadWaitNode*                m_HeapNext = nullptr;     // Next sibling.
+    KThreadWaitNode*                m_HeapPrev = nullptr;     // Previous sibling, or parent for the first child.
 };
 
 typedef PIntrusiveList<KThreadWaitNode> KThreadWaitList;
@@ -0,0 +1,103 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 22:00
+
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+
+namespace kernel
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// Time bookkeeping for tickless idle. The idle thread stretches the SysTick
+/// reload value to cover several ticks and uses these helpers to compute the
+/// reload value and to split the time actually slept into whole ticks and
+/// the remainder of the tick that was interrupted. Kept free of hardware
+/// access so the arithmetic can be tested without a SysTick.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+class KTicklessIdle
+{
+public:
+    static constexpr int64_t  NANOSECONDS_PER_TICK = 1000000;
+    static constexpr uint32_t SYSTICK_MAX_RELOAD   = 0x00ffffff;
+
+    struct WakeupCorrection
+    {
+        uint32_t CompletedTicks;    // Whole ticks to add to the system time.
+        uint32_t RemainingCycles;   // Cycles left of the current tick.
+    };
+
+    // Largest number of ticks the 24-bit SysTick can cover from any point in a tick.
+    static constexpr uint32_t GetMaxIdleTicks(uint32_t cyclesPerTick) noexcept
+    {
+        return (SYSTICK_MAX_RELOAD + 1) / cyclesPerTick;
+    }
+
+    // Number of ticks until the tick interrupt that will find 'deadlineNS' expired.
+    // 'tickStartNS' is the time at the start of the current tick (Kernel::s_SystemTimeNS).
+    static constexpr uint32_t CalculateIdleTicks(int64_t tickStartNS, int64_t deadlineNS, uint32_t maxIdleTicks) noexcept
+    {
+        if (deadlineNS <= tickStartNS) {
+            return 0;
+        }
+        const int64_t ticks = (deadlineNS - tickStartNS + NANOSECONDS_PER_TICK - 1) / NANOSECONDS_PER_TICK;
+        return uint32_t(std::min<int64_t>(ticks, maxIdleTicks));
+    }
+
+    // SysTick reload value that makes the counter reach zero at the end of
+    // tick number 'idleTicks', given the counter value when it was stopped.
+    static constexpr uint32_t CalculateReloadValue(uint32_t currentValue, uint32_t idleTicks, uint32_t cyclesPerTick) noexcept
+    {
+        return currentValue + (idleTicks - 1) * cyclesPerTick;
+    }
+
+    // Split the time slept into whole ticks and the remainder of the current tick.
+    // If the counter reached zero the tick interrupt is pending and will add the
+    // last tick itself, so it is not included in CompletedTicks. The counter must
+    // be restarted at RemainingCycles - 1 to keep the tick phase.
+    static constexpr WakeupCorrection CalculateWakeupCorrection(uint32_t reloadValue, uint32_t valueAtWakeup, bool reachedZero, uint32_t idleTicks, uint32_t cyclesPerTick) noexcept
+    {
+        WakeupCorrection correction{};
+        if (reachedZero)
+        {
+            const uint32_t cyclesSinceWrap = reloadValue - valueAtWakeup;
+            correction.CompletedTicks  = idleTicks - 1;
+            correction.RemainingCycles = (cyclesSinceWrap < cyclesPerTick) ? (cyclesPerTick - cyclesSinceWrap) : 1;
+        }
+        else
+        {
+            const uint32_t elapsedCycles = idleTicks * cyclesPerTick - 1 - valueAtWakeup;
+            correction.CompletedTicks  = elapsedCycles / cyclesPerTick;
+            correction.RemainingCycles = cyclesPerTick - elapsedCycles % cyclesPerTick;
+        }
+        // The tick interrupt is raised when the counter goes from 1 to 0, so a
+        // restart value of 0 would lose a tick. Round up to the next tick instead.
+        if (correction.RemainingCycles < 2)
+        {
+            correction.CompletedTicks++;
+            correction.RemainingCycles = cyclesPerTick;
+        }
+        return correction;
+    }
+};
+
+} // namespace kernel
@@ -59,6 +59,7 @@ void add_to_sleep_list(KThreadWaitNode* waitNode);
 void remove_from_sleep_list(KThreadWaitNode* waitNode);
 
 void add_thread_to_ready_list(KThreadCB* thread);
+bool remove_thread_from_ready_list(KThreadCB* thread);
 void add_thread_to_zombie_list(KThreadCB* thread);
 void kwakeup_init_thread();
 
@@ -70,6 +71,10 @@ PErrorCode  wakeup_thread(KThreadCB& thread, bool wakeupSuspended) noexcept;
 
 void start_scheduler(size_t mainThreadStackSize);
 
+#ifdef PADOS_OPT_TICKLESS_IDLE
+void ktickless_idle() noexcept;
+#endif // PADOS_OPT_TICKLESS_IDLE
+
 int  get_remaining_stack();
 void check_stack_overflow();
 
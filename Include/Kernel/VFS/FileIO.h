@@ -109,10 +109,12 @@ PErrorCode kpwrite(int handle, const void* buffer, size_t length, off_t position
 off_t klseek_trw(int handle, off_t offset, int mode);
 
 void    kfsync_trw(int handle);
+void    kfallocate_trw(int handle, int mode, off_t offset, off_t length);
 
 void    kdevice_control_trw(int handle, int request, const void* inData, size_t inDataLength, void* outData, size_t outDataLength);
 
 size_t  kread_directory_trw(int handle, void* buffer, size_t bufferSize);
+size_t  kread_directory_plus_trw(int handle, void* buffer, size_t bufferSize);
 void    krewind_directory_trw(int handle);
 
 void    kcreate_directory_trw(KLocateFlags locateFlags, const char* name, int permission = S_IRWXU);
@@ -148,10 +150,12 @@ void                kset_filehandle(int handle, Ptr<KFileTableNode> file) noexce
 off_t       klseek(int handle, off_t offset, int mode) noexcept;
 
 int         kfsync(int handle) noexcept;
+PErrorCode  kfallocate(int handle, int mode, off_t offset, off_t length) noexcept;
 
 PErrorCode  kdevice_control(int handle, int request, const void* inData, size_t inDataLength, void* outData, size_t outDataLength) noexcept;
 
 ssize_t     kread_directory(int handle, void* buffer, size_t bufferSize) noexcept;
+ssize_t     kread_directory_plus(int handle, void* buffer, size_t bufferSize) noexcept;
 PErrorCode  krewind_directory(int handle) noexcept;
 
 int         kcreate_directory(KLocateFlags locateFlags, const char* name, int permission = S_IRWXU) noexcept;
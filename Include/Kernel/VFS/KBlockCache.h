@@ -22,9 +22,13 @@
 #include <stddef.h>
 
 #include <atomic>
+#include <map>
+#include <vector>
 
 #include "System/Types.h"
+#include "DeviceControl/BlockCacheStats.h"
 #include "Utils/IntrusiveList.h"
+#include "Utils/TwoQueueCachePolicy.h"
 #include "Kernel/KMutex.h"
 #include "Kernel/KConditionVariable.h"
 
@@ -36,7 +40,8 @@ enum
     BCF_DIRTY           = 0x01,
     BCF_DIRTY_PENDING   = 0x02,
     BCF_FLUSH_REQUESTED = 0x04,
-    BCF_IS_FLUSHING     = 0x08
+    BCF_IS_FLUSHING     = 0x08,
+    BCF_IN_DIRTY_TREE   = 0x10
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -60,12 +65,125 @@ struct KCacheBlockHeader : PIntrusiveListNode<KCacheBlockHeader>
     inline bool IsFlushing() const { return (m_Flags & BCF_IS_FLUSHING) != 0; }
     inline void SetIsFlushing(bool isFlushing) { m_Flags = (isFlushing) ? (m_Flags | BCF_IS_FLUSHING) : (m_Flags & ~BCF_IS_FLUSHING); }
 
-    int             m_Device       = 0;
-    off64_t         m_bufferNumber = 0;
-    uint32_t        m_UseCount     = 0;
-    void*           m_Buffer       = nullptr;
-    TimeValNanos    m_DirtyTime;
-    uint32_t        m_Flags        = 0;
+    inline uint32_t GetFullValidMask() const { return (1u << (1u << m_BlockShift)) - 1; }
+    inline bool     IsFullyValid() const { return m_ValidMask == GetFullValidMask(); }
+
+    int                     m_Device       = 0;
+    off64_t                 m_bufferNumber = 0;
+    std::atomic<uint32_t>   m_UseCount     = 0;
+    std::atomic_bool        m_Referenced   = false; // Hit while the LRU lock was busy.
+    bool                    m_IsReadAhead  = false; // Loaded by read-ahead and not used yet. Protected by the device lock.
+    void*                   m_Buffer       = nullptr;
+    TimeValNanos            m_DirtyTime;
+    uint32_t                m_Flags        = 0;
+    uint16_t                m_BufferSize   = 0; // Size of m_Buffer. Set when the owning cache page is split.
+    uint8_t                 m_BlockShift   = 0; // log2 of device blocks per buffer.
+    uint8_t                 m_ValidMask    = 0; // One bit per device block holding valid data. Modified with both the device lock and s_Mutex held.
+    KCacheBlockHeader*      m_DirtyTreeLeft  = nullptr; // Links in the owner's KCacheBlockDirtyTree. Protected by s_Mutex.
+    KCacheBlockHeader*      m_DirtyTreeRight = nullptr;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// Open-addressing (linear probing) hash table mapping buffer numbers to
+/// cache blocks. The key is stored in the block header itself, so each
+/// slot is a single pointer. Removal uses backward-shift deletion to keep
+/// probe sequences short without tombstones.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+class KCacheBlockMap
+{
+public:
+    static constexpr size_t MIN_CAPACITY = 64;
+
+    KCacheBlockHeader*  Find(off64_t bufferNumber) const;
+    void                Insert_trw(KCacheBlockHeader* block);
+    void                Reserve_trw(size_t count);
+    bool                Remove(KCacheBlockHeader* block);
+    void                Clear();
+
+    size_t GetCount() const     { return m_Count; }
+    size_t GetCapacity() const  { return m_Slots.size(); }
+
+    template<typename TCallback>
+    void ForEach(TCallback&& callback) const
+    {
+        for (KCacheBlockHeader* block : m_Slots) {
+            if (block != nullptr) callback(block);
+        }
+    }
+
+private:
+    inline size_t GetHomeSlot(off64_t bufferNumber) const { return size_t((uint64_t(bufferNumber) * 0x9e3779b97f4a7c15ull) >> m_HashShift); }
+    void Rehash_trw(size_t newCapacity);
+
+    std::vector<KCacheBlockHeader*> m_Slots;
+    size_t                          m_Count     = 0;
+    uint32_t                        m_HashShift = 64;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// Dirty blocks of one device ordered by buffer number, so the flusher can
+/// sweep the device in order and find contiguous runs. Implemented as an
+/// intrusive treap with the links in the block header, and the priority
+/// derived from a hash of the buffer number, so insertion and removal never
+/// allocate memory.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+class KCacheBlockDirtyTree
+{
+public:
+    void                Insert(KCacheBlockHeader* block);
+    void                Remove(KCacheBlockHeader* block);
+    KCacheBlockHeader*  FindFirstAtOrAfter(off64_t bufferNumber) const;
+
+    size_t GetCount() const { return m_Count; }
+
+    template<typename TCallback>
+    void ForEach(TCallback&& callback) const { ForEach(m_Root, callback); }
+
+    // Remove all blocks, calling "callback" for each after it is unlinked.
+    template<typename TCallback>
+    void Clear(TCallback&& callback)
+    {
+        Clear(m_Root, callback);
+        m_Root  = nullptr;
+        m_Count = 0;
+    }
+
+private:
+    static uint32_t GetPriority(const KCacheBlockHeader* block) { return uint32_t((uint64_t(block->m_bufferNumber) * 0x9e3779b97f4a7c15ull) >> 32); }
+
+    static void               Split(KCacheBlockHeader* node, off64_t bufferNumber, KCacheBlockHeader*& outLeft, KCacheBlockHeader*& outRight);
+    static KCacheBlockHeader* Merge(KCacheBlockHeader* left, KCacheBlockHeader* right);
+
+    template<typename TCallback>
+    static void ForEach(KCacheBlockHeader* node, TCallback& callback)
+    {
+        if (node != nullptr)
+        {
+            ForEach(node->m_DirtyTreeLeft, callback);
+            callback(node);
+            ForEach(node->m_DirtyTreeRight, callback);
+        }
+    }
+    template<typename TCallback>
+    static void Clear(KCacheBlockHeader* node, TCallback& callback)
+    {
+        if (node != nullptr)
+        {
+            Clear(node->m_DirtyTreeLeft, callback);
+            Clear(node->m_DirtyTreeRight, callback);
+            node->m_DirtyTreeLeft  = nullptr;
+            node->m_DirtyTreeRight = nullptr;
+            node->m_Flags &= ~BCF_IN_DIRTY_TREE;
+            callback(node);
+        }
+    }
+
+    KCacheBlockHeader*  m_Root  = nullptr;
+    size_t              m_Count = 0;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -92,6 +210,9 @@ struct KCacheBlockDesc
     KCacheBlockDesc& operator=(const KCacheBlockDesc&) = delete;
 };
 
+// The statistics are handed to user space unchanged through /dev/bcache/stats.
+using KBlockCacheStats = PBlockCacheStats;
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -99,42 +220,100 @@ struct KCacheBlockDesc
 class KBlockCache
 {
 public:
-    static const size_t BUFFER_BLOCK_SIZE = 512; //4096;
+    static const size_t BUFFER_BLOCK_SIZE = 512;  // Smallest buffer size, and the allocation unit of the buffer pool.
+    static const size_t MAX_BUFFER_SIZE   = 4096; // Largest buffer size, and the size of a cache page.
     static const size_t MIN_BLOCK_SIZE    = 512;
-    static const size_t MAX_BLOCK_SIZE    = BUFFER_BLOCK_SIZE;
+    static const size_t MAX_BLOCK_SIZE    = MAX_BUFFER_SIZE;
+    static const size_t BUFFER_SIZE_CLASS_COUNT = 4; // 512, 1024, 2048 and 4096 byte buffers.
+
+    static constexpr uint32_t MIN_READ_AHEAD_BUFFERS = 4;
+    static constexpr uint32_t MAX_READ_AHEAD_BUFFERS = 32;
     
     KBlockCache();
     ~KBlockCache();
 
     static inline size_t GetDirtyBlockCount() { return s_DirtyBlockCount; }
 
-    static KBlockCache* GetDeviceCache(int device);
-    bool SetDevice(int device, off64_t blockCount, size_t blockSize);
+    static KBlockCache* GetDeviceCache(int device); // Must be called with s_Mutex locked.
+    bool SetDevice(int device, off64_t blockCount, size_t blockSize, size_t bufferSize = 0);
+    size_t GetBufferSize() const { return m_BufferSize; }
     
     static void Initialize();
         
-    KCacheBlockDesc GetBlock_trw(off64_t blockNum, bool doLoad = true);
+    KCacheBlockDesc GetBlock_trw(off64_t blockNum, bool doLoad = true, bool isMetadata = false);
     bool            MarkBlockDirty(off64_t blockNum);
     
     void CachedRead_trw(off64_t blockNum, void* buffer, size_t blockCount);
     void CachedWrite_trw(off64_t blockNum, const void* buffer, size_t blockCount);
 
+    void DirectRead_trw(off64_t blockNum, void* buffer, size_t blockCount);
+    void DirectWrite_trw(off64_t blockNum, const void* buffer, size_t blockCount);
+
     bool Flush();
     bool Sync();
     inline bool Shutdown(bool flush) { if (flush) return Sync(); return true; }
+
+    KBlockCacheStats GetStats() const;
+    static size_t    GetAllStats(KBlockCacheStats* outStats, size_t maxCount);
         
 private:
     friend struct KCacheBlockHeader;
     friend struct KCacheBlockDesc;
 
-    static constexpr TimeValNanos FLUSH_PERIOD = TimeValNanos::FromMilliseconds(1000);
-    static constexpr size_t MAX_FLUSH_BLOCK_COUNT = 128;
-    static constexpr size_t MIN_FLUSH_WAKEUP_BLOCK_COUNT = 64;
-    static constexpr size_t MIN_FLUSH_BLOCK_COUNT = 96;
+    static constexpr TimeValNanos FLUSH_PERIOD       = TimeValNanos::FromMilliseconds(1000);  // Max age of a dirty buffer before it is written.
+    static constexpr TimeValNanos FLUSH_CHECK_PERIOD = TimeValNanos::FromMilliseconds(250);   // Flusher wakeup period while there are dirty buffers.
+    static constexpr size_t MAX_FLUSH_BLOCK_COUNT = 128;        // Max buffers in one write.
+    static constexpr size_t MIN_FLUSH_WAKEUP_BLOCK_COUNT = 64;  // Dirty buffers that trigger pressure flushing.
+    static constexpr size_t MAX_DIRTY_AFTER_PRESSURE_FLUSH = 32;// Pressure flushing continues until this many are left.
+    static constexpr size_t MIN_FLUSH_BLOCK_COUNT = 96;         // Runs this long are written without waiting for other triggers.
+#ifdef PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
+    static constexpr off64_t MAX_FLUSH_GAP_BUFFERS = 0;         // The flush diagnostics assume every written buffer was dirty.
+#else
+    static constexpr off64_t MAX_FLUSH_GAP_BUFFERS = 2;         // Clean buffers that may be written to join two dirty runs.
+#endif
+
+    static void FlushInternal();
+
+    KCacheBlockHeader* AllocateBlock_trw(bool mayWait = true);
+    size_t             LoadBlocks_trw(off64_t bufferNum, KCacheBlockHeader** blocks, size_t blockCount);
+    void               LoadMissingBlocks_trw(KCacheBlockHeader* block);
+    uint32_t           GetDeviceValidMask(off64_t bufferNum) const;
+    static KCacheBlockHeader* PopFreeBlock(size_t sizeClass);
+    static void               PushFreeBlock(KCacheBlockHeader* block);
+    static void               WritePartialBlock_trw(KCacheBlockHeader* block, uint32_t validMask);
+    uint32_t           UpdateReadAheadWindow(bool isSequential);
+    void               ReadAheadBlockEvicted(KCacheBlockHeader* block);
+    static bool        TryEvictBlock(KBlockCache* requester, KCacheBlockHeader* block);
+    static uint64_t    GetPolicyKey(const KCacheBlockHeader* block) { return (uint64_t(block->m_Device) << 48) ^ uint64_t(block->m_bufferNumber); }
+
+    // Call "callback(block, blockIndex, blockNum)" for each device block in
+    // the range that has a cache buffer. Must be called with m_Mutex held.
+    template<typename TCallback>
+    void ForEachCachedBlockInRange(off64_t firstBlock, size_t blockCount, TCallback&& callback)
+    {
+        for (off64_t curBlock = firstBlock; curBlock < firstBlock + off64_t(blockCount); )
+        {
+            const off64_t      bufferNum = curBlock >> m_BlockToBufferShift;
+            const off64_t      bufferEnd = (bufferNum + 1) << m_BlockToBufferShift;
+            KCacheBlockHeader* block     = m_BlockMap.Find(bufferNum);
+            if (block == nullptr)
+            {
+                curBlock = bufferEnd;
+                continue;
+            }
+            for (; curBlock < bufferEnd && curBlock < firstBlock + off64_t(blockCount); ++curBlock) {
+                callback(block, uint32_t(curBlock & m_BufferOffsetMask), curBlock);
+            }
+        }
+    }
 
-    bool FlushInternal();
+    void         FillStats(KBlockCacheStats& stats, TimeValNanos curTime) const;
 
-    static bool  FlushBlockList_trw(KCacheBlockHeader** blockList, size_t blockCount);
+    static bool  IsRegisteredCache(const KBlockCache* cache);
+    static bool  IsUnderWritePressure();
+    bool         FlushSweep_trw(TimeValNanos curTime);
+    size_t       CollectFlushRun(KCacheBlockHeader* first, KCacheBlockHeader** run, TimeValNanos curTime, size_t& outDirtyCount, bool& outIsDue) const;
+    void         WriteRun_trw(KCacheBlockHeader** run, size_t runLength, size_t dirtyCount);
     static void* DiskCacheFlusher(void* arg);
 
 #ifdef PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
@@ -145,20 +324,59 @@ private:
 #endif // PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
     
     static std::map<int, KBlockCache*>      s_DeviceMap;
-    static PIntrusiveList<KCacheBlockHeader> s_FreeList;
-    static PIntrusiveList<KCacheBlockHeader> s_MRUList;
+    static PIntrusiveList<KCacheBlockHeader> s_FreeLists[BUFFER_SIZE_CLASS_COUNT]; // Unused buffers in split pages, per size class.
+    static PIntrusiveList<KCacheBlockHeader> s_FreePages; // First header of each unused cache page.
+    static PTwoQueueCachePolicy<KCacheBlockHeader> s_ReplacementPolicy; // All cached blocks, in eviction order.
     static KMutex                           s_Mutex;
     static KConditionVariable               s_FlushingRequestConditionVar;
     static KConditionVariable               s_FlushingDoneConditionVar;
     static std::atomic_int                  s_DirtyBlockCount;
-    
+    static std::atomic_int                  s_BlockWaiterCount;
+
+    // m_Mutex serializes lookups and loads for this device. s_Mutex protects
+    // the global free lists, replacement queues, block flags and the device map. Lock order is
+    // always m_Mutex before s_Mutex, and m_BlockMap is only modified with both
+    // held so either lock is enough to read it.
+    KMutex                                  m_Mutex;
     int                                     m_Device;
     size_t                                  m_BlockSize;
     off64_t                                 m_BlockCount;
+    size_t                                  m_BufferSize;
+    size_t                                  m_BufferSizeClass;
     int                                     m_BlocksPerBuffer;
     int                                     m_BlockToBufferShift;
     uint32_t                                m_BufferOffsetMask;
-    std::map<off64_t, KCacheBlockHeader*>   m_BlockMap;
+    KCacheBlockMap                          m_BlockMap;
+    KCacheBlockDirtyTree                    m_DirtyTree;    // Protected by s_Mutex.
+    off64_t                                 m_FlushCursor = 0; // Elevator position of the flusher. Protected by s_Mutex.
+
+    // Sequential access detection and read-ahead state. Protected by m_Mutex,
+    // the counters are atomic so they can be read without it.
+    off64_t                                 m_LastAccessBuffer = -1;
+    uint32_t                                m_ReadAheadWindow = 0;
+    std::atomic<uint32_t>                   m_ReadAheadBlocks = 0;
+    std::atomic<uint32_t>                   m_ReadAheadHits = 0;
+    std::atomic<uint32_t>                   m_ReadAheadWasted = 0;
+
+    // Lookup statistics. Updated with atomic increments on the I/O paths,
+    // so they don't need any of the locks.
+    std::atomic<uint32_t>                   m_Lookups = 0;
+    std::atomic<uint32_t>                   m_Hits = 0;
+    std::atomic<uint32_t>                   m_LoadedBuffers = 0;
+    std::atomic<uint32_t>                   m_Evictions = 0;
+    std::atomic<uint32_t>                   m_DirectReadBlocks = 0;
+    std::atomic<uint32_t>                   m_DirectWriteBlocks = 0;
+
+    // Write-back statistics. Atomic, so they don't need any lock. Only the
+    // flusher thread updates them. s_Mutex is held at the time, but only
+    // because it is needed for the dirty tree walk.
+    std::atomic<uint32_t>                   m_FlushWrites = 0;
+    std::atomic<uint32_t>                   m_FlushedBuffers = 0;
+    std::atomic<uint32_t>                   m_FlushedDirtyBuffers = 0;
+    std::atomic<uint32_t>                   m_FlushedDirtyAge = 0;      // Milliseconds.
+    std::atomic<uint32_t>                   m_MaxFlushedDirtyAge = 0;   // Milliseconds.
+    std::atomic<uint32_t>                   m_FlushTime = 0;            // Microseconds.
+    std::atomic<uint32_t>                   m_MaxFlushTime = 0;         // Microseconds.
     
     KBlockCache(const KBlockCache&) = delete;
     KBlockCache& operator=(const KBlockCache&) = delete;
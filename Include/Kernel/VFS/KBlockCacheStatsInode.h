@@ -0,0 +1,56 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 17.10.2026 09:00
+
+#pragma once
+
+#include <DeviceControl/BlockCacheStats.h>
+#include <Kernel/VFS/KFilesystem.h>
+#include <Kernel/VFS/KInode.h>
+#include <RPC/RPCDispatcher.h>
+
+
+namespace kernel
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// Device node (/dev/bcache/stats) giving user space access to the block
+/// cache statistics of each device.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+class KBlockCacheStatsInode : public KInode, public KFilesystemFileOps
+{
+public:
+    static void Initialize();
+
+    KBlockCacheStatsInode();
+
+    virtual void ReadStat(Ptr<KFSVolume> volume, Ptr<KInode> inode, struct stat* statBuf) override;
+    virtual void DeviceControl(Ptr<KFileNode> file, int request, const void* inData, size_t inDataLength, void* outData, size_t outDataLength) override;
+
+private:
+    size_t GetDeviceStats(PBlockCacheStats* outStats, size_t maxCount) const;
+
+    PRPCDispatcher m_DeviceControlDispatcher;
+
+    KBlockCacheStatsInode(const KBlockCacheStatsInode&) = delete;
+    KBlockCacheStatsInode& operator=(const KBlockCacheStatsInode&) = delete;
+};
+
+} // namespace kernel
@@ -71,6 +71,7 @@ public:
     virtual bool LastReferenceGone() override;
     
     size_t ReadDirectory(void* buffer, size_t bufferSize);
+    size_t ReadDirectoryPlus(void* buffer, size_t bufferSize);
     void RewindDirectory();
 };
 
@@ -53,7 +53,8 @@ enum class FSVolumeFlags : uint32_t
     FS_IS_PERSISTENT = 0x00000004, // Set if data written to the FS is preserved across reboots.
     FS_IS_SHARED     = 0x00000008, // Set if the FS is shared across multiple machines (Network FS).
     FS_IS_BLOCKBASED = 0x00000010, // Set if the FS use a regular block-device (or loopback from a single file) to store its data.
-    FS_CAN_MOUNT     = 0x00000020  // Set by probe() if the FS can mount the given device.
+    FS_CAN_MOUNT     = 0x00000020, // Set by probe() if the FS can mount the given device.
+    FS_FREE_BLOCKS_ESTIMATED = 0x00000040 // Set while fi_free_blocks is an estimate because free space is still being counted.
 };
 
 typedef struct
@@ -95,6 +96,7 @@ public:
     virtual void    DeviceControl(Ptr<KFileNode> file, int request, const void* inData, size_t inDataLength, void* outData, size_t outDataLength);
 
     virtual size_t  ReadDirectory(Ptr<KFSVolume> volume, Ptr<KDirectoryNode> directory, void* buffer, size_t bufferSize);
+    virtual size_t  ReadDirectoryPlus(Ptr<KFSVolume> volume, Ptr<KDirectoryNode> directory, void* buffer, size_t bufferSize);
     virtual void    RewindDirectory(Ptr<KFSVolume> volume, Ptr<KDirectoryNode> dirNode);
 
     virtual void    CheckAccess(Ptr<KFSVolume> volume, Ptr<KInode> inode, int mode);
@@ -103,6 +105,7 @@ public:
     virtual void    WriteStat(Ptr<KFSVolume> volume, Ptr<KInode> inode, const struct stat* value, uint32_t mask);
 
     virtual void    Sync(Ptr<KFileNode> file);
+    virtual void    Allocate(Ptr<KFileNode> file, int mode, off64_t offset, off64_t length);
 
 };
 
@@ -118,6 +121,7 @@ public:
     virtual void            ReadFSStat(Ptr<KFSVolume> volume, fs_info* fsinfo);
     virtual void            WriteFSStat(Ptr<KFSVolume> volume, const fs_info* fsinfo, uint32_t mask);
     virtual Ptr<KInode>     LocateInode(Ptr<KFSVolume> volume, Ptr<KInode> parent, const char* path, int pathLength);
+    virtual bool            SupportsNameCache() const;
     virtual void            ReleaseInode(KInode* inode);
     virtual Ptr<KFileNode>  CreateFile(Ptr<KFSVolume> volume, Ptr<KInode> parent, const char* name, int nameLength, int openFlags, int permission);
     virtual void            CreateSymlink(Ptr<KFSVolume> volume, Ptr<KInode> parent, const char* name, int nameLength, const char* targetPath);
@@ -0,0 +1,86 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 18.10.2026 10:00
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <Ptr/Ptr.h>
+
+
+namespace kernel
+{
+
+class KFSVolume;
+class KInode;
+
+struct KNameCacheStats
+{
+    size_t      EntryCount;
+    size_t      NegativeCount;
+    uint32_t    Hits;
+    uint32_t    NegativeHits;
+    uint32_t    Misses;
+    uint32_t    Inserts;
+    uint32_t    Evictions;
+    uint32_t    Invalidations;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// Cache of path component lookups, keyed by (parent inode, name). Each
+/// entry map a name in a directory to the inode it resolved to, or to
+/// nullptr if the filesystem reported that the name did not exist
+/// (negative entry). The cache hold a reference to both the parent and the
+/// inode, so a parent pointer can not be reused while it is used as a key.
+/// Positive entries holding the last reference to their inode are dropped
+/// by ReleaseUnusedInodes(), so the cache doesn't delay the release, and
+/// with it the metadata write-back, of inodes that are no longer in use.
+///
+/// Entries are recycled in LRU order when the cache is full. Directory
+/// operations that change the namespace must invalidate the affected
+/// directories after the filesystem has been updated. Lookups that race
+/// with an invalidation are detected through the generation counter and
+/// not inserted.
+///
+/// Only filesystems returning true from KFilesystem::SupportsNameCache()
+/// are cached.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+class KNameCache
+{
+public:
+    static constexpr size_t MAX_ENTRY_COUNT = 256;
+    static constexpr size_t MAX_NAME_LENGTH = 39;
+
+    static bool     Lookup(const Ptr<KInode>& parent, const char* name, size_t nameLength, Ptr<KInode>& outInode);
+    static uint32_t GetGeneration();
+    static void     Insert(const Ptr<KInode>& parent, const char* name, size_t nameLength, const Ptr<KInode>& inode, uint32_t generation);
+
+    static void     InvalidateNegative(const KInode* parent);
+    static void     InvalidateDirectory(const KInode* parent);
+    static void     InvalidateVolume(const KFSVolume* volume);
+    static void     ReleaseUnusedInodes();
+    static void     Flush();
+
+    static KNameCacheStats GetStats();
+};
+
+} // namespace kernel
@@ -22,6 +22,7 @@
 
 #include <string>
 #include <map>
+#include <functional>
 
 #include "Ptr/PtrTarget.h"
 #include "Ptr/Ptr.h"
@@ -52,6 +53,13 @@ struct disk_partition_desc
 };
 
 
+enum class KLoadedInodeState
+{
+    NotLoaded,
+    Loaded,
+    Busy    // Being loaded or released.
+};
+
 class KVFSManager
 {
 public:
@@ -66,6 +74,7 @@ public:
     static void           DetachVolume_trw(Ptr<KFSVolume> volume);
     static Ptr<KFSVolume> GetVolume(fs_id volumeID);
     static Ptr<KInode>    GetInode_trw(fs_id volumeID, ino_t inodeID, bool crossMount);
+    static KLoadedInodeState VisitLoadedInode(fs_id volumeID, ino_t inodeID, const std::function<void(KInode* inode)>& visitor);
     static void           InodeReleased(KInode* inode);
     static void           FlushInodes();
 private:
@@ -23,6 +23,8 @@
 #include <string.h>
 
 #include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
 #include <limits>
 #include <vector>
 
@@ -32,6 +34,14 @@ inline constexpr size_t P_DIR_ENTRY_HEADER_SIZE = offsetof(dirent_t, d_name);
 inline constexpr size_t P_DIR_ENTRY_ALIGNMENT = alignof(dirent_t);
 static_assert((P_DIR_ENTRY_ALIGNMENT & (P_DIR_ENTRY_ALIGNMENT - 1)) == 0);
 
+// Records returned by read_directory_plus() carry a "struct stat" after the
+// name, aligned to P_DIR_ENTRY_PLUS_ALIGNMENT.
+inline constexpr size_t P_DIR_ENTRY_PLUS_ALIGNMENT = std::max(alignof(dirent_t), alignof(struct stat));
+static_assert((P_DIR_ENTRY_PLUS_ALIGNMENT & (P_DIR_ENTRY_PLUS_ALIGNMENT - 1)) == 0);
+
+// Upper bound of how much bigger a record gets when the stat is added.
+inline constexpr size_t P_DIR_ENTRY_PLUS_MAX_GROWTH = sizeof(struct stat) + 2 * P_DIR_ENTRY_PLUS_ALIGNMENT;
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -48,6 +58,48 @@ inline constexpr size_t PGetDirEntryRecordSize(size_t nameLength) noexcept
     return (recordSize <= maxRecordSize) ? recordSize : 0;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Offset of the stat from the start of a read_directory_plus() record.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+inline constexpr size_t PGetDirEntryPlusStatOffset(size_t nameLength) noexcept
+{
+    return (P_DIR_ENTRY_HEADER_SIZE + nameLength + 1 + P_DIR_ENTRY_PLUS_ALIGNMENT - 1) & ~(P_DIR_ENTRY_PLUS_ALIGNMENT - 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+inline constexpr size_t PGetDirEntryPlusRecordSize(size_t nameLength) noexcept
+{
+    constexpr size_t maxRecordSize = std::numeric_limits<uint16_t>::max();
+    if (nameLength > maxRecordSize) {
+        return 0;
+    }
+    const size_t unalignedSize = PGetDirEntryPlusStatOffset(nameLength) + sizeof(struct stat);
+    const size_t recordSize = (unalignedSize + P_DIR_ENTRY_PLUS_ALIGNMENT - 1) & ~(P_DIR_ENTRY_PLUS_ALIGNMENT - 1);
+    return (recordSize <= maxRecordSize) ? recordSize : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Return the stat stored in a record from read_directory_plus(), or nullptr
+/// if the record has none. The filesystem leaves st_mode at zero for entries
+/// it could not describe without loading them, and the caller must then
+/// stat() the entry itself.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+inline const struct stat* PGetDirEntryStat(const dirent_t& entry) noexcept
+{
+    if ((reinterpret_cast<uintptr_t>(&entry) & (P_DIR_ENTRY_PLUS_ALIGNMENT - 1)) != 0 || entry.d_reclen < PGetDirEntryPlusRecordSize(entry.d_namlen)) {
+        return nullptr;
+    }
+    const struct stat* statBuffer = reinterpret_cast<const struct stat*>(reinterpret_cast<const uint8_t*>(&entry) + PGetDirEntryPlusStatOffset(entry.d_namlen));
+    return (statBuffer->st_mode != 0) ? statBuffer : nullptr;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -58,7 +110,7 @@ public:
     void* GetBuffer()
     {
         if (m_Storage.empty()) {
-            m_Storage.resize((P_DIR_ENTRY_BUFFER_SIZE + sizeof(dirent_t) - 1) / sizeof(dirent_t));
+            m_Storage.resize((P_DIR_ENTRY_BUFFER_SIZE + sizeof(StorageUnit) - 1) / sizeof(StorageUnit));
         }
         return m_Storage.data();
     }
@@ -66,7 +118,10 @@ public:
     constexpr size_t GetSize() const noexcept { return P_DIR_ENTRY_BUFFER_SIZE; }
 
 private:
-    std::vector<dirent_t> m_Storage;
+    // Aligned for both plain and read_directory_plus() records.
+    struct alignas(P_DIR_ENTRY_PLUS_ALIGNMENT) StorageUnit { uint8_t Data[P_DIR_ENTRY_PLUS_ALIGNMENT]; };
+
+    std::vector<StorageUnit> m_Storage;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -140,21 +195,32 @@ private:
 class PDirEntryWriter
 {
 public:
-    PDirEntryWriter(void* buffer, size_t bufferSize) noexcept
+    PDirEntryWriter(void* buffer, size_t bufferSize, bool includeStat = false) noexcept
         : m_Buffer(static_cast<uint8_t*>(buffer))
         , m_BufferSize(bufferSize)
+        , m_IncludeStat(includeStat)
     {
     }
 
     bool IsValid() const noexcept
     {
+        const size_t alignment = m_IncludeStat ? P_DIR_ENTRY_PLUS_ALIGNMENT : P_DIR_ENTRY_ALIGNMENT;
         return m_Buffer != nullptr
-            && (reinterpret_cast<uintptr_t>(m_Buffer) & (P_DIR_ENTRY_ALIGNMENT - 1)) == 0;
+            && (reinterpret_cast<uintptr_t>(m_Buffer) & (alignment - 1)) == 0;
     }
 
+    bool IncludesStat() const noexcept { return m_IncludeStat; }
+
+    size_t GetRecordSize(size_t nameLength) const noexcept
+    {
+        return m_IncludeStat ? PGetDirEntryPlusRecordSize(nameLength) : PGetDirEntryRecordSize(nameLength);
+    }
+
+    // Add a record. When the writer includes stats, the stat part is zeroed,
+    // which marks it as not available until filled in through GetStat().
     dirent_t* AddEntry(const char* name, size_t nameLength) noexcept
     {
-        const size_t recordSize = PGetDirEntryRecordSize(nameLength);
+        const size_t recordSize = GetRecordSize(nameLength);
         if (!IsValid() || name == nullptr || recordSize == 0 || recordSize > GetRemainingSize()) {
             return nullptr;
         }
@@ -174,6 +240,11 @@ public:
         return entry;
     }
 
+    static struct stat* GetStat(dirent_t* entry) noexcept
+    {
+        return reinterpret_cast<struct stat*>(reinterpret_cast<uint8_t*>(entry) + PGetDirEntryPlusStatOffset(entry->d_namlen));
+    }
+
     size_t GetBytesWritten() const noexcept { return m_BytesWritten; }
     size_t GetRemainingSize() const noexcept { return m_BufferSize - m_BytesWritten; }
 
@@ -181,4 +252,5 @@ private:
     uint8_t* m_Buffer;
     size_t m_BufferSize;
     size_t m_BytesWritten = 0;
+    bool   m_IncludeStat;
 };
@@ -89,7 +89,10 @@ public:
     bool Tick();
 
 private:
-    void ProcessMessage(handler_id targetHandler, int32_t code, ssize_t msgLength);
+    static constexpr size_t MAX_BATCH_SIZE = 16;
+
+    bool ProcessMessageBatch();
+    void ProcessMessage(handler_id targetHandler, int32_t code, const void* data, size_t length);
     void RunTimers();
 
 #if DEBUG_LOOPER_LIST
@@ -100,7 +103,12 @@ private:
     PConditionVariable                       m_TimerMapCondition;
     PObjectWaitGroup                         m_WaitGroup;
 
+    PMessagePortControl                         m_PortControl;
     std::vector<uint8_t>                        m_ReceiveBuffer;
+    std::vector<uint8_t>                        m_BatchBuffer;
+    PMessagePortBatchEntry                      m_BatchEntries[MAX_BATCH_SIZE];
+    size_t                                      m_BatchCount = 0;
+    size_t                                      m_BatchNext = 0;
     TimeValNanos                                m_NextEventTime = TimeValNanos::infinit;
     volatile std::atomic_bool                   m_DoRun;
     std::multimap<TimeValNanos, PEventTimer*>    m_TimerMap;
@@ -25,6 +25,7 @@
 #include "System/System.h"
 #include "System/HandleObject.h"
 #include "System/TimeValue.h"
+#include "DeviceControl/MessagePort.h"
 
 class PMessagePort : public PHandleObject
 {
@@ -68,6 +69,7 @@ public:
     ssize_t ReceiveMessageDeadline(handler_id* targetHandler, int32_t* code, void* buffer, size_t bufferSize, TimeValNanos deadline) const {
         return message_port_receive_deadline_ns(m_Handle, targetHandler, code, buffer, bufferSize, deadline.AsNanoseconds());
     }
+    ssize_t ReceiveMultipleDeadline(const PMessagePortControl& control, PMessagePortBatchEntry* entries, size_t maxCount, void* buffer, size_t bufferSize, TimeValNanos deadline) const;
 
     PMessagePort(PMessagePort&& other) = default;
     PMessagePort(const PMessagePort& other) = default;
@@ -0,0 +1,230 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 14:10
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <Utils/IntrusiveList.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// PTwoQueueCachePolicy
+///
+/// Scan-resistant replacement order for a cache of intrusive list nodes,
+/// based on the 2Q algorithm (Johnson & Shasha):
+///
+/// - New entries go to a FIFO probation queue. Hits there are assumed to be
+///   correlated with the load (e.g. several sectors of one buffer) and don't
+///   change the order.
+/// - Entries evicted from probation leave a "ghost" key behind. If the key
+///   is loaded again before half a cache worth of further probation
+///   evictions, the entry is inserted in the LRU protected queue instead.
+/// - Pinned entries (e.g. filesystem metadata) have their own LRU queue that
+///   is evicted last. It is limited to half the cache, and the least
+///   recently used pinned entry is demoted to protected beyond that.
+///
+/// A single pass over a large file thus only cycles the probation queue,
+/// leaving protected and pinned entries alone.
+///
+/// Queue sizes are counted in entries, and the targets are fractions of the
+/// number of entries currently in the cache. The policy is not thread safe,
+/// and knows nothing about whether an entry can actually be evicted.
+/// Callers iterate the candidates with ForEachVictimCandidate() and remove
+/// the ones they evict.
+////////////////////////////////////////////////////////////////////////////////
+
+template<typename TNodeType, size_t GHOST_SLOT_COUNT = 2048>
+class PTwoQueueCachePolicy
+{
+public:
+    static_assert((GHOST_SLOT_COUNT & (GHOST_SLOT_COUNT - 1)) == 0, "GHOST_SLOT_COUNT must be a power of 2.");
+
+    enum class EQueue : uint8_t { None, Probation, Protected, Pinned };
+
+    // Insert an entry loaded on demand.
+    void Insert(TNodeType* node, uint64_t key, bool pin)
+    {
+        if (pin) {
+            AppendPinned(node);
+        } else if (ConsumeGhost(key)) {
+            m_Protected.Append(node);
+        } else {
+            m_Probation.Append(node);
+        }
+    }
+
+    // Insert an entry loaded speculatively (read-ahead). It has not been
+    // referenced yet, so a ghost hit is not a second reference.
+    void InsertSpeculative(TNodeType* node)
+    {
+        m_Probation.Append(node);
+    }
+
+    // Register a hit on a cached entry.
+    void Touch(TNodeType* node, bool pin)
+    {
+        if (node->IsListMember(&m_Pinned))
+        {
+            if (m_Pinned.GetLast() != node) {
+                m_Pinned.Remove(node);
+                m_Pinned.Append(node);
+            }
+        }
+        else if (pin)
+        {
+            Unlink(node);
+            AppendPinned(node);
+        }
+        else if (node->IsListMember(&m_Protected))
+        {
+            if (m_Protected.GetLast() != node) {
+                m_Protected.Remove(node);
+                m_Protected.Append(node);
+            }
+        }
+    }
+
+    // Remove an entry that is evicted from the cache.
+    void Remove(TNodeType* node, uint64_t key)
+    {
+        if (node->IsListMember(&m_Probation))
+        {
+            m_Probation.Remove(node);
+            m_ProbationEvictions++;
+            GhostSlot& slot = m_GhostSlots[GetGhostSlot(key)];
+            slot.Fingerprint = GetGhostFingerprint(key);
+            slot.EvictionTime = m_ProbationEvictions;
+        }
+        else
+        {
+            Unlink(node);
+        }
+    }
+
+    EQueue GetQueue(const TNodeType* node) const
+    {
+        if (node->IsListMember(&m_Probation)) return EQueue::Probation;
+        if (node->IsListMember(&m_Protected)) return EQueue::Protected;
+        if (node->IsListMember(&m_Pinned))    return EQueue::Pinned;
+        return EQueue::None;
+    }
+
+    bool   IsEmpty() const          { return GetCount() == 0; }
+    size_t GetCount() const         { return m_Probation.GetCount() + m_Protected.GetCount() + m_Pinned.GetCount(); }
+    size_t GetCount(EQueue queue) const
+    {
+        switch (queue)
+        {
+            case EQueue::Probation: return m_Probation.GetCount();
+            case EQueue::Protected: return m_Protected.GetCount();
+            case EQueue::Pinned:    return m_Pinned.GetCount();
+            default:                return 0;
+        }
+    }
+
+    // Call "callback" with eviction candidates, best candidate first, until
+    // it returns true. The callback can remove the node it is given.
+    template<typename TCallback>
+    bool ForEachVictimCandidate(TCallback&& callback)
+    {
+        const bool probationFirst = m_Probation.GetCount() * PROBATION_TARGET_DIVISOR > GetCount() || m_Protected.IsEmpty();
+        if (probationFirst) {
+            return VisitQueue(m_Probation, callback) || VisitQueue(m_Protected, callback) || VisitQueue(m_Pinned, callback);
+        } else {
+            return VisitQueue(m_Protected, callback) || VisitQueue(m_Probation, callback) || VisitQueue(m_Pinned, callback);
+        }
+    }
+
+    template<typename TCallback>
+    void ForEach(TCallback&& callback) const
+    {
+        for (TNodeType* node : m_Probation) callback(node);
+        for (TNodeType* node : m_Protected) callback(node);
+        for (TNodeType* node : m_Pinned)    callback(node);
+    }
+
+private:
+    static constexpr size_t PROBATION_TARGET_DIVISOR = 4;  // Probation is kept at 1/4 of the cache.
+    static constexpr size_t PINNED_LIMIT_DIVISOR     = 2;  // Pinned entries may use 1/2 of the cache.
+    static constexpr size_t GHOST_WINDOW_DIVISOR     = 2;  // Ghosts are remembered for 1/2 cache worth of probation evictions.
+
+    struct GhostSlot
+    {
+        uint32_t Fingerprint  = 0;
+        uint32_t EvictionTime = 0;
+    };
+
+    template<typename TCallback>
+    static bool VisitQueue(PIntrusiveList<TNodeType>& queue, TCallback& callback)
+    {
+        for (auto i = queue.begin(); i != queue.end(); )
+        {
+            TNodeType* node = *i;
+            ++i; // Advance before the callback unlinks the node.
+            if (callback(node)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Unlink(TNodeType* node)
+    {
+        if (node->IsListMember(&m_Probation)) {
+            m_Probation.Remove(node);
+        } else if (node->IsListMember(&m_Protected)) {
+            m_Protected.Remove(node);
+        } else if (node->IsListMember(&m_Pinned)) {
+            m_Pinned.Remove(node);
+        }
+    }
+
+    void AppendPinned(TNodeType* node)
+    {
+        m_Pinned.Append(node);
+        if (m_Pinned.GetCount() * PINNED_LIMIT_DIVISOR > GetCount() && m_Pinned.GetCount() > 1)
+        {
+            TNodeType* oldest = m_Pinned.GetFirst();
+            m_Pinned.Remove(oldest);
+            m_Protected.Append(oldest);
+        }
+    }
+
+    bool ConsumeGhost(uint64_t key)
+    {
+        GhostSlot& slot = m_GhostSlots[GetGhostSlot(key)];
+        if (slot.EvictionTime == 0 || slot.Fingerprint != GetGhostFingerprint(key)) {
+            return false;
+        }
+        const uint32_t age = m_ProbationEvictions - slot.EvictionTime;
+        slot.EvictionTime = 0;
+        return age <= GetCount() / GHOST_WINDOW_DIVISOR;
+    }
+
+    static uint64_t HashKey(uint64_t key)          { return key * 0x9e3779b97f4a7c15ull; }
+    static size_t   GetGhostSlot(uint64_t key)     { return size_t(HashKey(key) >> 32) & (GHOST_SLOT_COUNT - 1); }
+    static uint32_t GetGhostFingerprint(uint64_t key) { return uint32_t(HashKey(key)) | 1; }
+
+    PIntrusiveList<TNodeType>   m_Probation;
+    PIntrusiveList<TNodeType>   m_Protected;
+    PIntrusiveList<TNodeType>   m_Pinned;
+    GhostSlot                   m_GhostSlots[GHOST_SLOT_COUNT];
+    uint32_t                    m_ProbationEvictions = 0;
+};
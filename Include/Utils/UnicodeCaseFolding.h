@@ -92,3 +92,6 @@ int unicode_case_fold_compare(const char* lhsBegin, const char* lhsEnd, const ch
 bool unicode_case_fold_starts_with(const char* sourceBegin, const char* sourceEnd, const char* tokenBegin, const char* tokenEnd) noexcept;
 bool unicode_case_fold_ends_with(const char* sourceBegin, const char* sourceEnd, const char* tokenBegin, const char* tokenEnd) noexcept;
 bool unicode_case_fold_contains(const char* sourceBegin, const char* sourceEnd, const char* tokenBegin, const char* tokenEnd) noexcept;
+
+// Hash that is equal for strings that compare equal with unicode_case_fold_compare().
+uint32_t unicode_case_fold_hash(const char* begin, const char* end) noexcept;
@@ -0,0 +1,69 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 17.10.2026 14:00
+
+#include <algorithm>
+
+#include <Kernel/DebugConsole/KConsoleCommand.h>
+#include <Kernel/VFS/KBlockCache.h>
+
+namespace kernel
+{
+
+class CCmdBCacheInfo : public KConsoleCommand
+{
+public:
+    static constexpr size_t MAX_DEVICES = 16;
+
+    virtual int Invoke(std::vector<std::string>&& args) override
+    {
+        KBlockCacheStats stats[MAX_DEVICES];
+        const size_t deviceCount = std::min(KBlockCache::GetAllStats(stats, MAX_DEVICES), MAX_DEVICES);
+
+        Print("Dirty blocks: {}\n", KBlockCache::GetDirtyBlockCount());
+        Print("{:>6} {:>10} {:>6} {:>10} {:>8} {:>10} {:>10} {:>10} {:>6} {:>8} {:>10} {:>8} {:>7}\n", "Device", "Lookups", "Hit%", "Evictions", "RAWindow", "RABlocks", "RAHits", "RAWasted", "Dirty", "OldestMS", "Writes", "WriteAmp", "AvgRun");
+        for (size_t i = 0; i < deviceCount; ++i)
+        {
+            const KBlockCacheStats& device = stats[i];
+            const double hitRatio           = (device.Lookups != 0) ? double(device.Hits) * 100.0 / double(device.Lookups) : 0.0;
+            const double writeAmplification = (device.FlushedDirtyBuffers != 0) ? double(device.FlushedBuffers) / double(device.FlushedDirtyBuffers) : 0.0;
+            const double averageRunLength   = (device.FlushWrites != 0) ? double(device.FlushedBuffers) / double(device.FlushWrites) : 0.0;
+            Print("{:>6} {:>10} {:>6.1f} {:>10} {:>8} {:>10} {:>10} {:>10} {:>6} {:>8} {:>10} {:>8.3f} {:>7.1f}\n",
+                device.Device,
+                device.Lookups,
+                hitRatio,
+                device.Evictions,
+                device.ReadAheadWindow,
+                device.ReadAheadBlocks,
+                device.ReadAheadHits,
+                device.ReadAheadWasted,
+                device.DirtyBlocks,
+                device.OldestDirtyAge,
+                device.FlushWrites,
+                writeAmplification,
+                averageRunLength
+            );
+        }
+        return 0;
+    }
+    static PString GetDescription() { return "List block cache statistics."; }
+};
+
+static KConsoleCommandRegistrator<CCmdBCacheInfo> g_RegisterCCmdBCacheInfo("bcacheinfo");
+
+} // namespace kernel
@@ -0,0 +1,62 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 19:30
+
+#include <Kernel/DebugConsole/KConsoleCommand.h>
+#include <Kernel/KHeap.h>
+
+namespace kernel
+{
+
+class CCmdHeapInfo : public KConsoleCommand
+{
+public:
+    virtual int Invoke(std::vector<std::string>&& args) override
+    {
+#ifdef PADOS_OPT_TLSF_HEAP
+        Print("{:<10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>6} {:>5} {:>8}\n", "Pool", "Start", "Total", "Used", "MaxUsed", "Largest", "Blocks", "Frag", "Failed");
+        const int poolCount = kheap_get_pool_count();
+        for (int i = 0; i < poolCount; ++i)
+        {
+            KHeapPoolInfo info;
+            if (kheap_get_pool_info(i, info) != PErrorCode::Success) {
+                continue;
+            }
+            Print("{:<10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>6} {:>4}% {:>8}\n",
+                info.Name,
+                info.Start,
+                info.Stats.TotalSize,
+                info.Stats.UsedSize,
+                info.Stats.MaxUsedSize,
+                info.Stats.LargestFreeBlock,
+                info.Stats.FreeBlockCount,
+                info.Stats.FragmentationPercent,
+                info.Stats.FailedCount
+            );
+        }
+#else
+        Print("Heap size: {} of {}\n", get_heap_size(), get_max_heap_size());
+#endif // PADOS_OPT_TLSF_HEAP
+        return 0;
+    }
+    static PString GetDescription() { return "List heap pool statistics."; }
+};
+
+static KConsoleCommandRegistrator<CCmdHeapInfo> g_RegisterCCmdHeapInfo("heapinfo");
+
+} // namespace kernel
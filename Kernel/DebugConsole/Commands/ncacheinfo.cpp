@@ -0,0 +1,55 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 18.10.2026 12:00
+
+#include <Kernel/DebugConsole/KConsoleCommand.h>
+#include <Kernel/VFS/KNameCache.h>
+
+namespace kernel
+{
+
+class CCmdNCacheInfo : public KConsoleCommand
+{
+public:
+    virtual int Invoke(std::vector<std::string>&& args) override
+    {
+        if (args.size() > 1 && args[1] == "flush")
+        {
+            KNameCache::Flush();
+            return 0;
+        }
+        const KNameCacheStats stats = KNameCache::GetStats();
+        const uint32_t lookups  = stats.Hits + stats.NegativeHits + stats.Misses;
+        const double   hitRatio = (lookups != 0) ? double(stats.Hits + stats.NegativeHits) * 100.0 / double(lookups) : 0.0;
+
+        Print("Entries:       {} / {} ({} negative)\n", stats.EntryCount, KNameCache::MAX_ENTRY_COUNT, stats.NegativeCount);
+        Print("Lookups:       {} ({:.1f}% hit)\n", lookups, hitRatio);
+        Print("Hits:          {}\n", stats.Hits);
+        Print("Negative hits: {}\n", stats.NegativeHits);
+        Print("Misses:        {}\n", stats.Misses);
+        Print("Inserts:       {}\n", stats.Inserts);
+        Print("Evictions:     {}\n", stats.Evictions);
+        Print("Invalidations: {}\n", stats.Invalidations);
+        return 0;
+    }
+    static PString GetDescription() { return "List name cache statistics, or flush the cache with 'ncacheinfo flush'."; }
+};
+
+static KConsoleCommandRegistrator<CCmdNCacheInfo> g_RegisterCCmdNCacheInfo("ncacheinfo");
+
+} // namespace kernel
@@ -20,7 +20,9 @@
 #include <argparse/argparse.hpp>
 
 #include <Kernel/DebugConsole/KConsoleCommand.h>
+#include <Kernel/KPIDNode.h>
 #include <Kernel/KThread.h>
+#include <Kernel/KThreadCB.h>
 
 namespace kernel
 {
@@ -103,6 +105,7 @@ private:
         Print("TID:        {}\n", threadID);
         Print("PID:        {}\n", threadInfo.ProcessID);
         Print("Priority:   {}\n", threadInfo.Priority);
+        Print("Dyn. pri:   {}\n", threadInfo.DynamicPri);
         Print("State:      {}\n", GetStateName(threadInfo.State));
         Print("Blocking:   {}\n", threadInfo.BlockingObject);
         Print("Stack size: {}\n", threadInfo.StackSize);
@@ -110,6 +113,13 @@ private:
         Print("User time:  {}\n", PString::format_time_period(TimeValNanos::FromNanoseconds(threadInfo.UserTimeNano), true));
         Print("Real time:  {}\n", PString::format_time_period(TimeValNanos::FromNanoseconds(threadInfo.RealTimeNano), true));
 
+        const Ptr<KThreadCB> thread = kget_thread(threadID);
+        if (thread != nullptr)
+        {
+            Print("Max boost:  {}\n", thread->m_MaxPriorityBoost);
+            Print("Inversions: {}\n", thread->m_PriorityInversionCount);
+        }
+
         return 0;
     }
 
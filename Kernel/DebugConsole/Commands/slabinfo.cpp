@@ -0,0 +1,53 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 16:00
+
+#include <Kernel/DebugConsole/KConsoleCommand.h>
+#include <Kernel/KSlabCache.h>
+
+namespace kernel
+{
+
+class CCmdSlabInfo : public KConsoleCommand
+{
+public:
+    virtual int Invoke(std::vector<std::string>&& args) override
+    {
+        Print("{:<24} {:>6} {:>6} {:>6} {:>8} {:>8} {:>10} {:>6}\n", "Name", "Size", "Slabs", "Total", "InUse", "MaxUse", "Allocs", "Failed");
+        for (const KSlabCache* cache = KSlabCache::GetFirstCache(); cache != nullptr; cache = cache->GetNextCache())
+        {
+            const KSlabCacheStats stats = cache->GetStats();
+            Print("{:<24} {:>6} {:>6} {:>6} {:>8} {:>8} {:>10} {:>6}\n",
+                stats.Name,
+                stats.ObjectSize,
+                stats.SlabCount,
+                stats.SlabCount * stats.ObjectsPerSlab,
+                stats.ObjectsInUse,
+                stats.MaxObjectsInUse,
+                stats.AllocCount,
+                stats.FailedCount
+            );
+        }
+        return 0;
+    }
+    static PString GetDescription() { return "List kernel slab cache statistics."; }
+};
+
+static KConsoleCommandRegistrator<CCmdSlabInfo> g_RegisterCCmdSlabInfo("slabinfo");
+
+} // namespace kernel
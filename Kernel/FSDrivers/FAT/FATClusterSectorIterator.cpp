@@ -150,12 +150,12 @@ bool FATClusterSectorIterator::Increment(int sectors)
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-KCacheBlockDesc FATClusterSectorIterator::GetBlock_(bool doLoad)
+KCacheBlockDesc FATClusterSectorIterator::GetBlock_(bool doLoad, bool isMetadata)
 {
     if (!IsValidClusterSector(m_Volume, m_CurrentCluster, m_CurrentSector)) {
         PERROR_THROW_CODE(PErrorCode::IO);
     }
-    return m_Volume->m_BCache.GetBlock_trw(GetBlockSector(), doLoad);
+    return m_Volume->m_BCache.GetBlock_trw(GetBlockSector(), doLoad, isMetadata);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -31,7 +31,7 @@ struct FATClusterSectorIterator
     void Set(uint32_t cluster, uint32_t sector);
     
     off64_t         GetBlockSector();
-    KCacheBlockDesc GetBlock_(bool doLoad);
+    KCacheBlockDesc GetBlock_(bool doLoad, bool isMetadata = false);
     
     bool Increment(int sectors);
 
@@ -0,0 +1,154 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 19.10.2026 09:30
+
+#include "System/Platform.h"
+
+#include <algorithm>
+
+#include <Utils/String.h>
+#include <Utils/UnicodeCaseFolding.h>
+
+#include "FATDirectoryIndex.h"
+
+
+namespace kernel
+{
+
+static constexpr size_t FAT_DIRECTORY_INDEX_MIN_BUCKETS = 16;
+
+///////////////////////////////////////////////////////////////////////////////
+/// Names that compare equal with PString::compare_nocase() get the same
+/// hash.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t FATDirectoryIndex::CalculateNameHash(const PString& name)
+{
+    return unicode_case_fold_hash(name.data(), name.data() + name.size());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Can throw std::bad_alloc, in which case the index is left unchanged.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATDirectoryIndex::Add(uint32_t nameHash, uint32_t shortNameHash, uint32_t startIndex, uint32_t endIndex)
+{
+    if (m_EntryCount + 1 > m_NameBuckets.size()) {
+        Rehash(std::max(FAT_DIRECTORY_INDEX_MIN_BUCKETS, m_NameBuckets.size() * 2));
+    }
+    uint32_t slot;
+    if (m_FreeList != INVALID_SLOT)
+    {
+        slot = m_FreeList;
+        m_FreeList = m_Entries[slot].NextByName;
+    }
+    else
+    {
+        m_Entries.emplace_back();
+        slot = uint32_t(m_Entries.size() - 1);
+    }
+    Entry& entry = m_Entries[slot];
+    entry.NameHash      = nameHash;
+    entry.ShortNameHash = shortNameHash;
+    entry.StartIndex    = startIndex;
+    entry.EndIndex      = endIndex;
+
+    LinkEntry(slot);
+    m_EntryCount++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Remove the record ending at "endIndex". The hashes must be the ones the
+/// record was added with.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool FATDirectoryIndex::Remove(uint32_t nameHash, uint32_t shortNameHash, uint32_t endIndex)
+{
+    if (m_NameBuckets.empty()) {
+        return false;
+    }
+    uint32_t* link = &m_NameBuckets[GetBucketIndex(nameHash)];
+    while (*link != INVALID_SLOT && !(m_Entries[*link].NameHash == nameHash && m_Entries[*link].EndIndex == endIndex)) {
+        link = &m_Entries[*link].NextByName;
+    }
+    const uint32_t slot = *link;
+    if (slot == INVALID_SLOT || m_Entries[slot].ShortNameHash != shortNameHash) {
+        return false;
+    }
+    *link = m_Entries[slot].NextByName;
+
+    link = &m_ShortNameBuckets[GetBucketIndex(shortNameHash)];
+    while (*link != slot) {
+        link = &m_Entries[*link].NextByShortName;
+    }
+    *link = m_Entries[slot].NextByShortName;
+
+    m_Entries[slot].NextByName = m_FreeList;
+    m_FreeList = slot;
+    m_EntryCount--;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATDirectoryIndex::Rehash(size_t bucketCount)
+{
+    // Allocate everything before touching the index, so a failed
+    // allocation leaves it intact.
+    m_Entries.reserve(bucketCount);
+    std::vector<uint32_t> nameBuckets(bucketCount, INVALID_SLOT);
+    std::vector<uint32_t> shortNameBuckets(bucketCount, INVALID_SLOT);
+
+    std::vector<bool> isFree(m_Entries.size(), false);
+    for (uint32_t slot = m_FreeList; slot != INVALID_SLOT; slot = m_Entries[slot].NextByName) {
+        isFree[slot] = true;
+    }
+    m_NameBuckets.swap(nameBuckets);
+    m_ShortNameBuckets.swap(shortNameBuckets);
+
+    for (uint32_t slot = 0; slot < m_Entries.size(); ++slot)
+    {
+        if (!isFree[slot]) {
+            LinkEntry(slot);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATDirectoryIndex::LinkEntry(uint32_t slot)
+{
+    Entry& entry = m_Entries[slot];
+
+    uint32_t& nameBucket = m_NameBuckets[GetBucketIndex(entry.NameHash)];
+    entry.NextByName = nameBucket;
+    nameBucket = slot;
+
+    uint32_t& shortNameBucket = m_ShortNameBuckets[GetBucketIndex(entry.ShortNameHash)];
+    entry.NextByShortName = shortNameBucket;
+    shortNameBucket = slot;
+}
+
+} // namespace kernel
@@ -0,0 +1,111 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 19.10.2026 09:30
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class PString;
+
+namespace kernel
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// In-memory hash index over the records of one FAT directory. Each record
+/// is keyed on the case folded hash of both its display name (long name,
+/// or short name if it has no long name) and its 8.3 alias, and stores the
+/// record's position in the directory.
+///
+/// The index only narrows the search. Hashes can collide, so callers must
+/// read the candidate records from the directory and compare the names. A
+/// candidate that no longer matches the on-disk record means the index is
+/// stale, and it must be discarded.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+class FATDirectoryIndex
+{
+public:
+    static constexpr uint32_t INVALID_SLOT = 0xffffffff;
+
+    struct Entry
+    {
+        uint32_t NameHash;
+        uint32_t ShortNameHash;
+        uint32_t StartIndex;
+        uint32_t EndIndex;
+        uint32_t NextByName;
+        uint32_t NextByShortName;
+    };
+
+    static uint32_t CalculateNameHash(const PString& name);
+
+    void Add(uint32_t nameHash, uint32_t shortNameHash, uint32_t startIndex, uint32_t endIndex);
+    bool Remove(uint32_t nameHash, uint32_t shortNameHash, uint32_t endIndex);
+
+    size_t GetEntryCount() const { return m_EntryCount; }
+
+    // Call "callback(const Entry&)" for each record whose display name
+    // hash is "nameHash". Iteration stops when the callback returns true.
+    template<typename TCallback>
+    bool ForEachNameCandidate(uint32_t nameHash, TCallback&& callback) const
+    {
+        if (m_NameBuckets.empty()) {
+            return false;
+        }
+        for (uint32_t slot = m_NameBuckets[GetBucketIndex(nameHash)]; slot != INVALID_SLOT; slot = m_Entries[slot].NextByName)
+        {
+            if (m_Entries[slot].NameHash == nameHash && callback(m_Entries[slot])) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Same as ForEachNameCandidate(), but matching the 8.3 alias.
+    template<typename TCallback>
+    bool ForEachShortNameCandidate(uint32_t shortNameHash, TCallback&& callback) const
+    {
+        if (m_ShortNameBuckets.empty()) {
+            return false;
+        }
+        for (uint32_t slot = m_ShortNameBuckets[GetBucketIndex(shortNameHash)]; slot != INVALID_SLOT; slot = m_Entries[slot].NextByShortName)
+        {
+            if (m_Entries[slot].ShortNameHash == shortNameHash && callback(m_Entries[slot])) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    size_t GetBucketIndex(uint32_t hash) const { return hash & (m_NameBuckets.size() - 1); }
+    void   Rehash(size_t bucketCount);
+    void   LinkEntry(uint32_t slot);
+
+    std::vector<Entry>      m_Entries;
+    std::vector<uint32_t>   m_NameBuckets;      // Size is always a power of 2.
+    std::vector<uint32_t>   m_ShortNameBuckets; // Same size as m_NameBuckets.
+    uint32_t                m_FreeList = INVALID_SLOT;
+    size_t                  m_EntryCount = 0;
+};
+
+} // namespace kernel
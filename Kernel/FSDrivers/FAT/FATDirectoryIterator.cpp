@@ -207,9 +207,9 @@ static bool IsShortNameCharacterCompatible(uint8_t character, bool& hasUppercase
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-static void FATRawShortNameToUTF8(const FATDirectoryEntry& entry, PString& destination)
+void FATDirectoryIterator::RawShortNameToUTF8(const FATDirectoryEntry& entry, PString& destination)
 {
-    kernel_log<PLogSeverity::INFO_HIGH_VOL>(LogCat_FATDIR, "FATRawShortNameToUTF8().");
+    kernel_log<PLogSeverity::INFO_HIGH_VOL>(LogCat_FATDIR, "FATDirectoryIterator::RawShortNameToUTF8().");
 
     const bool lowercaseBase = (entry.m_ShortNameCaseFlags & FAT_SHORT_NAME_LOWERCASE_BASE) != 0;
     const bool lowercaseExtension = (entry.m_ShortNameCaseFlags & FAT_SHORT_NAME_LOWERCASE_EXTENSION) != 0;
@@ -435,7 +435,7 @@ FATDirectoryIterator::FATDirectoryIterator(Ptr<FATVolume> vol, uint32_t cluster,
     {
         m_SectorIterator.Increment(m_CurrentIndex / m_EntriesPerSector);
     }
-    m_CurrentBlock = m_SectorIterator.GetBlock_(true);
+    m_CurrentBlock = m_SectorIterator.GetBlock_(true, true);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -469,7 +469,7 @@ FATDirectoryEntryCombo* FATDirectoryIterator::Set(uint32_t cluster, uint32_t ind
         m_SectorIterator.Increment(m_CurrentIndex / m_EntriesPerSector);
     }
 
-    m_CurrentBlock = m_SectorIterator.GetBlock_(true);
+    m_CurrentBlock = m_SectorIterator.GetBlock_(true, true);
 
     if (m_CurrentBlock.m_Buffer == nullptr) {
         PERROR_THROW_CODE(PErrorCode::IO);
@@ -504,7 +504,7 @@ FATDirectoryEntryCombo* FATDirectoryIterator::GetNextRawEntry()
         if (!m_SectorIterator.Increment(1)) {
             return nullptr;
         }
-        m_CurrentBlock = m_SectorIterator.GetBlock_(true);
+        m_CurrentBlock = m_SectorIterator.GetBlock_(true, true);
         if (m_CurrentBlock.m_Buffer == nullptr) {
             return nullptr;
         }            
@@ -672,12 +672,12 @@ bool FATDirectoryIterator::GetNextLFNEntry(FATDirectoryEntryInfo* outInfo, PStri
     {
         startIndex = m_CurrentIndex;
         if (filename != nullptr) {
-            FATRawShortNameToUTF8(buffer->m_Normal, *filename);
+            RawShortNameToUTF8(buffer->m_Normal, *filename);
         }            
     }
 
     if (outShortFilename != nullptr) {
-        FATRawShortNameToUTF8(buffer->m_Normal, *outShortFilename);
+        RawShortNameToUTF8(buffer->m_Normal, *outShortFilename);
     }
 
     if (outInfo != nullptr)
@@ -754,7 +754,7 @@ static void ValidateFATDirectoryEntry(Ptr<FATVolume> volume, Ptr<FATInode> direc
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-bool FATDirectoryIterator::GetNextDirectoryEntry(Ptr<FATInode> directory, ino_t* outInodeID, PString* outFilename, uint32_t* outDosAttribs)
+bool FATDirectoryIterator::GetNextDirectoryEntry(Ptr<FATInode> directory, ino_t* outInodeID, PString* outFilename, uint32_t* outDosAttribs, FATDirectoryEntryInfo* outInfo)
 {
     FATDirectoryEntryInfo info;
 
@@ -776,6 +776,9 @@ bool FATDirectoryIterator::GetNextDirectoryEntry(Ptr<FATInode> directory, ino_t*
     if (outDosAttribs != nullptr) {
 	    *outDosAttribs = info.m_DOSAttribs;
     }
+    if (outInfo != nullptr) {
+        *outInfo = info;
+    }
     if (*outFilename == ".")
     {
         // Assign inode ID based on parent.
@@ -846,7 +849,7 @@ FATDirectoryEntryCombo* FATDirectoryIterator::Rewind()
             ReleaseCurrentBlock();
         }            
         m_SectorIterator.Set(m_StartingCluster, 0);
-        m_CurrentBlock = m_SectorIterator.GetBlock_(true);
+        m_CurrentBlock = m_SectorIterator.GetBlock_(true, true);
     }
     m_CurrentIndex = 0;
     return static_cast<FATDirectoryEntryCombo*>(m_CurrentBlock.m_Buffer);
@@ -111,7 +111,7 @@ public:
     FATDirectoryEntryCombo* GetNextRawEntry();
 
     bool GetNextLFNEntry(FATDirectoryEntryInfo* outInfo, PString* outFilename, PString* outShortFilename = nullptr);
-    bool GetNextDirectoryEntry(Ptr<FATInode> directory, ino_t* outInodeID, PString* outFilename, uint32_t* outDosAttribs);
+    bool GetNextDirectoryEntry(Ptr<FATInode> directory, ino_t* outInodeID, PString* outFilename, uint32_t* outDosAttribs, FATDirectoryEntryInfo* outInfo = nullptr);
 
     FATDirectoryEntryCombo* Rewind();
     void MarkDirty() { m_IsDirty = true; }
@@ -121,6 +121,7 @@ public:
     static void GenerateShortName(const wchar16_t* longName, size_t longNameLength, char* shortName);
 
     static uint8_t HashMSDOSName(const char *name);
+    static void    RawShortNameToUTF8(const FATDirectoryEntry& entry, PString& destination);
 
 private:
     void     ReleaseCurrentBlock();    
@@ -0,0 +1,136 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 21.10.2026 09:45
+
+#include "System/Platform.h"
+
+#include <algorithm>
+#include <new>
+
+#include <System/ExceptionHandling.h>
+#include <Kernel/KLogging.h>
+#include <Kernel/FSDrivers/FAT/FATFilesystem.h>
+
+#include "FATExtentMap.h"
+#include "FATTable.h"
+
+namespace kernel
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// Return the physical cluster holding cluster number "clusterIndex" of the
+/// chain starting at "startCluster". Throws PErrorCode::IO if the chain ends
+/// before reaching it.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t FATExtentMap::GetCluster(FATTable& table, uint32_t startCluster, uint32_t iteration, uint32_t clusterIndex)
+{
+    if (!IsValid(iteration))
+    {
+        m_Extents.clear();
+        m_Iteration = iteration;
+        m_IsValid = true;
+    }
+
+    uint32_t logicalCluster  = 0;
+    uint32_t physicalCluster = startCluster;
+    bool     isRecording     = true;
+
+    if (!m_Extents.empty())
+    {
+        const Extent& lastExtent = m_Extents.back();
+        if (clusterIndex < lastExtent.LogicalCluster + lastExtent.Length)
+        {
+            auto extent = std::upper_bound(m_Extents.begin(), m_Extents.end(), clusterIndex, [](uint32_t index, const Extent& extent) { return index < extent.LogicalCluster; });
+            --extent;
+            return extent->PhysicalCluster + (clusterIndex - extent->LogicalCluster);
+        }
+        logicalCluster  = lastExtent.LogicalCluster + lastExtent.Length - 1;
+        physicalCluster = lastExtent.PhysicalCluster + lastExtent.Length - 1;
+    }
+    else
+    {
+        try {
+            m_Extents.push_back({ 0, startCluster, 1 });
+        } catch (const std::bad_alloc&) {
+            isRecording = false;
+        }
+    }
+
+    // Walk the chain from the end of the mapped part, merging physically
+    // consecutive clusters into the last extent.
+    while (logicalCluster < clusterIndex)
+    {
+        const uint32_t nextCluster = table.GetEntry(physicalCluster);
+        if (nextCluster < FATTable::FIRST_DATA_CLUSTER || nextCluster >= BAD_FAT_ENTRY)
+        {
+            kernel_log<PLogSeverity::ERROR>(LogCat_FATFILE, "FATExtentMap::GetCluster(): chain from {} ended at index {} looking for index {}.", startCluster, logicalCluster, clusterIndex);
+            PERROR_THROW_CODE(PErrorCode::IO);
+        }
+        logicalCluster++;
+        physicalCluster = nextCluster;
+
+        if (isRecording)
+        {
+            Extent& lastExtent = m_Extents.back();
+            if (physicalCluster == lastExtent.PhysicalCluster + lastExtent.Length)
+            {
+                lastExtent.Length++;
+            }
+            else if (m_Extents.size() < MAX_EXTENTS)
+            {
+                try {
+                    m_Extents.push_back({ logicalCluster, physicalCluster, 1 });
+                } catch (const std::bad_alloc&) {
+                    isRecording = false;
+                }
+            }
+            else
+            {
+                isRecording = false;
+            }
+        }
+    }
+    return physicalCluster;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Called when clusters have been appended to the chain. That only changes
+/// the end-of-chain marker, so whatever has been mapped stays valid.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATExtentMap::ChainExtended(uint32_t oldIteration, uint32_t newIteration) noexcept
+{
+    if (IsValid(oldIteration)) {
+        m_Iteration = newIteration;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATExtentMap::Clear() noexcept
+{
+    std::vector<Extent>().swap(m_Extents);
+    m_IsValid = false;
+}
+
+} // namespace kernel
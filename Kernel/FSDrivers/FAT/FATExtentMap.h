@@ -0,0 +1,67 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 21.10.2026 09:45
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace kernel
+{
+class FATTable;
+
+///////////////////////////////////////////////////////////////////////////////
+/// Maps cluster indexes within a file to physical clusters, as a sorted list
+/// of runs of physically consecutive clusters. The map is filled in lazily
+/// from the FAT as far as lookups need it, so looking up a cluster that has
+/// already been mapped is a binary search rather than a walk of the chain.
+///
+/// The map is tagged with the inode's m_Iteration, and is discarded when a
+/// lookup finds that the chain has changed since.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+class FATExtentMap
+{
+public:
+    // Highly fragmented files stop recording new extents here. Clusters past
+    // the last extent are then found by walking the chain from its end.
+    static constexpr size_t MAX_EXTENTS = 256;
+
+    struct Extent
+    {
+        uint32_t LogicalCluster;
+        uint32_t PhysicalCluster;
+        uint32_t Length;
+    };
+
+    uint32_t GetCluster(FATTable& table, uint32_t startCluster, uint32_t iteration, uint32_t clusterIndex);
+
+    bool IsValid(uint32_t iteration) const noexcept { return m_IsValid && m_Iteration == iteration; }
+    void ChainExtended(uint32_t oldIteration, uint32_t newIteration) noexcept;
+    void Clear() noexcept;
+
+private:
+    std::vector<Extent> m_Extents;
+    uint32_t            m_Iteration = 0;
+    bool                m_IsValid = false;
+};
+
+} // namespace kernel
@@ -19,6 +19,7 @@
 
 #include <System/Platform.h>
 
+#include <algorithm>
 #include <string_view>
 #include <utility>
 #include <string.h>
@@ -37,9 +38,11 @@
 #include <Kernel/VFS/KFileHandle.h>
 #include <Kernel/VFS/KVFSManager.h>
 #include <Storage/DirectoryEntry.h>
+#include <DeviceControl/FileAllocation.h>
 
 #include "FATVolume.h"
 #include "FATInode.h"
+#include "FATDirectoryIndex.h"
 #include "FATDirectoryNode.h"
 #include "FATDirectoryIterator.h"
 #include "FATFileNode.h"
@@ -47,6 +50,15 @@
 
 #define FAT_MAX_FILE_SIZE 0xffffffffLL
 
+// Sector aligned transfers of at least this size bypass the block cache even
+// if the file is not opened with O_DIRECT.
+#define FAT_DIRECT_IO_MIN_SIZE (32 * 1024)
+
+// Writes that extend the cluster chain allocate up to this much extra space
+// past the end of the write, so a file written in small appends ends up in
+// few, large runs. The surplus is released when the last writer closes.
+#define FAT_SPECULATIVE_PREALLOC_MAX_SIZE (1024 * 1024)
+
 namespace kernel
 {
 
@@ -97,6 +109,66 @@ static std::set<PString> g_DOSDeviceBaseNames =
     "CONFIG$"   // Only in MS-DOS 7.0-8.0.
 };
 
+///////////////////////////////////////////////////////////////////////////////
+/// Check if a sector aligned transfer should bypass the block cache.
+///////////////////////////////////////////////////////////////////////////////
+
+static bool UseDirectIO(Ptr<FATFileNode> fileNode, const void* buffer, size_t length)
+{
+    if (fileNode->GetOpenFlags() & O_DIRECT) {
+        return true;
+    }
+    // Unaligned buffers are bounced through the device driver's own buffer,
+    // so they are better off in the block cache.
+    return length >= FAT_DIRECT_IO_MIN_SIZE && (reinterpret_cast<uintptr_t>(buffer) & DCACHE_LINE_SIZE_MASK) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Split "sectorCount" sectors, starting at the current position of
+/// "iterator", into runs of physically contiguous clusters and call
+/// "callback(firstSector, runSectorCount)" for each run. The iterator is left
+/// at the last sector visited.
+///////////////////////////////////////////////////////////////////////////////
+
+template<typename TCallback>
+static void for_each_contiguous_sector_run(Ptr<FATVolume> volume, FATClusterSectorIterator& iterator, size_t sectorCount, TCallback&& callback)
+{
+    for (;;)
+    {
+        const off64_t firstSector = iterator.GetBlockSector();
+        size_t        runLength   = std::min(size_t(volume->m_SectorsPerCluster - iterator.m_CurrentSector), sectorCount);
+
+        if (!iterator.Increment(int(runLength - 1))) {
+            PERROR_THROW_CODE(PErrorCode::IO);
+        }
+        // Extend the run while the next cluster in the chain directly
+        // follows the current one. If it doesn't, the iterator is left
+        // at the start of the next run.
+        while (runLength < sectorCount)
+        {
+            if (!iterator.Increment(1)) {
+                PERROR_THROW_CODE(PErrorCode::IO);
+            }
+            if (iterator.GetBlockSector() != firstSector + off64_t(runLength)) {
+                break;
+            }
+            const size_t clusterSectors = std::min(size_t(volume->m_SectorsPerCluster), sectorCount - runLength);
+            if (!iterator.Increment(int(clusterSectors - 1))) {
+                PERROR_THROW_CODE(PErrorCode::IO);
+            }
+            runLength += clusterSectors;
+        }
+        callback(firstSector, runLength);
+        sectorCount -= runLength;
+        if (sectorCount == 0) {
+            return;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
 static void ValidateFATNameBuffer(const char* name, int nameLength)
 {
     if (name == nullptr || nameLength < 0) {
@@ -181,6 +253,34 @@ static TimeValNanos FATTimeToTimeValOrFallback(uint32_t fatTime, uint8_t createT
     return FATInode::FATTimeToTimeVal(fatTime, createTimeFine);
 }
 
+// Shared by ReadStat() and ReadDirectoryPlus(), so that both give the same
+// result. Doesn't take any references, so it is safe to use on inodes
+// visited through KVFSManager::VisitLoadedInode().
+static void FillFATStat(const FATVolume& volume, ino_t inodeID, mode_t fileMode, off64_t size, const TimeValNanos& accessTime, const TimeValNanos& modificationTime, const TimeValNanos& creationTime, struct stat* statBuf)
+{
+    *statBuf = {};
+
+    statBuf->st_dev = dev_t(volume.m_VolumeID);
+    statBuf->st_ino = inodeID;
+
+    statBuf->st_mode = fileMode;
+    if (volume.HasFlag(FSVolumeFlags::FS_IS_READONLY)) {
+        statBuf->st_mode &= ~(S_IWUSR | S_IWGRP | S_IWOTH);
+    }
+    statBuf->st_nlink   = 1;
+    statBuf->st_size    = S_ISDIR(fileMode) ? 0 : size;
+    statBuf->st_blksize = volume.m_BytesPerSector * volume.m_SectorsPerCluster;
+
+    statBuf->st_atim = accessTime.AsTimespec();
+    statBuf->st_mtim = modificationTime.AsTimespec();
+    statBuf->st_ctim = creationTime.AsTimespec();
+}
+
+static void FillFATStat(const FATVolume& volume, const FATInode& node, struct stat* statBuf)
+{
+    FillFATStat(volume, node.m_InodeID, node.m_FileMode, node.m_Size, node.m_ATime, node.m_MTime, node.m_CTime, statBuf);
+}
+
 static void InitFATDirectoryEntry(
     FATDirectoryEntry& entry,
     const char shortName[11],
@@ -419,7 +519,11 @@ Ptr<KFSVolume> FATFilesystem::Mount(fs_id volumeID, const char* devicePath, uint
 
     vol->m_LastAllocatedCluster = FATTable::FIRST_DATA_CLUSTER;
 
-    if (!vol->m_BCache.SetDevice(deviceFile, vol->m_TotalSectors, vol->m_BytesPerSector)) {
+    // Cache the volume in buffers of up to one cluster, so the device is read
+    // and written in larger chunks than single sectors.
+    const size_t cacheBufferSize = std::clamp(size_t(vol->m_BytesPerSector) * vol->m_SectorsPerCluster, size_t(vol->m_BytesPerSector), size_t(KBlockCache::MAX_BUFFER_SIZE));
+
+    if (!vol->m_BCache.SetDevice(deviceFile, vol->m_TotalSectors, vol->m_BytesPerSector, cacheBufferSize)) {
         kernel_log<PLogSeverity::ERROR>(LogCat_FATFS, "FATFilesystem::Mount(): error initializing block cache ({}).", strerror(get_last_error()));
         PERROR_THROW_CODE(PErrorCode(get_last_error()));
     }
@@ -427,7 +531,7 @@ Ptr<KFSVolume> FATFilesystem::Mount(fs_id volumeID, const char* devicePath, uint
     bool isFreeClustersValid = false;
     if (vol->m_FSInfoSector != 0xffff)
     {
-        KCacheBlockDesc bufferDesc = vol->m_BCache.GetBlock_trw(vol->m_FSInfoSector);
+        KCacheBlockDesc bufferDesc = vol->m_BCache.GetBlock_trw(vol->m_FSInfoSector, true, true);
         FATFSInfo* fsInfo = static_cast<FATFSInfo*>(bufferDesc.m_Buffer);
         if (fsInfo != nullptr)
         {
@@ -465,8 +569,11 @@ Ptr<KFSVolume> FATFilesystem::Mount(fs_id volumeID, const char* devicePath, uint
         }
     }
 
-    if (!isFreeClustersValid) {
+    // Probe() unmounts the volume right away, so it counts the free clusters
+    // synchronously. Real mounts leave that to the scan thread started below.
+    if (!isFreeClustersValid && volumeID == -1) {
         vol->m_FreeClusters = vol->GetFATTable()->CountFreeClusters();
+        isFreeClustersValid = true;
     }
 
     kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATFS, "mounting {} (id {:x}, device {:x}, media descriptor {:x})", vol->m_DevicePath.c_str(), vol->m_VolumeID, deviceFile, vol->m_MediaDescriptor);
@@ -533,6 +640,13 @@ Ptr<KFSVolume> FATFilesystem::Mount(fs_id volumeID, const char* devicePath, uint
     kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATFS, "FATFilesystem::Mount(): Root inode ID = {:x}.", vol->m_RootInode->m_InodeID);
     kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATFS, "FATFilesystem::Mount(): Volume label [{:11.11}] ({}).", vol->m_VolumeLabel, vol->m_VolumeLabelEntry);
 
+    // Count free clusters and build the allocation map in the background.
+    // Read-only volumes only need the count, and only if FSInfo had none.
+    const bool isReadOnly = vol->HasFlag(FSVolumeFlags::FS_IS_READONLY);
+    if (!isFreeClustersValid || !isReadOnly) {
+        vol->GetFATTable()->StartFreeClusterScan(!isReadOnly, !isFreeClustersValid);
+    }
+
     vol->m_DeviceFile = deviceFile;
     return vol;
 }
@@ -549,6 +663,7 @@ void FATFilesystem::Unmount(Ptr<KFSVolume> volume)
         PERROR_THROW_CODE(PErrorCode::IO);
     }
 
+    vol->GetFATTable()->StopFreeClusterScan();
     {
         KScopedLock volumeLock(vol->m_Mutex);
         vol->FlushDirtyInodes();
@@ -613,6 +728,9 @@ void FATFilesystem::ReadFSStat(Ptr<KFSVolume> _vol, fs_info* fss)
     
     // File system flags.
     fss->fi_flags = vol->GetFlags();
+    if (vol->GetFATTable()->IsFreeClusterCountEstimated()) {
+        fss->fi_flags |= uint32_t(FSVolumeFlags::FS_FREE_BLOCKS_ESTIMATED);
+    }
     
     // FS block size.
     fss->fi_block_size = vol->m_BytesPerSector * vol->m_SectorsPerCluster;
@@ -757,6 +875,7 @@ void FATFilesystem::WriteFSStat(Ptr<KFSVolume> _vol, const fs_info* fss, uint32_
             }
             memcpy(buffer->m_Normal.m_Filename, sanitizedName, FAT_VOLUME_LABEL_LENGTH);
             diri.MarkDirty();
+            vol->DiscardDirectoryIndex(ptr_raw_pointer_cast(vol->m_RootInode));
         }
         else
         {
@@ -802,6 +921,15 @@ Ptr<KInode> FATFilesystem::LocateInode(Ptr<KFSVolume> volume, Ptr<KInode> parent
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
+bool FATFilesystem::SupportsNameCache() const
+{
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
 void FATFilesystem::ReleaseInode(KInode* inode)
 {
     Ptr<FATVolume> vol  = ptr_static_cast<FATVolume>(inode->m_Volume);
@@ -811,6 +939,12 @@ void FATFilesystem::ReleaseInode(KInode* inode)
         PERROR_THROW_CODE(PErrorCode::IO);
     }
 
+    if (node->IsDirectory())
+    {
+        KScopedLock volumeLock(vol->m_Mutex);
+        vol->DiscardDirectoryIndex(node);
+    }
+
     if (node->IsDeleted() || node->IsMetadataDirty())
     {
         KScopedLock volumeLock(vol->m_Mutex);
@@ -924,6 +1058,9 @@ Ptr<KFileNode> FATFilesystem::OpenFile(Ptr<KFSVolume> volume, Ptr<KInode> _node,
     fileNode->m_FATChainIndex = 0;
     fileNode->m_CachedCluster = node->m_StartCluster;
 
+    if (writeAccessRequested) {
+        node->m_OpenWriterCount++;
+    }
     return fileNode;
 }
 
@@ -1032,7 +1169,10 @@ Ptr<KFileNode> FATFilesystem::CreateFile(Ptr<KFSVolume> volume, Ptr<KInode> pare
     fileNode->m_FATIteration  = file->m_Iteration;
     fileNode->m_FATChainIndex = 0;
     fileNode->m_CachedCluster = file->m_StartCluster;
-    
+
+    if ((openFlags & O_ACCMODE) != O_RDONLY) {
+        file->m_OpenWriterCount++;
+    }
     return fileNode;
 }
 
@@ -1052,6 +1192,14 @@ void FATFilesystem::CloseFile(Ptr<KFSVolume> volume, KFileNode* file)
         PERROR_THROW_CODE(PErrorCode::IO);
     }
     kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATFILE, "FATFilesystem::CloseFile() (inode ID {:x}).", node->m_InodeID);
+
+    if ((fileNode->GetOpenFlags() & O_ACCMODE) != O_RDONLY && node->m_OpenWriterCount > 0)
+    {
+        node->m_OpenWriterCount--;
+        if (node->m_OpenWriterCount == 0 && !node->IsDirectory() && !vol->HasFlag(FSVolumeFlags::FS_IS_READONLY)) {
+            TrimPreallocatedClusters(vol, node);
+        }
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1316,7 +1464,7 @@ void FATFilesystem::CreateDirectory(Ptr<KFSVolume> volume, Ptr<KInode> parent, c
         if (!csi.Increment(1)) {
             PERROR_THROW_CODE(PErrorCode::IO);
         }
-        KCacheBlockDesc blockDesc = csi.GetBlock_(false);
+        KCacheBlockDesc blockDesc = csi.GetBlock_(false, true);
         if (blockDesc.m_Buffer == nullptr) {
             PERROR_THROW_CODE(PErrorCode::IO);
         }
@@ -1452,7 +1600,7 @@ void FATFilesystem::Rename(Ptr<KFSVolume> inputVolume, Ptr<KInode> inputOldDirec
         if (destinationEntryCreated)
         {
             try {
-                EraseDirectoryEntry(volume, newDirectory->m_StartCluster, newStartIndex, newEndIndex);
+                EraseDirectoryEntry(volume, newDirectory, newStartIndex, newEndIndex);
             } catch (const std::exception& exception) {
                 kernel_log<PLogSeverity::CRITICAL>(LogCat_FATDIR, "FATFilesystem::Rename(): failed to remove the new directory entry during rollback: {}", exception.what());
             }
@@ -1544,7 +1692,7 @@ void FATFilesystem::Rename(Ptr<KFSVolume> inputVolume, Ptr<KInode> inputOldDirec
 
     // Removing the old entry commits the rename. EraseDirectoryEntry() restores
     // a partially erased entry before propagating an error.
-    EraseDirectoryEntry(volume, oldDirectory->m_StartCluster, sourceNode->m_DirStartIndex, sourceNode->m_DirEndIndex);
+    EraseDirectoryEntry(volume, oldDirectory, sourceNode->m_DirStartIndex, sourceNode->m_DirEndIndex);
 
     sourceNode->m_ParentInodeID = newDirectory->m_InodeID;
     sourceNode->m_DirStartIndex = newStartIndex;
@@ -1635,7 +1783,10 @@ size_t FATFilesystem::Read(Ptr<KFileNode> file, void* buf, size_t len, off64_t p
         len = availableBytes;
     }
 
-    if ((fileNode->m_FATIteration == node->m_Iteration) && (pos >= fileNode->m_FATChainIndex * vol->m_BytesPerSector * vol->m_SectorsPerCluster))
+    const uint32_t bytesPerCluster = vol->m_BytesPerSector * vol->m_SectorsPerCluster;
+    const uint32_t clusterIndex = uint32_t(pos / bytesPerCluster);
+
+    if ((fileNode->m_FATIteration == node->m_Iteration) && clusterIndex >= fileNode->m_FATChainIndex && clusterIndex - fileNode->m_FATChainIndex <= 1)
     {
         // The cached fat value is both valid and helpful.
         if (!vol->IsDataCluster(fileNode->m_CachedCluster))
@@ -1651,9 +1802,10 @@ size_t FATFilesystem::Read(Ptr<KFileNode> file, void* buf, size_t len, off64_t p
     }
     else
     {
-        // the fat chain changed, so we have to start from the beginning
-        cluster1 = node->m_StartCluster;
-        diff = pos;
+        // Random access, or the fat chain changed. Look the cluster up in the
+        // inode's extent map rather than walking the chain from the start.
+        cluster1 = GetFileCluster(vol, node, clusterIndex);
+        diff = pos - off64_t(clusterIndex) * bytesPerCluster;
     }
     diff /= vol->m_BytesPerSector; // convert to sectors
 
@@ -1692,6 +1844,25 @@ size_t FATFilesystem::Read(Ptr<KFileNode> file, void* buf, size_t len, off64_t p
         }
     }
 
+    // Large aligned middle parts go straight between the device and the
+    // caller's buffer, one request per physically contiguous run.
+    const size_t middleSectorCount = (len - bytes_read) / vol->m_BytesPerSector;
+    if (middleSectorCount != 0 && UseDirectIO(fileNode, static_cast<uint8_t*>(buf) + bytes_read, middleSectorCount * vol->m_BytesPerSector))
+    {
+        for_each_contiguous_sector_run(vol, iter, middleSectorCount, [&vol, buf, &bytes_read](off64_t firstSector, size_t sectorCount)
+            {
+                vol->m_BCache.DirectRead_trw(firstSector, static_cast<uint8_t*>(buf) + bytes_read, sectorCount);
+                bytes_read += sectorCount * vol->m_BytesPerSector;
+            }
+        );
+        if (bytes_read < len)
+        {
+            if (!iter.Increment(1)) {
+                PERROR_THROW_CODE(PErrorCode::IO);
+            }
+        }
+    }
+
     // read middle sectors
     while (bytes_read + vol->m_BytesPerSector <= len)
     {
@@ -1807,9 +1978,11 @@ size_t FATFilesystem::Write(Ptr<KFileNode> file, const void* buf, size_t len, of
         }
     });
 
+    const uint32_t bytesPerCluster = vol->m_BytesPerSector * vol->m_SectorsPerCluster;
+    const uint32_t clusterIndex = uint32_t(pos / bytesPerCluster);
     uint32_t cluster1;
 
-    if (node->m_Size && (fileNode->m_FATIteration == node->m_Iteration) && (pos >= fileNode->m_FATChainIndex * vol->m_BytesPerSector * vol->m_SectorsPerCluster))
+    if (node->m_Size && (fileNode->m_FATIteration == node->m_Iteration) && clusterIndex >= fileNode->m_FATChainIndex && clusterIndex - fileNode->m_FATChainIndex <= 1)
     {
         if (!vol->IsDataCluster(fileNode->m_CachedCluster))
         {
@@ -1833,9 +2006,33 @@ size_t FATFilesystem::Write(Ptr<KFileNode> file, const void* buf, size_t len, of
     {
         if (requiredClusterCount > GetFileClusterCount(vol, oldFileSize))
         {
+            const uint32_t iteration = node->m_Iteration;
             EnsureClusterChainMetadataLoaded(vol, node);
-            if (requiredClusterCount > node->m_AllocatedClusterCount) {
-                vol->GetFATTable()->SetChainLength(node, requiredClusterCount, true);
+            if (node->m_Iteration != iteration) {
+                cluster1 = 0xffffffff; // Stale clusters past the end were released, the cached cluster might be one of them.
+            }
+            if (requiredClusterCount > node->m_AllocatedClusterCount)
+            {
+                // Grow the chain by as much again as the file needs, up to
+                // FAT_SPECULATIVE_PREALLOC_MAX_SIZE, without taking the last
+                // free clusters on the volume.
+                const uint32_t newClusterCount = requiredClusterCount - node->m_AllocatedClusterCount;
+                uint32_t extraClusterCount = std::min(requiredClusterCount, uint32_t(FAT_SPECULATIVE_PREALLOC_MAX_SIZE / bytesPerCluster));
+                extraClusterCount = std::min(extraClusterCount, GetFileClusterCount(vol, FAT_MAX_FILE_SIZE) - requiredClusterCount);
+                extraClusterCount = (vol->m_FreeClusters > newClusterCount) ? std::min(extraClusterCount, (vol->m_FreeClusters - newClusterCount) / 2) : 0;
+
+                try
+                {
+                    vol->GetFATTable()->SetChainLength(node, requiredClusterCount + extraClusterCount, true);
+                }
+                catch (const std::system_error& error)
+                {
+                    // The free count can be an estimate while the volume is being scanned.
+                    if (extraClusterCount == 0 || PErrorCode(error.code().value()) != PErrorCode::NOSPC) {
+                        throw;
+                    }
+                    vol->GetFATTable()->SetChainLength(node, requiredClusterCount, true);
+                }
             }
         }
         if (pos > oldFileSize) {
@@ -1844,8 +2041,8 @@ size_t FATFilesystem::Write(Ptr<KFileNode> file, const void* buf, size_t len, of
     }
 
     if (cluster1 == 0xffffffff) {
-        cluster1 = node->m_StartCluster;
-        diff = pos;
+        cluster1 = GetFileCluster(vol, node, clusterIndex);
+        diff = pos - off64_t(clusterIndex) * bytesPerCluster;
     }
     diff /= vol->m_BytesPerSector; // Convert to sectors.
 
@@ -1887,6 +2084,25 @@ size_t FATFilesystem::Write(Ptr<KFileNode> file, const void* buf, size_t len, of
         }
     }
 
+    // Large aligned middle parts go straight between the caller's buffer and
+    // the device, one request per physically contiguous run.
+    const size_t middleSectorCount = (len - bytesWritten) / vol->m_BytesPerSector;
+    if (middleSectorCount != 0 && UseDirectIO(fileNode, static_cast<const uint8_t*>(buf) + bytesWritten, middleSectorCount * vol->m_BytesPerSector))
+    {
+        for_each_contiguous_sector_run(vol, iter, middleSectorCount, [&vol, buf, &bytesWritten](off64_t firstSector, size_t sectorCount)
+            {
+                vol->m_BCache.DirectWrite_trw(firstSector, static_cast<const uint8_t*>(buf) + bytesWritten, sectorCount);
+                bytesWritten += sectorCount * vol->m_BytesPerSector;
+            }
+        );
+        if (bytesWritten < len)
+        {
+            if (!iter.Increment(1)) {
+                PERROR_THROW_CODE(PErrorCode::IO);
+            }
+        }
+    }
+
     // write middle sectors
     while (bytesWritten + vol->m_BytesPerSector <= len)
     {
@@ -1954,14 +2170,31 @@ size_t FATFilesystem::Write(Ptr<KFileNode> file, const void* buf, size_t len, of
 size_t FATFilesystem::ReadDirectory(Ptr<KFSVolume> volume, Ptr<KDirectoryNode> directory, void* buffer, size_t bufferSize)
 {
     PDirEntryWriter entryWriter(buffer, bufferSize);
-    if (!entryWriter.IsValid() || bufferSize < PGetDirEntryRecordSize(0)) {
+    return DoReadDirectory(ptr_static_cast<FATVolume>(volume), ptr_static_cast<FATDirectoryNode>(directory), ptr_static_cast<FATInode>(directory->GetInode()), entryWriter);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Same as ReadDirectory(), but with the stat of each entry filled in from
+/// the directory entry, or from the inode if it is loaded.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t FATFilesystem::ReadDirectoryPlus(Ptr<KFSVolume> volume, Ptr<KDirectoryNode> directory, void* buffer, size_t bufferSize)
+{
+    PDirEntryWriter entryWriter(buffer, bufferSize, true);
+    return DoReadDirectory(ptr_static_cast<FATVolume>(volume), ptr_static_cast<FATDirectoryNode>(directory), ptr_static_cast<FATInode>(directory->GetInode()), entryWriter);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t FATFilesystem::DoReadDirectory(Ptr<FATVolume> vol, Ptr<FATDirectoryNode> dirNode, Ptr<FATInode> dir, PDirEntryWriter& entryWriter)
+{
+    if (!entryWriter.IsValid() || entryWriter.GetRemainingSize() < entryWriter.GetRecordSize(0)) {
         PERROR_THROW_CODE(PErrorCode::INVAL);
     }
 
-    Ptr<FATVolume>        vol = ptr_static_cast<FATVolume>(volume);
-    Ptr<FATDirectoryNode> dirNode = ptr_static_cast<FATDirectoryNode>(directory);
-    Ptr<FATInode>         dir = ptr_static_cast<FATInode>(directory->GetInode());
-
     CRITICAL_SCOPE(vol->m_Mutex);
 
     if (!vol->CheckMagic(__func__) || !dir->CheckMagic(__func__) || !dirNode->CheckMagic(__func__)) {
@@ -1988,6 +2221,9 @@ size_t FATFilesystem::ReadDirectory(Ptr<KFSVolume> volume, Ptr<KDirectoryNode> d
         entry->d_type = DT_DIR;
         entry->d_ino = vol->m_RootInode->m_InodeID;
         entry->d_volumeid = vol->m_VolumeID;
+        if (entryWriter.IncludesStat()) {
+            FillFATStat(*vol, *vol->m_RootInode, PDirEntryWriter::GetStat(entry));
+        }
         dirNode->m_CurrentIndex++;
     }
 
@@ -1997,14 +2233,15 @@ size_t FATFilesystem::ReadDirectory(Ptr<KFSVolume> volume, Ptr<KDirectoryNode> d
 
     for (;;)
     {
-        if (entryWriter.GetRemainingSize() < PGetDirEntryRecordSize(0)) {
+        if (entryWriter.GetRemainingSize() < entryWriter.GetRecordSize(0)) {
             break;
         }
 
         PString fileName;
         ino_t inodeID;
         uint32_t dosAttributes = 0;
-        if (!directoryIterator.GetNextDirectoryEntry(dir, &inodeID, &fileName, &dosAttributes))
+        FATDirectoryEntryInfo info;
+        if (!directoryIterator.GetNextDirectoryEntry(dir, &inodeID, &fileName, &dosAttributes, &info))
         {
             dirNode->m_CurrentIndex = directoryIterator.m_CurrentIndex + (isRootDirectory ? 2 : 0);
             break;
@@ -2024,12 +2261,56 @@ size_t FATFilesystem::ReadDirectory(Ptr<KFSVolume> volume, Ptr<KDirectoryNode> d
         entry->d_ino = inodeID;
         entry->d_type = ((dosAttributes & FAT_SUBDIR) != 0) ? DT_DIR : DT_REG;
         entry->d_volumeid = vol->m_VolumeID;
+        if (entryWriter.IncludesStat()) {
+            ReadEntryStat(vol, dir, inodeID, fileName, info, PDirEntryWriter::GetStat(entry));
+        }
         kernel_log<PLogSeverity::INFO_HIGH_VOL>(LogCat_FATDIR, "FATFilesystem::ReadDirectory(): found file '{}'.", entry->d_name);
         dirNode->m_CurrentIndex = directoryIterator.m_CurrentIndex + (isRootDirectory ? 2 : 0);
     }
     return entryWriter.GetBytesWritten();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Fill in the stat of a directory entry without loading the inode. A loaded
+/// inode may have changes not yet written to the entry, so it is used when
+/// available. The stat is left zeroed (not available) for ".." when the
+/// parent is not loaded, as its entry in this directory doesn't hold the
+/// parent's attributes, and for inodes being loaded or released.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATFilesystem::ReadEntryStat(Ptr<FATVolume> vol, Ptr<FATInode> dir, ino_t inodeID, const PString& fileName, const FATDirectoryEntryInfo& info, struct stat* statBuf)
+{
+    kassert(vol->m_Mutex.IsLocked());
+
+    if (fileName == ".") {
+        FillFATStat(*vol, *dir, statBuf);
+        return;
+    }
+    if (inodeID == vol->m_RootInode->m_InodeID) {
+        FillFATStat(*vol, *vol->m_RootInode, statBuf);
+        return;
+    }
+    const KLoadedInodeState inodeState = KVFSManager::VisitLoadedInode(vol->m_VolumeID, inodeID,
+        [&vol, statBuf](KInode* inode)
+        {
+            FillFATStat(*vol, *static_cast<FATInode*>(inode), statBuf);
+        });
+
+    if (inodeState == KLoadedInodeState::NotLoaded && fileName != "..")
+    {
+        const TimeValNanos modificationTime = FATTimeToTimeValOrFallback(info.m_FATModificationTime, 0, TimeValNanos::zero);
+        FillFATStat(*vol,
+            inodeID,
+            DOSAttribsToFileMode(info.m_DOSAttribs),
+            info.m_Size,
+            FATTimeToTimeValOrFallback(info.m_FATAccessTime, 0, modificationTime),
+            modificationTime,
+            FATTimeToTimeValOrFallback(info.m_FATCreateTime, info.m_FATCreateTimeFine, modificationTime),
+            statBuf);
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -2109,10 +2390,7 @@ void FATFilesystem::ReadStat(Ptr<KFSVolume> volume, Ptr<KInode> inode, struct st
 
     kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATFILE, "FATFilesystem::ReadStat(inode ID {:x})", fsInode->m_InodeID);
 
-    KFilesystemFileOps::ReadStat(volume, inode, statBuf);
-
-    statBuf->st_size    = fsInode->IsDirectory() ? 0 : fsInode->m_Size;
-    statBuf->st_blksize = fsVolume->m_BytesPerSector * fsVolume->m_SectorsPerCluster;
+    FillFATStat(*fsVolume, *fsInode, statBuf);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -2229,6 +2507,71 @@ void FATFilesystem::Sync(Ptr<KFileNode> file)
     Sync(file->GetInode()->m_Volume);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Allocate the clusters backing [offset, offset + length). New clusters
+/// are taken from a single free run when one is large enough. Unless
+/// FALLOC_FL_KEEP_SIZE is given, the file is extended to cover the range
+/// and the new part is zeroed. FAT has no way to record space reserved past
+/// the end of the file, so such clusters are released again by
+/// TrimPreallocatedClusters() when the last writer closes the file.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATFilesystem::Allocate(Ptr<KFileNode> file, int mode, off64_t offset, off64_t length)
+{
+    Ptr<FATInode>    node = ptr_static_cast<FATInode>(file->GetInode());
+    Ptr<FATVolume>   vol = ptr_static_cast<FATVolume>(node->m_Volume);
+    Ptr<FATFileNode> fileNode = ptr_static_cast<FATFileNode>(file);
+
+    CRITICAL_SCOPE(vol->m_Mutex);
+
+    if (!vol->CheckMagic(__func__) || !node->CheckMagic(__func__) || !fileNode->CheckMagic(__func__)) {
+        PERROR_THROW_CODE(PErrorCode::IO);
+    }
+
+    kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATFILE, "FATFilesystem::Allocate() called {} bytes at {}, mode {:x} (inode ID {:x}).", length, offset, mode, node->m_InodeID);
+
+    if (node->IsDirectory()) {
+        PERROR_THROW_CODE(PErrorCode::ISDIR);
+    }
+    if ((fileNode->GetOpenFlags() & O_ACCMODE) == O_RDONLY) {
+        PERROR_THROW_CODE(PErrorCode::BADF);
+    }
+    if (vol->HasFlag(FSVolumeFlags::FS_IS_READONLY)) {
+        PERROR_THROW_CODE(PErrorCode::ROFS);
+    }
+    if (offset < 0 || length <= 0 || (mode & ~FALLOC_FL_KEEP_SIZE) != 0) {
+        PERROR_THROW_CODE(PErrorCode::INVAL);
+    }
+    if (length > FAT_MAX_FILE_SIZE - offset) {
+        PERROR_THROW_CODE(PErrorCode::FBIG);
+    }
+
+    const off64_t oldFileSize = node->m_Size;
+    const off64_t endPosition = offset + length;
+
+    EnsureClusterChainMetadataLoaded(vol, node);
+
+    const uint32_t requiredClusterCount = GetFileClusterCount(vol, endPosition);
+    if (requiredClusterCount > node->m_AllocatedClusterCount) {
+        vol->GetFATTable()->SetChainLength(node, requiredClusterCount, true);
+    }
+
+    if ((mode & FALLOC_FL_KEEP_SIZE) == 0 && endPosition > oldFileSize)
+    {
+        ClearFileRange(vol, node, oldFileSize, endPosition);
+
+        PScopeFail restoreFileSize([&node, oldFileSize]()
+        {
+            node->m_Size = oldFileSize;
+        });
+
+        node->m_Size = endPosition;
+        node->MarkContentsModified();
+        node->Write();
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -2253,6 +2596,9 @@ void FATFilesystem::DeviceControl(Ptr<KFileNode> file, int request, const void*
 	    kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATDIR, "{:x} {}-bit fats, {:x} sectors/fat, {:x} root entries", vol->m_FATCount, vol->m_FATBits, vol->m_SectorsPerFAT, vol->m_RootEntriesCount);
 	    kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATDIR, "root directory starts at sector {:x} (cluster {:x}), data at sector {:x}", vol->m_RootStart, vol->m_RootInode->m_StartCluster, vol->m_FirstDataSector);
 	    kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATDIR, "{:x} total clusters, {:x} free", vol->m_TotalClusters, vol->m_FreeClusters);
+	    if (vol->GetFATTable()->IsFreeClusterScanRunning()) {
+	        kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATDIR, "free cluster scan at cluster {:x}{}", vol->GetFATTable()->GetFreeClusterScanPosition(), vol->GetFATTable()->IsFreeClusterCountEstimated() ? ", free count estimated" : "");
+	    }
 	    kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATDIR, "fat mirroring is {}, fs info sector at sector {:x}", (vol->m_FATMirrored) ? "on" : "off", vol->m_FSInfoSector);
 	    kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATDIR, "last allocated cluster = {:x}", vol->m_LastAllocatedCluster);
 	    kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATDIR, "root inode id = {:x}", vol->m_RootInode->m_InodeID);
@@ -2350,13 +2696,14 @@ void FATVolume::UpdateFSInfo()
 {
     if (m_FSInfoSector != 0xffff && !HasFlag(FSVolumeFlags::FS_IS_READONLY))
     {
-        KCacheBlockDesc bufferDesc = m_BCache.GetBlock_trw(m_FSInfoSector);
+        KCacheBlockDesc bufferDesc = m_BCache.GetBlock_trw(m_FSInfoSector, true, true);
         FATFSInfo* buffer = static_cast<FATFSInfo*>(bufferDesc.m_Buffer);
         if (buffer != nullptr)
         {
             if (buffer->m_Signature1 == 0x41615252 && buffer->m_Signature2 == 0x61417272 && buffer->m_Signature3 == 0xaa550000)
             {
-                buffer->m_FreeClusters         = m_FreeClusters;
+                // Don't persist an estimate. 0xffffffff tells the next mount to count.
+                buffer->m_FreeClusters         = (m_FATTable != nullptr && m_FATTable->IsFreeClusterCountEstimated()) ? 0xffffffff : m_FreeClusters;
                 buffer->m_LastAllocatedCluster = m_LastAllocatedCluster;
                 bufferDesc.MarkDirty();
             }
@@ -2375,6 +2722,115 @@ void FATVolume::UpdateFSInfo()
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Read the directory record "entry" refers to. Return false if the record
+/// at that position no longer match the index.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+static bool ReadIndexedDirectoryEntry(Ptr<FATVolume> volume, Ptr<FATInode> directory, const FATDirectoryIndex::Entry& entry, FATDirectoryEntryInfo& outInfo, PString* outFilename, PString* outShortFilename)
+{
+    if (outFilename != nullptr) {
+        outFilename->clear();
+    }
+    if (outShortFilename != nullptr) {
+        outShortFilename->clear();
+    }
+    FATDirectoryIterator iterator(volume, directory->m_StartCluster, entry.StartIndex);
+    if (iterator.GetCurrentEntry() == nullptr || !iterator.GetNextLFNEntry(&outInfo, outFilename, outShortFilename)) {
+        return false;
+    }
+    return outInfo.m_StartIndex == entry.StartIndex && outInfo.m_EndIndex == entry.EndIndex;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Return the name index of "directory", building it with a full scan if
+/// the directory has none. Return nullptr if the directory is too large to
+/// index or if there is not enough memory for the index. Running out of
+/// memory discards the indexes of all directories on the volume.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+FATDirectoryIndex* FATFilesystem::GetDirectoryIndex(Ptr<FATVolume> volume, Ptr<FATInode> directory)
+{
+    FATDirectoryIndex* index = volume->GetDirectoryIndex(ptr_raw_pointer_cast(directory));
+    if (index != nullptr) {
+        return index;
+    }
+    if (directory->IsDeleted() || directory->m_Size / sizeof(FATDirectoryEntry) > FAT_DIRECTORY_INDEX_MAX_SLOTS) {
+        return nullptr;
+    }
+    try
+    {
+        std::unique_ptr<FATDirectoryIndex> newIndex = std::make_unique<FATDirectoryIndex>();
+
+        FATDirectoryIterator  iterator(volume, directory->m_StartCluster, 0);
+        FATDirectoryEntryInfo entryInfo;
+        PString               filename;
+        PString               shortFilename;
+        for (;;)
+        {
+            filename.clear();
+            shortFilename.clear();
+            if (!iterator.GetNextLFNEntry(&entryInfo, &filename, &shortFilename)) {
+                break;
+            }
+            newIndex->Add(FATDirectoryIndex::CalculateNameHash(filename), FATDirectoryIndex::CalculateNameHash(shortFilename), entryInfo.m_StartIndex, entryInfo.m_EndIndex);
+        }
+        kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATDIR, "FATFilesystem::GetDirectoryIndex(): indexed {} entries in directory {:x}.", newIndex->GetEntryCount(), directory->m_InodeID);
+
+        index = newIndex.get();
+        volume->AddDirectoryIndex(ptr_raw_pointer_cast(directory), std::move(newIndex));
+        return index;
+    }
+    catch (const std::bad_alloc&)
+    {
+        kernel_log<PLogSeverity::WARNING>(LogCat_FATDIR, "FATFilesystem::GetDirectoryIndex(): out of memory while indexing directory {:x}. Discarding all directory indexes.", directory->m_InodeID);
+        volume->DiscardAllDirectoryIndexes();
+        return nullptr;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Add the record starting at "startIndex" to the directory's index, if it
+/// has one. Called after a new record has been committed, so errors only
+/// discard the index.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATFilesystem::AddDirectoryIndexEntry(Ptr<FATVolume> volume, Ptr<FATInode> directory, uint32_t startIndex) noexcept
+{
+    FATDirectoryIndex* index = volume->GetDirectoryIndex(ptr_raw_pointer_cast(directory));
+    if (index == nullptr) {
+        return;
+    }
+    try
+    {
+        FATDirectoryIterator  iterator(volume, directory->m_StartCluster, startIndex);
+        FATDirectoryEntryInfo entryInfo;
+        PString               filename;
+        PString               shortFilename;
+
+        if (iterator.GetCurrentEntry() != nullptr && iterator.GetNextLFNEntry(&entryInfo, &filename, &shortFilename) && entryInfo.m_StartIndex == startIndex)
+        {
+            index->Add(FATDirectoryIndex::CalculateNameHash(filename), FATDirectoryIndex::CalculateNameHash(shortFilename), entryInfo.m_StartIndex, entryInfo.m_EndIndex);
+            volume->TrimDirectoryIndexes();
+            return;
+        }
+        kernel_log<PLogSeverity::ERROR>(LogCat_FATDIR, "FATFilesystem::AddDirectoryIndexEntry(): failed to read back entry {} in directory {:x}.", startIndex, directory->m_InodeID);
+    }
+    catch (const std::bad_alloc&)
+    {
+        volume->DiscardAllDirectoryIndexes();
+        return;
+    }
+    catch (const std::exception& exception)
+    {
+        kernel_log<PLogSeverity::ERROR>(LogCat_FATDIR, "FATFilesystem::AddDirectoryIndexEntry(): failed to index entry {} in directory {:x}: {}", startIndex, directory->m_InodeID, exception.what());
+    }
+    volume->DiscardDirectoryIndex(ptr_raw_pointer_cast(directory));
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// Name is array of char[11] as returned by findfile
 /// \author Kurt Skauen
@@ -2382,6 +2838,33 @@ void FATVolume::UpdateFSInfo()
 
 bool FATFilesystem::FindShortName(Ptr<FATVolume> vol, Ptr<FATInode> parent, const char* rawShortName)
 {
+    FATDirectoryIndex* index = GetDirectoryIndex(vol, parent);
+    if (index != nullptr)
+    {
+        FATDirectoryEntry shortEntry = {};
+        PString           shortFilename;
+        memcpy(shortEntry.m_Filename, rawShortName, sizeof(shortEntry.m_Filename));
+        FATDirectoryIterator::RawShortNameToUTF8(shortEntry, shortFilename);
+
+        bool isStale = false;
+        const bool found = index->ForEachShortNameCandidate(FATDirectoryIndex::CalculateNameHash(shortFilename), [&](const FATDirectoryIndex::Entry& entry)
+        {
+            FATDirectoryIterator candidateIterator(vol, parent->m_StartCluster, entry.EndIndex);
+            const FATDirectoryEntryCombo* buffer = candidateIterator.GetCurrentEntry();
+            if (buffer == nullptr || buffer->m_Normal.m_Filename[0] == 0 || uint8_t(buffer->m_Normal.m_Filename[0]) == 0xe5 || (buffer->m_Normal.m_Attribs & FAT_LONG_NAME_ATTRIBUTE_MASK) == FAT_LONG_NAME_ATTRIBUTES)
+            {
+                isStale = true;
+                return true;
+            }
+            return memcmp(rawShortName, buffer->m_Normal.m_Filename, sizeof(buffer->m_Normal.m_Filename)) == 0;
+        });
+        if (!isStale) {
+            return found;
+        }
+        kernel_log<PLogSeverity::ERROR>(LogCat_FATDIR, "FATFilesystem::FindShortName(): stale index in directory {:x}.", parent->m_InodeID);
+        vol->DiscardDirectoryIndex(ptr_raw_pointer_cast(parent));
+    }
+
     FATDirectoryIterator diri(vol, parent->m_StartCluster, 0);
     
     for (FATDirectoryEntryCombo* buffer = diri.GetCurrentEntry(); buffer != nullptr; buffer = diri.GetNextRawEntry())
@@ -2404,19 +2887,12 @@ bool FATFilesystem::FindShortName(Ptr<FATVolume> vol, Ptr<FATInode> parent, cons
 
 bool FATFilesystem::FindNameCollision(Ptr<FATVolume> volume, Ptr<FATInode> parent, const PString& name, FATInode* excludedNode)
 {
-    FATDirectoryIterator iterator(volume, parent->m_StartCluster, 0);
     FATDirectoryEntryInfo entryInfo;
     PString filename;
     PString shortFilename;
 
-    for (;;)
+    auto isCollision = [&]()
     {
-        filename.clear();
-        shortFilename.clear();
-        if (!iterator.GetNextLFNEntry(&entryInfo, &filename, &shortFilename)) {
-            return false;
-        }
-
         const bool isExcludedEntry = excludedNode != nullptr &&
                                      parent->m_InodeID == excludedNode->m_ParentInodeID &&
                                      entryInfo.m_EndIndex == excludedNode->m_DirEndIndex;
@@ -2424,9 +2900,43 @@ bool FATFilesystem::FindNameCollision(Ptr<FATVolume> volume, Ptr<FATInode> paren
         {
             const bool longNameCollision = filename.compare_nocase(name) == 0;
             const bool shortNameCollision = shortFilename != filename && shortFilename.compare_nocase(name) == 0;
-            if (longNameCollision || shortNameCollision) {
+            return longNameCollision || shortNameCollision;
+        }
+        return false;
+    };
+
+    FATDirectoryIndex* index = GetDirectoryIndex(volume, parent);
+    if (index != nullptr)
+    {
+        bool isStale = false;
+        auto checkCandidate = [&](const FATDirectoryIndex::Entry& entry)
+        {
+            if (!ReadIndexedDirectoryEntry(volume, parent, entry, entryInfo, &filename, &shortFilename))
+            {
+                isStale = true;
                 return true;
             }
+            return isCollision();
+        };
+        const uint32_t nameHash = FATDirectoryIndex::CalculateNameHash(name);
+        const bool found = index->ForEachNameCandidate(nameHash, checkCandidate) || index->ForEachShortNameCandidate(nameHash, checkCandidate);
+        if (!isStale) {
+            return found;
+        }
+        kernel_log<PLogSeverity::ERROR>(LogCat_FATDIR, "FATFilesystem::FindNameCollision(): stale index in directory {:x}.", parent->m_InodeID);
+        volume->DiscardDirectoryIndex(ptr_raw_pointer_cast(parent));
+    }
+
+    FATDirectoryIterator iterator(volume, parent->m_StartCluster, 0);
+    for (;;)
+    {
+        filename.clear();
+        shortFilename.clear();
+        if (!iterator.GetNextLFNEntry(&entryInfo, &filename, &shortFilename)) {
+            return false;
+        }
+        if (isCollision()) {
+            return true;
         }
     }
 }
@@ -2455,6 +2965,42 @@ Ptr<FATInode> FATFilesystem::DoLocateInode(Ptr<FATVolume> vol, Ptr<FATInode> dir
     }
     else
     {
+        FATDirectoryIndex* index = GetDirectoryIndex(vol, dir);
+        if (index != nullptr)
+        {
+            const bool isRoot = dir->m_InodeID == vol->m_RootInode->m_InodeID;
+            bool       isStale = false;
+            const bool found = index->ForEachNameCandidate(FATDirectoryIndex::CalculateNameHash(fileName), [&](const FATDirectoryIndex::Entry& entry)
+            {
+                FATDirectoryEntryInfo entryInfo;
+                PString               curName;
+                if (!ReadIndexedDirectoryEntry(vol, dir, entry, entryInfo, &curName, nullptr))
+                {
+                    isStale = true;
+                    return true;
+                }
+                if (curName != fileName || (isRoot && (entryInfo.m_DOSAttribs & FAT_VOLUME))) {
+                    return false;
+                }
+                // Let the directory iterator validate the entry and resolve the inode ID.
+                FATDirectoryIterator diri(vol, dir->m_StartCluster, entry.StartIndex);
+                curName.clear();
+                if (!diri.GetNextDirectoryEntry(dir, &inodeID, &curName, nullptr) || curName != fileName) {
+                    isStale = true;
+                }
+                return true;
+            });
+            if (!isStale)
+            {
+                if (!found) {
+                    return nullptr;
+                }
+                return ptr_static_cast<FATInode>(KVFSManager::GetInode_trw(vol->m_VolumeID, inodeID, false));
+            }
+            kernel_log<PLogSeverity::ERROR>(LogCat_FATDIR, "FATFilesystem::DoLocateInode(): stale index in directory {:x}.", dir->m_InodeID);
+            vol->DiscardDirectoryIndex(ptr_raw_pointer_cast(dir));
+        }
+
         FATDirectoryIterator diri(vol, dir->m_StartCluster, 0);
 
         bool found = false;
@@ -2560,9 +3106,19 @@ void FATFilesystem::EnsureClusterChainMetadataLoaded(Ptr<FATVolume> volume, Ptr<
 
     node->m_EndCluster = endCluster;
     node->m_AllocatedClusterCount = uint32_t(chainLength);
-    if (node->IsDirectory()) {
+    if (node->IsDirectory())
+    {
         node->m_Size = chainLength * volume->m_SectorsPerCluster * volume->m_BytesPerSector;
     }
+    else if (chainLength > GetFileClusterCount(volume, node->m_Size) && !volume->HasFlag(FSVolumeFlags::FS_IS_READONLY))
+    {
+        // Clusters past the end of the file are released when the last
+        // writer closes it. If they are still there when the chain is first
+        // loaded, the file was not closed before a crash or power loss.
+        const uint32_t requiredClusterCount = GetFileClusterCount(volume, node->m_Size);
+        kernel_log<PLogSeverity::WARNING>(LogCat_FATFS, "FATFilesystem::EnsureClusterChainMetadataLoaded(): releasing {} stale clusters past the end of inode {:x}.", node->m_AllocatedClusterCount - requiredClusterCount, node->m_InodeID);
+        volume->GetFATTable()->SetChainLength(node, requiredClusterCount, true);
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -2579,6 +3135,21 @@ uint32_t FATFilesystem::GetFileClusterCount(Ptr<FATVolume> volume, off64_t fileS
     return uint32_t((fileSize + bytesPerCluster - 1) / bytesPerCluster);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Physical cluster holding cluster number "clusterIndex" of the file.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t FATFilesystem::GetFileCluster(Ptr<FATVolume> volume, Ptr<FATInode> node, uint32_t clusterIndex)
+{
+    if (!volume->IsDataCluster(node->m_StartCluster))
+    {
+        kernel_log<PLogSeverity::ERROR>(LogCat_FATFILE, "FATFilesystem::GetFileCluster(): inode {:x} has invalid start cluster {}.", node->m_InodeID, node->m_StartCluster);
+        PERROR_THROW_CODE(PErrorCode::IO);
+    }
+    return node->m_ExtentMap.GetCluster(*volume->GetFATTable(), node->m_StartCluster, node->m_Iteration, clusterIndex);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -2590,9 +3161,11 @@ void FATFilesystem::ClearFileRange(Ptr<FATVolume> volume, Ptr<FATInode> node, of
     }
 
     const uint32_t bytesPerSector = volume->m_BytesPerSector;
-    FATClusterSectorIterator iterator(volume, node->m_StartCluster, 0);
+    const uint32_t bytesPerCluster = bytesPerSector * volume->m_SectorsPerCluster;
+    const uint32_t firstClusterIndex = uint32_t(startPosition / bytesPerCluster);
+    FATClusterSectorIterator iterator(volume, GetFileCluster(volume, node, firstClusterIndex), 0);
 
-    const off64_t firstSectorIndex = startPosition / bytesPerSector;
+    const off64_t firstSectorIndex = (startPosition - off64_t(firstClusterIndex) * bytesPerCluster) / bytesPerSector;
     if (!iterator.Increment(int(firstSectorIndex))) {
         PERROR_THROW_CODE(PErrorCode::IO);
     }
@@ -2625,6 +3198,37 @@ void FATFilesystem::ClearFileRange(Ptr<FATVolume> volume, Ptr<FATInode> node, of
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Release clusters allocated past the end of the file by Allocate() or by
+/// speculative preallocation in Write(). Called from CloseFile(), so errors
+/// are logged rather than thrown. If the chain metadata has not been loaded
+/// since the inode was loaded, loading it releases clusters left past the
+/// end by a writer that never closed the file.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATFilesystem::TrimPreallocatedClusters(Ptr<FATVolume> volume, Ptr<FATInode> node)
+{
+    try
+    {
+        if (node->m_AllocatedClusterCount == 0)
+        {
+            EnsureClusterChainMetadataLoaded(volume, node);
+            return;
+        }
+        const uint32_t requiredClusterCount = GetFileClusterCount(volume, node->m_Size);
+        if (node->m_AllocatedClusterCount <= requiredClusterCount) {
+            return;
+        }
+        kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATFILE, "FATFilesystem::TrimPreallocatedClusters(): releasing {} clusters from inode {:x}.", node->m_AllocatedClusterCount - requiredClusterCount, node->m_InodeID);
+        volume->GetFATTable()->SetChainLength(node, requiredClusterCount, true);
+    }
+    catch (const std::exception& exc)
+    {
+        kernel_log<PLogSeverity::ERROR>(LogCat_FATFILE, "FATFilesystem::TrimPreallocatedClusters(): failed to release clusters from inode {:x}: {}", node->m_InodeID, exc.what());
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -3020,6 +3624,8 @@ void FATFilesystem::DoCreateDirectoryEntry(Ptr<FATVolume> vol, Ptr<FATInode> dir
     // the operation after all supporting records and the end marker are ready.
     buffer->m_Normal = shortDirectoryEntry;
     diri.MarkDirty();
+
+    AddDirectoryIndexEntry(vol, dir, *startIndex);
 }
 
 // shrink directory to the size needed
@@ -3087,9 +3693,13 @@ void FATFilesystem::CompactDirectoryNoThrow(Ptr<FATVolume> vol, Ptr<FATInode> di
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-void FATFilesystem::EraseDirectoryEntry(Ptr<FATVolume> vol, uint32_t parentCluster, uint32_t startIndex, uint32_t endIndex)
+void FATFilesystem::EraseDirectoryEntry(Ptr<FATVolume> vol, Ptr<FATInode> dir, uint32_t startIndex, uint32_t endIndex)
 {
+    const uint32_t        parentCluster = dir->m_StartCluster;
     FATDirectoryEntryInfo info;
+    PString               filename;
+    PString               shortFilename;
+    const bool            isIndexed = dir->m_DirectoryIndex != nullptr;
 
     if ((!vol->IsDataCluster(parentCluster) && !IS_FIXED_ROOT(parentCluster)) || endIndex < startIndex || endIndex - startIndex > FAT_LONG_NAME_MAX_ENTRY_COUNT)
     {
@@ -3106,7 +3716,8 @@ void FATFilesystem::EraseDirectoryEntry(Ptr<FATVolume> vol, uint32_t parentClust
             kernel_log<PLogSeverity::ERROR>(LogCat_FATDIR, "FATFilesystem::EraseDirectoryEntry(): error reading directory.");
             PERROR_THROW_CODE(PErrorCode::IO);
         }
-        if (!iterator.GetNextLFNEntry(&info, nullptr)) {
+        // The names are only needed to find the record in the index.
+        if (!iterator.GetNextLFNEntry(&info, isIndexed ? &filename : nullptr, isIndexed ? &shortFilename : nullptr)) {
             PERROR_THROW_CODE(PErrorCode::NOENT);
         }
     }
@@ -3163,6 +3774,15 @@ void FATFilesystem::EraseDirectoryEntry(Ptr<FATVolume> vol, uint32_t parentClust
             iterator.GetNextRawEntry();
         }
     }
+
+    if (FATDirectoryIndex* index = vol->GetDirectoryIndex(ptr_raw_pointer_cast(dir)); index != nullptr)
+    {
+        if (!isIndexed || !index->Remove(FATDirectoryIndex::CalculateNameHash(filename), FATDirectoryIndex::CalculateNameHash(shortFilename), endIndex))
+        {
+            kernel_log<PLogSeverity::ERROR>(LogCat_FATDIR, "FATFilesystem::EraseDirectoryEntry(): entry {} missing from the index of directory {:x}.", endIndex, dir->m_InodeID);
+            vol->DiscardDirectoryIndex(ptr_raw_pointer_cast(dir));
+        }
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -3244,7 +3864,7 @@ void FATFilesystem::DoUnlink(Ptr<KFSVolume> _vol, Ptr<KInode> _dir, const PStrin
     mappingChangeAttempted = true;
     vol->SetInodeIDToLocationIDMapping(file->m_InodeID, vol->AllocUniqueInodeID());
 
-    EraseDirectoryEntry(vol, dir->m_StartCluster, file->m_DirStartIndex, file->m_DirEndIndex);
+    EraseDirectoryEntry(vol, dir, file->m_DirStartIndex, file->m_DirEndIndex);
     file->DiscardPendingMetadata();
     file->SetDeletedFlag(true);
 
@@ -0,0 +1,197 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 20.10.2026 10:15
+
+#include "System/Platform.h"
+
+#include <algorithm>
+#include <bit>
+#include <new>
+
+#include "FATFreeClusterMap.h"
+#include "FATTable.h"
+
+namespace kernel
+{
+
+static constexpr uint32_t FAT_FREE_MAP_WORD_BITS = 32;
+
+///////////////////////////////////////////////////////////////////////////////
+/// Allocate a map with all clusters marked as used. Returns false if
+/// there is not enough memory, in which case the map is left empty.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool FATFreeClusterMap::Initialize(uint32_t clusterCount) noexcept
+{
+    Reset();
+    try {
+        m_Bitmap.assign((size_t(clusterCount) + FAT_FREE_MAP_WORD_BITS - 1) / FAT_FREE_MAP_WORD_BITS, 0);
+    } catch (const std::bad_alloc&) {
+        return false;
+    }
+    m_ClusterCount = clusterCount;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATFreeClusterMap::Reset() noexcept
+{
+    std::vector<uint32_t>().swap(m_Bitmap);
+    m_ClusterCount = 0;
+    m_FreeCount = 0;
+    m_IsValid = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool FATFreeClusterMap::IsFree(uint32_t cluster) const noexcept
+{
+    const uint32_t index = cluster - FATTable::FIRST_DATA_CLUSTER;
+    if (cluster < FATTable::FIRST_DATA_CLUSTER || index >= m_ClusterCount) {
+        return false;
+    }
+    return (m_Bitmap[index / FAT_FREE_MAP_WORD_BITS] & (1u << (index % FAT_FREE_MAP_WORD_BITS))) != 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Returns true if the state of the cluster changed.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool FATFreeClusterMap::SetFree(uint32_t cluster, bool isFree) noexcept
+{
+    const uint32_t index = cluster - FATTable::FIRST_DATA_CLUSTER;
+    if (cluster < FATTable::FIRST_DATA_CLUSTER || index >= m_ClusterCount) {
+        return false;
+    }
+    uint32_t&      word = m_Bitmap[index / FAT_FREE_MAP_WORD_BITS];
+    const uint32_t mask = 1u << (index % FAT_FREE_MAP_WORD_BITS);
+
+    if (((word & mask) != 0) == isFree) {
+        return false;
+    }
+    if (isFree) {
+        word |= mask;
+        m_FreeCount++;
+    } else {
+        word &= ~mask;
+        m_FreeCount--;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Number of consecutive free clusters starting at "cluster", up to
+/// "maxLength".
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t FATFreeClusterMap::GetRunLength(uint32_t cluster, uint32_t maxLength) const noexcept
+{
+    const uint32_t startIndex = cluster - FATTable::FIRST_DATA_CLUSTER;
+    if (cluster < FATTable::FIRST_DATA_CLUSTER || startIndex >= m_ClusterCount) {
+        return 0;
+    }
+    const uint32_t endIndex = startIndex + std::min(maxLength, m_ClusterCount - startIndex);
+
+    uint32_t index = startIndex;
+    while (index < endIndex)
+    {
+        const uint32_t bit = index % FAT_FREE_MAP_WORD_BITS;
+        // Shifting brings in zeros, which become ones when inverted, so the
+        // run can never count past the end of the word.
+        const uint32_t freeBits = uint32_t(std::countr_zero(~(m_Bitmap[index / FAT_FREE_MAP_WORD_BITS] >> bit)));
+        const uint32_t available = FAT_FREE_MAP_WORD_BITS - bit;
+
+        index += std::min(freeBits, available);
+        if (freeBits < available) {
+            break;
+        }
+    }
+    return std::min(index, endIndex) - startIndex;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Search for "length" consecutive free clusters, starting at
+/// "startCluster" and wrapping around at the end of the volume. The first
+/// run that is long enough is returned. If there is none, the longest run
+/// found is returned instead, and the caller must continue the allocation
+/// elsewhere. Returns false only if there are no free clusters at all.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool FATFreeClusterMap::FindRun(uint32_t startCluster, uint32_t length, uint32_t& outCluster, uint32_t& outLength) const noexcept
+{
+    if (m_FreeCount == 0 || length == 0) {
+        return false;
+    }
+    uint32_t startIndex = startCluster - FATTable::FIRST_DATA_CLUSTER;
+    if (startCluster < FATTable::FIRST_DATA_CLUSTER || startIndex >= m_ClusterCount) {
+        startIndex = 0;
+    }
+
+    uint32_t bestIndex  = 0;
+    uint32_t bestLength = 0;
+
+    const uint32_t ranges[2][2] = { { startIndex, m_ClusterCount }, { 0, startIndex } };
+    for (const auto& range : ranges)
+    {
+        uint32_t index = range[0];
+        while (index < range[1])
+        {
+            const uint32_t wordIndex = index / FAT_FREE_MAP_WORD_BITS;
+            const uint32_t word = m_Bitmap[wordIndex] >> (index % FAT_FREE_MAP_WORD_BITS);
+            if (word == 0)
+            {
+                index = (wordIndex + 1) * FAT_FREE_MAP_WORD_BITS;
+                continue;
+            }
+            index += uint32_t(std::countr_zero(word));
+            if (index >= range[1]) {
+                break;
+            }
+            const uint32_t runLength = GetRunLength(index + FATTable::FIRST_DATA_CLUSTER, length);
+            if (runLength >= length)
+            {
+                outCluster = index + FATTable::FIRST_DATA_CLUSTER;
+                outLength  = runLength;
+                return true;
+            }
+            if (runLength > bestLength)
+            {
+                bestIndex  = index;
+                bestLength = runLength;
+            }
+            index += runLength;
+        }
+    }
+    if (bestLength == 0) {
+        return false;
+    }
+    outCluster = bestIndex + FATTable::FIRST_DATA_CLUSTER;
+    outLength  = bestLength;
+    return true;
+}
+
+} // namespace kernel
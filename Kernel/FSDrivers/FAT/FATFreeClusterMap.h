@@ -0,0 +1,59 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 20.10.2026 10:15
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace kernel
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// One bit per data cluster, set if the cluster is free. Mirrors the FAT
+/// once it has been built by scanning the table, and is then kept up to
+/// date by FATTable::SetEntry(). Cluster numbers are FAT cluster numbers,
+/// starting at FATTable::FIRST_DATA_CLUSTER.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+class FATFreeClusterMap
+{
+public:
+    bool Initialize(uint32_t clusterCount) noexcept;
+    void Reset() noexcept;
+
+    bool IsValid() const noexcept { return m_IsValid; }
+    void SetValid(bool isValid) noexcept { m_IsValid = isValid; }
+
+    uint32_t GetFreeCount() const noexcept { return m_FreeCount; }
+    bool     IsFree(uint32_t cluster) const noexcept;
+    bool     SetFree(uint32_t cluster, bool isFree) noexcept;
+
+    uint32_t GetRunLength(uint32_t cluster, uint32_t maxLength) const noexcept;
+    bool     FindRun(uint32_t startCluster, uint32_t length, uint32_t& outCluster, uint32_t& outLength) const noexcept;
+
+private:
+    std::vector<uint32_t> m_Bitmap;
+    uint32_t              m_ClusterCount = 0;
+    uint32_t              m_FreeCount = 0;
+    bool                  m_IsValid = false;
+};
+
+} // namespace kernel
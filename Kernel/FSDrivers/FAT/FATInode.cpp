@@ -27,6 +27,7 @@
 
 #include "FATInode.h"
 #include "FATVolume.h"
+#include "FATDirectoryIndex.h"
 #include "FATDirectoryIterator.h"
 #include "Kernel/FSDrivers/FAT/FATFilesystem.h"
 
@@ -180,6 +181,7 @@ FATInode::~FATInode()
 {
     kassert(!m_MetadataDirty);
     kassert(!m_DirtyListNode.IsListMember());
+    kassert(!m_DirectoryIndexNode.IsListMember());
     m_Magic = ~MAGIC;
 }
 
@@ -20,11 +20,15 @@
 #pragma once
 
 
+#include <memory>
+
 #include "Kernel/VFS/KInode.h"
+#include "FATExtentMap.h"
 
 namespace kernel
 {
 class FATFilesystem;
+class FATDirectoryIndex;
 
 #define ARTIFICIAL_INODEID_BITS    (0x6LL << 60)
 #define DIR_CLUSTER_INODEID_BITS   (0x4LL << 60)
@@ -91,10 +95,20 @@ public:
     uint32_t m_StartCluster;       // Data starting cluster.
     uint32_t m_EndCluster = 0;     // Last data cluster.
     uint32_t m_AllocatedClusterCount = 0; // Zero if there is no chain or its metadata has not been loaded yet.
+    uint32_t m_OpenWriterCount = 0;       // Writable handles. Clusters allocated past the end of the file are released when it drops to zero.
     off_t    m_Size;             // Size in bytes.
     uint8_t  m_DOSAttribs;       // DOS-style attributes.
     PIntrusiveListNode<FATInode> m_DirtyListNode;
 
+    // Cluster runs of the file's chain, so seeks don't have to walk the FAT
+    // from m_StartCluster. Protected by the volume mutex.
+    FATExtentMap m_ExtentMap;
+
+    // Name index of directories. Created on first lookup, and owned by the
+    // volume's LRU list. Protected by the volume mutex.
+    std::unique_ptr<FATDirectoryIndex> m_DirectoryIndex;
+    PIntrusiveListNode<FATInode>       m_DirectoryIndexNode;
+
 private:
     bool m_MetadataDirty = false;
 
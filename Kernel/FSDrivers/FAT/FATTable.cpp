@@ -17,11 +17,14 @@
 ///////////////////////////////////////////////////////////////////////////////
 // Created: 18/05/25 23:04:14
 
+#include <algorithm>
 #include <utility>
 #include <string.h>
 
 #include <System/ExceptionHandling.h>
 #include <Kernel/KLogging.h>
+#include <Kernel/KThread.h>
+#include <Kernel/KTime.h>
 #include <Kernel/FSDrivers/FAT/FATFilesystem.h>
 
 #include "FATTable.h"
@@ -31,6 +34,31 @@
 namespace kernel
 {
 
+// The free-cluster scan reads this many FAT sectors per step, and releases
+// the volume lock between steps.
+static constexpr uint32_t FAT_FREE_SCAN_SECTORS_PER_STEP = 32;
+static constexpr int      FAT_FREE_SCAN_THREAD_PRIORITY  = -8;
+
+class FATTable::FreeClusterScanThread : public KThread
+{
+public:
+    explicit FreeClusterScanThread(FATTable& table)
+        : KThread("fat_free_scan")
+        , m_Table(table)
+    {
+        SetDeleteOnExit(false);
+    }
+
+    virtual void* Run() override
+    {
+        m_Table.RunFreeClusterScan();
+        return nullptr;
+    }
+
+private:
+    FATTable& m_Table;
+};
+
 static void ClearFATChainAfterFailureNoThrow(FATTable& table, uint32_t startCluster, const char* operation) noexcept
 {
     if (startCluster != 0)
@@ -58,6 +86,7 @@ FATTable::FATTable(Ptr<FATVolume> volume) : m_Volume(volume), m_TableIterator(vo
 
 FATTable::~FATTable()
 {
+    StopFreeClusterScan();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -89,7 +118,41 @@ uint32_t FATTable::GetEntry(uint32_t cluster)
 void FATTable::SetEntry(uint32_t cluster, uint32_t value)
 {
     m_TableIterator.SetCluster(cluster);
+    const bool wasFree = m_TableIterator.GetEntry() == 0;
     m_TableIterator.SetEntry(value);
+
+    const bool isFree = value == 0;
+    if (isFree == wasFree) {
+        return;
+    }
+    if (m_FreeClusterMap.IsValid())
+    {
+        m_FreeClusterMap.SetFree(cluster, isFree);
+        m_Volume->m_FreeClusters = m_FreeClusterMap.GetFreeCount();
+        return;
+    }
+    // The scan will see the new value of clusters it has not reached yet.
+    if (m_IsScanning && cluster < m_ScanPosition)
+    {
+        if (m_ScanBuildsMap) {
+            m_FreeClusterMap.SetFree(cluster, isFree);
+        }
+        if (isFree) {
+            m_ScannedFreeCount++;
+        } else {
+            m_ScannedFreeCount--;
+        }
+    }
+    if (isFree)
+    {
+        if (m_Volume->m_FreeClusters < m_Volume->m_TotalClusters) {
+            m_Volume->m_FreeClusters++;
+        }
+    }
+    else if (m_Volume->m_FreeClusters > 0)
+    {
+        m_Volume->m_FreeClusters--;
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -143,18 +206,268 @@ bool FATTable::ValidateChainEntry(uint32_t chainStart, uint32_t index, uint32_t
 
 uint32_t FATTable::CountFreeClusters()
 {
-    m_TableIterator.SetCluster(FATTable::FIRST_DATA_CLUSTER);
+    BuildFreeClusterMap();
+    return m_FreeClusterMap.IsValid() ? m_FreeClusterMap.GetFreeCount() : ScanFAT(nullptr, FIRST_DATA_CLUSTER, m_Volume->m_TotalClusters + FIRST_DATA_CLUSTER);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Count the free clusters on a thread of its own, so mounting doesn't have
+/// to wait for the whole FAT to be read. Until the scan is done, allocation
+/// searches the FAT directly. If "estimateFreeCount" is true (the volume had
+/// no valid count in FSInfo) the volume's count is extrapolated from the
+/// part of the FAT scanned so far. If "buildMap" is true the free cluster
+/// map is built at the same time.
+/// Must be called before the volume is made available to other threads.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATTable::StartFreeClusterScan(bool buildMap, bool estimateFreeCount)
+{
+    if (m_IsScanning || m_FreeClusterMap.IsValid()) {
+        return;
+    }
+    m_ScanBuildsMap = false;
+    if (buildMap && !m_FreeClusterMapUnavailable)
+    {
+        m_ScanBuildsMap = m_FreeClusterMap.Initialize(m_Volume->m_TotalClusters);
+        if (!m_ScanBuildsMap)
+        {
+            kernel_log<PLogSeverity::WARNING>(LogCat_FATTABLE, "FATTable::StartFreeClusterScan(): not enough memory for a map of {} clusters.", m_Volume->m_TotalClusters);
+            m_FreeClusterMapUnavailable = true;
+        }
+    }
+    m_ScanPosition         = FIRST_DATA_CLUSTER;
+    m_ScannedFreeCount     = 0;
+    m_IsFreeCountEstimated = estimateFreeCount;
+    m_IsScanning           = true;
+    m_ScanStopRequested    = false;
+    m_ScanStartTime        = kget_monotonic_time();
+
+    if (m_IsFreeCountEstimated) {
+        m_Volume->m_FreeClusters = 0;
+    }
+
+    try
+    {
+        m_ScanThread = std::make_unique<FreeClusterScanThread>(*this);
+        m_ScanThread->Start_trw(KSpawnThreadFlag::None, PThreadDetachState_Joinable, FAT_FREE_SCAN_THREAD_PRIORITY);
+    }
+    catch (const std::exception& exc)
+    {
+        kernel_log<PLogSeverity::WARNING>(LogCat_FATTABLE, "FATTable::StartFreeClusterScan(): failed to start scan thread ({}). Scanning synchronously.", exc.what());
+        m_ScanThread.reset();
+
+        PScopeFail abortScan([this]()
+        {
+            m_IsScanning = false;
+            m_FreeClusterMap.Reset();
+        });
+        while (ScanFreeClustersStep()) {}
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Stop the free-cluster scan and wait for the thread to exit. The volume
+/// lock must not be held. If the scan was not finished, the volume is left
+/// with whatever count it had (still flagged as estimated if it was), and
+/// the map is built synchronously by the first allocation.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATTable::StopFreeClusterScan()
+{
+    if (m_ScanThread == nullptr) {
+        return;
+    }
+    kassert(!m_Volume->m_Mutex.IsLocked());
+
+    m_ScanStopRequested = true;
+    try {
+        m_ScanThread->Join_trw();
+    } catch (const std::exception& exc) {
+        kernel_log<PLogSeverity::ERROR>(LogCat_FATTABLE, "FATTable::StopFreeClusterScan(): failed to join scan thread: {}", exc.what());
+    }
+    m_ScanThread.reset();
+
+    CRITICAL_SCOPE(m_Volume->m_Mutex);
+    if (m_IsScanning)
+    {
+        kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATTABLE, "FATTable::StopFreeClusterScan(): scan stopped at cluster {} of {}.", m_ScanPosition, m_Volume->m_TotalClusters + FIRST_DATA_CLUSTER);
+        m_IsScanning = false;
+        m_FreeClusterMap.Reset();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATTable::RunFreeClusterScan()
+{
+    while (!m_ScanStopRequested)
+    {
+        CRITICAL_SCOPE(m_Volume->m_Mutex);
+        try
+        {
+            if (!ScanFreeClustersStep()) {
+                break;
+            }
+        }
+        catch (const std::exception& exc)
+        {
+            kernel_log<PLogSeverity::ERROR>(LogCat_FATTABLE, "FATTable::RunFreeClusterScan(): scan failed at cluster {}: {}", m_ScanPosition, exc.what());
+            m_IsScanning = false;
+            m_FreeClusterMap.Reset();
+            break;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Scan the next part of the FAT. Returns false when the scan is complete.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool FATTable::ScanFreeClustersStep()
+{
+    if (!m_IsScanning) {
+        return false;
+    }
+    const uint32_t endCluster     = m_Volume->m_TotalClusters + FIRST_DATA_CLUSTER;
+    const uint32_t entriesPerStep = m_Volume->m_BytesPerSector * 8 / m_Volume->m_FATBits * FAT_FREE_SCAN_SECTORS_PER_STEP;
+    const uint32_t stepEnd        = std::min(endCluster, (m_ScanPosition / entriesPerStep + 1) * entriesPerStep);
+
+    m_ScannedFreeCount += ScanFAT(m_ScanBuildsMap ? &m_FreeClusterMap : nullptr, m_ScanPosition, stepEnd);
+    m_ScanPosition = stepEnd;
+
+    if (m_ScanPosition >= endCluster)
+    {
+        FinishFreeClusterScan();
+        return false;
+    }
+    if (m_IsFreeCountEstimated)
+    {
+        const uint64_t scannedCount = m_ScanPosition - FIRST_DATA_CLUSTER;
+        m_Volume->m_FreeClusters = uint32_t(uint64_t(m_ScannedFreeCount) * m_Volume->m_TotalClusters / scannedCount);
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATTable::FinishFreeClusterScan()
+{
+    m_IsScanning = false;
+    if (m_ScanBuildsMap) {
+        m_FreeClusterMap.SetValid(true);
+    }
+    const TimeValNanos scanTime = kget_monotonic_time() - m_ScanStartTime;
+    kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATTABLE, "FATTable::FinishFreeClusterScan(): {} of {} clusters free, scanned in {:.1f} ms.", m_ScannedFreeCount, m_Volume->m_TotalClusters, scanTime.AsSeconds() * 1000.0);
+
+    if (!m_IsFreeCountEstimated && m_Volume->m_FreeClusters != m_ScannedFreeCount) {
+        kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATTABLE, "FATTable::FinishFreeClusterScan(): free cluster count corrected from {} to {}.", m_Volume->m_FreeClusters, m_ScannedFreeCount);
+    }
+    m_Volume->m_FreeClusters = m_ScannedFreeCount;
+    m_IsFreeCountEstimated = false;
+    m_Volume->UpdateFSInfo();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Count the free entries from "firstCluster" up to "endCluster" in the
+/// active FAT, and mark them in "freeClusterMap" if not null. FAT16 and
+/// FAT32 tables are decoded a sector at a time rather than going through
+/// the table iterator.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t FATTable::ScanFAT(FATFreeClusterMap* freeClusterMap, uint32_t firstCluster, uint32_t endCluster)
+{
     uint32_t count = 0;
-    for (uint32_t i = 0; i < m_Volume->m_TotalClusters; ++i, m_TableIterator.Increment())
+    if (m_Volume->m_FATBits == 12)
     {
-        const uint32_t value = m_TableIterator.GetEntry();
-        if (value == 0) {
-            count++;
+        m_TableIterator.SetCluster(firstCluster);
+        for (uint32_t cluster = firstCluster; cluster < endCluster; ++cluster, m_TableIterator.Increment())
+        {
+            if (m_TableIterator.GetEntry() == 0)
+            {
+                count++;
+                if (freeClusterMap != nullptr) {
+                    freeClusterMap->SetFree(m_TableIterator.GetCurrentCluster(), true);
+                }
+            }
+        }
+        return count;
+    }
+    if (m_Volume->m_FATBits != 16 && m_Volume->m_FATBits != 32) {
+        PERROR_THROW_CODE(PErrorCode::IO);
+    }
+
+    const uint32_t bytesPerEntry     = m_Volume->m_FATBits / 8;
+    const uint32_t entriesPerSector  = m_Volume->m_BytesPerSector / bytesPerEntry;
+    const off64_t  fatStartSector    = off64_t(m_Volume->m_ReservedSectors) + off64_t(m_Volume->m_ActiveFAT) * m_Volume->m_SectorsPerFAT;
+
+    firstCluster = std::max(firstCluster, FATTable::FIRST_DATA_CLUSTER);
+    endCluster   = std::min(endCluster, m_Volume->m_TotalClusters + FATTable::FIRST_DATA_CLUSTER);
+
+    for (uint32_t sectorCluster = firstCluster - firstCluster % entriesPerSector; sectorCluster < endCluster; sectorCluster += entriesPerSector)
+    {
+        KCacheBlockDesc block = m_Volume->m_BCache.GetBlock_trw(fatStartSector + sectorCluster / entriesPerSector, true, true);
+        const uint8_t* buffer = static_cast<const uint8_t*>(block.m_Buffer);
+        if (buffer == nullptr) {
+            PERROR_THROW_CODE(PErrorCode::IO);
+        }
+        const uint32_t sectorFirstCluster = std::max(sectorCluster, firstCluster);
+        const uint32_t sectorEndCluster   = std::min(sectorCluster + entriesPerSector, endCluster);
+        for (uint32_t cluster = sectorFirstCluster; cluster < sectorEndCluster; ++cluster)
+        {
+            const uint8_t* entry = buffer + (cluster - sectorCluster) * bytesPerEntry;
+            const bool     isFree = (bytesPerEntry == 2) ? (entry[0] | entry[1]) == 0 : (entry[0] | entry[1] | entry[2] | (entry[3] & 0x0f)) == 0;
+            if (isFree)
+            {
+                count++;
+                if (freeClusterMap != nullptr) {
+                    freeClusterMap->SetFree(cluster, true);
+                }
+            }
         }
     }
     return count;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Build the free cluster map from the FAT if it is not already valid. If
+/// there is not enough memory for the map, the allocator falls back to
+/// searching the FAT directly.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATTable::BuildFreeClusterMap()
+{
+    // While the scan thread is running, the map is built by it.
+    if (m_FreeClusterMap.IsValid() || m_FreeClusterMapUnavailable || m_IsScanning) {
+        return;
+    }
+    if (!m_FreeClusterMap.Initialize(m_Volume->m_TotalClusters))
+    {
+        kernel_log<PLogSeverity::WARNING>(LogCat_FATTABLE, "FATTable::BuildFreeClusterMap(): not enough memory for a map of {} clusters.", m_Volume->m_TotalClusters);
+        m_FreeClusterMapUnavailable = true;
+        return;
+    }
+    PScopeFail resetMap([this]() { m_FreeClusterMap.Reset(); });
+
+    ScanFAT(&m_FreeClusterMap, FIRST_DATA_CLUSTER, m_Volume->m_TotalClusters + FIRST_DATA_CLUSTER);
+    m_FreeClusterMap.SetValid(true);
+    m_IsFreeCountEstimated = false;
+
+    if (m_Volume->m_FreeClusters != m_FreeClusterMap.GetFreeCount())
+    {
+        kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATTABLE, "FATTable::BuildFreeClusterMap(): free cluster count corrected from {} to {}.", m_Volume->m_FreeClusters, m_FreeClusterMap.GetFreeCount());
+        m_Volume->m_FreeClusters = m_FreeClusterMap.GetFreeCount();
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -241,6 +554,7 @@ void FATTable::SetChainLength(Ptr<FATInode> node, uint32_t clusterCount, bool up
         }
 
         node->m_Iteration++;
+        node->m_ExtentMap.Clear();
         if (updateICache) {
             m_Volume->SetInodeIDToLocationIDMapping(node->m_InodeID, GENERATE_DIR_INDEX_INODEID(node->m_ParentInodeID, node->m_DirStartIndex));
         }
@@ -284,7 +598,7 @@ void FATTable::SetChainLength(Ptr<FATInode> node, uint32_t clusterCount, bool up
         kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATTABLE, "FATTable::SetChainLength(): adding {} new fat entries.", additionalClusterCount);
 
         uint32_t newEndCluster;
-        const uint32_t newStartCluster = AllocateClusters(additionalClusterCount, &newEndCluster);
+        const uint32_t newStartCluster = AllocateClusters(additionalClusterCount, &newEndCluster, node->m_EndCluster + 1);
         kassert(m_Volume->IsDataCluster(newStartCluster));
 
         PScopeFail rollbackExtension([this, newStartCluster]()
@@ -297,6 +611,7 @@ void FATTable::SetChainLength(Ptr<FATInode> node, uint32_t clusterCount, bool up
         node->m_EndCluster = newEndCluster;
         node->m_AllocatedClusterCount = clusterCount;
         node->m_Iteration++;
+        node->m_ExtentMap.ChainExtended(node->m_Iteration - 1, node->m_Iteration);
         return;
     }
 
@@ -317,6 +632,7 @@ void FATTable::SetChainLength(Ptr<FATInode> node, uint32_t clusterCount, bool up
     node->m_EndCluster = newEndCluster;
     node->m_AllocatedClusterCount = clusterCount;
     node->m_Iteration++;
+    node->m_ExtentMap.Clear();
     ClearFATChain(trailingChainStart);
 }
 
@@ -324,7 +640,7 @@ void FATTable::SetChainLength(Ptr<FATInode> node, uint32_t clusterCount, bool up
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-uint32_t FATTable::AllocateClusters(size_t clusterCount, uint32_t* endCluster)
+uint32_t FATTable::AllocateClusters(size_t clusterCount, uint32_t* endCluster, uint32_t hintCluster)
 {
     uint32_t firstCluster = 0;
     uint32_t lastCluster = 0;
@@ -342,7 +658,13 @@ uint32_t FATTable::AllocateClusters(size_t clusterCount, uint32_t* endCluster)
     }
     kernel_log<PLogSeverity::INFO_LOW_VOL>(LogCat_FATTABLE, "FATTable::AllocateClusters(): {:x}", clusterCount);
 
-    FATTableIterator tableIterator(m_Volume, m_Volume->m_LastAllocatedCluster);
+    BuildFreeClusterMap();
+
+    if (m_FreeClusterMap.IsValid() && m_FreeClusterMap.GetFreeCount() < clusterCount)
+    {
+        kernel_log<PLogSeverity::WARNING>(LogCat_FATTABLE, "FATTable::AllocateClusters(): Failed to allocate {} clusters. Only {} free.", clusterCount, m_FreeClusterMap.GetFreeCount());
+        PERROR_THROW_CODE(PErrorCode::NOSPC);
+    }
 
     PScopeFail scopeCleanup(
         [this, &firstCluster, &detachedCluster]()
@@ -351,40 +673,73 @@ uint32_t FATTable::AllocateClusters(size_t clusterCount, uint32_t* endCluster)
             ClearFATChainAfterFailureNoThrow(*this, detachedCluster, "FATTable::AllocateClusters()");
         });
 
-    for (uint32_t clusterIndex = 0; clusterIndex < m_Volume->m_TotalClusters; ++clusterIndex)
+    auto appendCluster = [this, &firstCluster, &lastCluster, &detachedCluster, &allocatedClusterCount](uint32_t cluster)
     {
-        const uint32_t value = tableIterator.GetEntry();
+        SetEntry(cluster, END_FAT_ENTRY);
+        detachedCluster = cluster;
+        if (allocatedClusterCount == 0)
+        {
+            kassert(firstCluster == 0);
+            firstCluster = detachedCluster;
+            lastCluster = firstCluster;
+            detachedCluster = 0;
+        }
+        else
+        {
+            kassert(m_Volume->IsDataCluster(firstCluster));
+            kassert(m_Volume->IsDataCluster(lastCluster));
+
+            // Set previous last cluster to point to us
+            SetEntry(lastCluster, detachedCluster);
+            lastCluster = detachedCluster;
+            detachedCluster = 0;
+        }
+        m_Volume->m_LastAllocatedCluster = lastCluster;
+        allocatedClusterCount++;
+    };
 
-        if (value == 0)
+    if (m_FreeClusterMap.IsValid())
+    {
+        // Continue at the hint (typically right after the end of the chain
+        // being extended) as long as it is free, otherwise use the first run
+        // that fits the remaining request. If no single run is big enough,
+        // take the longest one and search again for the rest.
+        while (allocatedClusterCount < clusterCount)
         {
-            tableIterator.SetEntry(END_FAT_ENTRY);
-            detachedCluster = tableIterator.GetCurrentCluster();
-            if (m_Volume->m_FreeClusters > 0) {
-                m_Volume->m_FreeClusters--;
-            }
-            if (allocatedClusterCount == 0)
+            const uint32_t remainingCount = uint32_t(clusterCount - allocatedClusterCount);
+            uint32_t runStart;
+            uint32_t runLength;
+            if (m_FreeClusterMap.IsFree(hintCluster))
             {
-                kassert(firstCluster == 0);
-                firstCluster = detachedCluster;
-                lastCluster = firstCluster;
-                detachedCluster = 0;
+                runStart  = hintCluster;
+                runLength = m_FreeClusterMap.GetRunLength(hintCluster, remainingCount);
             }
-            else
+            else if (!m_FreeClusterMap.FindRun(m_Volume->m_LastAllocatedCluster, remainingCount, runStart, runLength))
             {
-                kassert(m_Volume->IsDataCluster(firstCluster));
-                kassert(m_Volume->IsDataCluster(lastCluster));
-
-                // Set previous last cluster to point to us
-                SetEntry(lastCluster, detachedCluster);
-                lastCluster = detachedCluster;
-                detachedCluster = 0;
-            }
-            m_Volume->m_LastAllocatedCluster = lastCluster;
-            if (++allocatedClusterCount == clusterCount) {
                 break;
             }
+            runLength = std::min(runLength, remainingCount);
+            for (uint32_t cluster = runStart; cluster < runStart + runLength; ++cluster) {
+                appendCluster(cluster);
+            }
+            hintCluster = runStart + runLength;
+        }
+    }
+    else
+    {
+        FATTableIterator tableIterator(m_Volume, m_Volume->IsDataCluster(hintCluster) ? hintCluster : m_Volume->m_LastAllocatedCluster);
+
+        for (uint32_t clusterIndex = 0; clusterIndex < m_Volume->m_TotalClusters; ++clusterIndex)
+        {
+            if (tableIterator.GetEntry() == 0)
+            {
+                appendCluster(tableIterator.GetCurrentCluster());
+                if (allocatedClusterCount == clusterCount) {
+                    break;
+                }
+            }
+            tableIterator.Increment();
         }
-        tableIterator.Increment();
     }
     m_Volume->UpdateFSInfo();
     if (allocatedClusterCount != clusterCount)
@@ -429,10 +784,6 @@ void FATTable::ClearFATChain(uint32_t cluster)
             break;
         }
         SetEntry(cluster, 0);
-
-        if (m_Volume->m_FreeClusters < m_Volume->m_TotalClusters) {
-            m_Volume->m_FreeClusters++;
-        }
         clearedClusterCount++;
         cluster = nextCluster;
         kernel_log<PLogSeverity::INFO_HIGH_VOL>(LogCat_FATTABLE, "  clearing cluster: {}", cluster);
@@ -20,10 +20,14 @@
 #pragma once
 
 #include <stdint.h>
+#include <atomic>
+#include <memory>
 
 #include "Ptr/Ptr.h"
 #include "Ptr/PtrTarget.h"
+#include "System/TimeValue.h"
 #include "FATTableIterator.h"
+#include "FATFreeClusterMap.h"
 
 #define END_FAT_ENTRY 0x0ffffff8
 #define BAD_FAT_ENTRY 0x0ffffff7
@@ -53,18 +57,42 @@ public:
 #endif // FAT_VERIFY_FAT_CHAINS
 
     uint32_t    CountFreeClusters();
+    void        StartFreeClusterScan(bool buildMap, bool estimateFreeCount);
+    void        StopFreeClusterScan();
+    bool        IsFreeClusterScanRunning() const { return m_IsScanning; }
+    bool        IsFreeClusterCountEstimated() const { return m_IsFreeCountEstimated; }
+    uint32_t    GetFreeClusterScanPosition() const { return m_ScanPosition; }
     size_t      GetChainLength(uint32_t cluster, uint32_t* endCluster = nullptr);
     void        SetChainLength(Ptr<FATInode> node, uint32_t clusterCount, bool updateICache);
-    uint32_t    AllocateClusters(size_t clusterCount, uint32_t* endCluster = nullptr);
+    uint32_t    AllocateClusters(size_t clusterCount, uint32_t* endCluster = nullptr, uint32_t hintCluster = 0);
     void        ClearFATChain(uint32_t cluster);
 
     void DumpChain(uint32_t startCluster);
     
 private:
+    class FreeClusterScanThread;
+
+    uint32_t    ScanFAT(FATFreeClusterMap* freeClusterMap, uint32_t firstCluster, uint32_t endCluster);
+    void        BuildFreeClusterMap();
+    void        RunFreeClusterScan();
+    bool        ScanFreeClustersStep();
+    void        FinishFreeClusterScan();
 
     Ptr<FATVolume> m_Volume;
 
-    FATTableIterator m_TableIterator;
+    FATTableIterator    m_TableIterator;
+    FATFreeClusterMap   m_FreeClusterMap;
+    bool                m_FreeClusterMapUnavailable = false; // Not enough memory for the map. Don't try again.
+
+    // Background counting of free clusters, started by StartFreeClusterScan().
+    std::unique_ptr<FreeClusterScanThread> m_ScanThread;
+    std::atomic_bool    m_ScanStopRequested = false;
+    bool                m_IsScanning = false;
+    bool                m_IsFreeCountEstimated = false; // The volume's free count is extrapolated from the part scanned so far.
+    bool                m_ScanBuildsMap = false;
+    uint32_t            m_ScanPosition = 0;             // Clusters below this have been counted.
+    uint32_t            m_ScannedFreeCount = 0;         // Free clusters below m_ScanPosition.
+    TimeValNanos        m_ScanStartTime;
 
     FATTable(const FATTable&) = delete;
     FATTable& operator=(const FATTable&) = delete;
@@ -228,7 +228,7 @@ size_t FATTableIterator::AcquireMirrorBlocks(off64_t activeSector, MirrorBlockAr
             continue;
         }
         const off64_t mirrorSector = off64_t(m_Volume->m_ReservedSectors) + off64_t(fatIndex) * m_Volume->m_SectorsPerFAT + sectorOffset;
-        mirrorBlocks[mirrorBlockCount] = m_Volume->m_BCache.GetBlock_trw(mirrorSector, false);
+        mirrorBlocks[mirrorBlockCount] = m_Volume->m_BCache.GetBlock_trw(mirrorSector, false, true);
         if (mirrorBlocks[mirrorBlockCount].m_Buffer == nullptr) {
             PERROR_THROW_CODE(PErrorCode::IO);
         }
@@ -265,7 +265,7 @@ void FATTableIterator::Update()
         if (m_Block2.m_Buffer != nullptr && m_LoadedSector2 == m_CurrentSector) {
             m_Block1 = std::move(m_Block2);
         } else {
-            m_Block1 = m_Volume->m_BCache.GetBlock_trw(m_CurrentSector, true);
+            m_Block1 = m_Volume->m_BCache.GetBlock_trw(m_CurrentSector, true, true);
             m_Block2.Reset();
         }
         m_LoadedSector1 = -1;
@@ -282,7 +282,7 @@ void FATTableIterator::Update()
         m_LoadedSector1 = m_CurrentSector;
         if (m_OffsetInSector == m_Volume->m_BytesPerSector - 1)
         {
-            m_Block2 = m_Volume->m_BCache.GetBlock_trw(m_CurrentSector + 1, true);
+            m_Block2 = m_Volume->m_BCache.GetBlock_trw(m_CurrentSector + 1, true, true);
             if (m_Block2.m_Buffer == nullptr) {
                 PERROR_THROW_CODE(PErrorCode::IO);
             }
@@ -28,6 +28,7 @@
 
 #include "FATVolume.h"
 #include "FATInode.h"
+#include "FATDirectoryIndex.h"
 
 
 namespace kernel
@@ -57,6 +58,7 @@ FATVolume::FATVolume(Ptr<FATFilesystem> filesystem, fs_id volumeID, const PStrin
 FATVolume::~FATVolume()
 {
     kassert(m_DirtyInodes.IsEmpty());
+    kassert(m_IndexedDirectories.IsEmpty());
     m_Magic = ~MAGIC;
 }
 
@@ -297,6 +299,10 @@ void FATVolume::ReadSuperBlock(int deviceFile)
 void FATVolume::Shutdown()
 {
     kassert(m_DirtyInodes.IsEmpty());
+    DiscardAllDirectoryIndexes();
+    if (m_FATTable != nullptr) {
+        m_FATTable->StopFreeClusterScan();
+    }
     m_FATTable = nullptr;
     m_BCache.SetDevice(-1, 0, 0);
 
@@ -666,5 +672,92 @@ void FATVolume::RemoveDirtyInode(FATInode* inode) noexcept
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Return the name index of "directory", or nullptr if it has none, and
+/// mark it as recently used.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+FATDirectoryIndex* FATVolume::GetDirectoryIndex(FATInode* directory) noexcept
+{
+    kassert(m_Mutex.IsLocked());
+
+    if (directory->m_DirectoryIndex == nullptr) {
+        return nullptr;
+    }
+    m_IndexedDirectories.Remove(directory);
+    m_IndexedDirectories.Append(directory);
+    return directory->m_DirectoryIndex.get();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATVolume::AddDirectoryIndex(FATInode* directory, std::unique_ptr<FATDirectoryIndex> index) noexcept
+{
+    kassert(m_Mutex.IsLocked());
+    kassert(directory->m_Volume == this);
+
+    DiscardDirectoryIndex(directory);
+    directory->m_DirectoryIndex = std::move(index);
+    m_IndexedDirectories.Append(directory);
+    TrimDirectoryIndexes();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATVolume::DiscardDirectoryIndex(FATInode* directory) noexcept
+{
+    kassert(m_Mutex.IsLocked());
+
+    if (directory->m_DirectoryIndex != nullptr)
+    {
+        kassert(directory->m_DirectoryIndexNode.IsListMember(&m_IndexedDirectories));
+        m_IndexedDirectories.Remove(directory);
+        directory->m_DirectoryIndex.reset();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Called when an allocation fails, to release all memory held by the
+/// indexes, and from Shutdown().
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATVolume::DiscardAllDirectoryIndexes() noexcept
+{
+    while (FATInode* directory = m_IndexedDirectories.GetFirst())
+    {
+        m_IndexedDirectories.Remove(directory);
+        directory->m_DirectoryIndex.reset();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Discard the least recently used indexes until the volume is within
+/// FAT_DIRECTORY_INDEX_MAX_ENTRIES. The most recently used index is always
+/// kept.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void FATVolume::TrimDirectoryIndexes() noexcept
+{
+    kassert(m_Mutex.IsLocked());
+
+    size_t entryCount = 0;
+    for (FATInode* directory : m_IndexedDirectories) {
+        entryCount += directory->m_DirectoryIndex->GetEntryCount();
+    }
+    while (entryCount > FAT_DIRECTORY_INDEX_MAX_ENTRIES && m_IndexedDirectories.GetCount() > 1)
+    {
+        FATInode* directory = m_IndexedDirectories.GetFirst();
+        entryCount -= directory->m_DirectoryIndex->GetEntryCount();
+        DiscardDirectoryIndex(directory);
+    }
+}
+
 
 } // kernel
@@ -28,9 +28,16 @@ namespace kernel
 {
 class FATFilesystem;    
 class FATInode;
+class FATDirectoryIndex;
 
 inline constexpr size_t FAT_VOLUME_LABEL_LENGTH = 11;
 
+// Total number of directory records indexed across all directories on a
+// volume. The least recently used indexes are discarded beyond this.
+inline constexpr size_t FAT_DIRECTORY_INDEX_MAX_ENTRIES = 8192;
+// Directories with more entry slots than this are never indexed.
+inline constexpr size_t FAT_DIRECTORY_INDEX_MAX_SLOTS = 16384;
+
 struct FATSuperBlock
 {
     uint8_t  m_JmpBoot[3];        // 0x00
@@ -135,6 +142,12 @@ public:
 
     void AddDirtyInode(FATInode* inode) noexcept;
     void RemoveDirtyInode(FATInode* inode) noexcept;
+
+    FATDirectoryIndex* GetDirectoryIndex(FATInode* directory) noexcept;
+    void               AddDirectoryIndex(FATInode* directory, std::unique_ptr<FATDirectoryIndex> index) noexcept;
+    void               DiscardDirectoryIndex(FATInode* directory) noexcept;
+    void               DiscardAllDirectoryIndexes() noexcept;
+    void               TrimDirectoryIndexes() noexcept;
     
     uint32_t	   m_Magic;
     mutable KMutex m_Mutex;
@@ -184,8 +197,10 @@ public:
 
 private:
     using DirtyInodeList = PIntrusiveList<FATInode, &FATInode::m_DirtyListNode>;
+    using DirectoryIndexList = PIntrusiveList<FATInode, &FATInode::m_DirectoryIndexNode>;
 
-    DirtyInodeList m_DirtyInodes;
+    DirtyInodeList     m_DirtyInodes;
+    DirectoryIndexList m_IndexedDirectories; // Least recently used first.
 };
 
 
@@ -0,0 +1,389 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 19:30
+
+#include "System/Platform.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <reent.h>
+
+#include <algorithm>
+
+#include <Kernel/Kernel.h>
+#include <Kernel/KHeap.h>
+#include <Kernel/KSchedulerLock.h>
+
+#ifdef PADOS_OPT_TLSF_HEAP
+
+extern unsigned char* _sheap;
+extern unsigned char* _eheap;
+
+namespace kernel
+{
+
+struct KHeapPool
+{
+    const char* Name;
+    void*       Start;
+    size_t      Size;
+    bool        GeneralPurpose;
+    KTLSFPool*  Pool;
+};
+
+static KHeapPool gk_HeapPools[KHEAP_MAX_POOLS];
+static int       gk_HeapPoolCount = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+/// Must be called with the scheduler lock held.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+static PErrorCode add_pool(int& outPoolID, const char* name, void* memory, size_t size, bool generalPurpose)
+{
+    if (gk_HeapPoolCount == KHEAP_MAX_POOLS) {
+        return PErrorCode::NOSPC;
+    }
+    KTLSFPool* pool = KTLSFPool::Create(memory, size);
+    if (pool == nullptr) {
+        return PErrorCode::INVAL;
+    }
+    KHeapPool& entry = gk_HeapPools[gk_HeapPoolCount];
+    entry.Name              = name;
+    entry.Start             = memory;
+    entry.Size              = size;
+    entry.GeneralPurpose    = generalPurpose;
+    entry.Pool              = pool;
+
+    outPoolID = gk_HeapPoolCount++;
+    return PErrorCode::Success;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// The main pool is created on the first allocation, which normally happen
+/// during static initialization. Must be called with the scheduler lock held.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+static void ensure_main_pool()
+{
+    if (gk_HeapPoolCount == 0)
+    {
+        int poolID;
+        if (add_pool(poolID, "main", &_sheap, size_t(reinterpret_cast<uint8_t*>(&_eheap) - reinterpret_cast<uint8_t*>(&_sheap)), true) != PErrorCode::Success) {
+            panic("Failed to initialize main heap pool.\n");
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Must be called with the scheduler lock held.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+static KTLSFPool* find_pool(const void* pointer)
+{
+    for (int i = 0; i < gk_HeapPoolCount; ++i)
+    {
+        if (gk_HeapPools[i].Pool->Contains(pointer)) {
+            return gk_HeapPools[i].Pool;
+        }
+    }
+    panic("Heap pointer {} not in any pool.\n", pointer);
+    return nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Allocate from the general purpose pools. The scheduler lock is only held
+/// for the bounded time a single pool operation take, so the heap never
+/// block higher priority threads for longer than that.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+static void* heap_alloc(size_t alignment, size_t size)
+{
+    KSchedulerLock slock;
+
+    ensure_main_pool();
+    for (int i = 0; i < gk_HeapPoolCount; ++i)
+    {
+        if (gk_HeapPools[i].GeneralPurpose)
+        {
+            void* pointer = gk_HeapPools[i].Pool->AllocateAligned(alignment, size);
+            if (pointer != nullptr) {
+                return pointer;
+            }
+        }
+    }
+    return nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+PErrorCode kheap_add_pool(int& outPoolID, const char* name, void* memory, size_t size, bool generalPurpose)
+{
+    KSchedulerLock slock;
+    ensure_main_pool();
+    return add_pool(outPoolID, name, memory, size, generalPurpose);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+int kheap_find_pool(const char* name)
+{
+    KSchedulerLock slock;
+    ensure_main_pool();
+    for (int i = 0; i < gk_HeapPoolCount; ++i)
+    {
+        if (strcmp(gk_HeapPools[i].Name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+int kheap_get_pool_count()
+{
+    KSchedulerLock slock;
+    ensure_main_pool();
+    return gk_HeapPoolCount;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+PErrorCode kheap_get_pool_info(int poolID, KHeapPoolInfo& outInfo)
+{
+    KSchedulerLock slock;
+    ensure_main_pool();
+
+    if (poolID < 0 || poolID >= gk_HeapPoolCount) {
+        return PErrorCode::INVAL;
+    }
+    const KHeapPool& entry = gk_HeapPools[poolID];
+    outInfo.Name            = entry.Name;
+    outInfo.Start           = entry.Start;
+    outInfo.Size            = entry.Size;
+    outInfo.GeneralPurpose  = entry.GeneralPurpose;
+    outInfo.Stats           = entry.Pool->GetStats();
+    return PErrorCode::Success;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Allocate from a specific pool. Memory is released with free().
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* kheap_alloc(int poolID, size_t size) noexcept
+{
+    return kheap_alloc_aligned(poolID, KTLSFPool::ALIGNMENT, size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* kheap_alloc_aligned(int poolID, size_t alignment, size_t size) noexcept
+{
+    KSchedulerLock slock;
+    ensure_main_pool();
+
+    if (poolID < 0 || poolID >= gk_HeapPoolCount) {
+        return nullptr;
+    }
+    return gk_HeapPools[poolID].Pool->AllocateAligned(alignment, size);
+}
+
+} // namespace kernel
+
+using namespace kernel;
+
+extern "C"
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* malloc(size_t size)
+{
+    return heap_alloc(KTLSFPool::ALIGNMENT, size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void free(void* pointer)
+{
+    if (pointer != nullptr)
+    {
+        KSchedulerLock slock;
+        find_pool(pointer)->Free(pointer);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* calloc(size_t count, size_t size)
+{
+    size_t totalSize;
+    if (__builtin_mul_overflow(count, size, &totalSize)) {
+        return nullptr;
+    }
+    void* pointer = malloc(totalSize);
+    if (pointer != nullptr) {
+        memset(pointer, 0, totalSize);
+    }
+    return pointer;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Resize in place if the following block is free, otherwise allocate a new
+/// block. The copy is done without holding the scheduler lock.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* realloc(void* pointer, size_t size)
+{
+    if (pointer == nullptr) {
+        return malloc(size);
+    }
+    if (size == 0)
+    {
+        free(pointer);
+        return nullptr;
+    }
+    size_t prevSize;
+    {
+        KSchedulerLock slock;
+        if (find_pool(pointer)->ResizeInPlace(pointer, size)) {
+            return pointer;
+        }
+        prevSize = KTLSFPool::GetAllocationSize(pointer);
+    }
+    void* newPointer = malloc(size);
+    if (newPointer != nullptr)
+    {
+        memcpy(newPointer, pointer, std::min(prevSize, size));
+        free(pointer);
+    }
+    return newPointer;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* memalign(size_t alignment, size_t size)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        return nullptr;
+    }
+    return heap_alloc(alignment, size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+int posix_memalign(void** outPointer, size_t alignment, size_t size)
+{
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void* pointer = heap_alloc(alignment, size);
+    if (pointer == nullptr) {
+        return ENOMEM;
+    }
+    *outPointer = pointer;
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t malloc_usable_size(void* pointer)
+{
+    return (pointer != nullptr) ? KTLSFPool::GetAllocationSize(pointer) : 0;
+}
+
+// Newlib internals call the reentrant variants directly.
+void*  _malloc_r(struct _reent*, size_t size)                           { return malloc(size); }
+void   _free_r(struct _reent*, void* pointer)                           { free(pointer); }
+void*  _calloc_r(struct _reent*, size_t count, size_t size)             { return calloc(count, size); }
+void*  _realloc_r(struct _reent*, void* pointer, size_t size)           { return realloc(pointer, size); }
+void*  _memalign_r(struct _reent*, size_t alignment, size_t size)       { return memalign(alignment, size); }
+size_t _malloc_usable_size_r(struct _reent*, void* pointer)             { return malloc_usable_size(pointer); }
+
+///////////////////////////////////////////////////////////////////////////////
+/// Replaces the sbrk based versions in Utils.cpp.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t get_heap_size()
+{
+    KSchedulerLock slock;
+    size_t size = 0;
+    for (int i = 0; i < gk_HeapPoolCount; ++i) {
+        size += gk_HeapPools[i].Pool->GetUsedSize();
+    }
+    return size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t get_max_heap_size()
+{
+    KSchedulerLock slock;
+    ensure_main_pool();
+    size_t size = 0;
+    for (int i = 0; i < gk_HeapPoolCount; ++i) {
+        size += gk_HeapPools[i].Pool->GetTotalSize();
+    }
+    return size;
+}
+
+} // extern "C"
+
+#endif // PADOS_OPT_TLSF_HEAP
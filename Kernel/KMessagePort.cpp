@@ -29,6 +29,7 @@
 #include <Kernel/KTime.h>
 #include <Kernel/Kernel.h>
 #include <Kernel/KMessagePort.h>
+#include <Kernel/KSlabCache.h>
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -43,51 +44,50 @@ struct KMessagePortMessage
     handler_id           m_TargetHandler;
     int32_t              m_Code;
     size_t               m_Length;
+    size_t               m_Capacity;
     KMessagePortMessage* m_Next;
 };
 
 
 static const size_t MAX_CACHED_MESSAGE_SIZE = 64;
-static const int    MAX_CACHED_MESSAGE_COUNT = 100;
 
-static KMessagePortMessage* gk_FirstCachedMessage = nullptr;
-static int                  gk_CachedMessageCount = 0;
+static KSlabCache gk_MessageCache("message_port_message", sizeof(KMessagePortMessage) + MAX_CACHED_MESSAGE_SIZE);
 
 static KMessagePortMessage* alloc_message(size_t size)
 {
+    KMessagePortMessage* message;
+    size_t               capacity;
     if (size <= MAX_CACHED_MESSAGE_SIZE)
     {
-        CRITICAL_SCOPE(CRITICAL_IRQ);
-        if (gk_CachedMessageCount > 0)
-        {
-            KMessagePortMessage* message = gk_FirstCachedMessage;
-            gk_FirstCachedMessage = message->m_Next;
-            gk_CachedMessageCount--;
-            message->m_Length = size;
-            return message;
-        }
+        message  = static_cast<KMessagePortMessage*>(gk_MessageCache.Allocate());
+        capacity = MAX_CACHED_MESSAGE_SIZE;
     }
-    KMessagePortMessage* message = static_cast<KMessagePortMessage*>(malloc(sizeof(KMessagePortMessage) + std::max(MAX_CACHED_MESSAGE_SIZE, size)));
-    if (message != nullptr) {
-        message->m_Length = size;
+    else
+    {
+        message  = static_cast<KMessagePortMessage*>(malloc(sizeof(KMessagePortMessage) + size));
+        capacity = size;
+    }
+    if (message != nullptr)
+    {
+        message->m_Length   = size;
+        message->m_Capacity = capacity;
+        message->m_Next     = nullptr;
     }
     return message;
 }
 
 static void free_message(KMessagePortMessage* message)
 {
-    if (message->m_Length <= MAX_CACHED_MESSAGE_SIZE)
-    {
-        CRITICAL_SCOPE(CRITICAL_IRQ);
-        if (gk_CachedMessageCount < MAX_CACHED_MESSAGE_COUNT)
-        {
-            message->m_Next = gk_FirstCachedMessage;
-            gk_FirstCachedMessage = message;
-            gk_CachedMessageCount++;
-            return;
-        }
+    if (message->m_Capacity <= MAX_CACHED_MESSAGE_SIZE) {
+        gk_MessageCache.Free(message);
+    } else {
+        free(message);
     }
-    free(message);
+}
+
+static KMessagePortMessage* get_message_header(const void* buffer)
+{
+    return const_cast<KMessagePortMessage*>(static_cast<const KMessagePortMessage*>(buffer)) - 1;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -114,6 +114,12 @@ KMessagePort::~KMessagePort()
         m_FirstMsg = message->m_Next;
         free_message(message);
     }
+    while (m_FirstFreeBuffer != nullptr)
+    {
+        KMessagePortMessage* message = m_FirstFreeBuffer;
+        m_FirstFreeBuffer = message->m_Next;
+        free_message(message);
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -168,26 +174,183 @@ PErrorCode KMessagePort::SendMessageTimeout(handler_id targetHandler, int32_t co
 
 PErrorCode KMessagePort::SendMessageDeadline(handler_id targetHandler, int32_t code, const void* data, size_t length, TimeValNanos deadline)
 {
+    void* buffer = LoanBuffer(length);
+    if (buffer == nullptr) {
+        return PErrorCode::NOMEM;
+    }
+    memcpy(buffer, data, length);
+    return CommitBufferDeadline(buffer, targetHandler, code, length, deadline);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+ssize_t KMessagePort::ReceiveMessage_trw(handler_id* targetHandler, int32_t* code, void* buffer, size_t bufferSize)
+{
+    return ReceiveMessageDeadline_trw(targetHandler, code, buffer, bufferSize, TimeValNanos::infinit);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+ssize_t KMessagePort::ReceiveMessageTimeout_trw(handler_id* targetHandler, int32_t* code, void* buffer, size_t bufferSize, TimeValNanos timeout)
+{
+    return ReceiveMessageDeadline_trw(targetHandler, code, buffer, bufferSize, (!timeout.IsInfinit()) ? (kget_monotonic_time() + timeout) : TimeValNanos::infinit);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+ssize_t KMessagePort::ReceiveMessageDeadline_trw(handler_id* targetHandler, int32_t* code, void* buffer, size_t bufferSize, TimeValNanos deadline)
+{
+    const void*   data;
+    const ssize_t length = BorrowMessageDeadline_trw(targetHandler, code, &data, deadline);
+
+    ssize_t bytesReceived = 0;
+    if (buffer != nullptr) {
+        bytesReceived = std::min(bufferSize, size_t(length));
+        memcpy(buffer, data, bytesReceived);
+    }
+    ReleaseBuffer(data);
+    return bytesReceived;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Wait until the deadline for at least one message, then dequeue up to
+/// "maxCount" messages that fit in the buffer. Payloads are packed at
+/// PMESSAGE_PORT_BATCH_ALIGNMENT boundaries and described by "entries".
+/// Only the first message is truncated if it is bigger than the buffer,
+/// later messages that don't fit are left for the next call.
+/// Returns the number of messages received, 0 if the deadline passed.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t KMessagePort::ReceiveMultipleDeadline_trw(PMessagePortBatchEntry* entries, size_t maxCount, void* buffer, size_t bufferSize, TimeValNanos deadline)
+{
+    if (maxCount == 0) {
+        return 0;
+    }
+    KMessagePortMessage* firstMessage = nullptr;
+    KMessagePortMessage* lastMessage  = nullptr;
+    size_t               count        = 0;
+    {
+        CRITICAL_SCOPE(m_Mutex);
+
+        while (m_MessageCount == 0)
+        {
+            const PErrorCode result = m_ReceiveCondition.WaitDeadline(m_Mutex, deadline);
+            if (result == PErrorCode::TIMEDOUT) {
+                return 0;
+            }
+            if (result != PErrorCode::Success && result != PErrorCode::INTR) {
+                PERROR_THROW_CODE(result);
+            }
+        }
+        size_t offset = 0;
+        while (count < maxCount && m_FirstMsg != nullptr)
+        {
+            const size_t alignedOffset = (offset + PMESSAGE_PORT_BATCH_ALIGNMENT - 1) & ~(PMESSAGE_PORT_BATCH_ALIGNMENT - 1);
+            if (count != 0 && (alignedOffset > bufferSize || m_FirstMsg->m_Length > bufferSize - alignedOffset)) {
+                break;
+            }
+            KMessagePortMessage* message = DetachMessage_trw();
+            if (lastMessage != nullptr) {
+                lastMessage->m_Next = message;
+            } else {
+                firstMessage = message;
+            }
+            lastMessage = message;
+            message->m_Next = nullptr;
+
+            offset = alignedOffset + std::min(message->m_Length, bufferSize);
+            count++;
+        }
+    }
+    // Copy without holding the port mutex.
+    size_t offset = 0;
+    size_t index  = 0;
+    for (KMessagePortMessage* message = firstMessage; message != nullptr; message = message->m_Next, ++index)
+    {
+        const size_t alignedOffset = (offset + PMESSAGE_PORT_BATCH_ALIGNMENT - 1) & ~(PMESSAGE_PORT_BATCH_ALIGNMENT - 1);
+        const size_t length = std::min(message->m_Length, bufferSize - std::min(alignedOffset, bufferSize));
+
+        entries[index].TargetHandler = message->m_TargetHandler;
+        entries[index].Code          = message->m_Code;
+        entries[index].Offset        = uint32_t(alignedOffset);
+        entries[index].Length        = uint32_t(length);
+        memcpy(static_cast<uint8_t*>(buffer) + alignedOffset, message + 1, length);
+        offset = alignedOffset + length;
+    }
     CRITICAL_SCOPE(m_Mutex);
+    while (firstMessage != nullptr)
+    {
+        KMessagePortMessage* message = firstMessage;
+        firstMessage = message->m_Next;
+        RecycleMessage(message);
+    }
+    return count;
+}
 
+///////////////////////////////////////////////////////////////////////////////
+/// Get a buffer for a message of up to "length" bytes from the port's
+/// buffer pool. SendMessageDeadline() fills it and passes it to
+/// CommitBufferDeadline(). Returns nullptr if out of memory.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* KMessagePort::LoanBuffer(size_t length)
+{
+    if (length <= MAX_CACHED_MESSAGE_SIZE)
+    {
+        CRITICAL_SCOPE(m_Mutex);
+
+        KMessagePortMessage* message = m_FirstFreeBuffer;
+        if (message != nullptr)
+        {
+            m_FirstFreeBuffer = message->m_Next;
+            m_FreeBufferCount--;
+            message->m_Length = length;
+            message->m_Next   = nullptr;
+            return message + 1;
+        }
+    }
+    KMessagePortMessage* message = alloc_message(length);
+    return (message != nullptr) ? (message + 1) : nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Queue a buffer from LoanBuffer(). Ownership of the buffer is transferred
+/// to the port, also if the send fail.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+PErrorCode KMessagePort::CommitBufferDeadline(void* buffer, handler_id targetHandler, int32_t code, size_t length, TimeValNanos deadline)
+{
+    KMessagePortMessage* message = get_message_header(buffer);
+
+    CRITICAL_SCOPE(m_Mutex);
+
+    if (length > message->m_Capacity)
+    {
+        RecycleMessage(message);
+        return PErrorCode::INVAL;
+    }
     while (m_MessageCount >= m_MaxCount)
     {
         const PErrorCode result = m_SendCondition.WaitDeadline(m_Mutex, deadline);
-        if (result != PErrorCode::Success && result != PErrorCode::INTR) {
+        if (result != PErrorCode::Success && result != PErrorCode::INTR)
+        {
+            RecycleMessage(message);
             return result;
         }
     }
-
-    KMessagePortMessage* message = alloc_message(length);
-    if (message == nullptr) {
-        return PErrorCode::NOMEM;
-    }
     message->m_TargetHandler = targetHandler;
     message->m_Code = code;
     message->m_Length = length;
 
-    memcpy(message + 1, data, length);
-
     message->m_Next = nullptr;
     if (m_LastMsg != nullptr) {
         m_LastMsg->m_Next = message;
@@ -201,55 +364,84 @@ PErrorCode KMessagePort::SendMessageDeadline(handler_id targetHandler, int32_t c
 }
 
 ///////////////////////////////////////////////////////////////////////////////
+/// Dequeue the next message. The payload is returned in "outData" and stay
+/// valid until passed to ReleaseBuffer().
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-ssize_t KMessagePort::ReceiveMessage_trw(handler_id* targetHandler, int32_t* code, void* buffer, size_t bufferSize)
+ssize_t KMessagePort::BorrowMessageDeadline_trw(handler_id* targetHandler, int32_t* code, const void** outData, TimeValNanos deadline)
 {
     CRITICAL_SCOPE(m_Mutex);
 
     while (m_MessageCount == 0)
     {
-        const PErrorCode result = m_ReceiveCondition.Wait(m_Mutex);
+        const PErrorCode result = m_ReceiveCondition.WaitDeadline(m_Mutex, deadline);
         if (result != PErrorCode::Success && result != PErrorCode::INTR) {
             PERROR_THROW_CODE(result);
         }
     }
-    return DetachMessage_trw(targetHandler, code, buffer, bufferSize);
+    KMessagePortMessage* message = DetachMessage_trw();
+
+    if (targetHandler != nullptr) *targetHandler = message->m_TargetHandler;
+    if (code != nullptr)          *code = message->m_Code;
+
+    *outData = message + 1;
+    return message->m_Length;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
+/// Return a dequeued message buffer to the port's buffer pool.
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-ssize_t KMessagePort::ReceiveMessageTimeout_trw(handler_id* targetHandler, int32_t* code, void* buffer, size_t bufferSize, TimeValNanos timeout)
+void KMessagePort::ReleaseBuffer(const void* buffer)
 {
-    return ReceiveMessageDeadline_trw(targetHandler, code, buffer, bufferSize, (!timeout.IsInfinit()) ? (kget_monotonic_time() + timeout) : TimeValNanos::infinit);
+    if (buffer != nullptr)
+    {
+        CRITICAL_SCOPE(m_Mutex);
+        RecycleMessage(get_message_header(buffer));
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
+/// Return the number of buffers kept in the port's buffer pool.
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-ssize_t KMessagePort::ReceiveMessageDeadline_trw(handler_id* targetHandler, int32_t* code, void* buffer, size_t bufferSize, TimeValNanos deadline)
+size_t KMessagePort::GetPooledBufferCount() const
 {
     CRITICAL_SCOPE(m_Mutex);
+    return m_FreeBufferCount;
+}
 
-    while (m_MessageCount == 0)
+///////////////////////////////////////////////////////////////////////////////
+/// Keep up to one queue worth of slab sized buffers in the pool. Larger
+/// buffers are freed right away, so a single burst of big messages doesn't
+/// pin their memory for the lifetime of the port. Must be called with the
+/// port mutex held.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KMessagePort::RecycleMessage(KMessagePortMessage* message)
+{
+    if (message->m_Capacity <= MAX_CACHED_MESSAGE_SIZE && m_FreeBufferCount < m_MaxCount)
     {
-        const PErrorCode result = m_ReceiveCondition.WaitDeadline(m_Mutex, deadline);
-        if (result != PErrorCode::Success && result != PErrorCode::INTR) {
-            PERROR_THROW_CODE(result);
-        }
+        message->m_Next = m_FirstFreeBuffer;
+        m_FirstFreeBuffer = message;
+        m_FreeBufferCount++;
+    }
+    else
+    {
+        free_message(message);
     }
-    return DetachMessage_trw(targetHandler, code, buffer, bufferSize);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
+/// Must be called with the port mutex held.
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-ssize_t KMessagePort::DetachMessage_trw(handler_id* targetHandler, int32_t* code, void* buffer, size_t bufferSize)
+KMessagePortMessage* KMessagePort::DetachMessage_trw()
 {
     KMessagePortMessage* message = m_FirstMsg;
     kassure(m_MessageCount > 0 && message != nullptr, "ERROR: KMessagePort::ReceiveMessage() acquired receive semaphore with no message available.: %s\n", GetName());
@@ -262,18 +454,7 @@ ssize_t KMessagePort::DetachMessage_trw(handler_id* targetHandler, int32_t* code
     }
     m_MessageCount--;
     m_SendCondition.WakeupAll();
-
-    ssize_t bytesReceived = 0;
-
-    if (targetHandler != nullptr) *targetHandler = message->m_TargetHandler;
-    if (code != nullptr)          *code = message->m_Code;
-
-    if (buffer != nullptr) {
-        bytesReceived = std::min(bufferSize, message->m_Length);
-        memcpy(buffer, message + 1, bytesReceived);
-    }
-    free_message(message);
-    return bytesReceived;
+    return message;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -364,4 +545,14 @@ ssize_t kmessage_port_receive_deadline_ns_trw(port_id handle, handler_id* target
     return port->ReceiveMessageDeadline_trw(targetHandler, code, buffer, bufferSize, TimeValNanos::FromNanoseconds(deadline));
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t kmessage_port_receive_multiple_deadline_ns_trw(port_id handle, PMessagePortBatchEntry* entries, size_t maxCount, void* buffer, size_t bufferSize, bigtime_t deadline)
+{
+    Ptr<KMessagePort> port = KNamedObject::GetObject_trw<KMessagePort>(handle);
+    return port->ReceiveMultipleDeadline_trw(entries, maxCount, buffer, bufferSize, TimeValNanos::FromNanoseconds(deadline));
+}
+
 } // namespace kernel
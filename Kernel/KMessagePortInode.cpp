@@ -0,0 +1,85 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 17.10.2026 10:00
+
+#include <sys/stat.h>
+
+#include <Kernel/KAddressValidation.h>
+#include <Kernel/KMessagePort.h>
+#include <Kernel/KMessagePortInode.h>
+#include <Kernel/VFS/KDriverManager.h>
+#include <System/ExceptionHandling.h>
+
+
+namespace kernel
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KMessagePortInode::Initialize()
+{
+    kregister_device_root_trw("kernel/message_ports", ptr_new<KMessagePortInode>());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KMessagePortInode::KMessagePortInode()
+    : KInode(nullptr, nullptr, this, S_IFCHR | S_IRUSR | S_IRGRP | S_IROTH)
+{
+    m_DeviceControlDispatcher.AddHandler(&PMessagePortControl::ReceiveMultiple, this, &KMessagePortInode::ReceiveMultiple);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KMessagePortInode::ReadStat(Ptr<KFSVolume> volume, Ptr<KInode> inode, struct stat* statBuf)
+{
+    KFilesystemFileOps::ReadStat(volume, inode, statBuf);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KMessagePortInode::DeviceControl(Ptr<KFileNode> file, int request, const void* inData, size_t inDataLength, void* outData, size_t outDataLength)
+{
+    m_DeviceControlDispatcher.Dispatch(request, inData, inDataLength, outData, outDataLength);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t KMessagePortInode::ReceiveMultiple(port_id port, PMessagePortBatchEntry* entries, size_t maxCount, void* buffer, size_t bufferSize, bigtime_t deadline) const
+{
+    size_t entriesSize;
+    if (__builtin_mul_overflow(maxCount, sizeof(PMessagePortBatchEntry), &entriesSize)) {
+        PERROR_THROW_CODE(PErrorCode::INVAL);
+    }
+    validate_user_write_pointer_trw(entries, entriesSize);
+    validate_user_write_pointer_trw(buffer, bufferSize);
+
+    return kmessage_port_receive_multiple_deadline_ns_trw(port, entries, maxCount, buffer, bufferSize, deadline);
+}
+
+} // namespace kernel
@@ -17,6 +17,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 // Created: 04.03.2018 22:38:38
 
+#include <algorithm>
 #include <string.h>
 
 #include <Kernel/KTime.h>
@@ -47,6 +48,12 @@ KMutex::~KMutex()
     if (m_WaitQueue.GetFirst() != nullptr) {
         panic("KMutex destructed while threads waiting for it\n");
     }
+#ifdef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    CRITICAL_BEGIN(CRITICAL_IRQ)
+    {
+        ClearExclusiveHolder();
+    } CRITICAL_END;
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -56,16 +63,20 @@ KMutex::~KMutex()
 PErrorCode KMutex::Lock(bool interruptible)
 {
     KThreadCB* thread = gk_CurrentThread;
+
+    if (TryLockFast(thread)) {
+        return PErrorCode::Success;
+    }
     for (;;)
     {
         KThreadWaitNode waitNode;
 
         CRITICAL_BEGIN(CRITICAL_IRQ)
         {
-            if (m_Count == 0 || (m_RecursionMode == PEMutexRecursionMode_Recurse && m_Holder == thread->GetHandle()))
+            if (m_Count.GetCount() == 0 || (m_RecursionMode == PEMutexRecursionMode_Recurse && m_Holder == thread->GetHandle()))
             {
-                m_Count--;
-                m_Holder = thread->GetHandle();
+                m_Count.AddCount(-1);
+                SetExclusiveHolder(thread);
                 return PErrorCode::Success;
             }
             else
@@ -79,6 +90,7 @@ PErrorCode KMutex::Lock(bool interruptible)
             thread->SetState(ThreadState_Waiting);
             m_WaitQueue.Append(&waitNode);
             thread->SetBlockingObject(this);
+            BeginWait(thread);
 
             KSWITCH_CONTEXT();
         } CRITICAL_END;
@@ -87,15 +99,16 @@ PErrorCode KMutex::Lock(bool interruptible)
         {
             waitNode.Detatch();
             thread->SetBlockingObject(nullptr);
+            EndWait(thread);
             
             if (waitNode.m_TargetDeleted) {
                 return PErrorCode::INVAL;
             }
             
-            if (m_Count == 0)
+            if (m_Count.GetCount() == 0)
             {
-                m_Count--;
-                m_Holder = thread->GetHandle();
+                m_Count.AddCount(-1);
+                SetExclusiveHolder(thread);
                 return PErrorCode::Success;
             }
         } CRITICAL_END;
@@ -121,6 +134,10 @@ PErrorCode KMutex::LockDeadline(TimeValNanos deadline, bool interruptible)
 PErrorCode KMutex::LockClock(int clockID, TimeValNanos clockDeadline, bool interruptible)
 {
     KThreadCB* thread = gk_CurrentThread;
+
+    if (TryLockFast(thread)) {
+        return PErrorCode::Success;
+    }
     
     TimeValNanos deadline;
     const PErrorCode result = kconvert_clock_to_monotonic(clockID, clockDeadline, deadline);
@@ -135,10 +152,10 @@ PErrorCode KMutex::LockClock(int clockID, TimeValNanos clockDeadline, bool inter
 
         CRITICAL_BEGIN(CRITICAL_IRQ)
         {
-            if (m_Count == 0 || (m_RecursionMode == PEMutexRecursionMode_Recurse && m_Holder == thread->GetHandle()))
+            if (m_Count.GetCount() == 0 || (m_RecursionMode == PEMutexRecursionMode_Recurse && m_Holder == thread->GetHandle()))
             {
-                m_Count--;
-                m_Holder = thread->GetHandle();
+                m_Count.AddCount(-1);
+                SetExclusiveHolder(thread);
                 return PErrorCode::Success;
             }
             else
@@ -156,6 +173,7 @@ PErrorCode KMutex::LockClock(int clockID, TimeValNanos clockDeadline, bool inter
                 waitNode.m_Thread = thread;
 
                 m_WaitQueue.Append(&waitNode);
+                BeginWait(thread);
                 if (!deadline.IsInfinit())
                 {
                     thread->SetState(ThreadState_Sleeping);
@@ -180,6 +198,7 @@ PErrorCode KMutex::LockClock(int clockID, TimeValNanos clockDeadline, bool inter
         {
             waitNode.Detatch();
             sleepNode.Detatch();
+            EndWait(thread);
             
             if (waitNode.m_TargetDeleted) {
                 return PErrorCode::INVAL;
@@ -205,12 +224,16 @@ PErrorCode KMutex::TryLock()
 {
     KThreadCB* thread = gk_CurrentThread;
 
+    if (TryLockFast(thread)) {
+        return PErrorCode::Success;
+    }
+
     CRITICAL_SCOPE(CRITICAL_IRQ);
 
-    if (m_Count == 0 || (m_RecursionMode == PEMutexRecursionMode_Recurse && m_Holder == thread->GetHandle()))
+    if (m_Count.GetCount() == 0 || (m_RecursionMode == PEMutexRecursionMode_Recurse && m_Holder == thread->GetHandle()))
     {
-        m_Count--;
-        m_Holder = thread->GetHandle();
+        m_Count.AddCount(-1);
+        SetExclusiveHolder(thread);
         return PErrorCode::Success;
     }
 
@@ -223,19 +246,26 @@ PErrorCode KMutex::TryLock()
 
 PErrorCode KMutex::Unlock()
 {
+    if (TryUnlockFast()) {
+        return PErrorCode::Success;
+    }
+
     CRITICAL_SCOPE(CRITICAL_IRQ);
 
-    if (m_Count < 0) {
-        m_Count++;
-    } else if (m_Count > 0) {
-        m_Count--;
+    if (m_Count.GetCount() < 0) {
+        m_Count.AddCount(1);
+    } else if (m_Count.GetCount() > 0) {
+        m_Count.AddCount(-1);
     } else {
         return PErrorCode::INVAL;
     }
 
-    if (m_Count == 0) {
-        m_Holder = -1;
-        if (wakeup_wait_queue(&m_WaitQueue, 0, 0)) KSWITCH_CONTEXT();
+    if (m_Count.GetCount() == 0)
+    {
+        const bool priorityChanged = ClearExclusiveHolder();
+        const bool needSchedule = wakeup_wait_queue(&m_WaitQueue, 0, 0);
+        m_Count.ClearWaiters();
+        if (needSchedule || priorityChanged) KSWITCH_CONTEXT();
     }
 
     return PErrorCode::Success;
@@ -248,21 +278,26 @@ PErrorCode KMutex::Unlock()
 PErrorCode KMutex::LockShared(bool interruptible)
 {
     KThreadCB* thread = gk_CurrentThread;
+
+    if (TryLockSharedFast()) {
+        return PErrorCode::Success;
+    }
     for (;;)
     {
         KThreadWaitNode waitNode;
 
         CRITICAL_BEGIN(CRITICAL_IRQ)
         {
-            if (m_Count >= 0)
+            if (m_Count.GetCount() >= 0)
             {
-                m_Count++;
+                m_Count.AddCount(1);
                 return PErrorCode::Success;
             }
             waitNode.m_Thread = thread;
             thread->SetState(ThreadState_Waiting);
             m_WaitQueue.Append(&waitNode);
             thread->SetBlockingObject(this);
+            BeginWait(thread);
 
             KSWITCH_CONTEXT();
         } CRITICAL_END;
@@ -271,14 +306,15 @@ PErrorCode KMutex::LockShared(bool interruptible)
         {
             waitNode.Detatch();
             thread->SetBlockingObject(nullptr);
+            EndWait(thread);
 
             if (waitNode.m_TargetDeleted) {
                 return PErrorCode::INVAL;
             }
             
-            if (m_Count >= 0)
+            if (m_Count.GetCount() >= 0)
             {
-                m_Count++;
+                m_Count.AddCount(1);
                 return PErrorCode::Success;
             }
         } CRITICAL_END;
@@ -304,6 +340,10 @@ PErrorCode KMutex::LockSharedDeadline(TimeValNanos deadline, bool interruptible)
 PErrorCode KMutex::LockSharedClock(clockid_t clockID, TimeValNanos clockDeadline, bool interruptible)
 {
     KThreadCB* thread = gk_CurrentThread;
+
+    if (TryLockSharedFast()) {
+        return PErrorCode::Success;
+    }
     
     TimeValNanos deadline;
     const PErrorCode result = kconvert_clock_to_monotonic(clockID, clockDeadline, deadline);
@@ -318,9 +358,9 @@ PErrorCode KMutex::LockSharedClock(clockid_t clockID, TimeValNanos clockDeadline
 
         CRITICAL_BEGIN(CRITICAL_IRQ)
         {
-            if (m_Count >= 0)
+            if (m_Count.GetCount() >= 0)
             {
-                m_Count++;
+                m_Count.AddCount(1);
                 return PErrorCode::Success;
             }
             if (deadline.IsInfinit() || kget_monotonic_time() < deadline)
@@ -331,6 +371,7 @@ PErrorCode KMutex::LockSharedClock(clockid_t clockID, TimeValNanos clockDeadline
                 waitNode.m_Thread      = thread;
 
                 m_WaitQueue.Append(&waitNode);
+                BeginWait(thread);
                 if (!deadline.IsInfinit())
                 {
                     thread->SetState(ThreadState_Sleeping);
@@ -355,12 +396,15 @@ PErrorCode KMutex::LockSharedClock(clockid_t clockID, TimeValNanos clockDeadline
         {
             waitNode.Detatch();
             sleepNode.Detatch();
+            EndWait(thread);
 
             if (waitNode.m_TargetDeleted) {
                 return PErrorCode::INVAL;
             }
             
-            if (wakeup_wait_queue(&m_WaitQueue, 0, 0)) KSWITCH_CONTEXT();
+            const bool needSchedule = wakeup_wait_queue(&m_WaitQueue, 0, 0);
+            m_Count.ClearWaiters();
+            if (needSchedule) KSWITCH_CONTEXT();
         } CRITICAL_END;
     }
 }
@@ -380,11 +424,15 @@ PErrorCode KMutex::LockSharedTimeout(TimeValNanos timeout, bool interruptible)
 
 PErrorCode KMutex::TryLockShared()
 {
+    if (TryLockSharedFast()) {
+        return PErrorCode::Success;
+    }
+
     CRITICAL_SCOPE(CRITICAL_IRQ);
 
-    if (m_Count >= 0)
+    if (m_Count.GetCount() >= 0)
     {
-        m_Count++;
+        m_Count.AddCount(1);
         return PErrorCode::Success;
     }
 
@@ -397,7 +445,268 @@ PErrorCode KMutex::TryLockShared()
 
 bool KMutex::IsLocked() const
 {
-    return !(m_Count == 0 || m_Holder != gk_CurrentThread->GetHandle());
+    return !(m_Count.GetCount() == 0 || m_Holder != gk_CurrentThread->GetHandle());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Take an unlocked mutex for exclusive access without disabling interrupts.
+/// Fails if the mutex is locked or has waiters. Priority inheritance need to
+/// link the mutex into the holder's owner list with interrupts disabled, so
+/// with that enabled the slow path is always used.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool KMutex::TryLockFast(KThreadCB* thread) noexcept
+{
+#ifndef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    if (m_Count.TryExchange(0, -1))
+    {
+        m_Holder = thread->GetHandle();
+        return true;
+    }
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool KMutex::TryLockSharedFast() noexcept
+{
+    return m_Count.TryAdd(1, 1, KLockWord::MAX_COUNT);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Release a shared or non-recursive exclusive lock without disabling
+/// interrupts. Fails if there might be waiters to wake up.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool KMutex::TryUnlockFast() noexcept
+{
+    const int32_t count = m_Count.GetCount();
+    if (count > 0) {
+        return m_Count.TryAdd(-1, 0, KLockWord::MAX_COUNT);
+    }
+#ifndef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    if (count == -1)
+    {
+        // Clear the holder before releasing, as it belong to the next owner
+        // as soon as the count hit zero. Nobody else can touch it while we
+        // still hold the lock, so it is safe to restore on failure.
+        const thread_id holder = m_Holder;
+        m_Holder = INVALID_HANDLE;
+        if (m_Count.TryExchange(-1, 0)) {
+            return true;
+        }
+        m_Holder = holder;
+    }
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Record the thread that took the mutex for exclusive access. With priority
+/// inheritance enabled the mutex is also linked into the holder's list of
+/// owned mutexes, so waiters arriving later can boost it.
+/// Must be called with interrupts disabled.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KMutex::SetExclusiveHolder(KThreadCB* thread) noexcept
+{
+    m_Holder = thread->GetHandle();
+#ifdef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    if (m_HolderThread != thread)
+    {
+        m_HolderThread = thread;
+        m_NextOwnedMutex = thread->m_FirstOwnedMutex;
+        thread->m_FirstOwnedMutex = this;
+
+        if (m_WaitQueue.GetFirst() != nullptr) {
+            kmutex_update_inherited_priority(thread);
+        }
+    }
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Forget the exclusive holder and drop any priority it inherited through
+/// this mutex. Returns true if the holder's effective priority changed.
+/// Must be called with interrupts disabled.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool KMutex::ClearExclusiveHolder() noexcept
+{
+    m_Holder = INVALID_HANDLE;
+#ifdef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    KThreadCB* const thread = m_HolderThread;
+    if (thread != nullptr)
+    {
+        for (KMutex** link = &thread->m_FirstOwnedMutex; *link != nullptr; link = &(*link)->m_NextOwnedMutex)
+        {
+            if (*link == this)
+            {
+                *link = m_NextOwnedMutex;
+                break;
+            }
+        }
+        m_HolderThread   = nullptr;
+        m_NextOwnedMutex = nullptr;
+        return kmutex_update_inherited_priority(thread);
+    }
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Called after "thread" has been added to the wait queue. Flags the lock word
+/// so the fast paths back off, and propagates the waiter's priority to the
+/// exclusive holder (and whatever it is blocked on).
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KMutex::BeginWait(KThreadCB* thread) noexcept
+{
+    m_Count.SetWaiters();
+#ifdef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    thread->m_WaitingForMutex = this;
+    if (m_HolderThread != nullptr && m_HolderThread->m_PriorityLevel < thread->m_PriorityLevel) {
+        kmutex_update_inherited_priority(m_HolderThread);
+    }
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Called after "thread" has been removed from the wait queue. If it left
+/// because of a timeout or a signal the holder might not deserve the boost
+/// anymore, and if it was the last waiter the fast paths can be used again.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KMutex::EndWait(KThreadCB* thread) noexcept
+{
+    if (m_WaitQueue.IsEmpty()) {
+        m_Count.ClearWaiters();
+    }
+#ifdef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    thread->m_WaitingForMutex = nullptr;
+    if (m_HolderThread != nullptr && m_HolderThread != thread) {
+        kmutex_update_inherited_priority(m_HolderThread);
+    }
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+}
+
+#ifdef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+int KMutex::GetHighestWaiterLevel() const noexcept
+{
+    int level = 0;
+    for (const KThreadWaitNode* waitNode : m_WaitQueue)
+    {
+        if (waitNode->m_Thread != nullptr) {
+            level = std::max(level, waitNode->m_Thread->m_PriorityLevel);
+        }
+    }
+    return level;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Returns the highest effective priority level among threads waiting for
+/// any mutex exclusively held by "thread", or 0 if there are no waiters.
+/// Must be called with interrupts disabled.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+int kmutex_get_inherited_priority_level(const KThreadCB* thread) noexcept
+{
+    int level = 0;
+    for (const KMutex* mutex = thread->m_FirstOwnedMutex; mutex != nullptr; mutex = mutex->m_NextOwnedMutex) {
+        level = std::max(level, mutex->GetHighestWaiterLevel());
+    }
+    return level;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Recalculate the effective priority of "thread" from its base priority and
+/// the waiters of the mutexes it holds. If it changes, the thread is moved to
+/// the right ready list and the change is propagated to the holder of the
+/// mutex "thread" is blocked on, if any. Returns true if the effective
+/// priority of "thread" itself changed.
+/// Must be called with interrupts disabled.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool kmutex_update_inherited_priority(KThreadCB* thread) noexcept
+{
+    bool changed = false;
+    for (int depth = 0; thread != nullptr && depth < KMUTEX_MAX_INHERITANCE_DEPTH; ++depth)
+    {
+        const int prevLevel = thread->m_PriorityLevel;
+        const int newLevel  = std::max(thread->m_BasePriorityLevel, kmutex_get_inherited_priority_level(thread));
+
+        if (newLevel == prevLevel) {
+            break;
+        }
+        if (depth == 0) {
+            changed = true;
+        }
+        if (newLevel > thread->m_BasePriorityLevel)
+        {
+            if (prevLevel == thread->m_BasePriorityLevel) {
+                thread->m_PriorityInversionCount++;
+            }
+            thread->m_MaxPriorityBoost = std::max(thread->m_MaxPriorityBoost, newLevel - thread->m_BasePriorityLevel);
+        }
+        const bool requeue = remove_thread_from_ready_list(thread);
+        thread->m_PriorityLevel = newLevel;
+        if (requeue) {
+            add_thread_to_ready_list(thread);
+        }
+        thread = (thread->m_WaitingForMutex != nullptr) ? thread->m_WaitingForMutex->m_HolderThread : nullptr;
+    }
+    return changed;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Called when the priority of "thread" has been changed while it might be
+/// blocked on a mutex, to let the holder of that mutex follow the change.
+/// Must be called with interrupts disabled.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void kmutex_waiter_priority_changed(KThreadCB* thread) noexcept
+{
+    if (thread->m_WaitingForMutex != nullptr && thread->m_WaitingForMutex->m_HolderThread != nullptr) {
+        kmutex_update_inherited_priority(thread->m_WaitingForMutex->m_HolderThread);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Detach all mutexes still held by a thread that is being destroyed.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void kmutex_disown_all(KThreadCB* thread) noexcept
+{
+    CRITICAL_SCOPE(CRITICAL_IRQ);
+
+    while (thread->m_FirstOwnedMutex != nullptr)
+    {
+        KMutex* const mutex = thread->m_FirstOwnedMutex;
+        thread->m_FirstOwnedMutex = mutex->m_NextOwnedMutex;
+        mutex->m_HolderThread   = nullptr;
+        mutex->m_NextOwnedMutex = nullptr;
+    }
+    thread->m_WaitingForMutex = nullptr;
+}
+
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+
 } // namespace kernel
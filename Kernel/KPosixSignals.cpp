@@ -28,6 +28,7 @@
 #include <Kernel/KStackFrames.h>
 #include <Kernel/KPosixSignals.h>
 #include <Kernel/KCapabilities.h>
+#include <Kernel/KSlabCache.h>
 #include <Threads/ThreadUserspaceState.h>
 
 namespace kernel
@@ -35,8 +36,7 @@ namespace kernel
 
 #ifdef PADOS_MODULE_POSIX_SIGNALS
 
-KSignalQueueNode* gk_FirstFreeSignalQueueNode = nullptr;
-size_t            gk_FreeSignalQueueNodeCount = 0;
+static KObjectCache<KSignalQueueNode> gk_SignalQueueNodeCache("signal_queue_node");
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
@@ -697,23 +697,11 @@ PErrorCode kkillpg_pl(const KProcessGroup& group, int sigNum)
 
 KSignalQueueNode* kalloc_signal_queue_node()
 {
-    {
-        KSchedulerLock slock;
-
-        if (gk_FirstFreeSignalQueueNode != nullptr)
-        {
-            KSignalQueueNode* node = gk_FirstFreeSignalQueueNode;
-            gk_FirstFreeSignalQueueNode = node->Next;
-            gk_FreeSignalQueueNodeCount--;
-            node->Next = nullptr;
-            return node;
-        }
-    }
-    try {
-        return new KSignalQueueNode;
-    } catch(std::exception& exc) {
-        return nullptr;
+    KSignalQueueNode* node = gk_SignalQueueNodeCache.Construct();
+    if (node != nullptr) {
+        node->Next = nullptr;
     }
+    return node;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -722,11 +710,7 @@ KSignalQueueNode* kalloc_signal_queue_node()
 
 void kfree_signal_queue_node(KSignalQueueNode* node)
 {
-    KSchedulerLock slock;
-
-    node->Next = gk_FirstFreeSignalQueueNode;
-    gk_FirstFreeSignalQueueNode = node;
-    gk_FreeSignalQueueNodeCount++;
+    gk_SignalQueueNodeCache.Destroy(node);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
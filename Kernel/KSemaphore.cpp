@@ -39,9 +39,8 @@ static std::map<PString, Ptr<KSemaphore>> gk_PublicSemaphores;
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-KSemaphore::KSemaphore(const char* name, clockid_t clockID, int count) : KNamedObject(name, KNamedObjectType::Semaphore), m_ClockID(clockID)
+KSemaphore::KSemaphore(const char* name, clockid_t clockID, int count) : KNamedObject(name, KNamedObjectType::Semaphore), m_Count(count), m_ClockID(clockID)
 {
-    m_Count = count;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -62,21 +61,26 @@ KSemaphore::~KSemaphore()
 PErrorCode KSemaphore::Acquire()
 {
     KThreadCB* thread = gk_CurrentThread;
+
+    if (TryAcquireFast(thread)) {
+        return PErrorCode::Success;
+    }
     for (;;)
     {
         KThreadWaitNode waitNode;
 
         CRITICAL_BEGIN(CRITICAL_IRQ)
         {
-            if (m_Count > 0)
+            if (m_Count.GetCount() > 0)
             {
-                m_Count--;
+                m_Count.AddCount(-1);
                 m_Holder = thread->GetHandle();
                 return PErrorCode::Success;
             }
             waitNode.m_Thread = thread;
             thread->SetState(ThreadState_Waiting);
             m_WaitQueue.Append(&waitNode);
+            m_Count.SetWaiters();
             thread->SetBlockingObject(this);
 
             KSWITCH_CONTEXT();
@@ -86,12 +90,15 @@ PErrorCode KSemaphore::Acquire()
         {
         	thread->SetBlockingObject(nullptr);
             waitNode.Detatch();
+            if (m_WaitQueue.IsEmpty()) {
+                m_Count.ClearWaiters();
+            }
             if (waitNode.m_TargetDeleted) {
                 return PErrorCode::INVAL;
             }
-            if (m_Count > 0)
+            if (m_Count.GetCount() > 0)
             {
-                m_Count--;
+                m_Count.AddCount(-1);
                 m_Holder = thread->GetHandle();
                 return PErrorCode::Success;
             }
@@ -115,6 +122,10 @@ PErrorCode KSemaphore::AcquireDeadline(TimeValNanos deadline)
 PErrorCode KSemaphore::AcquireClock(clockid_t clockID, TimeValNanos clockDeadline)
 {
     KThreadCB* thread = gk_CurrentThread;
+
+    if (TryAcquireFast(thread)) {
+        return PErrorCode::Success;
+    }
     
     TimeValNanos deadline;
     const PErrorCode result = kconvert_clock_to_monotonic(clockID, clockDeadline, deadline);
@@ -128,9 +139,9 @@ PErrorCode KSemaphore::AcquireClock(clockid_t clockID, TimeValNanos clockDeadlin
 
         CRITICAL_BEGIN(CRITICAL_IRQ)
         {
-            if (m_Count > 0)
+            if (m_Count.GetCount() > 0)
             {
-                m_Count--;
+                m_Count.AddCount(-1);
                 m_Holder = thread->GetHandle();
                 return PErrorCode::Success;
             }
@@ -139,6 +150,7 @@ PErrorCode KSemaphore::AcquireClock(clockid_t clockID, TimeValNanos clockDeadlin
                 waitNode.m_Thread = thread;
 
                 m_WaitQueue.Append(&waitNode);
+                m_Count.SetWaiters();
                 if (!deadline.IsInfinit())
                 {
                     thread->SetState(ThreadState_Sleeping);
@@ -165,6 +177,9 @@ PErrorCode KSemaphore::AcquireClock(clockid_t clockID, TimeValNanos clockDeadlin
             thread->SetBlockingObject(nullptr);
             waitNode.Detatch();
             sleepNode.Detatch();
+            if (m_WaitQueue.IsEmpty()) {
+                m_Count.ClearWaiters();
+            }
             if (waitNode.m_TargetDeleted) {
                 return PErrorCode::INVAL;
             }
@@ -189,11 +204,15 @@ PErrorCode KSemaphore::TryAcquire()
 {
     KThreadCB* thread = gk_CurrentThread;
 
+    if (TryAcquireFast(thread)) {
+        return PErrorCode::Success;
+    }
+
     CRITICAL_BEGIN(CRITICAL_IRQ)
     {
-        if (m_Count > 0)
+        if (m_Count.GetCount() > 0)
         {
-            m_Count--;
+            m_Count.AddCount(-1);
             m_Holder = thread->GetHandle();
             return PErrorCode::Success;
         }
@@ -207,20 +226,62 @@ PErrorCode KSemaphore::TryAcquire()
 
 PErrorCode KSemaphore::Release()
 {
+    if (m_Count.TryAdd(1, 1, MAX_COUNT))
+    {
+        m_Holder = -1;
+        return PErrorCode::Success;
+    }
     CRITICAL_BEGIN(CRITICAL_IRQ)
     {
-        if (m_Count == SEM_VALUE_MAX) {
+        if (m_Count.GetCount() >= MAX_COUNT) {
             return PErrorCode::OVERFLOW;
         }
-        m_Count++;
+        m_Count.AddCount(1);
 
-        if (m_Count > 0) {
+        if (m_Count.GetCount() > 0)
+        {
             m_Holder = -1;
-            if (wakeup_wait_queue(&m_WaitQueue, 0, m_Count)) KSWITCH_CONTEXT();
+            const bool needSchedule = wakeup_wait_queue(&m_WaitQueue, 0, m_Count.GetCount());
+            if (m_WaitQueue.IsEmpty()) {
+                m_Count.ClearWaiters();
+            }
+            if (needSchedule) KSWITCH_CONTEXT();
         }
     } CRITICAL_END;
 
     return PErrorCode::Success;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Set the count, without waking any waiting threads. Fails with INVAL if
+/// "count" is above MAX_COUNT or below what a KLockWord can hold.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+PErrorCode KSemaphore::SetCount(int count)
+{
+    if (count > MAX_COUNT || count < KLockWord::MIN_COUNT) {
+        return PErrorCode::INVAL;
+    }
+    CRITICAL_SCOPE(CRITICAL_IRQ);
+    m_Count.SetCount(count);
+    return PErrorCode::Success;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Take one count without disabling interrupts. Fails if the count is zero or
+/// if there are threads in the wait queue that should be served first.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool KSemaphore::TryAcquireFast(KThreadCB* thread) noexcept
+{
+    if (m_Count.TryAdd(-1, 0, MAX_COUNT))
+    {
+        m_Holder = thread->GetHandle();
+        return true;
+    }
+    return false;
+}
+
 } // namespace kernel
@@ -0,0 +1,257 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 16:00
+
+#include <stdlib.h>
+
+#include <new>
+
+#include <Kernel/KSlabCache.h>
+#include <Kernel/KSchedulerLock.h>
+
+namespace kernel
+{
+
+static KSlabCache* gk_FirstSlabCache = nullptr;
+
+static KSlabCache gk_SizeClassCaches[] =
+{
+    KSlabCache("kslab-32",  32),
+    KSlabCache("kslab-48",  48),
+    KSlabCache("kslab-64",  64),
+    KSlabCache("kslab-96",  96),
+    KSlabCache("kslab-128", 128),
+    KSlabCache("kslab-192", 192),
+    KSlabCache("kslab-256", 256),
+    KSlabCache("kslab-384", 384, 8),
+    KSlabCache("kslab-512", KSLAB_MAX_SIZE_CLASS, 8)
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KSlabCache::~KSlabCache()
+{
+    {
+        KSchedulerLock slock;
+        for (KSlabCache** i = &gk_FirstSlabCache; *i != nullptr; i = &(*i)->m_NextCache)
+        {
+            if (*i == this)
+            {
+                *i = m_NextCache;
+                break;
+            }
+        }
+    }
+    while (m_FirstSlab != nullptr)
+    {
+        Slab* slab = m_FirstSlab;
+        m_FirstSlab = slab->Next;
+        free(slab);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Allocate one object. Returns nullptr if the cache is empty and a new
+/// slab could not be allocated.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* KSlabCache::Allocate() noexcept
+{
+    for (;;)
+    {
+        {
+            KSchedulerLock slock;
+
+            FreeObject* object = m_FreeList;
+            if (object != nullptr)
+            {
+                m_FreeList = object->Next;
+                m_AllocCount++;
+                if (++m_ObjectsInUse > m_MaxObjectsInUse) {
+                    m_MaxObjectsInUse = m_ObjectsInUse;
+                }
+                return object;
+            }
+        }
+        if (!Grow())
+        {
+            KSchedulerLock slock;
+            m_FailedCount++;
+            return nullptr;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* KSlabCache::Allocate_trw()
+{
+    void* object = Allocate();
+    if (object == nullptr) {
+        throw std::bad_alloc();
+    }
+    return object;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KSlabCache::Free(void* object) noexcept
+{
+    if (object == nullptr) {
+        return;
+    }
+    FreeObject* freeObject = static_cast<FreeObject*>(object);
+
+    KSchedulerLock slock;
+
+    freeObject->Next = m_FreeList;
+    m_FreeList = freeObject;
+    m_ObjectsInUse--;
+    m_FreeCount++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KSlabCacheStats KSlabCache::GetStats() const noexcept
+{
+    KSchedulerLock slock;
+
+    KSlabCacheStats stats;
+    stats.Name              = m_Name;
+    stats.ObjectSize        = m_ObjectSize;
+    stats.ObjectsPerSlab    = m_ObjectsPerSlab;
+    stats.SlabCount         = m_SlabCount;
+    stats.ObjectsInUse      = m_ObjectsInUse;
+    stats.MaxObjectsInUse   = m_MaxObjectsInUse;
+    stats.AllocCount        = m_AllocCount;
+    stats.FreeCount         = m_FreeCount;
+    stats.FailedCount       = m_FailedCount;
+    return stats;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KSlabCache* KSlabCache::GetFirstCache() noexcept
+{
+    return gk_FirstSlabCache;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Allocate a new slab and add all it's objects to the free list. The slab
+/// is allocated without holding the scheduler lock, so several threads
+/// might grow the cache at the same time. That only cost some extra memory.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool KSlabCache::Grow() noexcept
+{
+    Slab* slab = static_cast<Slab*>(malloc(sizeof(Slab) + m_ObjectSize * m_ObjectsPerSlab));
+    if (slab == nullptr) {
+        return false;
+    }
+    FreeObject* first = nullptr;
+    for (size_t i = m_ObjectsPerSlab; i > 0; --i)
+    {
+        FreeObject* object = reinterpret_cast<FreeObject*>(&slab->Objects[(i - 1) * m_ObjectSize]);
+        object->Next = first;
+        first = object;
+    }
+    FreeObject* last = reinterpret_cast<FreeObject*>(&slab->Objects[(m_ObjectsPerSlab - 1) * m_ObjectSize]);
+
+    KSchedulerLock slock;
+
+    if (m_FirstSlab == nullptr)
+    {
+        m_NextCache = gk_FirstSlabCache;
+        gk_FirstSlabCache = this;
+    }
+    slab->Next  = m_FirstSlab;
+    m_FirstSlab = slab;
+    m_SlabCount++;
+
+    last->Next = m_FreeList;
+    m_FreeList = first;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+static KSlabCache* get_size_class_cache(size_t size) noexcept
+{
+    for (KSlabCache& cache : gk_SizeClassCaches)
+    {
+        if (size <= cache.GetObjectSize()) {
+            return &cache;
+        }
+    }
+    return nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* kslab_alloc(size_t size) noexcept
+{
+    KSlabCache* cache = get_size_class_cache(size);
+    return (cache != nullptr) ? cache->Allocate() : malloc(size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* kslab_alloc_trw(size_t size)
+{
+    void* object = kslab_alloc(size);
+    if (object == nullptr) {
+        throw std::bad_alloc();
+    }
+    return object;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Free memory allocated with kslab_alloc(). The size must be the same
+/// as was passed to kslab_alloc().
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void kslab_free(void* object, size_t size) noexcept
+{
+    KSlabCache* cache = get_size_class_cache(size);
+    if (cache != nullptr) {
+        cache->Free(object);
+    } else {
+        free(object);
+    }
+}
+
+} // namespace kernel
@@ -0,0 +1,171 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 21:00
+
+#include <assert.h>
+#include <utility>
+
+#include <Kernel/KSleepQueue.h>
+
+namespace kernel
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool KThreadWaitNode::DetatchFromSleepQueue()
+{
+    m_SleepQueue->Remove(this);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KSleepQueue::Insert(KThreadWaitNode* node) noexcept
+{
+    assert(node->m_SleepQueue == nullptr);
+
+    node->m_SleepQueue = this;
+    node->m_HeapChild  = nullptr;
+    node->m_HeapNext   = nullptr;
+    node->m_HeapPrev   = nullptr;
+
+    m_Root = (m_Root != nullptr) ? Merge(m_Root, node) : node;
+    m_NodeCount++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KSleepQueue::Remove(KThreadWaitNode* node) noexcept
+{
+    assert(node->m_SleepQueue == this);
+
+    if (node == m_Root)
+    {
+        RemoveFirst();
+        return;
+    }
+    // Unlink the node (and its sub-heap) from the sibling list.
+    if (node->m_HeapPrev->m_HeapChild == node) {
+        node->m_HeapPrev->m_HeapChild = node->m_HeapNext;
+    } else {
+        node->m_HeapPrev->m_HeapNext = node->m_HeapNext;
+    }
+    if (node->m_HeapNext != nullptr) {
+        node->m_HeapNext->m_HeapPrev = node->m_HeapPrev;
+    }
+    KThreadWaitNode* const subHeap = MergePairs(node->m_HeapChild);
+    if (subHeap != nullptr) {
+        m_Root = Merge(m_Root, subHeap);
+    }
+    node->m_SleepQueue = nullptr;
+    node->m_HeapChild  = nullptr;
+    node->m_HeapNext   = nullptr;
+    node->m_HeapPrev   = nullptr;
+    m_NodeCount--;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KThreadWaitNode* KSleepQueue::RemoveFirst() noexcept
+{
+    KThreadWaitNode* const node = m_Root;
+    if (node != nullptr)
+    {
+        m_Root = MergePairs(node->m_HeapChild);
+
+        node->m_SleepQueue = nullptr;
+        node->m_HeapChild  = nullptr;
+        m_NodeCount--;
+    }
+    return node;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Merge two heap roots. The root with the later resume time becomes the
+/// first child of the other.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KThreadWaitNode* KSleepQueue::Merge(KThreadWaitNode* first, KThreadWaitNode* second) noexcept
+{
+    if (second->m_ResumeTime < first->m_ResumeTime) {
+        std::swap(first, second);
+    }
+    second->m_HeapPrev = first;
+    second->m_HeapNext = first->m_HeapChild;
+    if (first->m_HeapChild != nullptr) {
+        first->m_HeapChild->m_HeapPrev = second;
+    }
+    first->m_HeapChild = second;
+    return first;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Standard two-pass pairing of a sibling list: merge pairs left to right,
+/// then fold the results together right to left.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KThreadWaitNode* KSleepQueue::MergePairs(KThreadWaitNode* first) noexcept
+{
+    if (first == nullptr) {
+        return nullptr;
+    }
+    // First pass. The merged pairs are chained in reverse order through m_HeapNext.
+    KThreadWaitNode* pairs = nullptr;
+    while (first != nullptr)
+    {
+        KThreadWaitNode* node1 = first;
+        KThreadWaitNode* node2 = node1->m_HeapNext;
+
+        first = (node2 != nullptr) ? node2->m_HeapNext : nullptr;
+
+        node1->m_HeapNext = nullptr;
+        node1->m_HeapPrev = nullptr;
+        if (node2 != nullptr)
+        {
+            node2->m_HeapNext = nullptr;
+            node2->m_HeapPrev = nullptr;
+            node1 = Merge(node1, node2);
+        }
+        node1->m_HeapNext = pairs;
+        pairs = node1;
+    }
+    // Second pass.
+    KThreadWaitNode* result = pairs;
+    pairs = pairs->m_HeapNext;
+    result->m_HeapNext = nullptr;
+    while (pairs != nullptr)
+    {
+        KThreadWaitNode* const next = pairs->m_HeapNext;
+        pairs->m_HeapNext = nullptr;
+        result = Merge(result, pairs);
+        pairs = next;
+    }
+    return result;
+}
+
+} // namespace kernel
@@ -0,0 +1,581 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 18:30
+
+#include <stddef.h>
+#include <new>
+
+#include <Kernel/KTLSFPool.h>
+
+namespace kernel
+{
+
+static inline int find_last_set(size_t value) noexcept  { return 63 - __builtin_clzll(value); }
+static inline int find_first_set(uint32_t value) noexcept { return __builtin_ctz(value); }
+static inline size_t align_up(size_t value, size_t alignment) noexcept   { return (value + alignment - 1) & ~(alignment - 1); }
+static inline size_t align_down(size_t value, size_t alignment) noexcept { return value & ~(alignment - 1); }
+
+///////////////////////////////////////////////////////////////////////////////
+/// Initialize a pool covering the given memory. The control structure is
+/// placed at the start of the memory. Returns nullptr if the memory is too
+/// small to hold the control structure and at least one block.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KTLSFPool* KTLSFPool::Create(void* memory, size_t size) noexcept
+{
+    static_assert(offsetof(BlockHeader, NextFree) == BLOCK_START_OFFSET);
+
+    const uintptr_t memoryStart = align_up(uintptr_t(memory), alignof(KTLSFPool));
+    const uintptr_t memoryEnd   = uintptr_t(memory) + size;
+
+    if (memoryStart + sizeof(KTLSFPool) >= memoryEnd) {
+        return nullptr;
+    }
+    const uintptr_t firstPayload = align_up(memoryStart + sizeof(KTLSFPool) + BLOCK_START_OFFSET, ALIGNMENT);
+    if (firstPayload + BLOCK_HEADER_OVERHEAD >= memoryEnd) {
+        return nullptr;
+    }
+    size_t blockSize = align_down(memoryEnd - firstPayload - BLOCK_HEADER_OVERHEAD, ALIGNMENT);
+    if (blockSize < BLOCK_SIZE_MIN) {
+        return nullptr;
+    }
+    if (blockSize >= BLOCK_SIZE_MAX) {
+        blockSize = BLOCK_SIZE_MAX - ALIGNMENT;
+    }
+    KTLSFPool* pool = new (reinterpret_cast<void*>(memoryStart)) KTLSFPool();
+
+    pool->m_PoolStart = reinterpret_cast<const void*>(firstPayload);
+    pool->m_PoolEnd   = reinterpret_cast<const void*>(firstPayload + blockSize);
+    pool->m_TotalSize = blockSize;
+
+    BlockHeader* block = BlockFromPointer(reinterpret_cast<void*>(firstPayload));
+    block->Size = blockSize | BLOCK_FREE_BIT;
+    pool->InsertFreeBlock(block);
+
+    // Zero-sized sentinel block terminating the pool.
+    BlockHeader* sentinel = LinkNext(block);
+    sentinel->Size = BLOCK_PREV_FREE_BIT;
+
+    return pool;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* KTLSFPool::Allocate(size_t size) noexcept
+{
+    const size_t adjustedSize = AdjustRequestSize(size, ALIGNMENT);
+    return PrepareUsed(LocateFree(adjustedSize), adjustedSize);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Allocate a block with the payload aligned to the given power-of-two.
+/// A large enough block is located, and the unaligned start is split off
+/// and returned to the free lists.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* KTLSFPool::AllocateAligned(size_t alignment, size_t size) noexcept
+{
+    if (alignment <= ALIGNMENT) {
+        return Allocate(size);
+    }
+    const size_t adjustedSize = AdjustRequestSize(size, ALIGNMENT);
+    if (adjustedSize == 0) {
+        m_FailedCount++;
+        return nullptr;
+    }
+    BlockHeader* block = LocateFree(AdjustRequestSize(adjustedSize + alignment + GAP_MINIMUM, alignment));
+    if (block != nullptr)
+    {
+        const uintptr_t pointer = uintptr_t(BlockToPointer(block));
+        uintptr_t aligned = align_up(pointer, alignment);
+        size_t    gap     = aligned - pointer;
+
+        // The leading gap must be big enough to become a free block of its own.
+        if (gap != 0 && gap < GAP_MINIMUM)
+        {
+            const size_t gapRemain = GAP_MINIMUM - gap;
+            aligned = align_up(aligned + ((gapRemain > alignment) ? gapRemain : alignment), alignment);
+            gap     = aligned - pointer;
+        }
+        if (gap != 0) {
+            block = TrimFreeLeading(block, gap);
+        }
+    }
+    return PrepareUsed(block, adjustedSize);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KTLSFPool::Free(void* pointer) noexcept
+{
+    if (pointer == nullptr) {
+        return;
+    }
+    BlockHeader* block = BlockFromPointer(pointer);
+
+    m_UsedSize -= GetBlockSize(block);
+    m_FreeCount++;
+
+    MarkAsFree(block);
+    block = MergePrev(block);
+    block = MergeNext(block);
+    InsertFreeBlock(block);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Try to grow or shrink an allocation without moving it. Growing is only
+/// possible if the following block is free and large enough.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool KTLSFPool::ResizeInPlace(void* pointer, size_t size) noexcept
+{
+    BlockHeader*        block        = BlockFromPointer(pointer);
+    const BlockHeader*  next         = GetNextBlock(block);
+    const size_t        currentSize  = GetBlockSize(block);
+    const size_t        combinedSize = currentSize + GetBlockSize(next) + BLOCK_HEADER_OVERHEAD;
+    const size_t        adjustedSize = AdjustRequestSize(size, ALIGNMENT);
+
+    if (adjustedSize == 0 || (adjustedSize > currentSize && (!IsFree(next) || adjustedSize > combinedSize))) {
+        return false;
+    }
+    if (adjustedSize > currentSize)
+    {
+        MergeNext(block);
+        MarkAsUsed(block);
+    }
+    TrimUsed(block, adjustedSize);
+
+    m_UsedSize = m_UsedSize - currentSize + GetBlockSize(block);
+    if (m_UsedSize > m_MaxUsedSize) {
+        m_MaxUsedSize = m_UsedSize;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t KTLSFPool::GetAllocationSize(const void* pointer) noexcept
+{
+    return GetBlockSize(BlockFromPointer(pointer));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Collect pool statistics. Finding the largest free block require
+/// scanning the highest non-empty free list, so this is not O(1).
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KHeapPoolStats KTLSFPool::GetStats() const noexcept
+{
+    KHeapPoolStats stats;
+    stats.TotalSize         = m_TotalSize;
+    stats.UsedSize          = m_UsedSize;
+    stats.MaxUsedSize       = m_MaxUsedSize;
+    stats.FreeSize          = m_FreeSize;
+    stats.LargestFreeBlock  = 0;
+    stats.FreeBlockCount    = m_FreeBlockCount;
+    stats.AllocCount        = m_AllocCount;
+    stats.FreeCount         = m_FreeCount;
+    stats.FailedCount       = m_FailedCount;
+
+    if (m_FLBitmap != 0)
+    {
+        const int fl = 31 - __builtin_clz(m_FLBitmap);
+        const int sl = 31 - __builtin_clz(m_SLBitmap[fl]);
+        for (const BlockHeader* block = m_Blocks[fl][sl]; block != nullptr; block = block->NextFree)
+        {
+            if (GetBlockSize(block) > stats.LargestFreeBlock) {
+                stats.LargestFreeBlock = GetBlockSize(block);
+            }
+        }
+    }
+    stats.FragmentationPercent = (m_FreeSize != 0) ? uint32_t(100 - uint64_t(stats.LargestFreeBlock) * 100 / m_FreeSize) : 0;
+    return stats;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KTLSFPool::SetPrevFree(BlockHeader* block, bool isFree) noexcept
+{
+    if (isFree) {
+        block->Size |= BLOCK_PREV_FREE_BIT;
+    } else {
+        block->Size &= ~BLOCK_PREV_FREE_BIT;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KTLSFPool::BlockHeader* KTLSFPool::BlockFromPointer(const void* pointer) noexcept
+{
+    return reinterpret_cast<BlockHeader*>(const_cast<uint8_t*>(static_cast<const uint8_t*>(pointer)) - BLOCK_START_OFFSET);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* KTLSFPool::BlockToPointer(BlockHeader* block) noexcept
+{
+    return reinterpret_cast<uint8_t*>(block) + BLOCK_START_OFFSET;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// The next block's size field start right after this block's payload.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KTLSFPool::BlockHeader* KTLSFPool::GetNextBlock(const BlockHeader* block) noexcept
+{
+    return reinterpret_cast<BlockHeader*>(reinterpret_cast<uintptr_t>(block) + BLOCK_START_OFFSET + GetBlockSize(block) - SIZE_FIELD_OFFSET);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KTLSFPool::BlockHeader* KTLSFPool::LinkNext(BlockHeader* block) noexcept
+{
+    BlockHeader* next = GetNextBlock(block);
+    next->PrevPhysBlock = block;
+    return next;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KTLSFPool::MarkAsFree(BlockHeader* block) noexcept
+{
+    BlockHeader* next = LinkNext(block);
+    SetPrevFree(next, true);
+    block->Size |= BLOCK_FREE_BIT;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KTLSFPool::MarkAsUsed(BlockHeader* block) noexcept
+{
+    SetPrevFree(GetNextBlock(block), false);
+    block->Size &= ~BLOCK_FREE_BIT;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Split a block in two, keeping "size" bytes in the first. The second
+/// block is marked free but not inserted in the free lists.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KTLSFPool::BlockHeader* KTLSFPool::Split(BlockHeader* block, size_t size) noexcept
+{
+    BlockHeader* remaining = reinterpret_cast<BlockHeader*>(static_cast<uint8_t*>(BlockToPointer(block)) + size - SIZE_FIELD_OFFSET);
+    const size_t remainingSize = GetBlockSize(block) - (size + BLOCK_HEADER_OVERHEAD);
+
+    remaining->Size = remainingSize;
+    SetBlockSize(block, size);
+    MarkAsFree(remaining);
+    return remaining;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KTLSFPool::BlockHeader* KTLSFPool::Absorb(BlockHeader* prev, BlockHeader* block) noexcept
+{
+    prev->Size += GetBlockSize(block) + BLOCK_HEADER_OVERHEAD;
+    LinkNext(prev);
+    return prev;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Round the size up to the allocation granularity. Returns 0 if the
+/// request can never be satisfied.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t KTLSFPool::AdjustRequestSize(size_t size, size_t alignment) noexcept
+{
+    if (size >= BLOCK_SIZE_MAX) {
+        return 0;
+    }
+    const size_t aligned = align_up(size, alignment);
+    if (aligned >= BLOCK_SIZE_MAX) {
+        return 0;
+    }
+    return (aligned > BLOCK_SIZE_MIN) ? aligned : BLOCK_SIZE_MIN;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Calculate the free list holding blocks of the given size.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KTLSFPool::MappingInsert(size_t size, int& outFL, int& outSL) noexcept
+{
+    if (size < SMALL_BLOCK_SIZE)
+    {
+        outFL = 0;
+        outSL = int(size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT));
+    }
+    else
+    {
+        const int fl = find_last_set(size);
+        outSL = int((size >> (fl - SL_INDEX_COUNT_LOG2)) ^ (size_t(1) << SL_INDEX_COUNT_LOG2));
+        outFL = fl - (FL_INDEX_SHIFT - 1);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Calculate the first free list where every block is at least "size"
+/// bytes, by rounding the size up to the next list boundary.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KTLSFPool::MappingSearch(size_t size, int& outFL, int& outSL) noexcept
+{
+    if (size >= SMALL_BLOCK_SIZE) {
+        size += (size_t(1) << (find_last_set(size) - SL_INDEX_COUNT_LOG2)) - 1;
+    }
+    MappingInsert(size, outFL, outSL);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KTLSFPool::BlockHeader* KTLSFPool::SearchSuitableBlock(int& inOutFL, int& inOutSL) noexcept
+{
+    uint32_t slMap = m_SLBitmap[inOutFL] & (~0u << inOutSL);
+    if (slMap == 0)
+    {
+        const uint32_t flMap = (inOutFL + 1 < 32) ? (m_FLBitmap & (~0u << (inOutFL + 1))) : 0;
+        if (flMap == 0) {
+            return nullptr;
+        }
+        inOutFL = find_first_set(flMap);
+        slMap   = m_SLBitmap[inOutFL];
+    }
+    inOutSL = find_first_set(slMap);
+    return m_Blocks[inOutFL][inOutSL];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KTLSFPool::InsertFreeBlock(BlockHeader* block) noexcept
+{
+    int fl;
+    int sl;
+    MappingInsert(GetBlockSize(block), fl, sl);
+
+    BlockHeader* current = m_Blocks[fl][sl];
+    block->NextFree = current;
+    block->PrevFree = nullptr;
+    if (current != nullptr) {
+        current->PrevFree = block;
+    }
+    m_Blocks[fl][sl] = block;
+    m_FLBitmap     |= 1u << fl;
+    m_SLBitmap[fl] |= 1u << sl;
+
+    m_FreeSize += GetBlockSize(block);
+    m_FreeBlockCount++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KTLSFPool::RemoveFreeBlock(BlockHeader* block) noexcept
+{
+    int fl;
+    int sl;
+    MappingInsert(GetBlockSize(block), fl, sl);
+    RemoveFreeBlock(block, fl, sl);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KTLSFPool::RemoveFreeBlock(BlockHeader* block, int fl, int sl) noexcept
+{
+    BlockHeader* prev = block->PrevFree;
+    BlockHeader* next = block->NextFree;
+
+    if (next != nullptr) {
+        next->PrevFree = prev;
+    }
+    if (prev != nullptr)
+    {
+        prev->NextFree = next;
+    }
+    else
+    {
+        m_Blocks[fl][sl] = next;
+        if (next == nullptr)
+        {
+            m_SLBitmap[fl] &= ~(1u << sl);
+            if (m_SLBitmap[fl] == 0) {
+                m_FLBitmap &= ~(1u << fl);
+            }
+        }
+    }
+    m_FreeSize -= GetBlockSize(block);
+    m_FreeBlockCount--;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KTLSFPool::BlockHeader* KTLSFPool::MergePrev(BlockHeader* block) noexcept
+{
+    if (IsPrevFree(block))
+    {
+        BlockHeader* prev = block->PrevPhysBlock;
+        RemoveFreeBlock(prev);
+        block = Absorb(prev, block);
+    }
+    return block;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KTLSFPool::BlockHeader* KTLSFPool::MergeNext(BlockHeader* block) noexcept
+{
+    BlockHeader* next = GetNextBlock(block);
+    if (IsFree(next))
+    {
+        RemoveFreeBlock(next);
+        block = Absorb(block, next);
+    }
+    return block;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Return the tail of a free block beyond "size" bytes to the free lists.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KTLSFPool::TrimFree(BlockHeader* block, size_t size) noexcept
+{
+    if (CanSplit(block, size))
+    {
+        BlockHeader* remaining = Split(block, size);
+        LinkNext(block);
+        SetPrevFree(remaining, true);
+        InsertFreeBlock(remaining);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Return the tail of a used block beyond "size" bytes to the free lists.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KTLSFPool::TrimUsed(BlockHeader* block, size_t size) noexcept
+{
+    if (CanSplit(block, size))
+    {
+        BlockHeader* remaining = Split(block, size);
+        SetPrevFree(remaining, false);
+        remaining = MergeNext(remaining);
+        InsertFreeBlock(remaining);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Split "gap" bytes off the start of a free block and return them to the
+/// free lists. Returns the remaining block.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KTLSFPool::BlockHeader* KTLSFPool::TrimFreeLeading(BlockHeader* block, size_t gap) noexcept
+{
+    BlockHeader* remaining = Split(block, gap - BLOCK_HEADER_OVERHEAD);
+    SetPrevFree(remaining, true);
+    LinkNext(block);
+    InsertFreeBlock(block);
+    return remaining;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KTLSFPool::BlockHeader* KTLSFPool::LocateFree(size_t size) noexcept
+{
+    if (size == 0) {
+        return nullptr;
+    }
+    int fl;
+    int sl;
+    MappingSearch(size, fl, sl);
+    if (fl >= FL_INDEX_COUNT) {
+        return nullptr;
+    }
+    BlockHeader* block = SearchSuitableBlock(fl, sl);
+    if (block != nullptr) {
+        RemoveFreeBlock(block, fl, sl);
+    }
+    return block;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void* KTLSFPool::PrepareUsed(BlockHeader* block, size_t size) noexcept
+{
+    if (block == nullptr)
+    {
+        m_FailedCount++;
+        return nullptr;
+    }
+    TrimFree(block, size);
+    MarkAsUsed(block);
+
+    m_UsedSize += GetBlockSize(block);
+    if (m_UsedSize > m_MaxUsedSize) {
+        m_MaxUsedSize = m_UsedSize;
+    }
+    m_AllocCount++;
+    return BlockToPointer(block);
+}
+
+} // namespace kernel
@@ -29,6 +29,7 @@
 #include <Kernel/KThreadCB.h>
 #include <Kernel/Scheduler.h>
 #include <Kernel/KHandleArray.h>
+#include <Kernel/KMutex.h>
 #include <Kernel/KTime.h>
 #include <Kernel/KLogging.h>
 #include <Threads/ThreadUserspaceState.h>
@@ -514,8 +515,15 @@ void kthread_set_priority_trw(thread_id handle, int priority)
     {
         if (thread->GetState() != ThreadState_Deleted)
         {
-            const int prevPriorityLevel = thread->GetPriorityLevel();
+            const int  prevPriorityLevel = thread->GetPriorityLevel();
+            const bool requeue = remove_thread_from_ready_list(ptr_raw_pointer_cast(thread));
             thread->SetPriority(priority);
+            if (requeue) {
+                add_thread_to_ready_list(ptr_raw_pointer_cast(thread));
+            }
+#ifdef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+            kmutex_waiter_priority_changed(ptr_raw_pointer_cast(thread));
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
             if (thread != gk_CurrentThread && thread->GetPriorityLevel() > prevPriorityLevel) {
                 KSWITCH_CONTEXT();
             }
@@ -579,7 +587,7 @@ static void get_thread_info(Ptr<KThreadCB> thread, ThreadInfo* info)
     info->State = thread->GetState();
     info->Flags = 0; // thread->m_Flags;
     info->Priority = thread->GetPriority();
-    info->DynamicPri = info->Priority;
+    info->DynamicPri = thread->GetDynamicPriority();
     info->SysTimeNano = 0;   // We don't track system time yet (system calls are included in RunTime, IRQ's are not).
     info->RealTimeNano = thread->m_RunTime.AsNanoseconds();
     info->UserTimeNano = info->RealTimeNano - info->SysTimeNano;
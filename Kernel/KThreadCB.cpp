@@ -31,7 +31,9 @@
 #include <Kernel/KProcess.h>
 #include <Kernel/KThreadCB.h>
 #include <Kernel/KHandleArray.h>
+#include <Kernel/KMutex.h>
 #include <Kernel/KStackFrames.h>
+#include <Kernel/KTime.h>
 #include <Kernel/Scheduler.h>
 #include <Kernel/ThreadSyncDebugTracker.h>
 #include <Kernel/Syscalls.h>
@@ -157,7 +159,11 @@ KThreadCB::KThreadCB(
 
     m_CurrentStackAndPrivilege = (intptr_t(m_StackBuffer) - 4 + m_StackSize) & ~(KSTACK_ALIGNMENT - 1);
     m_ThreadState = ThreadState_Ready;
-    m_PriorityLevel = PriToLevel(priority);
+    m_BasePriorityLevel = PriToLevel(priority);
+    m_PriorityLevel = m_BasePriorityLevel;
+#ifdef PADOS_OPT_THREAD_LATENCY_HISTOGRAMS
+    m_ReadyTime = kget_monotonic_time_hires();
+#endif // PADOS_OPT_THREAD_LATENCY_HISTOGRAMS
 
 #ifdef PADOS_MODULE_USER_SPACE
     m_ThreadUserData = threadUserData;
@@ -187,6 +193,10 @@ KThreadCB::KThreadCB(
 
 KThreadCB::~KThreadCB()
 {
+#ifdef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    kmutex_disown_all(this);
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+
 #ifdef PADOS_MODULE_POSIX_SIGNALS
     while (m_FirstQueuedSignal != nullptr)
     {
@@ -212,6 +222,21 @@ KThreadCB::~KThreadCB()
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
+int KThreadCB::SetPriority(int priority) noexcept
+{
+    m_BasePriorityLevel = PriToLevel(priority);
+#ifdef PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    m_PriorityLevel = std::max(m_BasePriorityLevel, kmutex_get_inherited_priority_level(this));
+#else // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    m_PriorityLevel = m_BasePriorityLevel;
+#endif // PADOS_OPT_MUTEX_PRIORITY_INHERITANCE
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
 bool KThreadCB::IsMainThread() const noexcept
 {
     return GetHandle() == m_Process->GetPID();
@@ -0,0 +1,149 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 16.10.2026 10:00
+
+#include <algorithm>
+#include <sys/stat.h>
+
+#include <Kernel/KAddressValidation.h>
+#include <Kernel/KPIDNode.h>
+#include <Kernel/KThreadCB.h>
+#include <Kernel/KThreadStatsInode.h>
+#include <Kernel/Scheduler.h>
+#include <Kernel/VFS/KDriverManager.h>
+#include <System/ExceptionHandling.h>
+
+
+namespace kernel
+{
+
+static_assert(KTHREAD_LATENCY_HISTOGRAM_BUCKETS == PTHREAD_LATENCY_HISTOGRAM_BUCKETS);
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KThreadStatsInode::Initialize()
+{
+    kregister_device_root_trw("kernel/threads", ptr_new<KThreadStatsInode>());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KThreadStatsInode::KThreadStatsInode()
+    : KInode(nullptr, nullptr, this, S_IFCHR | S_IRUSR | S_IRGRP | S_IROTH)
+{
+    m_DeviceControlDispatcher.AddHandler(&PThreadStatsControl::GetSchedulingStats, this, &KThreadStatsInode::GetSchedulingStats);
+    m_DeviceControlDispatcher.AddHandler(&PThreadStatsControl::GetLatencyHistograms, this, &KThreadStatsInode::GetLatencyHistograms);
+    m_DeviceControlDispatcher.AddHandler(&PThreadStatsControl::ResetLatencyHistograms, this, &KThreadStatsInode::ResetLatencyHistograms);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KThreadStatsInode::ReadStat(Ptr<KFSVolume> volume, Ptr<KInode> inode, struct stat* statBuf)
+{
+    KFilesystemFileOps::ReadStat(volume, inode, statBuf);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KThreadStatsInode::DeviceControl(Ptr<KFileNode> file, int request, const void* inData, size_t inDataLength, void* outData, size_t outDataLength)
+{
+    m_DeviceControlDispatcher.Dispatch(request, inData, inDataLength, outData, outDataLength);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KThreadStatsInode::GetSchedulingStats(thread_id threadID, PThreadSchedulingStats* outStats) const
+{
+    validate_user_write_pointer_trw(outStats);
+
+    const Ptr<KThreadCB> thread = GetThread(threadID);
+    PThreadSchedulingStats stats;
+    CRITICAL_BEGIN(CRITICAL_IRQ)
+    {
+        stats.Priority                  = thread->GetPriority();
+        stats.DynamicPriority           = thread->GetDynamicPriority();
+        stats.MaxPriorityBoost          = thread->m_MaxPriorityBoost;
+        stats.PriorityInversionCount    = thread->m_PriorityInversionCount;
+    } CRITICAL_END;
+    *outStats = stats;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KThreadStatsInode::GetLatencyHistograms(thread_id threadID, PThreadLatencyHistograms* outHistograms) const
+{
+#ifdef PADOS_OPT_THREAD_LATENCY_HISTOGRAMS
+    validate_user_write_pointer_trw(outHistograms);
+
+    const Ptr<KThreadCB> thread = GetThread(threadID);
+    PThreadLatencyHistograms histograms;
+    CRITICAL_BEGIN(CRITICAL_IRQ)
+    {
+        std::copy(thread->m_ReadyLatencyHistogram.GetBuckets().begin(), thread->m_ReadyLatencyHistogram.GetBuckets().end(), histograms.ReadyLatency);
+        std::copy(thread->m_RunSliceHistogram.GetBuckets().begin(), thread->m_RunSliceHistogram.GetBuckets().end(), histograms.RunSlice);
+    } CRITICAL_END;
+    *outHistograms = histograms;
+#else // PADOS_OPT_THREAD_LATENCY_HISTOGRAMS
+    PERROR_THROW_CODE(PErrorCode::NOSYS);
+#endif // PADOS_OPT_THREAD_LATENCY_HISTOGRAMS
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KThreadStatsInode::ResetLatencyHistograms(thread_id threadID)
+{
+#ifdef PADOS_OPT_THREAD_LATENCY_HISTOGRAMS
+    const Ptr<KThreadCB> thread = GetThread(threadID);
+    CRITICAL_BEGIN(CRITICAL_IRQ)
+    {
+        thread->m_ReadyLatencyHistogram.Reset();
+        thread->m_RunSliceHistogram.Reset();
+    } CRITICAL_END;
+#else // PADOS_OPT_THREAD_LATENCY_HISTOGRAMS
+    PERROR_THROW_CODE(PErrorCode::NOSYS);
+#endif // PADOS_OPT_THREAD_LATENCY_HISTOGRAMS
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+Ptr<KThreadCB> KThreadStatsInode::GetThread(thread_id threadID)
+{
+    Ptr<KThreadCB> thread = kget_thread(threadID);
+    if (thread == nullptr) {
+        PERROR_THROW_CODE(PErrorCode::INVAL);
+    }
+    return thread;
+}
+
+} // namespace kernel
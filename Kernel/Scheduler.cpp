@@ -30,9 +30,12 @@
 #include <Kernel/HAL/DigitalPort.h>
 #include <Kernel/HAL/STM32/RealtimeClock.h>
 #include <Kernel/KPIDNode.h>
+#include <Kernel/KPriorityLevelMask.h>
 #include <Kernel/KThread.h>
 #include <Kernel/KProcess.h>
 #include <Kernel/KSemaphore.h>
+#include <Kernel/KSleepQueue.h>
+#include <Kernel/KTicklessIdle.h>
 #include <Kernel/Kernel.h>
 #include <Kernel/KHandleArray.h>
 #include <Kernel/KStackFrames.h>
@@ -56,7 +59,8 @@ thread_id  gk_MainThreadID;
 KThreadCB* gk_InitThread = nullptr;
 
 static KThreadList          gk_ReadyThreadLists[KTHREAD_PRIORITY_LEVELS];
-static KThreadWaitList      gk_SleepingThreads;
+static KPriorityLevelMask   gk_ReadyLevelMask; // One bit per non-empty list in gk_ReadyThreadLists.
+static KSleepQueue          gk_SleepingThreads;
 KThreadList                 gk_ZombieThreadLists;
 volatile thread_id          gk_DebugWakeupThread = 0;
 
@@ -117,8 +121,33 @@ void add_thread_to_ready_list(KThreadCB* thread)
 {
     kassert(KSchedulerLock::IsLocked());
 
+#ifdef PADOS_OPT_THREAD_LATENCY_HISTOGRAMS
+    if (thread->GetState() != ThreadState_Ready) {
+        thread->m_ReadyTime = kget_monotonic_time_hires();
+    }
+#endif // PADOS_OPT_THREAD_LATENCY_HISTOGRAMS
     thread->SetState(ThreadState_Ready);
     gk_ReadyThreadLists[thread->m_PriorityLevel].Append(thread);
+    gk_ReadyLevelMask.SetLevel(thread->m_PriorityLevel);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool remove_thread_from_ready_list(KThreadCB* thread)
+{
+    kassert(KSchedulerLock::IsLocked());
+
+    KThreadList* const list = thread->GetList();
+    if (list < &gk_ReadyThreadLists[0] || list >= &gk_ReadyThreadLists[KTHREAD_PRIORITY_LEVELS]) {
+        return false;
+    }
+    list->Remove(thread);
+    if (list->IsEmpty()) {
+        gk_ReadyLevelMask.ClearLevel(int(list - &gk_ReadyThreadLists[0]));
+    }
+    return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -197,28 +226,27 @@ extern "C" uint32_t select_thread(uint32_t * currentStack, uint32_t controlReg)
             panic("Stack overflow!\n");
             return prevThread->m_CurrentStackAndPrivilege;
         }
-        for (int i = KTHREAD_PRIORITY_LEVELS - 1; i >= 0; --i)
+        const int level = gk_ReadyLevelMask.GetHighestLevel();
+        if (level != -1 && (prevThread->GetState() != ThreadState_Running || level >= prevThread->m_PriorityLevel))
         {
-            KThreadCB* const nextThread = gk_ReadyThreadLists[i].GetFirst();
-            if (nextThread != nullptr)
-            {
-                if (prevThread->GetState() != ThreadState_Running || i >= prevThread->m_PriorityLevel)
-                {
-                    gk_ReadyThreadLists[i].Remove(nextThread);
-                    if (prevThread->GetState() == ThreadState_Running) {
-                        add_thread_to_ready_list(prevThread);
-                    }
-                    nextThread->SetState(ThreadState_Running);
-                    gk_CurrentThread = nextThread;
-                    __kernel_thread_data = gk_CurrentThread->m_KernelTLS;
+            KThreadList&     readyList  = gk_ReadyThreadLists[level];
+            KThreadCB* const nextThread = readyList.GetFirst();
+
+            readyList.Remove(nextThread);
+            if (readyList.IsEmpty()) {
+                gk_ReadyLevelMask.ClearLevel(level);
+            }
+            if (prevThread->GetState() == ThreadState_Running) {
+                add_thread_to_ready_list(prevThread);
+            }
+            nextThread->SetState(ThreadState_Running);
+            gk_CurrentThread = nextThread;
+            __kernel_thread_data = gk_CurrentThread->m_KernelTLS;
 #ifdef PADOS_MODULE_USER_SPACE
-                    __app_thread_data    = gk_CurrentThread->m_UserspaceTLS;
+            __app_thread_data    = gk_CurrentThread->m_UserspaceTLS;
 #endif // PADOS_MODULE_USER_SPACE
 
-                    nextThread->DebugValidate();
-                    break;
-                }
-            }
+            nextThread->DebugValidate();
         }
         if (prevThread->GetState() == ThreadState_Zombie) [[unlikely]]
         {
@@ -231,6 +259,14 @@ extern "C" uint32_t select_thread(uint32_t * currentStack, uint32_t controlReg)
         const TimeValNanos curTime = kget_monotonic_time_hires();
         prevThread->m_RunTime += curTime - prevThread->m_StartTime;
         gk_CurrentThread->m_StartTime = curTime;
+#ifdef PADOS_OPT_THREAD_LATENCY_HISTOGRAMS
+        if (gk_CurrentThread != prevThread)
+        {
+            prevThread->m_RunSliceHistogram.Add((curTime - prevThread->m_SliceStartTime).AsMicroseconds());
+            gk_CurrentThread->m_ReadyLatencyHistogram.Add((curTime - gk_CurrentThread->m_ReadyTime).AsMicroseconds());
+            gk_CurrentThread->m_SliceStartTime = curTime;
+        }
+#endif // PADOS_OPT_THREAD_LATENCY_HISTOGRAMS
     }
 
     if (gk_DebugWakeupThread != 0 && gk_CurrentThread->GetHandle() == gk_DebugWakeupThread) [[unlikely]]
@@ -357,6 +393,79 @@ static void wakeup_sleeping_threads()
 
 }
 
+#ifdef PADOS_OPT_TICKLESS_IDLE
+
+///////////////////////////////////////////////////////////////////////////////
+/// Called by the idle thread. Stretch the SysTick period to cover the time
+/// until the first sleeping thread should be woken, sleep, and correct the
+/// system time for the ticks that were suppressed.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void ktickless_idle() noexcept
+{
+    // Use PRIMASK rather than the scheduler lock. Interrupts masked by PRIMASK
+    // still wake the CPU from WFI, but are not serviced until the system time
+    // has been corrected.
+    __disable_irq();
+
+    if (!gk_ReadyLevelMask.IsEmpty() || (SCB->ICSR & (SCB_ICSR_PENDSTSET_Msk | SCB_ICSR_PENDSVSET_Msk)) != 0)
+    {
+        __enable_irq();
+        return;
+    }
+    const uint32_t cyclesPerTick = SysTick->LOAD + 1;
+    const uint32_t maxIdleTicks  = KTicklessIdle::GetMaxIdleTicks(cyclesPerTick);
+
+    const KThreadWaitNode* const firstSleeper = gk_SleepingThreads.GetFirst();
+    const uint32_t idleTicks = (firstSleeper != nullptr) ? KTicklessIdle::CalculateIdleTicks(Kernel::s_SystemTimeNS, firstSleeper->m_ResumeTime.AsNanoseconds(), maxIdleTicks) : maxIdleTicks;
+    if (idleTicks < 2)
+    {
+        __enable_irq();
+        return;
+    }
+    static constexpr uint32_t SYSTICK_CTRL_STOPPED = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk;
+    static constexpr uint32_t SYSTICK_CTRL_RUNNING = SYSTICK_CTRL_STOPPED | SysTick_CTRL_ENABLE_Msk;
+
+    SysTick->CTRL = SYSTICK_CTRL_STOPPED;
+    const uint32_t reloadValue = KTicklessIdle::CalculateReloadValue(SysTick->VAL, idleTicks, cyclesPerTick);
+    SysTick->LOAD = reloadValue;
+    SysTick->VAL  = 0;
+    SysTick->CTRL = SYSTICK_CTRL_RUNNING;
+
+    __DSB();
+    __WFI();
+    __ISB();
+
+    SysTick->CTRL = SYSTICK_CTRL_STOPPED;
+    const bool reachedZero = (SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk) != 0;
+    const KTicklessIdle::WakeupCorrection correction = KTicklessIdle::CalculateWakeupCorrection(reloadValue, SysTick->VAL, reachedZero, idleTicks, cyclesPerTick);
+
+    // Restart the counter with what is left of the current tick, and restore
+    // the normal period for the following ticks.
+    SysTick->LOAD = correction.RemainingCycles - 1;
+    SysTick->VAL  = 0;
+    SysTick->CTRL = SYSTICK_CTRL_RUNNING;
+    SysTick->LOAD = cyclesPerTick - 1;
+
+    Kernel::s_SystemTimeNS += bigtime_t(correction.CompletedTicks) * KTicklessIdle::NANOSECONDS_PER_TICK;
+    Kernel::s_SystemTicks  += bigtime_t(correction.CompletedTicks) * cyclesPerTick;
+
+    // If the counter wrapped, the pending SysTick interrupt will add the last
+    // tick and wake the sleeping threads. Otherwise we were woken early and
+    // only need to catch up in case the correction was rounded up.
+    if (!reachedZero)
+    {
+        wakeup_sleeping_threads();
+        if (!gk_ReadyLevelMask.IsEmpty()) {
+            KSWITCH_CONTEXT();
+        }
+    }
+    __enable_irq();
+}
+
+#endif // PADOS_OPT_TICKLESS_IDLE
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -381,17 +490,7 @@ KThreadCB& kget_current_thread()
 
 void add_to_sleep_list(KThreadWaitNode* waitNode)
 {
-    for (auto i : gk_SleepingThreads)
-    {
-        if (waitNode->m_ResumeTime <= i->m_ResumeTime)
-        {
-            gk_SleepingThreads.Insert(i, waitNode);
-            break;
-        }
-    }
-    if (!waitNode->IsListMember()) {
-        gk_SleepingThreads.Append(waitNode);
-    }
+    gk_SleepingThreads.Insert(waitNode);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -28,13 +28,16 @@
 #include <Kernel/KThreadCB.h>
 #include <Kernel/KHandleArray.h>
 #include <Kernel/KProcess.h>
+#include <Kernel/KMessagePortInode.h>
 #include <Kernel/KThread.h>
+#include <Kernel/KThreadStatsInode.h>
 #include <Kernel/KPIDNode.h>
 #include <Kernel/KTime.h>
 #include <Kernel/KLogging.h>
 #include <Kernel/VFS/KFSVolume.h>
 #include <Kernel/VFS/FileIO.h>
 #include <Kernel/VFS/KBlockCache.h>
+#include <Kernel/VFS/KBlockCacheStatsInode.h>
 #ifdef PADOS_FSDRIVER_PIPE
 #include <Kernel/VFS/KPipeFilesystem.h>
 #endif // PADOS_FSDRIVER_PIPE
@@ -159,7 +162,11 @@ static void* idle_thread_entry(void* arguments)
 {
     for (;;)
     {
+#ifdef PADOS_OPT_TICKLESS_IDLE
+        ktickless_idle();
+#else
         //        __WFI();
+#endif // PADOS_OPT_TICKLESS_IDLE
         if (gk_DebugWakeupThread != 0)
         {
             Ptr<KThreadCB> thread = kget_thread(gk_DebugWakeupThread);
@@ -239,6 +246,9 @@ static void* init_thread_entry(void* arguments)
 
     kchdir_trw(KLocateFlag::None, "/");
 
+    KThreadStatsInode::Initialize();
+    KBlockCacheStatsInode::Initialize();
+    KMessagePortInode::Initialize();
     initialize_device_drivers();
 
 #ifdef PADOS_FSDRIVER_PTY
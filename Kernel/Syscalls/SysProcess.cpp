@@ -29,6 +29,7 @@
 #include <Kernel/Scheduler.h>
 #include <Kernel/KProcess.h>
 #include <Kernel/KProcessGroups.h>
+#include <Kernel/KSemaphore.h>
 #include <Kernel/Syscalls.h>
 #include <Kernel/VFS/FileIO.h>
 
@@ -204,7 +205,9 @@ PErrorCode sys_sysconf(int name, long* outValue)
         case _SC_MQ_PRIO_MAX:                   return PErrorCode::INVAL;
         case _SC_RTSIG_MAX:                     return PErrorCode::INVAL;
         case _SC_SEM_NSEMS_MAX:                 return PErrorCode::INVAL;
-        case _SC_SEM_VALUE_MAX:                 return PErrorCode::INVAL;
+        case _SC_SEM_VALUE_MAX:
+            *outValue = KSemaphore::MAX_COUNT;
+            return PErrorCode::Success;
         case _SC_SIGQUEUE_MAX:                  return PErrorCode::INVAL;
         case _SC_TIMER_MAX:                     return PErrorCode::INVAL;
         case _SC_TZNAME_MAX:                    return PErrorCode::INVAL;
@@ -40,6 +40,9 @@ extern "C"
 
 PErrorCode sys_semaphore_create(sem_id* outHandle, const char* name, clockid_t clockID, int count)
 {
+    if (count < 0 || count > KSemaphore::MAX_COUNT) {
+        return PErrorCode::INVAL;
+    }
     try {
         return KNamedObject::RegisterObject(*outHandle, ptr_new<KSemaphore>(name, clockID, count));
     }
@@ -99,6 +102,9 @@ PErrorCode sys_semaphore_create_public(sem_id* outHandle, const char* name, cloc
             if ((flags & O_CREAT) == 0) {
                 return PErrorCode::NOENT;
             }
+            if (count < 0 || count > KSemaphore::MAX_COUNT) {
+                return PErrorCode::INVAL;
+            }
             const size_t nameLength = strlen(name);
             const size_t nameOffset = (nameLength > (OS_NAME_LENGTH - 1)) ? (nameLength - (OS_NAME_LENGTH - 1)) : 0;
 
@@ -0,0 +1,506 @@
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <map>
+
+#include <PadOS/DeviceControl.h>
+#include <System/ExceptionHandling.h>
+#include <Kernel/KMutex.h>
+#include <Kernel/KTime.h>
+#include <Kernel/KThread.h>
+#include <Kernel/VFS/FileIO.h>
+#include <Kernel/VFS/KDriverManager.h>
+#include <Kernel/VFS/KFilesystem.h>
+#include <Kernel/VFS/KFSVolume.h>
+#include <Kernel/VFS/KInode.h>
+#include <Kernel/VFS/KNameCache.h>
+#include <Kernel/VFS/KVFSManager.h>
+#include <Kernel/FSDrivers/FAT/FATFilesystem.h>
+#include <UnitTests/BenchmarkTestUtils.h>
+
+using namespace kernel;
+
+namespace FATMountTest
+{
+
+static constexpr uint32_t   SECTOR_SIZE         = 512;
+static constexpr uint32_t   RESERVED_SECTORS    = 32;
+static constexpr uint32_t   FAT_COUNT           = 2;
+static constexpr uint32_t   FSINFO_SECTOR       = 1;
+static constexpr uint32_t   BACKUP_BOOT_SECTOR  = 6;
+static constexpr uint32_t   ROOT_CLUSTER        = 2;
+static constexpr fs_id      TEST_VOLUME_ID      = 0x7ffffff0;
+static constexpr TimeValNanos SCAN_TIMEOUT      = TimeValNanos::FromSeconds(60);
+static constexpr TimeValNanos RELEASE_TIMEOUT   = TimeValNanos::FromSeconds(10);
+static constexpr const char*  MOUNT_POINT       = "/fatmount_unittest";
+
+static void PutLE16(uint8_t* buffer, size_t offset, uint16_t value)
+{
+    buffer[offset]     = uint8_t(value);
+    buffer[offset + 1] = uint8_t(value >> 8);
+}
+
+static void PutLE32(uint8_t* buffer, size_t offset, uint32_t value)
+{
+    PutLE16(buffer, offset, uint16_t(value));
+    PutLE16(buffer, offset + 2, uint16_t(value >> 16));
+}
+
+// FAT32 volume generated on the fly, with one sector per cluster so the FAT
+// is as large as possible for the volume size. The first half of the data
+// area has every fourth cluster marked as used. FSInfo has no free count,
+// so mounting it has to count the free clusters. The volume is read-only
+// unless "writable" is true, in which case written sectors are kept in
+// memory and override the generated content.
+class SyntheticFATDevice : public KInode, public KFilesystemFileOps
+{
+public:
+    SyntheticFATDevice(uint32_t clusterCount, bool writable = false)
+        : KInode(nullptr, nullptr, this, S_IFBLK | S_IRUSR | S_IRGRP | S_IROTH | (writable ? S_IWUSR : 0))
+        , m_Writable(writable)
+        , m_ClusterCount(clusterCount)
+        , m_SectorsPerFAT((clusterCount + 2) * 4 / SECTOR_SIZE + 1)
+        , m_TotalSectors(RESERVED_SECTORS + FAT_COUNT * m_SectorsPerFAT + clusterCount)
+    {
+    }
+
+    uint32_t GetExpectedFreeCount() const
+    {
+        uint32_t count = 0;
+        for (uint32_t cluster = 2; cluster < m_ClusterCount + 2; ++cluster)
+        {
+            if (GetFATEntry(cluster) == 0) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    // Size of the root directory entry with the 8.3 name "shortName", as
+    // written to the device, or -1 if there is no such entry.
+    int64_t GetRootEntrySize(const char* shortName)
+    {
+        uint8_t sector[SECTOR_SIZE];
+        ReadSector(sector, RESERVED_SECTORS + FAT_COUNT * m_SectorsPerFAT);
+        for (size_t offset = 0; offset < SECTOR_SIZE; offset += 32)
+        {
+            if (memcmp(sector + offset, shortName, 11) == 0) {
+                return int64_t(sector[offset + 28]) | (int64_t(sector[offset + 29]) << 8) | (int64_t(sector[offset + 30]) << 16) | (int64_t(sector[offset + 31]) << 24);
+            }
+        }
+        return -1;
+    }
+
+    // Add a file to the root directory, with a chain of "clusterCount"
+    // clusters starting at "firstCluster". Must be called before mounting.
+    void AddRootFile(const char* shortName, uint32_t size, uint32_t firstCluster, uint32_t clusterCount)
+    {
+        uint8_t entry[32] = {};
+        memcpy(entry, shortName, 11);
+        entry[11] = 0x20; // Archive.
+        PutLE16(entry, 20, uint16_t(firstCluster >> 16));
+        PutLE16(entry, 26, uint16_t(firstCluster & 0xffff));
+        PutLE32(entry, 28, size);
+        StoreSectors(entry, sizeof(entry), off64_t(RESERVED_SECTORS + FAT_COUNT * m_SectorsPerFAT) * SECTOR_SIZE + m_RootEntryCount++ * sizeof(entry));
+
+        for (uint32_t i = 0; i < clusterCount; ++i)
+        {
+            uint8_t fatEntry[4];
+            PutLE32(fatEntry, 0, (i == clusterCount - 1) ? 0x0fffffff : (firstCluster + i + 1));
+            for (uint32_t fat = 0; fat < FAT_COUNT; ++fat) {
+                StoreSectors(fatEntry, sizeof(fatEntry), off64_t(RESERVED_SECTORS + fat * m_SectorsPerFAT) * SECTOR_SIZE + (firstCluster + i) * 4);
+            }
+        }
+    }
+
+    virtual void ReadStat(Ptr<KFSVolume> volume, Ptr<KInode> inode, struct stat* statBuf) override
+    {
+        KFilesystemFileOps::ReadStat(volume, inode, statBuf);
+    }
+    virtual size_t Read(Ptr<KFileNode> file, void* buffer, size_t length, off64_t position) override
+    {
+        uint8_t sector[SECTOR_SIZE];
+        for (size_t offset = 0; offset < length;)
+        {
+            const off64_t sectorNum    = (position + offset) / SECTOR_SIZE;
+            const size_t  sectorOffset = size_t((position + offset) % SECTOR_SIZE);
+            const size_t  chunk        = std::min(length - offset, size_t(SECTOR_SIZE) - sectorOffset);
+            ReadSector(sector, sectorNum);
+            memcpy(static_cast<uint8_t*>(buffer) + offset, sector + sectorOffset, chunk);
+            offset += chunk;
+        }
+        return length;
+    }
+    virtual size_t Read(Ptr<KFileNode> file, const iovec_t* segments, size_t segmentCount, off64_t position) override
+    {
+        size_t length = 0;
+        for (size_t i = 0; i < segmentCount; ++i) {
+            length += Read(file, segments[i].iov_base, segments[i].iov_len, position + length);
+        }
+        return length;
+    }
+    virtual size_t Write(Ptr<KFileNode> file, const void* buffer, size_t length, off64_t position) override
+    {
+        StoreSectors(buffer, length, position);
+        WriteCount++;
+        return length;
+    }
+    virtual size_t Write(Ptr<KFileNode> file, const iovec_t* segments, size_t segmentCount, off64_t position) override
+    {
+        size_t length = 0;
+        for (size_t i = 0; i < segmentCount; ++i)
+        {
+            StoreSectors(segments[i].iov_base, segments[i].iov_len, position + length);
+            length += segments[i].iov_len;
+        }
+        WriteCount++;
+        return length;
+    }
+    virtual void DeviceControl(Ptr<KFileNode> file, int request, const void* inData, size_t inDataLength, void* outData, size_t outDataLength) override
+    {
+        if (request != DEVCTL_GET_DEVICE_GEOMETRY || outData == nullptr || outDataLength < sizeof(device_geometry)) {
+            PERROR_THROW_CODE(PErrorCode::INVAL);
+        }
+        device_geometry* geometry = static_cast<device_geometry*>(outData);
+        geometry->bytes_per_sector = SECTOR_SIZE;
+        geometry->sector_count     = m_TotalSectors;
+        geometry->read_only        = !m_Writable;
+        geometry->removable        = false;
+    }
+
+    std::atomic_int WriteCount = 0;
+
+private:
+    void ReadSector(uint8_t* sector, off64_t sectorNum)
+    {
+        CRITICAL_SCOPE(m_SectorsMutex);
+        auto written = m_WrittenSectors.find(sectorNum);
+        if (written != m_WrittenSectors.end()) {
+            memcpy(sector, written->second.data(), SECTOR_SIZE);
+        } else {
+            FillSector(sector, sectorNum);
+        }
+    }
+    void StoreSectors(const void* buffer, size_t length, off64_t position)
+    {
+        if (!m_Writable) {
+            return;
+        }
+        for (size_t offset = 0; offset < length;)
+        {
+            const off64_t sectorNum    = (position + offset) / SECTOR_SIZE;
+            const size_t  sectorOffset = size_t((position + offset) % SECTOR_SIZE);
+            const size_t  chunk        = std::min(length - offset, size_t(SECTOR_SIZE) - sectorOffset);
+
+            std::array<uint8_t, SECTOR_SIZE> sector;
+            ReadSector(sector.data(), sectorNum);
+            memcpy(sector.data() + sectorOffset, static_cast<const uint8_t*>(buffer) + offset, chunk);
+
+            CRITICAL_SCOPE(m_SectorsMutex);
+            m_WrittenSectors[sectorNum] = sector;
+            offset += chunk;
+        }
+    }
+
+    uint32_t GetFATEntry(uint32_t cluster) const
+    {
+        if (cluster == 0) return 0x0ffffff8;
+        if (cluster == 1 || cluster == ROOT_CLUSTER) return 0x0fffffff;
+        if (cluster < m_ClusterCount / 2 && (cluster % 4) == 0) return 0x0fffffff;
+        return 0;
+    }
+
+    void FillSector(uint8_t* sector, off64_t sectorNum) const
+    {
+        memset(sector, 0, SECTOR_SIZE);
+
+        if (sectorNum == 0 || sectorNum == BACKUP_BOOT_SECTOR)
+        {
+            sector[0] = 0xeb; sector[1] = 0x58; sector[2] = 0x90;
+            memcpy(sector + 0x03, "MSWIN4.1", 8);
+            PutLE16(sector, 0x0b, SECTOR_SIZE);
+            sector[0x0d] = 1;                                // Sectors per cluster.
+            PutLE16(sector, 0x0e, RESERVED_SECTORS);
+            sector[0x10] = FAT_COUNT;
+            sector[0x15] = 0xf8;                             // Media descriptor.
+            PutLE32(sector, 0x20, m_TotalSectors);
+            PutLE32(sector, 0x24, m_SectorsPerFAT);
+            PutLE32(sector, 0x2c, ROOT_CLUSTER);
+            PutLE16(sector, 0x30, FSINFO_SECTOR);
+            PutLE16(sector, 0x32, BACKUP_BOOT_SECTOR);
+            sector[0x42] = 0x29;                             // Extended boot signature.
+            memcpy(sector + 0x47, "FATMOUNT   ", 11);
+            memcpy(sector + 0x52, "FAT32   ", 8);
+            PutLE16(sector, 0x1fe, 0xaa55);
+            return;
+        }
+        if (sectorNum == FSINFO_SECTOR)
+        {
+            PutLE32(sector, 0, 0x41615252);
+            PutLE32(sector, 484, 0x61417272);
+            PutLE32(sector, 488, 0xffffffff);                // Free count unknown.
+            PutLE32(sector, 492, 0xffffffff);
+            PutLE32(sector, 508, 0xaa550000);
+            return;
+        }
+        const off64_t fatSector = sectorNum - RESERVED_SECTORS;
+        if (fatSector >= 0 && fatSector < off64_t(FAT_COUNT) * m_SectorsPerFAT)
+        {
+            const uint32_t entriesPerSector = SECTOR_SIZE / 4;
+            const uint32_t firstCluster     = uint32_t(fatSector % m_SectorsPerFAT) * entriesPerSector;
+            for (uint32_t i = 0; i < entriesPerSector && firstCluster + i < m_ClusterCount + 2; ++i) {
+                PutLE32(sector, i * 4, GetFATEntry(firstCluster + i));
+            }
+        }
+        // Everything else, including the root directory, reads as zeros.
+    }
+
+    bool     m_Writable;
+    uint32_t m_ClusterCount;
+    uint32_t m_SectorsPerFAT;
+    uint32_t m_TotalSectors;
+    uint32_t m_RootEntryCount = 0;
+
+    KMutex                                              m_SectorsMutex{"fatmount_sectors", PEMutexRecursionMode_RaiseError};
+    std::map<off64_t, std::array<uint8_t, SECTOR_SIZE>> m_WrittenSectors;
+};
+
+class FATMountFixture : public ::testing::Test
+{
+protected:
+    void CreateDevice(uint32_t clusterCount, bool writable = false)
+    {
+        m_Device       = ptr_new<SyntheticFATDevice>(clusterCount, writable);
+        m_DeviceHandle = kregister_device_root_trw("fatmount_unittest", m_Device);
+    }
+    // Mount the volume read/write at MOUNT_POINT, so it can be reached
+    // through paths.
+    void MountInNamespace()
+    {
+        kcreate_directory_trw(KLocateFlag::None, MOUNT_POINT);
+        m_HasMountPoint = true;
+
+        m_Volume = m_Filesystem->Mount(TEST_VOLUME_ID, "/dev/fatmount_unittest", 0, nullptr, 0);
+        ASSERT_NE(m_Volume, nullptr);
+        m_Volume->m_Filesystem = m_Filesystem;
+        m_Volume->m_MountPoint = klocate_inode_by_path_trw(KLocateFlag::None, nullptr, MOUNT_POINT, int(strlen(MOUNT_POINT)));
+        KVFSManager::RegisterVolume_trw(m_Volume);
+    }
+    void TearDown() override
+    {
+        if (m_Volume != nullptr) {
+            m_Filesystem->Unmount(m_Volume);
+        }
+        if (m_HasMountPoint) {
+            kremove_directory(KLocateFlag::None, MOUNT_POINT);
+        }
+        if (m_DeviceHandle != -1) {
+            kremove_device_root_trw(m_DeviceHandle);
+        }
+    }
+    // Wait for the scan thread to finish counting, and return the time it took.
+    TimeValNanos WaitForFreeCount(fs_info& fsInfo)
+    {
+        const TimeValNanos startTime = kget_monotonic_time();
+        for (;;)
+        {
+            m_Filesystem->ReadFSStat(m_Volume, &fsInfo);
+            if ((fsInfo.fi_flags & uint32_t(FSVolumeFlags::FS_FREE_BLOCKS_ESTIMATED)) == 0 || kget_monotonic_time() - startTime > SCAN_TIMEOUT) {
+                return kget_monotonic_time() - startTime;
+            }
+            ksnooze_ms(1);
+        }
+    }
+
+    Ptr<FATFilesystem>      m_Filesystem = ptr_new<FATFilesystem>();
+    Ptr<SyntheticFATDevice> m_Device;
+    Ptr<KFSVolume>          m_Volume;
+    int                     m_DeviceHandle = -1;
+    bool                    m_HasMountPoint = false;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(FATMountFixture, FreeCountIsCountedInBackground)
+{
+    CreateDevice(65536);
+    m_Volume = m_Filesystem->Mount(TEST_VOLUME_ID, "/dev/fatmount_unittest", MOUNT_READ_ONLY, nullptr, 0);
+    ASSERT_NE(m_Volume, nullptr);
+
+    fs_info fsInfo;
+    WaitForFreeCount(fsInfo);
+    EXPECT_EQ(fsInfo.fi_flags & uint32_t(FSVolumeFlags::FS_FREE_BLOCKS_ESTIMATED), 0u);
+    EXPECT_EQ(fsInfo.fi_total_blocks, 65536);
+    EXPECT_EQ(fsInfo.fi_free_blocks, m_Device->GetExpectedFreeCount());
+    EXPECT_EQ(m_Device->WriteCount, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// A name looked up in a directory is cached with the directory as parent.
+/// Removing the directory must drop that entry, or it keeps the deleted
+/// inode, and with it the directory's cluster, alive.
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(FATMountFixture, RemoveDirectoryReleasesClusters)
+{
+    CreateDevice(65536, true);
+    MountInNamespace();
+    ASSERT_NE(m_Volume, nullptr);
+
+    fs_info fsInfo;
+    WaitForFreeCount(fsInfo);
+    const off_t freeBefore = fsInfo.fi_free_blocks;
+
+    const PString directoryPath = PString(MOUNT_POINT) + "/removed";
+    const PString missingPath   = directoryPath + "/missing";
+
+    kcreate_directory_trw(KLocateFlag::None, directoryPath.c_str());
+    m_Filesystem->ReadFSStat(m_Volume, &fsInfo);
+    EXPECT_LT(fsInfo.fi_free_blocks, freeBefore);
+
+    EXPECT_ANY_THROW(klocate_inode_by_path_trw(KLocateFlag::None, nullptr, missingPath.c_str(), int(missingPath.size())));
+
+    kremove_directory_trw(KLocateFlag::None, directoryPath.c_str());
+
+    // The released inode lingers in the unused inode cache for a second or
+    // two before the filesystem is told to release it.
+    const TimeValNanos startTime = kget_monotonic_time();
+    for (;;)
+    {
+        KVFSManager::FlushInodes();
+        m_Filesystem->ReadFSStat(m_Volume, &fsInfo);
+        if (fsInfo.fi_free_blocks == freeBefore || kget_monotonic_time() - startTime > RELEASE_TIMEOUT) {
+            break;
+        }
+        ksnooze_ms(50);
+    }
+    EXPECT_EQ(fsInfo.fi_free_blocks, freeBefore);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// A file opened by path gets a name cache entry. Once the file is closed
+/// the entry must not keep the inode from being released, or the new size
+/// is not written to the directory entry until the entry is evicted.
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(FATMountFixture, CachedInodeIsWrittenBack)
+{
+    CreateDevice(65536, true);
+    MountInNamespace();
+    ASSERT_NE(m_Volume, nullptr);
+
+    const PString path = PString(MOUNT_POINT) + "/LOG.TXT";
+    uint8_t data[200];
+    memset(data, 0x42, sizeof(data));
+
+    int file = kopen_trw(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
+    EXPECT_EQ(kwrite_trw(file, data, 100), 100u);
+    kclose(file);
+
+    // Reopening by path adds a positive name cache entry for the file.
+    file = kopen_trw(path.c_str(), O_WRONLY | O_APPEND);
+    EXPECT_EQ(kwrite_trw(file, data, sizeof(data)), sizeof(data));
+    kclose(file);
+    const KNameCacheStats stats = KNameCache::GetStats();
+    EXPECT_GT(stats.EntryCount, stats.NegativeCount);
+
+    const TimeValNanos startTime = kget_monotonic_time();
+    while (m_Device->GetRootEntrySize("LOG     TXT") != 300 && kget_monotonic_time() - startTime < RELEASE_TIMEOUT)
+    {
+        KVFSManager::FlushInodes();
+        ksnooze_ms(50);
+    }
+    EXPECT_EQ(m_Device->GetRootEntrySize("LOG     TXT"), 300);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Clusters preallocated past the end of a file that was never closed, as
+/// after a crash, are released the next time a writer closes the file.
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(FATMountFixture, StalePreallocationIsReleased)
+{
+    static constexpr uint32_t CLUSTER_COUNT = 65536;
+    static constexpr uint32_t CHAIN_LENGTH  = 64;
+
+    CreateDevice(CLUSTER_COUNT, true);
+    // One cluster holds the 100 bytes, the rest is a leftover preallocation.
+    m_Device->AddRootFile("STALE   TXT", 100, CLUSTER_COUNT / 2 + 16, CHAIN_LENGTH);
+    MountInNamespace();
+    ASSERT_NE(m_Volume, nullptr);
+
+    fs_info fsInfo;
+    WaitForFreeCount(fsInfo);
+    const off_t freeBefore = fsInfo.fi_free_blocks;
+
+    // Append within the last cluster, so the write itself doesn't need the chain.
+    const PString path = PString(MOUNT_POINT) + "/STALE.TXT";
+    const uint8_t data[10] = {};
+    const int file = kopen_trw(path.c_str(), O_WRONLY | O_APPEND);
+    EXPECT_EQ(kwrite_trw(file, data, sizeof(data)), sizeof(data));
+    kclose(file);
+
+    m_Filesystem->ReadFSStat(m_Volume, &fsInfo);
+    EXPECT_EQ(fsInfo.fi_free_blocks, freeBefore + CHAIN_LENGTH - 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(FATMountFixture, UnmountDuringScan)
+{
+    CreateDevice(1024 * 1024);
+    m_Volume = m_Filesystem->Mount(TEST_VOLUME_ID, "/dev/fatmount_unittest", MOUNT_READ_ONLY, nullptr, 0);
+    ASSERT_NE(m_Volume, nullptr);
+
+    const TimeValNanos startTime = kget_monotonic_time();
+    m_Filesystem->Unmount(m_Volume);
+    m_Volume = nullptr;
+    BenchPrintf("unmount during scan %.2f ms", (kget_monotonic_time() - startTime).AsSeconds() * 1000.0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Mount latency and time until the free count is known, for a range of
+/// volume sizes. Probe() counts synchronously, which is what mounting used
+/// to do.
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(FATMountFixture, MountLatencyBenchmark)
+{
+    for (uint32_t clusterCount = 65536; clusterCount <= 1024 * 1024; clusterCount *= 4)
+    {
+        CreateDevice(clusterCount);
+
+        TimeValNanos startTime = kget_monotonic_time();
+        fs_info      probeInfo;
+        ASSERT_EQ(m_Filesystem->Probe("/dev/fatmount_unittest", &probeInfo), PErrorCode::Success);
+        const TimeValNanos probeTime = kget_monotonic_time() - startTime;
+        EXPECT_EQ(probeInfo.fi_free_blocks, m_Device->GetExpectedFreeCount());
+
+        startTime = kget_monotonic_time();
+        m_Volume = m_Filesystem->Mount(TEST_VOLUME_ID, "/dev/fatmount_unittest", MOUNT_READ_ONLY, nullptr, 0);
+        const TimeValNanos mountTime = kget_monotonic_time() - startTime;
+        ASSERT_NE(m_Volume, nullptr);
+
+        fs_info fsInfo;
+        const TimeValNanos scanTime = WaitForFreeCount(fsInfo);
+        EXPECT_EQ(fsInfo.fi_free_blocks, m_Device->GetExpectedFreeCount());
+
+        m_Filesystem->Unmount(m_Volume);
+        m_Volume = nullptr;
+        kremove_device_root_trw(m_DeviceHandle);
+        m_DeviceHandle = -1;
+
+        BenchPrintf("FAT32 %7u clusters: synchronous count %8.2f ms, mount %6.2f ms, free count after %8.2f ms",
+            clusterCount, probeTime.AsSeconds() * 1000.0, mountTime.AsSeconds() * 1000.0, (mountTime + scanTime).AsSeconds() * 1000.0);
+    }
+}
+
+} // namespace FATMountTest
@@ -0,0 +1,492 @@
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <Kernel/KThread.h>
+#include <Kernel/KTime.h>
+#include <Kernel/VFS/FileIO.h>
+#include <Kernel/VFS/KBlockCache.h>
+#include <Kernel/VFS/KDriverManager.h>
+#include <Kernel/VFS/KFilesystem.h>
+#include <Kernel/VFS/KInode.h>
+#include <UnitTests/BenchmarkTestUtils.h>
+
+using namespace kernel;
+
+namespace KBlockCacheTest
+{
+
+static constexpr off64_t    TEST_DEVICE_BLOCK_COUNT = 4096;
+static constexpr off64_t    BENCHMARK_WORKING_SET   = 1024;
+static constexpr int        BENCHMARK_MAX_THREADS   = 4;
+static constexpr TimeValNanos BENCHMARK_DURATION    = TimeValNanos::FromMilliseconds(250);
+
+// Block device where every byte of a block holds the low 8 bits of the
+// block number. Writes are counted, and the first byte written to each
+// block is recorded in WrittenBlocks.
+class TestBlockDevice : public KInode, public KFilesystemFileOps
+{
+public:
+    TestBlockDevice() : KInode(nullptr, nullptr, this, S_IFBLK | S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) {}
+
+    virtual void ReadStat(Ptr<KFSVolume> volume, Ptr<KInode> inode, struct stat* statBuf) override
+    {
+        KFilesystemFileOps::ReadStat(volume, inode, statBuf);
+    }
+    virtual size_t Read(Ptr<KFileNode> file, void* buffer, size_t length, off64_t position) override
+    {
+        Fill(buffer, length, position);
+        ReadCount++;
+        return length;
+    }
+    virtual size_t Read(Ptr<KFileNode> file, const iovec_t* segments, size_t segmentCount, off64_t position) override
+    {
+        size_t length = 0;
+        for (size_t i = 0; i < segmentCount; ++i)
+        {
+            Fill(segments[i].iov_base, segments[i].iov_len, position + length);
+            length += segments[i].iov_len;
+        }
+        ReadCount++;
+        return length;
+    }
+    virtual size_t Write(Ptr<KFileNode> file, const void* buffer, size_t length, off64_t position) override
+    {
+        Record(buffer, length, position);
+        WriteCount++;
+        return length;
+    }
+    virtual size_t Write(Ptr<KFileNode> file, const iovec_t* segments, size_t segmentCount, off64_t position) override
+    {
+        // The data is captured before OnVectorWrite is called, like a DMA
+        // transfer that has already started reading the buffers.
+        std::vector<std::vector<uint8_t>> data;
+        size_t length = 0;
+        for (size_t i = 0; i < segmentCount; ++i)
+        {
+            const uint8_t* segment = static_cast<const uint8_t*>(segments[i].iov_base);
+            data.emplace_back(segment, segment + segments[i].iov_len);
+            length += segments[i].iov_len;
+        }
+        if (OnVectorWrite)
+        {
+            std::function<void()> callback = std::move(OnVectorWrite);
+            OnVectorWrite = nullptr;
+            callback();
+        }
+        size_t offset = 0;
+        for (const std::vector<uint8_t>& segment : data)
+        {
+            Record(segment.data(), segment.size(), position + offset);
+            offset += segment.size();
+        }
+        WriteCount++;
+        return length;
+    }
+    static void Fill(void* buffer, size_t length, off64_t position)
+    {
+        for (size_t offset = 0; offset < length; offset += KBlockCache::MIN_BLOCK_SIZE) {
+            memset(static_cast<uint8_t*>(buffer) + offset, uint8_t((position + offset) / KBlockCache::MIN_BLOCK_SIZE), std::min(length - offset, size_t(KBlockCache::MIN_BLOCK_SIZE)));
+        }
+    }
+    void Record(const void* buffer, size_t length, off64_t position)
+    {
+        for (size_t offset = 0; offset < length; offset += KBlockCache::MIN_BLOCK_SIZE) {
+            WrittenBlocks[(position + offset) / KBlockCache::MIN_BLOCK_SIZE] = static_cast<const uint8_t*>(buffer)[offset];
+        }
+    }
+    std::atomic_int                 ReadCount = 0;
+    std::atomic_int                 WriteCount = 0;
+    std::map<off64_t, uint8_t>      WrittenBlocks;
+    std::function<void()>           OnVectorWrite;
+};
+
+class BlockCacheReader : public KThread
+{
+public:
+    BlockCacheReader(KBlockCache& cache, uint32_t seed, const std::atomic_bool& stop) : KThread("bcache_bench"), m_Cache(cache), m_Random(seed), m_Stop(stop) {}
+
+    virtual void* Run() override
+    {
+        std::uniform_int_distribution<off64_t> blockDist(0, BENCHMARK_WORKING_SET - 1);
+        while (!m_Stop)
+        {
+            const off64_t   blockNum = blockDist(m_Random);
+            KCacheBlockDesc block    = m_Cache.GetBlock_trw(blockNum);
+            if (*static_cast<const uint8_t*>(block.m_Buffer) != uint8_t(blockNum)) {
+                Errors++;
+            }
+            Lookups++;
+        }
+        return nullptr;
+    }
+    uint64_t        Lookups = 0;
+    uint64_t        Errors = 0;
+private:
+    KBlockCache&            m_Cache;
+    std::mt19937            m_Random;
+    const std::atomic_bool& m_Stop;
+};
+
+class KBlockCacheFixture : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        m_Device       = ptr_new<TestBlockDevice>();
+        m_DeviceHandle = kregister_device_root_trw("bcache_unittest", m_Device);
+        m_DeviceFile   = kopen_trw("/dev/bcache_unittest", O_RDWR);
+        ASSERT_TRUE(m_Cache.SetDevice(m_DeviceFile, TEST_DEVICE_BLOCK_COUNT, KBlockCache::MIN_BLOCK_SIZE));
+    }
+    void TearDown() override
+    {
+        m_Cache.SetDevice(-1, 0, 0);
+        kclose(m_DeviceFile);
+        kremove_device_root_trw(m_DeviceHandle);
+    }
+    Ptr<TestBlockDevice>    m_Device;
+    int                     m_DeviceHandle = -1;
+    int                     m_DeviceFile = -1;
+    KBlockCache             m_Cache;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KCacheBlockMap, MatchesReferenceMap)
+{
+    std::vector<KCacheBlockHeader>          blocks(2000);
+    std::vector<KCacheBlockHeader*>         freeBlocks;
+    std::map<off64_t, KCacheBlockHeader*>   reference;
+    KCacheBlockMap                          map;
+    std::mt19937                            random(1234);
+
+    for (KCacheBlockHeader& block : blocks) {
+        freeBlocks.push_back(&block);
+    }
+    for (int i = 0; i < 100000; ++i)
+    {
+        const off64_t key = random() % 3000;
+        auto          ref = reference.find(key);
+        switch (random() % 3)
+        {
+            case 0:
+                if (ref == reference.end() && !freeBlocks.empty())
+                {
+                    KCacheBlockHeader* block = freeBlocks.back();
+                    freeBlocks.pop_back();
+                    block->m_bufferNumber = key;
+                    map.Insert_trw(block);
+                    reference[key] = block;
+                }
+                break;
+            case 1:
+                if (ref != reference.end())
+                {
+                    ASSERT_TRUE(map.Remove(ref->second));
+                    freeBlocks.push_back(ref->second);
+                    reference.erase(ref);
+                }
+                break;
+            default:
+                ASSERT_EQ(map.Find(key), (ref != reference.end()) ? ref->second : nullptr);
+                break;
+        }
+        ASSERT_EQ(map.GetCount(), reference.size());
+    }
+    for (const auto& [key, block] : reference) {
+        EXPECT_EQ(map.Find(key), block);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KBlockCacheFixture, HitDoesNotReload)
+{
+    {
+        KCacheBlockDesc block = m_Cache.GetBlock_trw(17);
+        EXPECT_EQ(*static_cast<const uint8_t*>(block.m_Buffer), 17);
+    }
+    const int readCount = m_Device->ReadCount;
+    KCacheBlockDesc block = m_Cache.GetBlock_trw(17);
+    EXPECT_EQ(*static_cast<const uint8_t*>(block.m_Buffer), 17);
+    EXPECT_EQ(m_Device->ReadCount, readCount);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KBlockCacheFixture, SequentialReadsAreBatched)
+{
+    static constexpr off64_t FIRST_BLOCK = 2000;
+    static constexpr off64_t BLOCK_COUNT = 256;
+
+    const int readCount = m_Device->ReadCount;
+    for (off64_t blockNum = FIRST_BLOCK; blockNum < FIRST_BLOCK + BLOCK_COUNT; ++blockNum)
+    {
+        KCacheBlockDesc block = m_Cache.GetBlock_trw(blockNum);
+        ASSERT_EQ(*static_cast<const uint8_t*>(block.m_Buffer), uint8_t(blockNum));
+    }
+    const KBlockCacheStats stats = m_Cache.GetStats();
+    EXPECT_LT(m_Device->ReadCount - readCount, BLOCK_COUNT / 4);
+    EXPECT_GT(stats.ReadAheadHits, 0u);
+    EXPECT_LE(stats.ReadAheadHits, stats.ReadAheadBlocks);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KBlockCacheFixture, RandomReadsDontReadAhead)
+{
+    const KBlockCacheStats before = m_Cache.GetStats();
+    for (off64_t i = 0; i < 100; ++i) {
+        m_Cache.GetBlock_trw((i * 37) % TEST_DEVICE_BLOCK_COUNT);
+    }
+    EXPECT_EQ(m_Cache.GetStats().ReadAheadBlocks, before.ReadAheadBlocks);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KBlockCacheFixture, MetadataSurvivesSequentialScan)
+{
+    static constexpr off64_t METADATA_BLOCK_COUNT = 8;
+    static constexpr off64_t SCAN_BLOCK_COUNT     = TEST_DEVICE_BLOCK_COUNT * 4;
+
+    // Make the device larger than the whole cache.
+    m_Cache.SetDevice(-1, 0, 0);
+    ASSERT_TRUE(m_Cache.SetDevice(m_DeviceFile, METADATA_BLOCK_COUNT + SCAN_BLOCK_COUNT, KBlockCache::MIN_BLOCK_SIZE));
+
+    for (off64_t blockNum = 0; blockNum < METADATA_BLOCK_COUNT; ++blockNum) {
+        m_Cache.GetBlock_trw(blockNum, true, true);
+    }
+    for (off64_t blockNum = METADATA_BLOCK_COUNT; blockNum < METADATA_BLOCK_COUNT + SCAN_BLOCK_COUNT; ++blockNum)
+    {
+        KCacheBlockDesc block = m_Cache.GetBlock_trw(blockNum);
+        ASSERT_EQ(*static_cast<const uint8_t*>(block.m_Buffer), uint8_t(blockNum));
+    }
+    const int readCount = m_Device->ReadCount;
+    for (off64_t blockNum = 0; blockNum < METADATA_BLOCK_COUNT; ++blockNum)
+    {
+        KCacheBlockDesc block = m_Cache.GetBlock_trw(blockNum, true, true);
+        EXPECT_EQ(*static_cast<const uint8_t*>(block.m_Buffer), uint8_t(blockNum));
+    }
+    EXPECT_EQ(m_Device->ReadCount, readCount);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KBlockCacheFixture, DirectReadSeesCachedBlocks)
+{
+    static constexpr off64_t FIRST_BLOCK  = 96;
+    static constexpr off64_t CACHED_BLOCK = 100;
+    static constexpr size_t  BLOCK_COUNT  = 8;
+
+    {
+        KCacheBlockDesc block = m_Cache.GetBlock_trw(CACHED_BLOCK, false);
+        memset(block.m_Buffer, 0xaa, KBlockCache::MIN_BLOCK_SIZE);
+    }
+    const int readCount = m_Device->ReadCount;
+    std::vector<uint8_t> buffer(BLOCK_COUNT * KBlockCache::MIN_BLOCK_SIZE);
+    m_Cache.DirectRead_trw(FIRST_BLOCK, buffer.data(), BLOCK_COUNT);
+
+    EXPECT_EQ(m_Device->ReadCount, readCount + 1);
+    for (size_t i = 0; i < BLOCK_COUNT; ++i)
+    {
+        const off64_t blockNum = FIRST_BLOCK + off64_t(i);
+        EXPECT_EQ(buffer[i * KBlockCache::MIN_BLOCK_SIZE], (blockNum == CACHED_BLOCK) ? 0xaa : uint8_t(blockNum));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KBlockCacheFixture, FlushMergesDirtyRuns)
+{
+#ifdef PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
+    GTEST_SKIP() << "Gaps are not bridged with the block cache diagnostics.";
+#endif // PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
+    // Dirty 300-302 and 304, with 303 cached clean in the gap. None of them
+    // are due, so the flusher leaves them alone until the sync.
+    static constexpr off64_t DIRTY_BLOCKS[] = { 302, 300, 304, 301 };
+    static constexpr off64_t GAP_BLOCK      = 303;
+
+    m_Cache.GetBlock_trw(GAP_BLOCK);
+    for (off64_t blockNum : DIRTY_BLOCKS)
+    {
+        KCacheBlockDesc block = m_Cache.GetBlock_trw(blockNum, false);
+        memset(block.m_Buffer, 0x55, KBlockCache::MIN_BLOCK_SIZE);
+        block.MarkDirty();
+    }
+    const KBlockCacheStats before     = m_Cache.GetStats();
+    const int              writeCount = m_Device->WriteCount;
+    EXPECT_EQ(before.DirtyBlocks, 4u);
+
+    ASSERT_TRUE(m_Cache.Sync());
+
+    const KBlockCacheStats after = m_Cache.GetStats();
+    EXPECT_EQ(after.DirtyBlocks, 0u);
+    EXPECT_EQ(m_Device->WriteCount - writeCount, 1);
+    EXPECT_EQ(after.FlushWrites - before.FlushWrites, 1u);
+    EXPECT_EQ(after.FlushedBuffers - before.FlushedBuffers, 5u);
+    EXPECT_EQ(after.FlushedDirtyBuffers - before.FlushedDirtyBuffers, 4u);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KBlockCacheFixture, DirectWriteDuringGapFlush)
+{
+#ifdef PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
+    GTEST_SKIP() << "Gaps are not bridged with the block cache diagnostics.";
+#endif // PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
+    // The clean block 403 is written along with the dirty 402 and 404. A
+    // direct write to it that reaches the device before the flush does must
+    // not be overwritten by the old content for good.
+    static constexpr off64_t GAP_BLOCK = 403;
+
+    m_Cache.GetBlock_trw(GAP_BLOCK);
+    for (off64_t blockNum : { GAP_BLOCK - 1, GAP_BLOCK + 1 })
+    {
+        KCacheBlockDesc block = m_Cache.GetBlock_trw(blockNum, false);
+        memset(block.m_Buffer, 0x55, KBlockCache::MIN_BLOCK_SIZE);
+        block.MarkDirty();
+    }
+    std::vector<uint8_t> newData(KBlockCache::MIN_BLOCK_SIZE, 0xcc);
+    m_Device->OnVectorWrite = [this, &newData]() { m_Cache.DirectWrite_trw(GAP_BLOCK, newData.data(), 1); };
+
+    ASSERT_TRUE(m_Cache.Sync());
+
+    EXPECT_FALSE(bool(m_Device->OnVectorWrite));
+    EXPECT_EQ(m_Device->WrittenBlocks[GAP_BLOCK], 0xcc);
+    EXPECT_EQ(m_Device->WrittenBlocks[GAP_BLOCK - 1], 0x55);
+    EXPECT_EQ(m_Device->WrittenBlocks[GAP_BLOCK + 1], 0x55);
+    EXPECT_EQ(m_Cache.GetStats().DirtyBlocks, 0u);
+
+    KCacheBlockDesc block = m_Cache.GetBlock_trw(GAP_BLOCK);
+    EXPECT_EQ(*static_cast<const uint8_t*>(block.m_Buffer), 0xcc);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KBlockCacheFixture, StatsCountLookups)
+{
+    static constexpr off64_t BLOCK_NUM = 3000;
+
+    uint8_t buffer[KBlockCache::MIN_BLOCK_SIZE * 4];
+
+    const KBlockCacheStats before = m_Cache.GetStats();
+    m_Cache.GetBlock_trw(BLOCK_NUM);
+    m_Cache.GetBlock_trw(BLOCK_NUM);
+    m_Cache.DirectRead_trw(BLOCK_NUM, buffer, 4);
+    const KBlockCacheStats after = m_Cache.GetStats();
+
+    EXPECT_EQ(after.Lookups - before.Lookups, 2u);
+    EXPECT_EQ(after.Hits - before.Hits, 1u);
+    EXPECT_EQ(after.LoadedBuffers - before.LoadedBuffers, 1u);
+    EXPECT_EQ(after.DirectReadBlocks - before.DirectReadBlocks, 4u);
+    EXPECT_EQ(after.DirtyBlocks, 0u);
+    EXPECT_EQ(after.OldestDirtyAge, 0u);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KBlockCacheFixture, PartialBufferKeepsWrittenBlock)
+{
+    static constexpr off64_t FIRST_BLOCK = 800;
+    static constexpr off64_t BLOCKS_PER_BUFFER = KBlockCache::MAX_BUFFER_SIZE / KBlockCache::MIN_BLOCK_SIZE;
+
+    m_Cache.SetDevice(-1, 0, 0);
+    ASSERT_TRUE(m_Cache.SetDevice(m_DeviceFile, TEST_DEVICE_BLOCK_COUNT, KBlockCache::MIN_BLOCK_SIZE, KBlockCache::MAX_BUFFER_SIZE));
+    if (m_Cache.GetBufferSize() != KBlockCache::MAX_BUFFER_SIZE) {
+        GTEST_SKIP() << "Buffer size forced by the block cache diagnostics.";
+    }
+    const int readCount = m_Device->ReadCount;
+    {
+        KCacheBlockDesc block = m_Cache.GetBlock_trw(FIRST_BLOCK + 2, false);
+        memset(block.m_Buffer, 0xaa, KBlockCache::MIN_BLOCK_SIZE);
+    }
+    EXPECT_EQ(m_Device->ReadCount, readCount);
+
+    for (off64_t blockNum = FIRST_BLOCK; blockNum < FIRST_BLOCK + BLOCKS_PER_BUFFER; ++blockNum)
+    {
+        KCacheBlockDesc block    = m_Cache.GetBlock_trw(blockNum);
+        const uint8_t   expected = (blockNum == FIRST_BLOCK + 2) ? 0xaa : uint8_t(blockNum);
+        EXPECT_EQ(static_cast<const uint8_t*>(block.m_Buffer)[0], expected);
+        EXPECT_EQ(static_cast<const uint8_t*>(block.m_Buffer)[KBlockCache::MIN_BLOCK_SIZE - 1], expected);
+    }
+    // One read for the blocks before the written one, and one for those after.
+    EXPECT_EQ(m_Device->ReadCount - readCount, 2);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KBlockCacheFixture, LastBufferIsClippedToDevice)
+{
+    static constexpr off64_t BLOCK_COUNT = TEST_DEVICE_BLOCK_COUNT - 3;
+
+    m_Cache.SetDevice(-1, 0, 0);
+    ASSERT_TRUE(m_Cache.SetDevice(m_DeviceFile, BLOCK_COUNT, KBlockCache::MIN_BLOCK_SIZE, KBlockCache::MAX_BUFFER_SIZE));
+    if (m_Cache.GetBufferSize() != KBlockCache::MAX_BUFFER_SIZE) {
+        GTEST_SKIP() << "Buffer size forced by the block cache diagnostics.";
+    }
+    {
+        KCacheBlockDesc block = m_Cache.GetBlock_trw(BLOCK_COUNT - 1);
+        EXPECT_EQ(*static_cast<const uint8_t*>(block.m_Buffer), uint8_t(BLOCK_COUNT - 1));
+    }
+    const int readCount = m_Device->ReadCount;
+    KCacheBlockDesc block = m_Cache.GetBlock_trw(BLOCK_COUNT - 5);
+    EXPECT_EQ(*static_cast<const uint8_t*>(block.m_Buffer), uint8_t(BLOCK_COUNT - 5));
+    EXPECT_EQ(m_Device->ReadCount, readCount);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KBlockCacheFixture, ConcurrentGetBlockBenchmark)
+{
+    for (int threadCount = 1; threadCount <= BENCHMARK_MAX_THREADS; threadCount *= 2)
+    {
+        std::atomic_bool                stop = false;
+        std::vector<BlockCacheReader*>  readers;
+        for (int i = 0; i < threadCount; ++i)
+        {
+            BlockCacheReader* reader = new BlockCacheReader(m_Cache, 1000 + i, stop);
+            reader->SetDeleteOnExit(false);
+            readers.push_back(reader);
+        }
+        const TimeValNanos startTime = kget_monotonic_time();
+        for (BlockCacheReader* reader : readers) {
+            reader->Start_trw(KSpawnThreadFlag::Privileged, PThreadDetachState_Joinable);
+        }
+        ksnooze_ns(BENCHMARK_DURATION.AsNanoseconds());
+        stop = true;
+
+        uint64_t lookups = 0;
+        for (BlockCacheReader* reader : readers)
+        {
+            reader->Join_trw();
+            EXPECT_EQ(reader->Errors, 0u);
+            lookups += reader->Lookups;
+            delete reader;
+        }
+        const double seconds = (kget_monotonic_time() - startTime).AsSeconds();
+        BenchPrintf("KBlockCache::GetBlock_trw() %d threads: %.0f lookups/s", threadCount, double(lookups) / seconds);
+    }
+}
+
+} // namespace KBlockCacheTest
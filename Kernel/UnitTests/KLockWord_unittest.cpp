@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include <Kernel/KLockWord.h>
+
+using namespace kernel;
+
+namespace KLockWordTest
+{
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KLockWord, CountRoundTrip)
+{
+    KLockWord word;
+    EXPECT_EQ(word.GetCount(), 0);
+
+    for (int32_t count : { 1, -1, 2, -2, 1000, -1000, KLockWord::MAX_COUNT, KLockWord::MIN_COUNT })
+    {
+        word.SetCount(count);
+        EXPECT_EQ(word.GetCount(), count);
+        EXPECT_FALSE(word.HasWaiters());
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KLockWord, ExclusiveFastPath)
+{
+    KLockWord word;
+
+    EXPECT_TRUE(word.TryExchange(0, -1));
+    EXPECT_EQ(word.GetCount(), -1);
+    EXPECT_FALSE(word.TryExchange(0, -1));
+    EXPECT_TRUE(word.TryExchange(-1, 0));
+    EXPECT_EQ(word.GetCount(), 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KLockWord, WaitersForceSlowPath)
+{
+    KLockWord word;
+
+    ASSERT_TRUE(word.TryExchange(0, -1));
+    word.SetWaiters();
+
+    EXPECT_FALSE(word.TryExchange(-1, 0));
+    EXPECT_FALSE(word.TryAdd(1, KLockWord::MIN_COUNT, KLockWord::MAX_COUNT));
+    EXPECT_EQ(word.GetCount(), -1);
+
+    // The slow path keep the flag while updating the count.
+    word.AddCount(1);
+    EXPECT_EQ(word.GetCount(), 0);
+    EXPECT_TRUE(word.HasWaiters());
+    EXPECT_FALSE(word.TryExchange(0, -1));
+
+    word.ClearWaiters();
+    EXPECT_TRUE(word.TryExchange(0, -1));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KLockWord, AddRespectsLimits)
+{
+    KLockWord word(2);
+
+    EXPECT_TRUE(word.TryAdd(-1, 0, 10));
+    EXPECT_TRUE(word.TryAdd(-1, 0, 10));
+    EXPECT_FALSE(word.TryAdd(-1, 0, 10));
+    EXPECT_EQ(word.GetCount(), 0);
+
+    word.SetCount(10);
+    EXPECT_FALSE(word.TryAdd(1, 0, 10));
+    EXPECT_EQ(word.GetCount(), 10);
+}
+
+} // namespace KLockWordTest
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include <Kernel/KLog2Histogram.h>
+
+using namespace kernel;
+
+namespace KLog2HistogramTest
+{
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KLog2Histogram, BucketBoundaries)
+{
+    using Histogram = KLog2Histogram<24>;
+
+    EXPECT_EQ(Histogram::GetBucketIndex(0), 0u);
+    EXPECT_EQ(Histogram::GetBucketIndex(1), 1u);
+    EXPECT_EQ(Histogram::GetBucketIndex(2), 2u);
+    EXPECT_EQ(Histogram::GetBucketIndex(3), 2u);
+    EXPECT_EQ(Histogram::GetBucketIndex(4), 3u);
+    EXPECT_EQ(Histogram::GetBucketIndex(1023), 10u);
+    EXPECT_EQ(Histogram::GetBucketIndex(1024), 11u);
+
+    for (size_t i = 1; i < Histogram::BucketCount - 1; ++i)
+    {
+        EXPECT_EQ(Histogram::GetBucketIndex(uint64_t(1) << (i - 1)), i);
+        EXPECT_EQ(Histogram::GetBucketIndex((uint64_t(1) << i) - 1), i);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KLog2Histogram, LastBucketCollectsOverflow)
+{
+    using Histogram = KLog2Histogram<8>;
+
+    EXPECT_EQ(Histogram::GetBucketIndex(uint64_t(1) << 6), 7u);
+    EXPECT_EQ(Histogram::GetBucketIndex(uint64_t(1) << 40), 7u);
+    EXPECT_EQ(Histogram::GetBucketIndex(std::numeric_limits<uint64_t>::max()), 7u);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KLog2Histogram, AddAndReset)
+{
+    KLog2Histogram<16> histogram;
+
+    histogram.Add(0);
+    histogram.Add(5);
+    histogram.Add(6);
+    histogram.Add(7);
+    histogram.Add(100000);
+
+    EXPECT_EQ(histogram.GetCount(0), 1u);
+    EXPECT_EQ(histogram.GetCount(3), 3u);
+    EXPECT_EQ(histogram.GetCount(15), 1u);
+
+    uint32_t total = 0;
+    for (uint32_t count : histogram.GetBuckets()) {
+        total += count;
+    }
+    EXPECT_EQ(total, 5u);
+
+    histogram.Reset();
+    for (uint32_t count : histogram.GetBuckets()) {
+        EXPECT_EQ(count, 0u);
+    }
+}
+
+} // namespace KLog2HistogramTest
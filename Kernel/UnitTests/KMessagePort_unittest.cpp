@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <vector>
+
+#include <Kernel/KMessagePort.h>
+#include <Kernel/KTime.h>
+
+using namespace kernel;
+
+namespace KMessagePortTest
+{
+
+static constexpr size_t   QUEUE_SIZE  = 4;
+static constexpr size_t   SMALL_SIZE  = 32;
+static constexpr size_t   LARGE_SIZE  = 4096;
+static constexpr int32_t  TEST_CODE   = 42;
+
+///////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// A received slab sized buffer goes back to the pool, and is used for the
+/// next message.
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KMessagePort, SmallBuffersArePooled)
+{
+    KMessagePort port("kmessageport_unittest", QUEUE_SIZE);
+
+    uint8_t data[SMALL_SIZE];
+    memset(data, 0x5a, sizeof(data));
+    ASSERT_EQ(port.SendMessage(7, TEST_CODE, data, sizeof(data)), PErrorCode::Success);
+    EXPECT_EQ(port.GetPooledBufferCount(), 0);
+
+    handler_id targetHandler = -1;
+    int32_t    code = 0;
+    uint8_t    buffer[SMALL_SIZE] = {};
+    ASSERT_EQ(port.ReceiveMessage_trw(&targetHandler, &code, buffer, sizeof(buffer)), ssize_t(SMALL_SIZE));
+    EXPECT_EQ(targetHandler, 7);
+    EXPECT_EQ(code, TEST_CODE);
+    EXPECT_EQ(memcmp(buffer, data, sizeof(data)), 0);
+    EXPECT_EQ(port.GetPooledBufferCount(), 1);
+
+    // The pooled buffer is used for the next message.
+    ASSERT_EQ(port.SendMessage(-1, TEST_CODE, data, sizeof(data)), PErrorCode::Success);
+    EXPECT_EQ(port.GetPooledBufferCount(), 0);
+    ASSERT_EQ(port.ReceiveMessage_trw(nullptr, nullptr, buffer, sizeof(buffer)), ssize_t(SMALL_SIZE));
+    EXPECT_EQ(port.GetPooledBufferCount(), 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KMessagePort, LargeBuffersAreNotPooled)
+{
+    KMessagePort port("kmessageport_unittest", QUEUE_SIZE);
+
+    std::vector<uint8_t> data(LARGE_SIZE, 0xa5);
+    for (size_t i = 0; i < QUEUE_SIZE; ++i) {
+        ASSERT_EQ(port.SendMessage(-1, TEST_CODE, data.data(), data.size()), PErrorCode::Success);
+    }
+    std::vector<uint8_t> buffer(LARGE_SIZE);
+    for (size_t i = 0; i < QUEUE_SIZE; ++i) {
+        ASSERT_EQ(port.ReceiveMessage_trw(nullptr, nullptr, buffer.data(), buffer.size()), ssize_t(LARGE_SIZE));
+    }
+    EXPECT_EQ(port.GetPooledBufferCount(), 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KMessagePort, PoolIsLimitedToQueueSize)
+{
+    KMessagePort port("kmessageport_unittest", QUEUE_SIZE);
+
+    uint8_t data[SMALL_SIZE] = {};
+    for (int round = 0; round < 2; ++round)
+    {
+        for (size_t i = 0; i < QUEUE_SIZE; ++i) {
+            ASSERT_EQ(port.SendMessage(-1, TEST_CODE, data, sizeof(data)), PErrorCode::Success);
+        }
+        for (size_t i = 0; i < QUEUE_SIZE; ++i) {
+            ASSERT_EQ(port.ReceiveMessage_trw(nullptr, nullptr, data, sizeof(data)), ssize_t(SMALL_SIZE));
+        }
+        EXPECT_EQ(port.GetPooledBufferCount(), QUEUE_SIZE);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// The buffer of a send that times out goes back to the pool, or is freed
+/// if it is too big to be pooled.
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KMessagePort, FailedSendRecyclesBuffer)
+{
+    KMessagePort port("kmessageport_unittest", 1);
+
+    std::vector<uint8_t> data(LARGE_SIZE);
+    ASSERT_EQ(port.SendMessage(-1, TEST_CODE, data.data(), SMALL_SIZE), PErrorCode::Success);
+    EXPECT_EQ(port.GetPooledBufferCount(), 0);
+
+    // The queue is full, so the next sends time out.
+    EXPECT_EQ(port.SendMessageDeadline(-1, TEST_CODE, data.data(), SMALL_SIZE, kget_monotonic_time()), PErrorCode::TIMEDOUT);
+    EXPECT_EQ(port.GetPooledBufferCount(), 1);
+
+    EXPECT_EQ(port.SendMessageDeadline(-1, TEST_CODE, data.data(), LARGE_SIZE, kget_monotonic_time()), PErrorCode::TIMEDOUT);
+    EXPECT_EQ(port.GetPooledBufferCount(), 1);
+}
+
+} // namespace KMessagePortTest
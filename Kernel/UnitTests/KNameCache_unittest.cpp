@@ -0,0 +1,209 @@
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <sys/stat.h>
+#include <string>
+
+#include <Kernel/VFS/KFilesystem.h>
+#include <Kernel/VFS/KInode.h>
+#include <Kernel/VFS/KNameCache.h>
+
+using namespace kernel;
+
+namespace KNameCacheTest
+{
+
+class TestInode : public KInode, public KFilesystemFileOps
+{
+public:
+    TestInode(mode_t fileMode = S_IFREG) : KInode(nullptr, nullptr, this, fileMode) {}
+
+    virtual void ReadStat(Ptr<KFSVolume> volume, Ptr<KInode> inode, struct stat* statBuf) override
+    {
+        KFilesystemFileOps::ReadStat(volume, inode, statBuf);
+    }
+};
+
+static void Insert(const Ptr<KInode>& parent, const char* name, const Ptr<KInode>& inode)
+{
+    KNameCache::Insert(parent, name, strlen(name), inode, KNameCache::GetGeneration());
+}
+
+static bool Lookup(const Ptr<KInode>& parent, const char* name, Ptr<KInode>& outInode)
+{
+    return KNameCache::Lookup(parent, name, strlen(name), outInode);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KNameCache, PositiveAndNegativeEntries)
+{
+    KNameCache::Flush();
+
+    Ptr<KInode> directory = ptr_new<TestInode>(S_IFDIR);
+    Ptr<KInode> file      = ptr_new<TestInode>();
+
+    Ptr<KInode> result;
+    EXPECT_FALSE(Lookup(directory, "file.txt", result));
+
+    Insert(directory, "file.txt", file);
+    Insert(directory, "missing.txt", nullptr);
+
+    ASSERT_TRUE(Lookup(directory, "file.txt", result));
+    EXPECT_EQ(result, file);
+
+    result = file;
+    ASSERT_TRUE(Lookup(directory, "missing.txt", result));
+    EXPECT_EQ(result, nullptr);
+
+    // Names are keyed on the parent.
+    Ptr<KInode> otherDirectory = ptr_new<TestInode>(S_IFDIR);
+    EXPECT_FALSE(Lookup(otherDirectory, "file.txt", result));
+
+    const KNameCacheStats stats = KNameCache::GetStats();
+    EXPECT_EQ(stats.EntryCount, 2);
+    EXPECT_EQ(stats.NegativeCount, 1);
+
+    KNameCache::Flush();
+    EXPECT_EQ(KNameCache::GetStats().EntryCount, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KNameCache, DotNamesAndLongNamesAreNotCached)
+{
+    KNameCache::Flush();
+
+    Ptr<KInode> directory = ptr_new<TestInode>(S_IFDIR);
+    Ptr<KInode> file      = ptr_new<TestInode>();
+    const std::string longName(KNameCache::MAX_NAME_LENGTH + 1, 'x');
+
+    Insert(directory, ".", directory);
+    Insert(directory, "..", file);
+    Insert(directory, longName.c_str(), file);
+
+    Ptr<KInode> result;
+    EXPECT_FALSE(Lookup(directory, ".", result));
+    EXPECT_FALSE(Lookup(directory, "..", result));
+    EXPECT_FALSE(Lookup(directory, longName.c_str(), result));
+    EXPECT_EQ(KNameCache::GetStats().EntryCount, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KNameCache, InvalidateNegativeKeepsPositiveEntries)
+{
+    KNameCache::Flush();
+
+    Ptr<KInode> directory      = ptr_new<TestInode>(S_IFDIR);
+    Ptr<KInode> otherDirectory = ptr_new<TestInode>(S_IFDIR);
+    Ptr<KInode> file           = ptr_new<TestInode>();
+
+    Insert(directory, "file.txt", file);
+    Insert(directory, "NEW.TXT", nullptr);
+    Insert(otherDirectory, "NEW.TXT", nullptr);
+
+    KNameCache::InvalidateNegative(ptr_raw_pointer_cast(directory));
+
+    Ptr<KInode> result;
+    EXPECT_TRUE(Lookup(directory, "file.txt", result));
+    EXPECT_FALSE(Lookup(directory, "NEW.TXT", result));
+    EXPECT_TRUE(Lookup(otherDirectory, "NEW.TXT", result));
+
+    KNameCache::InvalidateDirectory(ptr_raw_pointer_cast(directory));
+    EXPECT_FALSE(Lookup(directory, "file.txt", result));
+    EXPECT_TRUE(Lookup(otherDirectory, "NEW.TXT", result));
+
+    KNameCache::Flush();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KNameCache, StaleGenerationIsNotInserted)
+{
+    KNameCache::Flush();
+
+    Ptr<KInode> directory = ptr_new<TestInode>(S_IFDIR);
+
+    const uint32_t generation = KNameCache::GetGeneration();
+    KNameCache::InvalidateNegative(ptr_raw_pointer_cast(directory)); // Name created while the lookup was in progress.
+    KNameCache::Insert(directory, "racy", 4, nullptr, generation);
+
+    Ptr<KInode> result;
+    EXPECT_FALSE(Lookup(directory, "racy", result));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KNameCache, LeastRecentlyUsedIsEvicted)
+{
+    KNameCache::Flush();
+
+    Ptr<KInode> directory = ptr_new<TestInode>(S_IFDIR);
+    Ptr<KInode> file      = ptr_new<TestInode>();
+
+    Insert(directory, "first", file);
+    Insert(directory, "second", file);
+    for (size_t i = 2; i < KNameCache::MAX_ENTRY_COUNT; ++i) {
+        Insert(directory, std::to_string(i).c_str(), nullptr);
+    }
+    Ptr<KInode> result;
+    EXPECT_TRUE(Lookup(directory, "first", result)); // Make "second" the oldest entry.
+
+    Insert(directory, "overflow", nullptr);
+
+    EXPECT_EQ(KNameCache::GetStats().EntryCount, KNameCache::MAX_ENTRY_COUNT);
+    EXPECT_TRUE(Lookup(directory, "first", result));
+    EXPECT_FALSE(Lookup(directory, "second", result));
+    EXPECT_TRUE(Lookup(directory, "overflow", result));
+
+    // The cache must not keep the inodes alive once flushed.
+    KNameCache::Flush();
+    result = nullptr;
+    EXPECT_EQ(file->GetPtrCount(), 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Entries holding the last reference to their inode must be dropped, so
+/// the inode can be released and written back by its filesystem.
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KNameCache, ReleaseUnusedInodes)
+{
+    KNameCache::Flush();
+
+    Ptr<KInode> directory    = ptr_new<TestInode>(S_IFDIR);
+    Ptr<KInode> subDirectory = ptr_new<TestInode>(S_IFDIR);
+    Ptr<KInode> openFile     = ptr_new<TestInode>();
+    Ptr<KInode> closedFile   = ptr_new<TestInode>();
+
+    Insert(directory, "open.txt", openFile);
+    Insert(directory, "closed.txt", closedFile);
+    Insert(directory, "subdir", subDirectory);
+    Insert(subDirectory, "child.txt", openFile);
+    Insert(directory, "missing.txt", nullptr);
+
+    closedFile = nullptr;
+    subDirectory = nullptr;
+
+    KNameCache::ReleaseUnusedInodes();
+
+    Ptr<KInode> result;
+    EXPECT_TRUE(Lookup(directory, "open.txt", result));
+    EXPECT_FALSE(Lookup(directory, "closed.txt", result));
+    EXPECT_TRUE(Lookup(directory, "missing.txt", result));
+
+    // Still the parent of a cached entry.
+    ASSERT_TRUE(Lookup(directory, "subdir", result));
+    EXPECT_NE(result, nullptr);
+    result = nullptr;
+
+    KNameCache::Flush();
+}
+
+} // namespace KNameCacheTest
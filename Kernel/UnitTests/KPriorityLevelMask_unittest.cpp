@@ -0,0 +1,115 @@
+// Checks that KPriorityLevelMask picks the same ready thread as a linear scan.
+
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <random>
+
+#include <Kernel/KPriorityLevelMask.h>
+#include <Kernel/KThreadCB.h>
+
+using namespace kernel;
+
+namespace KPriorityLevelMaskTest
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// Model of the scheduler ready-lists. Selection through the level mask is
+/// compared against the linear top-down scan the scheduler used to do.
+///////////////////////////////////////////////////////////////////////////////
+
+struct ReadyQueueModel
+{
+    void Add(int thread, int level)
+    {
+        Lists[level].push_back(thread);
+        Mask.SetLevel(level);
+    }
+
+    int SelectLinear() const
+    {
+        for (int i = KTHREAD_PRIORITY_LEVELS - 1; i >= 0; --i)
+        {
+            if (!Lists[i].empty()) {
+                return Lists[i].front();
+            }
+        }
+        return -1;
+    }
+
+    int SelectMask()
+    {
+        const int level = Mask.GetHighestLevel();
+        if (level == -1) {
+            return -1;
+        }
+        const int thread = Lists[level].front();
+        Lists[level].pop_front();
+        if (Lists[level].empty()) {
+            Mask.ClearLevel(level);
+        }
+        return thread;
+    }
+
+    std::deque<int>     Lists[KTHREAD_PRIORITY_LEVELS];
+    KPriorityLevelMask  Mask;
+};
+
+} // namespace KPriorityLevelMaskTest
+
+using namespace KPriorityLevelMaskTest;
+
+TEST(KPriorityLevelMask, EmptyMask)
+{
+    KPriorityLevelMask mask;
+    EXPECT_TRUE(mask.IsEmpty());
+    EXPECT_EQ(mask.GetHighestLevel(), -1);
+}
+
+TEST(KPriorityLevelMask, HighestLevel)
+{
+    static_assert(KTHREAD_PRIORITY_LEVELS <= KPriorityLevelMask::MAX_LEVELS);
+
+    KPriorityLevelMask mask;
+    for (int level = 0; level < KTHREAD_PRIORITY_LEVELS; ++level)
+    {
+        mask.SetLevel(level);
+        EXPECT_TRUE(mask.IsLevelSet(level));
+        EXPECT_EQ(mask.GetHighestLevel(), level);
+    }
+    for (int level = KTHREAD_PRIORITY_LEVELS - 1; level > 0; --level)
+    {
+        mask.ClearLevel(level);
+        EXPECT_FALSE(mask.IsLevelSet(level));
+        EXPECT_EQ(mask.GetHighestLevel(), level - 1);
+    }
+    mask.ClearLevel(0);
+    EXPECT_TRUE(mask.IsEmpty());
+}
+
+TEST(KPriorityLevelMask, SelectionOrderMatchesLinearScan)
+{
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<int> levelDist(0, KTHREAD_PRIORITY_LEVELS - 1);
+    std::uniform_int_distribution<int> actionDist(0, 2);
+
+    ReadyQueueModel model;
+    int             nextThread = 0;
+
+    for (int i = 0; i < 10000; ++i)
+    {
+        if (actionDist(random) != 0)
+        {
+            model.Add(nextThread++, levelDist(random));
+        }
+        else
+        {
+            const int expected = model.SelectLinear();
+            EXPECT_EQ(model.SelectMask(), expected);
+        }
+    }
+    for (int expected = model.SelectLinear(); expected != -1; expected = model.SelectLinear()) {
+        EXPECT_EQ(model.SelectMask(), expected);
+    }
+    EXPECT_TRUE(model.Mask.IsEmpty());
+}
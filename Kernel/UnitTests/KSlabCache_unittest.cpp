@@ -0,0 +1,155 @@
+// KSlabCache tests, and a benchmark of slab allocation against malloc().
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <set>
+#include <vector>
+
+#include <Kernel/KSlabCache.h>
+#include <UnitTests/BenchmarkTestUtils.h>
+
+using namespace kernel;
+
+namespace KSlabCacheTest
+{
+
+struct TestObject
+{
+    TestObject(int value) : Value(value) { ++s_LiveCount; }
+    ~TestObject() { --s_LiveCount; }
+
+    int             Value;
+    uint8_t         Padding[20];
+    static int      s_LiveCount;
+};
+int TestObject::s_LiveCount = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KSlabCache, ObjectSizeIsAligned)
+{
+    KSlabCache tiny("tiny", 1);
+    EXPECT_EQ(tiny.GetObjectSize(), KSlabCache::OBJECT_ALIGNMENT);
+
+    KSlabCache odd("odd", 13);
+    EXPECT_EQ(odd.GetObjectSize(), 16);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KSlabCache, AllocateFreeReuse)
+{
+    KSlabCache cache("test", 40, 8);
+
+    std::set<void*> objects;
+    for (int i = 0; i < 20; ++i)
+    {
+        void* object = cache.Allocate();
+        ASSERT_NE(object, nullptr);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(object) % KSlabCache::OBJECT_ALIGNMENT, 0);
+        EXPECT_TRUE(objects.insert(object).second);
+        memset(object, 0xaa, 40);
+    }
+    KSlabCacheStats stats = cache.GetStats();
+    EXPECT_EQ(stats.SlabCount, 3);
+    EXPECT_EQ(stats.ObjectsInUse, 20);
+    EXPECT_EQ(stats.AllocCount, 20);
+
+    for (void* object : objects) {
+        cache.Free(object);
+    }
+    stats = cache.GetStats();
+    EXPECT_EQ(stats.ObjectsInUse, 0);
+    EXPECT_EQ(stats.MaxObjectsInUse, 20);
+    EXPECT_EQ(stats.FreeCount, 20);
+
+    // Freed objects are reused without growing the cache.
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_EQ(objects.count(cache.Allocate()), 1);
+    }
+    EXPECT_EQ(cache.GetStats().SlabCount, 3);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KSlabCache, CacheRegistersOnFirstSlab)
+{
+    KSlabCache cache("registered", 16);
+
+    auto isRegistered = [&cache]() {
+        for (KSlabCache* i = KSlabCache::GetFirstCache(); i != nullptr; i = i->GetNextCache()) {
+            if (i == &cache) return true;
+        }
+        return false;
+    };
+    EXPECT_FALSE(isRegistered());
+    cache.Free(cache.Allocate());
+    EXPECT_TRUE(isRegistered());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KSlabCache, ObjectCacheConstructDestroy)
+{
+    KObjectCache<TestObject> cache("test_object");
+
+    TestObject* object = cache.Construct(42);
+    ASSERT_NE(object, nullptr);
+    EXPECT_EQ(object->Value, 42);
+    EXPECT_EQ(TestObject::s_LiveCount, 1);
+
+    cache.Destroy(object);
+    EXPECT_EQ(TestObject::s_LiveCount, 0);
+    EXPECT_EQ(cache.GetStats().ObjectsInUse, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KSlabCache, SizeClasses)
+{
+    for (size_t size : std::initializer_list<size_t>{ 1, 32, 33, 100, 384, KSLAB_MAX_SIZE_CLASS, KSLAB_MAX_SIZE_CLASS + 1, 4096 })
+    {
+        void* object = kslab_alloc_trw(size);
+        ASSERT_NE(object, nullptr);
+        memset(object, 0x55, size);
+        kslab_free(object, size);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST(KSlabCache, BenchmarkVsMalloc)
+{
+    static constexpr int ROUNDS = 1000;
+    static constexpr int BATCH  = 64;
+    static constexpr size_t SIZE = 48;
+
+    KSlabCache cache("bench", SIZE);
+    void* objects[BATCH];
+
+    auto measure = [&](auto&& allocate, auto&& release)
+    {
+        const BenchTimer timer;
+        for (int round = 0; round < ROUNDS; ++round)
+        {
+            for (void*& object : objects) object = allocate();
+            for (void* object : objects) release(object);
+        }
+        return timer.GetNanoseconds() / (ROUNDS * BATCH);
+    };
+    const double slabNs   = measure([&]() { return cache.Allocate(); }, [&](void* object) { cache.Free(object); });
+    const double mallocNs = measure([]() { return malloc(SIZE); }, [](void* object) { free(object); });
+
+    BenchPrintf("KSlabCache alloc+free: %.1fns, malloc+free: %.1fns", slabNs, mallocNs);
+    EXPECT_EQ(cache.GetStats().ObjectsInUse, 0);
+}
+
+} // namespace KSlabCacheTest
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <Kernel/KSleepQueue.h>
+#include <UnitTests/BenchmarkTestUtils.h>
+
+using namespace kernel;
+
+namespace KSleepQueueTest
+{
+
+static constexpr size_t BENCHMARK_NODE_COUNT = 10000;
+
+std::vector<KThreadWaitNode> CreateNodes(size_t count, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int64_t> deadlineDist(0, 10000000000LL);
+
+    std::vector<KThreadWaitNode> nodes(count);
+    for (KThreadWaitNode& node : nodes) {
+        node.m_ResumeTime = TimeValNanos::FromNanoseconds(deadlineDist(random));
+    }
+    return nodes;
+}
+
+// The sorted-list insertion previously used by add_to_sleep_list().
+void InsertSorted(KThreadWaitList& list, KThreadWaitNode* waitNode)
+{
+    for (auto i : list)
+    {
+        if (waitNode->m_ResumeTime <= i->m_ResumeTime)
+        {
+            list.Insert(i, waitNode);
+            return;
+        }
+    }
+    list.Append(waitNode);
+}
+
+} // namespace KSleepQueueTest
+
+using namespace KSleepQueueTest;
+
+TEST(KSleepQueue, RemoveFirstIsOrdered)
+{
+    std::vector<KThreadWaitNode> nodes = CreateNodes(1000, 1);
+    KSleepQueue queue;
+
+    for (KThreadWaitNode& node : nodes) {
+        queue.Insert(&node);
+    }
+    EXPECT_EQ(queue.GetCount(), nodes.size());
+
+    TimeValNanos prevTime = TimeValNanos::zero;
+    while (!queue.IsEmpty())
+    {
+        KThreadWaitNode* node = queue.RemoveFirst();
+        EXPECT_GE(node->m_ResumeTime, prevTime);
+        EXPECT_FALSE(node->IsSleepQueueMember());
+        prevTime = node->m_ResumeTime;
+    }
+    EXPECT_EQ(queue.GetCount(), 0u);
+}
+
+TEST(KSleepQueue, DetatchArbitraryNodes)
+{
+    std::vector<KThreadWaitNode> nodes = CreateNodes(1000, 2);
+    KSleepQueue queue;
+
+    for (KThreadWaitNode& node : nodes) {
+        queue.Insert(&node);
+    }
+    // Force some structure into the heap before removing nodes from the middle.
+    std::vector<KThreadWaitNode*> removed;
+    for (int i = 0; i < 10; ++i) {
+        removed.push_back(queue.RemoveFirst());
+    }
+    for (size_t i = 0; i < nodes.size(); i += 3)
+    {
+        const bool wasMember = nodes[i].IsSleepQueueMember();
+        EXPECT_EQ(nodes[i].Detatch(), wasMember);
+        EXPECT_FALSE(nodes[i].IsSleepQueueMember());
+    }
+    std::vector<TimeValNanos> expected;
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (i % 3 != 0 && std::find(removed.begin(), removed.end(), &nodes[i]) == removed.end()) {
+            expected.push_back(nodes[i].m_ResumeTime);
+        }
+    }
+    std::sort(expected.begin(), expected.end());
+
+    ASSERT_EQ(queue.GetCount(), expected.size());
+    for (TimeValNanos time : expected) {
+        EXPECT_EQ(queue.RemoveFirst()->m_ResumeTime, time);
+    }
+    EXPECT_TRUE(queue.IsEmpty());
+    EXPECT_FALSE(nodes[1].Detatch());
+}
+
+TEST(KSleepQueue, InsertBenchmark)
+{
+    std::vector<KThreadWaitNode> heapNodes = CreateNodes(BENCHMARK_NODE_COUNT, 3);
+    std::vector<KThreadWaitNode> listNodes = CreateNodes(BENCHMARK_NODE_COUNT, 3);
+
+    KSleepQueue queue;
+    BenchTimer timer;
+    for (KThreadWaitNode& node : heapNodes) {
+        queue.Insert(&node);
+    }
+    const double heapTime = timer.GetMilliseconds();
+
+    KThreadWaitList list;
+    timer.Restart();
+    for (KThreadWaitNode& node : listNodes) {
+        InsertSorted(list, &node);
+    }
+    const double listTime = timer.GetMilliseconds();
+
+    BenchPrintf("KSleepQueue: %zu inserts: heap %.3fms, sorted list %.3fms", BENCHMARK_NODE_COUNT, heapTime, listTime);
+
+    // Both structures must hand the nodes back in the same order.
+    for (KThreadWaitNode* listNode = list.GetFirst(); listNode != nullptr; listNode = list.GetFirst())
+    {
+        list.Remove(listNode);
+        EXPECT_EQ(queue.RemoveFirst()->m_ResumeTime, listNode->m_ResumeTime);
+    }
+    EXPECT_TRUE(queue.IsEmpty());
+}
@@ -0,0 +1,232 @@
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <Kernel/KTLSFPool.h>
+#include <UnitTests/BenchmarkTestUtils.h>
+
+using namespace kernel;
+
+namespace KTLSFPoolTest
+{
+
+static constexpr size_t POOL_SIZE = 256 * 1024;
+
+class KTLSFPoolFixture : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        m_Memory.resize(POOL_SIZE);
+        m_Pool = KTLSFPool::Create(m_Memory.data(), m_Memory.size());
+        ASSERT_NE(m_Pool, nullptr);
+        m_InitialStats = m_Pool->GetStats();
+    }
+
+    void ExpectPristine()
+    {
+        const KHeapPoolStats stats = m_Pool->GetStats();
+        EXPECT_EQ(stats.UsedSize, 0);
+        EXPECT_EQ(stats.FreeBlockCount, 1);
+        EXPECT_EQ(stats.FreeSize, m_InitialStats.FreeSize);
+        EXPECT_EQ(stats.LargestFreeBlock, m_InitialStats.FreeSize);
+        EXPECT_EQ(stats.FragmentationPercent, 0);
+    }
+
+    std::vector<uint8_t>    m_Memory;
+    KTLSFPool*              m_Pool = nullptr;
+    KHeapPoolStats          m_InitialStats;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KTLSFPoolFixture, InitialState)
+{
+    EXPECT_GT(m_InitialStats.TotalSize, POOL_SIZE - 4096);
+    EXPECT_EQ(m_InitialStats.FreeSize, m_InitialStats.TotalSize);
+    ExpectPristine();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KTLSFPoolFixture, AllocateFreeCoalesce)
+{
+    void* a = m_Pool->Allocate(100);
+    void* b = m_Pool->Allocate(0);
+    void* c = m_Pool->Allocate(5000);
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    ASSERT_NE(c, nullptr);
+    EXPECT_GE(KTLSFPool::GetAllocationSize(a), 100);
+    EXPECT_TRUE(m_Pool->Contains(a) && m_Pool->Contains(b) && m_Pool->Contains(c));
+
+    for (void* pointer : { a, b, c }) {
+        EXPECT_EQ(uintptr_t(pointer) % KTLSFPool::ALIGNMENT, 0);
+    }
+    EXPECT_EQ(m_Pool->GetStats().AllocCount, 3);
+
+    // Free the middle block first, so both merge directions are exercised.
+    m_Pool->Free(b);
+    EXPECT_EQ(m_Pool->GetStats().FreeBlockCount, 2);
+    m_Pool->Free(a);
+    m_Pool->Free(c);
+    ExpectPristine();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KTLSFPoolFixture, AlignedAllocation)
+{
+    std::vector<void*> pointers;
+    for (size_t alignment = 16; alignment <= 4096; alignment *= 2)
+    {
+        void* pointer = m_Pool->AllocateAligned(alignment, 24);
+        ASSERT_NE(pointer, nullptr);
+        EXPECT_EQ(uintptr_t(pointer) % alignment, 0);
+        memset(pointer, 0xcc, 24);
+        pointers.push_back(pointer);
+    }
+    for (void* pointer : pointers) {
+        m_Pool->Free(pointer);
+    }
+    ExpectPristine();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KTLSFPoolFixture, ResizeInPlace)
+{
+    void* a = m_Pool->Allocate(64);
+    void* b = m_Pool->Allocate(64);
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+
+    EXPECT_FALSE(m_Pool->ResizeInPlace(a, 256)); // Blocked by b.
+    EXPECT_TRUE(m_Pool->ResizeInPlace(b, 4096)); // Followed by free space.
+    EXPECT_GE(KTLSFPool::GetAllocationSize(b), 4096);
+    EXPECT_TRUE(m_Pool->ResizeInPlace(b, 32));
+    EXPECT_LT(KTLSFPool::GetAllocationSize(b), 4096);
+
+    m_Pool->Free(a);
+    m_Pool->Free(b);
+    ExpectPristine();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KTLSFPoolFixture, ExhaustionAndStats)
+{
+    std::vector<void*> pointers;
+    for (;;)
+    {
+        void* pointer = m_Pool->Allocate(1000);
+        if (pointer == nullptr) break;
+        pointers.push_back(pointer);
+    }
+    KHeapPoolStats stats = m_Pool->GetStats();
+    EXPECT_EQ(stats.FailedCount, 1);
+    EXPECT_EQ(stats.MaxUsedSize, stats.UsedSize);
+
+    // Free every other block. The free space is now fragmented.
+    for (size_t i = 0; i < pointers.size(); i += 2) {
+        m_Pool->Free(pointers[i]);
+    }
+    stats = m_Pool->GetStats();
+    EXPECT_GT(stats.FragmentationPercent, 90);
+    EXPECT_EQ(m_Pool->Allocate(4000), nullptr);
+
+    for (size_t i = 1; i < pointers.size(); i += 2) {
+        m_Pool->Free(pointers[i]);
+    }
+    ExpectPristine();
+    EXPECT_EQ(m_Pool->GetStats().MaxUsedSize, stats.MaxUsedSize);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KTLSFPoolFixture, RandomStress)
+{
+    std::mt19937 random(1234);
+    std::map<uint8_t*, size_t> allocations;
+
+    for (int i = 0; i < 20000; ++i)
+    {
+        if (allocations.empty() || random() % 3 != 0)
+        {
+            const size_t size      = (random() % 8 == 0) ? random() % 8192 : random() % 256;
+            const size_t alignment = (random() % 16 == 0) ? size_t(1) << (4 + random() % 6) : 0;
+            uint8_t* pointer = static_cast<uint8_t*>((alignment != 0) ? m_Pool->AllocateAligned(alignment, size) : m_Pool->Allocate(size));
+            if (pointer == nullptr) continue;
+            if (alignment != 0) {
+                ASSERT_EQ(uintptr_t(pointer) % alignment, 0);
+            }
+            // Must not overlap the neighbours.
+            auto next = allocations.lower_bound(pointer);
+            if (next != allocations.end()) {
+                ASSERT_LE(pointer + size, next->first);
+            }
+            if (next != allocations.begin()) {
+                auto prev = std::prev(next);
+                ASSERT_LE(prev->first + prev->second, pointer);
+            }
+            memset(pointer, uint8_t(uintptr_t(pointer)), size);
+            allocations[pointer] = size;
+        }
+        else
+        {
+            auto it = allocations.begin();
+            std::advance(it, random() % allocations.size());
+            for (size_t j = 0; j < it->second; ++j) {
+                ASSERT_EQ(it->first[j], uint8_t(uintptr_t(it->first)));
+            }
+            m_Pool->Free(it->first);
+            allocations.erase(it);
+        }
+    }
+    for (auto& allocation : allocations) {
+        m_Pool->Free(allocation.first);
+    }
+    ExpectPristine();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TEST_F(KTLSFPoolFixture, BenchmarkWorstCase)
+{
+    static constexpr int COUNT = 1000;
+    std::mt19937 random(42);
+    std::vector<void*> pointers(COUNT);
+
+    double maxNs = 0.0;
+    double totalNs = 0.0;
+    for (int round = 0; round < 20; ++round)
+    {
+        for (void*& pointer : pointers)
+        {
+            const BenchTimer timer;
+            pointer = m_Pool->Allocate(random() % 200);
+            const double ns = timer.GetNanoseconds();
+            maxNs = std::max(maxNs, ns);
+            totalNs += ns;
+        }
+        std::shuffle(pointers.begin(), pointers.end(), random);
+        for (void* pointer : pointers) {
+            m_Pool->Free(pointer);
+        }
+    }
+    BenchPrintf("KTLSFPool::Allocate avg %.1fns, max %.1fns", totalNs / (20 * COUNT), maxNs);
+    ExpectPristine();
+}
+
+} // namespace KTLSFPoolTest
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include <Kernel/KTicklessIdle.h>
+
+using namespace kernel;
+
+namespace KTicklessIdleTest
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// Simulated SysTick and kernel clock. Time is tracked in CPU cycles, and the
+/// kernel's view of time is s_SystemTicks + (LOAD - VAL) like in
+/// kget_system_ticks_hires().
+///////////////////////////////////////////////////////////////////////////////
+
+struct SimulatedClock
+{
+    int64_t  SystemTicks  = 0;  // Cycle count at the start of the current tick.
+    int64_t  SystemTimeNS = 0;  // Nanoseconds at the start of the current tick.
+    uint32_t CyclesPerTick = 0;
+
+    // Run one tickless sleep entered with the SysTick counter at 'counterValue',
+    // waking 'sleepCycles' later. Returns false if the deadline is too close to
+    // suppress any ticks. Otherwise the kernel's and the true cycle count after
+    // the wakeup are returned in 'kernelCycles' and 'trueCycles'.
+    bool Sleep(uint32_t counterValue, int64_t deadlineNS, uint32_t sleepCycles, int64_t& kernelCycles, int64_t& trueCycles, bool& wrapped)
+    {
+        const uint32_t maxIdleTicks = KTicklessIdle::GetMaxIdleTicks(CyclesPerTick);
+        const uint32_t idleTicks    = KTicklessIdle::CalculateIdleTicks(SystemTimeNS, deadlineNS, maxIdleTicks);
+        if (idleTicks < 2) {
+            return false;
+        }
+        const uint32_t reloadValue = KTicklessIdle::CalculateReloadValue(counterValue, idleTicks, CyclesPerTick);
+        EXPECT_LE(reloadValue, KTicklessIdle::SYSTICK_MAX_RELOAD);
+
+        trueCycles = SystemTicks + (CyclesPerTick - 1 - counterValue) + sleepCycles;
+
+        // The counter counts down from reloadValue, and reloads with reloadValue after reaching zero.
+        uint32_t valueAtWakeup;
+        wrapped = sleepCycles > reloadValue;
+        if (!wrapped) {
+            valueAtWakeup = reloadValue - sleepCycles;
+        } else {
+            valueAtWakeup = reloadValue - (sleepCycles - reloadValue - 1);
+        }
+        const KTicklessIdle::WakeupCorrection correction = KTicklessIdle::CalculateWakeupCorrection(reloadValue, valueAtWakeup, wrapped, idleTicks, CyclesPerTick);
+        EXPECT_GE(correction.RemainingCycles, 2u);
+        EXPECT_LE(correction.RemainingCycles, CyclesPerTick);
+
+        SystemTicks  += int64_t(correction.CompletedTicks) * CyclesPerTick;
+        SystemTimeNS += int64_t(correction.CompletedTicks) * KTicklessIdle::NANOSECONDS_PER_TICK;
+        if (wrapped)
+        {
+            // The pending SysTick interrupt adds the last tick.
+            SystemTicks  += CyclesPerTick;
+            SystemTimeNS += KTicklessIdle::NANOSECONDS_PER_TICK;
+            // Deadline must be expired when the tick interrupt runs, unless the sleep was truncated.
+            if (idleTicks < maxIdleTicks) {
+                EXPECT_GE(SystemTimeNS, deadlineNS);
+            }
+        }
+        else
+        {
+            // Woken early by some other interrupt. The deadline can not have been passed.
+            EXPECT_LT(SystemTimeNS, deadlineNS);
+        }
+        const uint32_t restartValue = correction.RemainingCycles - 1;
+        kernelCycles = SystemTicks + (CyclesPerTick - 1 - restartValue);
+        return true;
+    }
+};
+
+} // namespace KTicklessIdleTest
+
+using namespace KTicklessIdleTest;
+
+TEST(KTicklessIdle, IdleTicks)
+{
+    const uint32_t maxIdleTicks = KTicklessIdle::GetMaxIdleTicks(480000);
+    EXPECT_EQ(maxIdleTicks, 34u);
+    EXPECT_EQ(KTicklessIdle::CalculateIdleTicks(5000000, 5000000, maxIdleTicks), 0u);
+    EXPECT_EQ(KTicklessIdle::CalculateIdleTicks(5000000, 5000001, maxIdleTicks), 1u);
+    EXPECT_EQ(KTicklessIdle::CalculateIdleTicks(5000000, 6000000, maxIdleTicks), 1u);
+    EXPECT_EQ(KTicklessIdle::CalculateIdleTicks(5000000, 6000001, maxIdleTicks), 2u);
+    EXPECT_EQ(KTicklessIdle::CalculateIdleTicks(5000000, 500000000, maxIdleTicks), maxIdleTicks);
+}
+
+TEST(KTicklessIdle, FullSleepKeepsTickPhase)
+{
+    SimulatedClock clock;
+    clock.CyclesPerTick = 480000;
+
+    int64_t kernelCycles;
+    int64_t trueCycles;
+    bool    wrapped;
+    const uint32_t counterValue = 123456;
+    const uint32_t reloadValue  = KTicklessIdle::CalculateReloadValue(counterValue, 10, clock.CyclesPerTick);
+
+    // Wake exactly when the counter wraps: the tick interrupt starts tick number 10.
+    ASSERT_TRUE(clock.Sleep(counterValue, 10 * KTicklessIdle::NANOSECONDS_PER_TICK, reloadValue + 1, kernelCycles, trueCycles, wrapped));
+    EXPECT_TRUE(wrapped);
+    EXPECT_EQ(kernelCycles, trueCycles);
+    EXPECT_EQ(clock.SystemTimeNS, 10 * KTicklessIdle::NANOSECONDS_PER_TICK);
+    EXPECT_EQ(clock.SystemTicks, 10 * int64_t(clock.CyclesPerTick));
+}
+
+TEST(KTicklessIdle, SimulatedBookkeeping)
+{
+    std::mt19937 random(4321);
+
+    for (uint32_t cyclesPerTick : { 64000u, 480000u, 550000u })
+    {
+        SimulatedClock clock;
+        clock.CyclesPerTick = cyclesPerTick;
+
+        std::uniform_int_distribution<uint32_t> counterDist(0, cyclesPerTick - 1);
+        std::uniform_int_distribution<int64_t>  deadlineDist(1, 60 * KTicklessIdle::NANOSECONDS_PER_TICK);
+
+        for (int i = 0; i < 10000; ++i)
+        {
+            const uint32_t counterValue = counterDist(random);
+            const int64_t  deadlineNS   = clock.SystemTimeNS + deadlineDist(random);
+
+            const uint32_t idleTicks   = KTicklessIdle::CalculateIdleTicks(clock.SystemTimeNS, deadlineNS, KTicklessIdle::GetMaxIdleTicks(cyclesPerTick));
+            const uint32_t reloadValue = (idleTicks >= 2) ? KTicklessIdle::CalculateReloadValue(counterValue, idleTicks, cyclesPerTick) : 0;
+
+            // Either woken early by another interrupt, or by the SysTick wrapping.
+            std::uniform_int_distribution<uint32_t> sleepDist(0, reloadValue + cyclesPerTick / 4);
+            const uint32_t sleepCycles = sleepDist(random);
+
+            int64_t kernelCycles;
+            int64_t trueCycles;
+            bool    wrapped;
+            if (clock.Sleep(counterValue, deadlineNS, sleepCycles, kernelCycles, trueCycles, wrapped))
+            {
+                // Allow one cycle of error for the case where the wakeup lands on the last cycle of a tick.
+                EXPECT_GE(kernelCycles, trueCycles);
+                EXPECT_LE(kernelCycles, trueCycles + 1);
+                EXPECT_EQ(clock.SystemTimeNS / KTicklessIdle::NANOSECONDS_PER_TICK, clock.SystemTicks / cyclesPerTick);
+            }
+            // Move on to a new tick, as the normal SysTick interrupt would.
+            clock.SystemTicks  += cyclesPerTick;
+            clock.SystemTimeNS += KTicklessIdle::NANOSECONDS_PER_TICK;
+        }
+    }
+}
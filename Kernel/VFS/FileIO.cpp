@@ -27,8 +27,11 @@
 #include <Kernel/VFS/KFileHandle.h>
 #include <Kernel/VFS/KFSVolume.h>
 #include <Kernel/VFS/KInode.h>
+#include <Kernel/VFS/KNameCache.h>
 #include <Kernel/VFS/KRootFilesystem.h>
 #include <Kernel/VFS/KVFSManager.h>
+#include <DeviceControl/FileAllocation.h>
+#include <DeviceControl/ReadDirectoryPlus.h>
 #include <Storage/DirectoryEntry.h>
 #include <System/ExceptionHandling.h>
 
@@ -264,6 +267,7 @@ int kopen_trw(int baseFolderFD, const char* path, int openFlags, int permissions
         {
             if (error == PErrorCode::NOENT && (openFlags & O_CREAT))
             {
+                PScopeExit nameCacheGuard([&parent]() { KNameCache::InvalidateNegative(ptr_raw_pointer_cast(parent)); });
                 const Ptr<KFileTableNode> file = parent->m_Filesystem->CreateFile(parent->m_Volume, parent, name, nameLength, openFlags, permissions);
                 kset_filehandle(handle, file);
                 return handle;
@@ -619,10 +623,57 @@ void kfsync_trw(int handle)
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
+void kfallocate_trw(int handle, int mode, off_t offset, off_t length)
+{
+    Ptr<KInode> inode;
+    Ptr<KFileNode> file = kget_file_node_trw(handle, inode);
+
+    if (!S_ISREG(inode->m_FileMode)) {
+        PERROR_THROW_CODE(S_ISDIR(inode->m_FileMode) ? PErrorCode::ISDIR : PErrorCode::NODEV);
+    }
+    if ((file->GetOpenFlags() & O_ACCMODE) == O_RDONLY) {
+        PERROR_THROW_CODE(PErrorCode::BADF);
+    }
+    if (offset < 0 || length <= 0 || (mode & ~FALLOC_FL_KEEP_SIZE) != 0) {
+        PERROR_THROW_CODE(PErrorCode::INVAL);
+    }
+    inode->m_FileOps->Allocate(file, mode, offset, length);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
 void kdevice_control_trw(int handle, int request, const void* inData, size_t inDataLength, void* outData, size_t outDataLength)
 {
+    // Directories only accept the generic directory requests.
+    Ptr<KFileTableNode> node = kget_file_table_node_trw(handle);
+    if (!node->IsPathObject() && node->IsDirectory())
+    {
+        if (request != PDirRequest_ReadDirectoryPlus) {
+            PERROR_THROW_CODE(PErrorCode::ISDIR);
+        }
+        const size_t bytesRead = kread_directory_plus_trw(handle, outData, outDataLength);
+        if (outDataLength - bytesRead >= P_DIR_ENTRY_HEADER_SIZE) {
+            memset(static_cast<uint8_t*>(outData) + bytesRead, 0, P_DIR_ENTRY_HEADER_SIZE);
+        }
+        return;
+    }
+
     Ptr<KInode> inode;
     Ptr<KFileNode> file = kget_file_node_trw(handle, inode);
+
+    // Generic requests on regular files. Device nodes use their own request
+    // numbers, so these are only recognized for regular files.
+    if (request == PFileRequest_Allocate && S_ISREG(inode->m_FileMode))
+    {
+        if (inDataLength != sizeof(PFileAllocateArgs)) {
+            PERROR_THROW_CODE(PErrorCode::INVAL);
+        }
+        const PFileAllocateArgs* args = static_cast<const PFileAllocateArgs*>(inData);
+        kfallocate_trw(handle, args->Mode, args->Offset, args->Length);
+        return;
+    }
     inode->m_FileOps->DeviceControl(file, request, inData, inDataLength, outData, outDataLength);
 }
 
@@ -636,6 +687,38 @@ size_t kread_directory_trw(int handle, void* buffer, size_t bufferSize)
     return dir->ReadDirectory(buffer, bufferSize);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Read directory entries with a stat for each. Entries that have another
+/// volume mounted on them get the stat of the mounted root, like stat()
+/// would give.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t kread_directory_plus_trw(int handle, void* buffer, size_t bufferSize)
+{
+    Ptr<KDirectoryNode> dir = kget_directory_node_trw(handle);
+    const size_t bytesRead = dir->ReadDirectoryPlus(buffer, bufferSize);
+
+    for (PDirEntryIterator iterator(buffer, bytesRead); iterator; ++iterator)
+    {
+        dirent_t* entry = const_cast<dirent_t*>(&*iterator);
+        if (entry->d_type != DT_DIR || PGetDirEntryStat(*entry) == nullptr) {
+            continue;
+        }
+        Ptr<KInode> mountRoot;
+        KVFSManager::VisitLoadedInode(entry->d_volumeid, entry->d_ino, [&mountRoot](KInode* inode) { mountRoot = inode->m_MountRoot; });
+        if (mountRoot != nullptr)
+        {
+            try {
+                kread_stat_trw(mountRoot, PDirEntryWriter::GetStat(entry));
+            } catch (const std::exception&) {
+                *PDirEntryWriter::GetStat(entry) = {};
+            }
+        }
+    }
+    return bytesRead;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -667,6 +750,8 @@ void kcreate_directory_trw(KLocateFlags locateFlags, int baseFolderFD, const cha
     }
 
     Ptr<KInode> parent = klocate_parent_inode_trw(locateFlags, baseInode, path, pathLength, &name, &nameLength);
+
+    PScopeExit nameCacheGuard([&parent]() { KNameCache::InvalidateNegative(ptr_raw_pointer_cast(parent)); });
     parent->m_Filesystem->CreateDirectory(parent->m_Volume, parent, name, nameLength, permission);
 }
 
@@ -700,6 +785,8 @@ void ksymlink_trw(KLocateFlags locateFlags, const char* target, int baseFolderFD
     size_t      nameLength;
 
     Ptr<KInode> parent = klocate_parent_inode_trw(locateFlags, baseInode, linkPath, pathLength, &name, &nameLength);
+
+    PScopeExit nameCacheGuard([&parent]() { KNameCache::InvalidateNegative(ptr_raw_pointer_cast(parent)); });
     parent->m_Filesystem->CreateSymlink(parent->m_Volume, parent, name, nameLength, target);
 }
 
@@ -795,6 +882,15 @@ void krename_trw(KLocateFlags locateFlags, const char* inOldPath, const char* in
     if (oldParent->m_Volume->m_VolumeID != newParent->m_Volume->m_VolumeID) {
         PERROR_THROW_CODE(PErrorCode::XDEV);
     }
+
+    PScopeExit nameCacheGuard([&oldParent, &newParent]()
+        {
+            KNameCache::InvalidateDirectory(ptr_raw_pointer_cast(oldParent));
+            if (newParent != oldParent) {
+                KNameCache::InvalidateDirectory(ptr_raw_pointer_cast(newParent));
+            }
+        }
+    );
     oldParent->m_Filesystem->Rename(oldParent->m_Volume, oldParent, oldName, oldNameLength, newParent, newName, newNameLength, mustBeDir);
 }
 
@@ -823,6 +919,8 @@ void kunlink_trw(KLocateFlags locateFlags, int baseFolderFD, const char* inPath)
     size_t      nameLength;
 
     Ptr<KInode> parent = klocate_parent_inode_trw(locateFlags, baseInode, path.c_str(), path.size(), &name, &nameLength);
+
+    PScopeExit nameCacheGuard([&parent]() { KNameCache::InvalidateDirectory(ptr_raw_pointer_cast(parent)); });
     parent->m_Filesystem->Unlink(parent->m_Volume, parent, name, nameLength);
 }
 
@@ -860,6 +958,8 @@ void kremove_directory_trw(KLocateFlags locateFlags, int baseFolderFD, const cha
     }
 
     Ptr<KInode> parent = klocate_parent_inode_trw(locateFlags, baseInode, path.c_str(), path.size(), &name, &nameLength);
+
+    PScopeExit nameCacheGuard([&parent]() { KNameCache::InvalidateDirectory(ptr_raw_pointer_cast(parent)); });
     parent->m_Filesystem->RemoveDirectory(parent->m_Volume, parent, name, nameLength);
 }
 
@@ -904,6 +1004,20 @@ int kfsync(int handle) noexcept
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
+PErrorCode kfallocate(int handle, int mode, off_t offset, off_t length) noexcept
+{
+    try
+    {
+        kfallocate_trw(handle, mode, offset, length);
+        return PErrorCode::Success;
+    }
+    PERROR_CATCH_RET_CODE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
 PErrorCode kdevice_control(int handle, int request, const void* inData, size_t inDataLength, void* outData, size_t outDataLength) noexcept
 {
     try
@@ -931,6 +1045,19 @@ ssize_t kread_directory(int handle, void* buffer, size_t bufferSize) noexcept
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
+ssize_t kread_directory_plus(int handle, void* buffer, size_t bufferSize) noexcept
+{
+    try
+    {
+        return kread_directory_plus_trw(handle, buffer, bufferSize);
+    }
+    PERROR_CATCH_SET_ERRNO(-1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
 PErrorCode krewind_directory(int handle) noexcept
 {
     try
@@ -1219,7 +1346,36 @@ Ptr<KInode> klocate_inode_by_name_trw(KLocateFlags locateFlags, Ptr<KInode> pare
             return parent;
         }
     }
-    Ptr<KInode> inode = parent->m_Filesystem->LocateInode(parent->m_Volume, parent, name, nameLength);
+    Ptr<KInode> inode;
+    if (parent->m_Filesystem->SupportsNameCache() && !PString::is_dot(name, nameLength) && !PString::is_dot_dot(name, nameLength))
+    {
+        if (KNameCache::Lookup(parent, name, nameLength, inode))
+        {
+            if (inode == nullptr) {
+                PERROR_THROW_CODE(PErrorCode::NOENT);
+            }
+        }
+        else
+        {
+            const uint32_t generation = KNameCache::GetGeneration();
+            try
+            {
+                inode = parent->m_Filesystem->LocateInode(parent->m_Volume, parent, name, nameLength);
+            }
+            catch (const std::system_error& error)
+            {
+                if (PErrorCode(error.code().value()) == PErrorCode::NOENT) {
+                    KNameCache::Insert(parent, name, nameLength, nullptr, generation);
+                }
+                throw;
+            }
+            KNameCache::Insert(parent, name, nameLength, inode, generation);
+        }
+    }
+    else
+    {
+        inode = parent->m_Filesystem->LocateInode(parent->m_Volume, parent, name, nameLength);
+    }
     RequireActiveInode(inode);
     if (locateFlags.Has(KLocateFlag::CrossMount) && inode->m_MountRoot != nullptr) {
         inode = inode->m_MountRoot;
@@ -26,7 +26,6 @@
 
 #include <algorithm>
 #include <map>
-#include <tuple>
 
 #include <Kernel/KTime.h>
 #include <Kernel/VFS/KBlockCache.h>
@@ -41,29 +40,310 @@
 namespace kernel
 {
 
+// Number of BUFFER_BLOCK_SIZE units in the cache. The units are grouped in
+// pages of MAX_BUFFER_SIZE bytes, and each page is split into buffers of a
+// single size when taken into use.
 #ifdef PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
 static constexpr int KBLOCK_CACHE_BLOCK_COUNT = 4080;
 #else
 static constexpr int KBLOCK_CACHE_BLOCK_COUNT = 4096;
 #endif // PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
 
+static constexpr int KBLOCK_CACHE_UNITS_PER_PAGE = int(KBlockCache::MAX_BUFFER_SIZE / KBlockCache::BUFFER_BLOCK_SIZE);
+static constexpr int KBLOCK_CACHE_PAGE_COUNT     = KBLOCK_CACHE_BLOCK_COUNT / KBLOCK_CACHE_UNITS_PER_PAGE;
+
+static_assert(KBLOCK_CACHE_BLOCK_COUNT % KBLOCK_CACHE_UNITS_PER_PAGE == 0);
+static_assert((KBlockCache::BUFFER_BLOCK_SIZE << (KBlockCache::BUFFER_SIZE_CLASS_COUNT - 1)) == KBlockCache::MAX_BUFFER_SIZE);
+
 static uint8_t* gk_BCacheBuffer;
 static KCacheBlockHeader gk_BCacheHeaders[KBLOCK_CACHE_BLOCK_COUNT];
+static uint8_t gk_BCachePageUseCount[KBLOCK_CACHE_PAGE_COUNT]; // Buffers in each page not on a free list.
 
 std::map<int, KBlockCache*>         KBlockCache::s_DeviceMap;
-PIntrusiveList<KCacheBlockHeader>   KBlockCache::s_FreeList;
-PIntrusiveList<KCacheBlockHeader>   KBlockCache::s_MRUList;
+PIntrusiveList<KCacheBlockHeader>   KBlockCache::s_FreeLists[KBlockCache::BUFFER_SIZE_CLASS_COUNT];
+PIntrusiveList<KCacheBlockHeader>   KBlockCache::s_FreePages;
+PTwoQueueCachePolicy<KCacheBlockHeader> KBlockCache::s_ReplacementPolicy;
 KMutex                              KBlockCache::s_Mutex("bcache_mutex", PEMutexRecursionMode_RaiseError);
 KConditionVariable                  KBlockCache::s_FlushingRequestConditionVar("bcache_flush_req");
 KConditionVariable                  KBlockCache::s_FlushingDoneConditionVar("bcache_flush_done");
 std::atomic_int                     KBlockCache::s_DirtyBlockCount;
+std::atomic_int                     KBlockCache::s_BlockWaiterCount;
+
+static inline size_t get_page_index(const KCacheBlockHeader* block)
+{
+    return size_t(block - gk_BCacheHeaders) / KBLOCK_CACHE_UNITS_PER_PAGE;
+}
+
+static inline size_t get_buffer_size_class(size_t bufferSize)
+{
+    size_t sizeClass = 0;
+    while ((KBlockCache::BUFFER_BLOCK_SIZE << sizeClass) < bufferSize) {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+static inline bool is_power_of_two(size_t value)
+{
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KCacheBlockHeader* KCacheBlockMap::Find(off64_t bufferNumber) const
+{
+    if (m_Count == 0) {
+        return nullptr;
+    }
+    const size_t mask = m_Slots.size() - 1;
+    for (size_t slot = GetHomeSlot(bufferNumber); ; slot = (slot + 1) & mask)
+    {
+        KCacheBlockHeader* block = m_Slots[slot];
+        if (block == nullptr) {
+            return nullptr;
+        }
+        if (block->m_bufferNumber == bufferNumber) {
+            return block;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KCacheBlockMap::Insert_trw(KCacheBlockHeader* block)
+{
+    Reserve_trw(m_Count + 1);
+
+    const size_t mask = m_Slots.size() - 1;
+    size_t slot = GetHomeSlot(block->m_bufferNumber);
+    while (m_Slots[slot] != nullptr)
+    {
+        kassert(m_Slots[slot]->m_bufferNumber != block->m_bufferNumber);
+        slot = (slot + 1) & mask;
+    }
+    m_Slots[slot] = block;
+    m_Count++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Make room for "count" entries so that inserting up to that many can't fail.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KCacheBlockMap::Reserve_trw(size_t count)
+{
+    // Keep the load factor at or below 1/2.
+    size_t capacity = std::max(MIN_CAPACITY, m_Slots.size());
+    while (count * 2 > capacity) {
+        capacity *= 2;
+    }
+    if (capacity != m_Slots.size()) {
+        Rehash_trw(capacity);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool KCacheBlockMap::Remove(KCacheBlockHeader* block)
+{
+    if (m_Count == 0) {
+        return false;
+    }
+    const size_t mask = m_Slots.size() - 1;
+    size_t slot = GetHomeSlot(block->m_bufferNumber);
+    for (;;)
+    {
+        if (m_Slots[slot] == nullptr) {
+            return false;
+        }
+        if (m_Slots[slot] == block) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    // Backward-shift deletion: pull later members of the probe run into
+    // the hole if their home slot is at or before it.
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & mask; m_Slots[next] != nullptr; next = (next + 1) & mask)
+    {
+        const size_t home = GetHomeSlot(m_Slots[next]->m_bufferNumber);
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            m_Slots[hole] = m_Slots[next];
+            hole = next;
+        }
+    }
+    m_Slots[hole] = nullptr;
+    m_Count--;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KCacheBlockMap::Clear()
+{
+    m_Slots.clear();
+    m_Count     = 0;
+    m_HashShift = 64;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
 
+void KCacheBlockMap::Rehash_trw(size_t newCapacity)
+{
+    std::vector<KCacheBlockHeader*> oldSlots(newCapacity, nullptr);
+    std::swap(oldSlots, m_Slots);
+
+    m_HashShift = 64;
+    for (size_t capacity = newCapacity; capacity > 1; capacity >>= 1) {
+        m_HashShift--;
+    }
+    const size_t mask = m_Slots.size() - 1;
+    for (KCacheBlockHeader* block : oldSlots)
+    {
+        if (block != nullptr)
+        {
+            size_t slot = GetHomeSlot(block->m_bufferNumber);
+            while (m_Slots[slot] != nullptr) {
+                slot = (slot + 1) & mask;
+            }
+            m_Slots[slot] = block;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KCacheBlockDirtyTree::Insert(KCacheBlockHeader* block)
+{
+    kassert((block->m_Flags & BCF_IN_DIRTY_TREE) == 0);
+
+    KCacheBlockHeader* left;
+    KCacheBlockHeader* right;
+    Split(m_Root, block->m_bufferNumber, left, right);
+
+    block->m_DirtyTreeLeft  = nullptr;
+    block->m_DirtyTreeRight = nullptr;
+    block->m_Flags |= BCF_IN_DIRTY_TREE;
+    m_Root = Merge(Merge(left, block), right);
+    m_Count++;
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-KBlockCache::KBlockCache() : m_Device(-1), m_BlockSize(0), m_BlockCount(0), m_BlocksPerBuffer(1), m_BlockToBufferShift(0), m_BufferOffsetMask(0x00)
+void KCacheBlockDirtyTree::Remove(KCacheBlockHeader* block)
+{
+    kassert((block->m_Flags & BCF_IN_DIRTY_TREE) != 0);
+
+    KCacheBlockHeader* left;
+    KCacheBlockHeader* middle;
+    KCacheBlockHeader* right;
+    Split(m_Root, block->m_bufferNumber, left, right);
+    Split(right, block->m_bufferNumber + 1, middle, right);
+    kassert(middle == block);
+
+    block->m_DirtyTreeLeft  = nullptr;
+    block->m_DirtyTreeRight = nullptr;
+    block->m_Flags &= ~BCF_IN_DIRTY_TREE;
+    m_Root = Merge(left, right);
+    m_Count--;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Find the dirty block with the lowest buffer number not below
+/// "bufferNumber", or nullptr if there is none.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KCacheBlockHeader* KCacheBlockDirtyTree::FindFirstAtOrAfter(off64_t bufferNumber) const
+{
+    KCacheBlockHeader* result = nullptr;
+    for (KCacheBlockHeader* node = m_Root; node != nullptr; )
+    {
+        if (node->m_bufferNumber >= bufferNumber)
+        {
+            result = node;
+            node = node->m_DirtyTreeLeft;
+        }
+        else
+        {
+            node = node->m_DirtyTreeRight;
+        }
+    }
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Split the subtree at "node" into blocks below "bufferNumber" and blocks
+/// at or above it.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KCacheBlockDirtyTree::Split(KCacheBlockHeader* node, off64_t bufferNumber, KCacheBlockHeader*& outLeft, KCacheBlockHeader*& outRight)
+{
+    if (node == nullptr)
+    {
+        outLeft  = nullptr;
+        outRight = nullptr;
+    }
+    else if (node->m_bufferNumber < bufferNumber)
+    {
+        Split(node->m_DirtyTreeRight, bufferNumber, node->m_DirtyTreeRight, outRight);
+        outLeft = node;
+    }
+    else
+    {
+        Split(node->m_DirtyTreeLeft, bufferNumber, outLeft, node->m_DirtyTreeLeft);
+        outRight = node;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Join two subtrees where all blocks in "left" sort before all blocks in
+/// "right".
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KCacheBlockHeader* KCacheBlockDirtyTree::Merge(KCacheBlockHeader* left, KCacheBlockHeader* right)
+{
+    if (left == nullptr) {
+        return right;
+    }
+    if (right == nullptr) {
+        return left;
+    }
+    if (GetPriority(left) > GetPriority(right))
+    {
+        left->m_DirtyTreeRight = Merge(left->m_DirtyTreeRight, right);
+        return left;
+    }
+    else
+    {
+        right->m_DirtyTreeLeft = Merge(left, right->m_DirtyTreeLeft);
+        return right;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KBlockCache::KBlockCache() : m_Mutex("bcache_device", PEMutexRecursionMode_RaiseError), m_Device(-1), m_BlockSize(0), m_BlockCount(0), m_BufferSize(0), m_BufferSizeClass(0), m_BlocksPerBuffer(1), m_BlockToBufferShift(0), m_BufferOffsetMask(0x00)
 {
 }
 
@@ -93,11 +373,19 @@ KBlockCache* KBlockCache::GetDeviceCache(int device)
 }
 
 ///////////////////////////////////////////////////////////////////////////////
+/// Attach the cache to "device". Blocks are cached in buffers of
+/// "bufferSize" bytes, which must be a power of two between "blockSize" and
+/// MAX_BUFFER_SIZE. A "bufferSize" of 0 use one device block per buffer.
+/// Larger buffers let the cache read and write the device in bigger chunks,
+/// at the cost of some memory for sparsely accessed blocks.
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-bool KBlockCache::SetDevice(int device, off64_t blockCount, size_t blockSize)
+bool KBlockCache::SetDevice(int device, off64_t blockCount, size_t blockSize, size_t bufferSize)
 {
+    CRITICAL_SCOPE(m_Mutex);
+    CRITICAL_SCOPE(s_Mutex);
+
     if (m_Device != -1 )
     {
         auto i = s_DeviceMap.find(m_Device);
@@ -107,53 +395,53 @@ bool KBlockCache::SetDevice(int device, off64_t blockCount, size_t blockSize)
             kernel_log<PLogSeverity::ERROR>(LogCatKernel_BlockCache, "KBlockCache::SetDevice() previous device {} not registered!", m_Device);
         }
         m_Device = -1;
+        // Blocks from the old device stay in the replacement queues until evicted,
+        // but must never be found through this cache again.
+        m_BlockMap.Clear();
+        m_LastAccessBuffer = -1;
+        m_ReadAheadWindow  = 0;
+        m_FlushCursor      = 0;
+        // The flusher can't reach blocks of a detached device, so any that
+        // are still dirty are lost.
+        if (m_DirtyTree.GetCount() != 0)
+        {
+            kernel_log<PLogSeverity::ERROR>(LogCatKernel_BlockCache, "KBlockCache::SetDevice() discarding {} dirty blocks.", m_DirtyTree.GetCount());
+            m_DirtyTree.Clear([](KCacheBlockHeader* block) { block->SetDirty(false); });
+        }
     }
     if (s_DeviceMap.find(device) != s_DeviceMap.end()) {
         kernel_log<PLogSeverity::ERROR>(LogCatKernel_BlockCache, "KBlockCache::SetDevice() device {} already registered!", device);
         return false;        
     }
-    m_Device     = device;
-
-    if (m_Device == -1) {
+    if (device == -1) {
         return true;
     }
-
+    if (bufferSize == 0) {
+        bufferSize = std::max(blockSize, size_t(BUFFER_BLOCK_SIZE));
+    }
+#ifdef PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
+    // The flush diagnostics mirror the device in BUFFER_BLOCK_SIZE units.
+    bufferSize = BUFFER_BLOCK_SIZE;
+#endif // PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
+    if (!is_power_of_two(blockSize) || !is_power_of_two(bufferSize) || blockSize < MIN_BLOCK_SIZE || blockSize > bufferSize || bufferSize > MAX_BUFFER_SIZE)
+    {
+        kernel_log<PLogSeverity::ERROR>(LogCatKernel_BlockCache, "KBlockCache::SetDevice() unsupported block size {} / buffer size {}.", blockSize, bufferSize);
+        set_last_error(EINVAL);
+        return false;
+    }
+    m_Device = device;
     s_DeviceMap[m_Device] = this;
     
-    m_BlockCount = blockCount;
-    m_BlockSize  = blockSize;
-    
-    switch(m_BlockSize)
-    {
-        case 512:
-//            m_BlocksPerBuffer = 8;
-//            m_BlockToBufferShift = 3;
-//            m_BufferOffsetMask = 0x07;
-            m_BlocksPerBuffer = 1;
-            m_BlockToBufferShift = 0;
-            m_BufferOffsetMask = 0x00;
-            break;
-        case 1024:
-            m_BlocksPerBuffer = 4;
-            m_BlockToBufferShift = 2;
-            m_BufferOffsetMask = 0x03;
-            break;
-        case 2048:
-            m_BlocksPerBuffer = 2;
-            m_BlockToBufferShift = 1;
-            m_BufferOffsetMask = 0x01;
-            break;
-        case 4096:
-            m_BlocksPerBuffer = 1;
-            m_BlockToBufferShift = 0;
-            m_BufferOffsetMask = 0x00;
-            break;
-        default:
-            m_BlocksPerBuffer = 1;
-            m_BlockToBufferShift = 0;
-            m_BufferOffsetMask = 0x00;
-            return false;
+    m_BlockCount         = blockCount;
+    m_BlockSize          = blockSize;
+    m_BufferSize         = bufferSize;
+    m_BufferSizeClass    = get_buffer_size_class(bufferSize);
+    m_BlocksPerBuffer    = int(bufferSize / blockSize);
+    m_BlockToBufferShift = 0;
+    while ((1 << m_BlockToBufferShift) < m_BlocksPerBuffer) {
+        m_BlockToBufferShift++;
     }
+    m_BufferOffsetMask = uint32_t(m_BlocksPerBuffer - 1);
     return true;
 }
 
@@ -178,7 +466,9 @@ void KBlockCache::Initialize()
     {
         gk_BCacheHeaders[i].m_Buffer = buffer;
         buffer += BUFFER_BLOCK_SIZE;
-        s_FreeList.Append(&gk_BCacheHeaders[i]);
+    }
+    for (int i = 0; i < KBLOCK_CACHE_PAGE_COUNT; ++i) {
+        s_FreePages.Append(&gk_BCacheHeaders[i * KBLOCK_CACHE_UNITS_PER_PAGE]);
     }
     PThreadAttribs attrs("disk_cache_flusher", 0, PThreadDetachState_Detached, 4096);
     kthread_spawn_trw(
@@ -195,123 +485,475 @@ void KBlockCache::Initialize()
 }
 
 ///////////////////////////////////////////////////////////////////////////////
+/// Get the cache block holding "blockNum". Blocks requested with
+/// "isMetadata" (FAT tables, directories, etc.) are kept in a separate
+/// queue that is evicted last, so large sequential transfers don't push
+/// the filesystem's working set out of the cache.
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-KCacheBlockDesc KBlockCache::GetBlock_trw(off64_t blockNum, bool doLoad)
+KCacheBlockDesc KBlockCache::GetBlock_trw(off64_t blockNum, bool doLoad, bool isMetadata)
 {
 //    ProfileTimer pt("GetBlock", 2.0e-3);
-    CRITICAL_SCOPE(s_Mutex);
-    
-    
-    doLoad = true; // Until we properly handle partially loaded blocks.
-    
-    off64_t bufferNum   = blockNum >> m_BlockToBufferShift;
-    size_t  blockOffset = size_t((blockNum & m_BufferOffsetMask) * m_BlockSize);
-    
-    for (int retry = 0; retry < 10; ++retry)
+    CRITICAL_SCOPE(m_Mutex);
+
+    const off64_t  bufferNum   = blockNum >> m_BlockToBufferShift;
+    const uint32_t blockIndex  = uint32_t(blockNum & m_BufferOffsetMask);
+    const size_t   blockOffset = blockIndex * m_BlockSize;
+    const uint32_t blockMask   = 1u << blockIndex;
+
+    const bool isSequential = bufferNum == m_LastAccessBuffer + 1;
+    m_LastAccessBuffer = bufferNum;
+    m_Lookups++;
+
+    KCacheBlockHeader* block = m_BlockMap.Find(bufferNum);
+    if (block != nullptr)
     {
-        auto i = m_BlockMap.find(bufferNum);
-        if (i != m_BlockMap.end())
+        m_Hits++;
+        block->AddRef();
+        KCacheBlockDesc blockDesc(block, blockOffset);
+        if (block->m_IsReadAhead)
         {
-            KCacheBlockHeader* block = i->second;
-            block->AddRef();
-            if (s_MRUList.GetLast() != block)
-            {
-                s_MRUList.Remove(block);
-                s_MRUList.Append(block);
+            block->m_IsReadAhead = false;
+            m_ReadAheadHits++;
+        }
+        // Don't stall cache hits on the global lock. If it is busy the block
+        // is flagged instead, and registered as a hit by the next eviction.
+        // Metadata hits always take the lock, since they may need to move
+        // the block to the pinned queue.
+        if (isMetadata)
+        {
+            CRITICAL_SCOPE(s_Mutex);
+            block->m_Referenced = false;
+            s_ReplacementPolicy.Touch(block, true);
+        }
+        else if (s_Mutex.TryLock() == PErrorCode::Success)
+        {
+            block->m_Referenced = false;
+            s_ReplacementPolicy.Touch(block, false);
+            s_Mutex.Unlock();
+        }
+        else
+        {
+            block->m_Referenced = true;
+        }
+        // Buffers written without loading are only partially valid. A load
+        // fills in the rest of the buffer, while a caller that will
+        // overwrite the block only needs it flagged as valid.
+        if (doLoad)
+        {
+            if (block->m_ValidMask != GetDeviceValidMask(bufferNum)) {
+                LoadMissingBlocks_trw(block);
             }
-            return KCacheBlockDesc(block, blockOffset);
         }
+        else if ((block->m_ValidMask & blockMask) == 0)
+        {
+            CRITICAL_SCOPE(s_Mutex);
+            block->m_ValidMask |= uint8_t(blockMask);
+        }
+        return blockDesc;
+    }
+
+    KCacheBlockHeader* blocks[MAX_READ_AHEAD_BUFFERS + 1];
+    size_t             blockCount = 0;
 
-        KCacheBlockHeader* block = nullptr;
+    PScopeFail contextCleanup([&blocks, &blockCount]()
+        {
+            CRITICAL_SCOPE(s_Mutex);
+            for (size_t i = 0; i < blockCount; ++i) {
+                PushFreeBlock(blocks[i]);
+            }
+        }
+    );
+    blocks[blockCount++] = AllocateBlock_trw();
+
+    // Extend the load with the following buffers while they are uncached,
+    // inside the device, and can be allocated without waiting.
+    if (doLoad)
+    {
+        const uint32_t readAhead   = UpdateReadAheadWindow(isSequential);
+        const off64_t  bufferCount = (m_BlockCount + m_BlocksPerBuffer - 1) >> m_BlockToBufferShift;
+        for (uint32_t i = 1; i <= readAhead; ++i)
+        {
+            const off64_t nextBuffer = bufferNum + i;
+            if (nextBuffer >= bufferCount || m_BlockMap.Find(nextBuffer) != nullptr) {
+                break;
+            }
+            KCacheBlockHeader* extraBlock = AllocateBlock_trw(false);
+            if (extraBlock == nullptr) {
+                break;
+            }
+            blocks[blockCount++] = extraBlock;
+        }
+    }
+    // The blocks are not visible to anyone else until they are added to the
+    // map, so the load only need to hold the device lock.
+    const size_t loadedCount = (doLoad) ? LoadBlocks_trw(bufferNum, blocks, blockCount) : blockCount;
+
+    CRITICAL_SCOPE(s_Mutex);
+
+    m_BlockMap.Reserve_trw(m_BlockMap.GetCount() + loadedCount);
+
+    for (size_t i = 0; i < blockCount; ++i)
+    {
+        KCacheBlockHeader* loadedBlock = blocks[i];
+        if (i >= loadedCount)
+        {
+            PushFreeBlock(loadedBlock);
+            continue;
+        }
+        loadedBlock->m_UseCount     = (i == 0) ? 1 : 0;
+        loadedBlock->m_Referenced   = false;
+        loadedBlock->m_IsReadAhead  = i != 0;
+        loadedBlock->m_Flags        = 0;
+        loadedBlock->m_Device       = m_Device;
+        loadedBlock->m_bufferNumber = bufferNum + off64_t(i);
+        loadedBlock->m_BlockShift   = uint8_t(m_BlockToBufferShift);
+        loadedBlock->m_ValidMask    = uint8_t((doLoad) ? GetDeviceValidMask(loadedBlock->m_bufferNumber) : blockMask);
+        m_BlockMap.Insert_trw(loadedBlock);
+        if (i == 0) {
+            s_ReplacementPolicy.Insert(loadedBlock, GetPolicyKey(loadedBlock), isMetadata);
+        } else {
+            s_ReplacementPolicy.InsertSpeculative(loadedBlock);
+        }
+    }
+    m_ReadAheadBlocks += uint32_t(loadedCount - 1);
+    if (doLoad) {
+        m_LoadedBuffers += uint32_t(loadedCount);
+    }
+
+//                kernel_log<PLogSeverity::ERROR>(LogCatKernel_BlockCache, "Block {} read.", bufferNum);
+
+    return KCacheBlockDesc(blocks[0], blockOffset);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Read "blockCount" consecutive buffers starting at "bufferNum" with a
+/// single request. The last buffer of the device is only read up to the end
+/// of the device. Returns the number of buffers completely loaded, which
+/// is at least one.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t KBlockCache::LoadBlocks_trw(off64_t bufferNum, KCacheBlockHeader** blocks, size_t blockCount)
+{
+    const off64_t position   = bufferNum * m_BufferSize;
+    const off64_t deviceSize = m_BlockCount * m_BlockSize;
+
+    iovec_t segments[MAX_READ_AHEAD_BUFFERS + 1];
+    off64_t length = 0;
+    for (size_t i = 0; i < blockCount; ++i)
+    {
+        segments[i].iov_base = blocks[i]->m_Buffer;
+        segments[i].iov_len  = size_t(std::min(off64_t(m_BufferSize), deviceSize - position - length));
+        length += segments[i].iov_len;
+    }
+    size_t bytesRead;
+    if (blockCount == 1) {
+        bytesRead = kpread_trw(m_Device, segments[0].iov_base, segments[0].iov_len, position);
+    } else {
+        bytesRead = kpreadv_trw(m_Device, segments, blockCount, position);
+    }
+    size_t loadedCount = 0;
+    for (; loadedCount < blockCount && bytesRead >= segments[loadedCount].iov_len; ++loadedCount) {
+        bytesRead -= segments[loadedCount].iov_len;
+    }
+    if (loadedCount == 0) {
+        PERROR_THROW_CODE(PErrorCode::IO);
+    }
+    return loadedCount;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Read the blocks of a cached buffer that are not valid yet. Blocks already
+/// valid might be dirty, so each run of missing blocks is read separately
+/// directly into place. Must be called with the device lock held.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KBlockCache::LoadMissingBlocks_trw(KCacheBlockHeader* block)
+{
+    kassert(m_Mutex.IsLocked());
+
+    const uint32_t missingMask = GetDeviceValidMask(block->m_bufferNumber) & ~uint32_t(block->m_ValidMask);
+    const off64_t  position    = block->m_bufferNumber * m_BufferSize;
+
+    uint32_t loadedMask = 0;
+    for (int first = 0; first < m_BlocksPerBuffer; )
+    {
+        if ((missingMask & (1u << first)) == 0)
+        {
+            first++;
+            continue;
+        }
+        int end = first + 1;
+        while (end < m_BlocksPerBuffer && (missingMask & (1u << end)) != 0) {
+            end++;
+        }
+        const size_t offset = first * m_BlockSize;
+        const size_t length = (end - first) * m_BlockSize;
+        if (kpread_trw(m_Device, static_cast<uint8_t*>(block->m_Buffer) + offset, length, position + offset) != length) {
+            PERROR_THROW_CODE(PErrorCode::IO);
+        }
+        loadedMask |= ((1u << end) - 1) & ~((1u << first) - 1);
+        first = end;
+    }
+    m_LoadedBuffers++;
+
+    CRITICAL_SCOPE(s_Mutex);
+    block->m_ValidMask |= uint8_t(loadedMask);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Get the valid mask of a completely loaded buffer. This has one bit per
+/// block in the buffer, except for the last buffer of a device with a block
+/// count that is not a multiple of the blocks per buffer.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t KBlockCache::GetDeviceValidMask(off64_t bufferNum) const
+{
+    const off64_t blocksInDevice = std::min(off64_t(m_BlocksPerBuffer), m_BlockCount - (bufferNum << m_BlockToBufferShift));
+    return (blocksInDevice > 0) ? ((1u << blocksInDevice) - 1) : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Grow the read-ahead window while misses are sequential, and drop it on
+/// the first random access. Evicting unused read-ahead buffers shrinks it
+/// (see TryEvictBlock()). Returns the number of buffers to read ahead.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t KBlockCache::UpdateReadAheadWindow(bool isSequential)
+{
+    if (!isSequential) {
+        m_ReadAheadWindow = 0;
+    } else if (m_ReadAheadWindow == 0) {
+        m_ReadAheadWindow = MIN_READ_AHEAD_BUFFERS;
+    } else {
+        m_ReadAheadWindow = std::min(m_ReadAheadWindow * 2, MAX_READ_AHEAD_BUFFERS);
+    }
+    return m_ReadAheadWindow;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Account for a block leaving the cache. Read-ahead buffers evicted before
+/// use count as waste and halve the read-ahead window. Must be called with
+/// the device lock held.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KBlockCache::ReadAheadBlockEvicted(KCacheBlockHeader* block)
+{
+    if (block->m_IsReadAhead)
+    {
+        block->m_IsReadAhead = false;
+        m_ReadAheadWasted++;
+        m_ReadAheadWindow /= 2;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Get an unused buffer of "sizeClass" from its free list, splitting a free
+/// page if there are none. Returns nullptr if there are no free pages
+/// either. Must be called with s_Mutex held.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KCacheBlockHeader* KBlockCache::PopFreeBlock(size_t sizeClass)
+{
+    kassert(s_Mutex.IsLocked());
+
+    PIntrusiveList<KCacheBlockHeader>& freeList = s_FreeLists[sizeClass];
+    if (freeList.IsEmpty())
+    {
+        KCacheBlockHeader* page = s_FreePages.GetLast();
+        if (page == nullptr) {
+            return nullptr;
+        }
+        s_FreePages.Remove(page);
+
+        const int unitsPerBuffer = 1 << sizeClass;
+        for (int i = 0; i < KBLOCK_CACHE_UNITS_PER_PAGE; i += unitsPerBuffer)
+        {
+            page[i].m_BufferSize = uint16_t(BUFFER_BLOCK_SIZE << sizeClass);
+            freeList.Append(&page[i]);
+        }
+    }
+    KCacheBlockHeader* block = freeList.GetLast();
+    freeList.Remove(block);
+    gk_BCachePageUseCount[get_page_index(block)]++;
+    return block;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Return an unused buffer to the free list of its size class. When the last
+/// buffer of a page is released the page is returned to the free page list,
+/// so it can be split to a different buffer size. Must be called with
+/// s_Mutex held.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KBlockCache::PushFreeBlock(KCacheBlockHeader* block)
+{
+    kassert(s_Mutex.IsLocked());
+
+    const size_t sizeClass = get_buffer_size_class(block->m_BufferSize);
+    const size_t pageIndex = get_page_index(block);
+
+    block->m_ValidMask = 0;
+    s_FreeLists[sizeClass].Append(block);
+
+    if (--gk_BCachePageUseCount[pageIndex] == 0)
+    {
+        KCacheBlockHeader* page = &gk_BCacheHeaders[pageIndex * KBLOCK_CACHE_UNITS_PER_PAGE];
+        const int unitsPerBuffer = 1 << sizeClass;
+        for (int i = 0; i < KBLOCK_CACHE_UNITS_PER_PAGE; i += unitsPerBuffer) {
+            s_FreeLists[sizeClass].Remove(&page[i]);
+        }
+        s_FreePages.Append(page);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Get an unused buffer of the device's buffer size from the free lists, or
+/// evict clean buffers in the replacement policy's order until one is
+/// available.
+/// Must be called with the device lock held. The returned block is not a
+/// member of any list or map. If "mayWait" is false nullptr is returned
+/// instead of waiting for blocks to be flushed or released.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KCacheBlockHeader* KBlockCache::AllocateBlock_trw(bool mayWait)
+{
+    kassert(m_Mutex.IsLocked());
+    CRITICAL_SCOPE(s_Mutex);
 
-        if (s_FreeList.GetLast() != nullptr)
-        {
-            block = s_FreeList.GetLast();
-            s_FreeList.Remove(block);
+    for (int retry = 0; retry < 10; ++retry)
+    {
+        KCacheBlockHeader* block = PopFreeBlock(m_BufferSizeClass);
+        if (block != nullptr) {
+            return block;
         }
-        else if (s_MRUList.GetFirst() != nullptr)
+        if (s_ReplacementPolicy.IsEmpty())
         {
-            for (auto i : s_MRUList)
-            {
-                if (i->m_UseCount == 0 /*&& !i->IsFlushing() && !i->IsDirty()*/)
-                {
-                    block = i;
-                    break;
-                }
-            }
-            if (block == nullptr)
-            {
-                s_FlushingRequestConditionVar.WakeupAll();
-                s_FlushingDoneConditionVar.Wait(s_Mutex);
-                continue;
+            if (!mayWait) {
+                return nullptr;
             }
-            if (block->IsFlushing())
-            {
-                s_FlushingDoneConditionVar.Wait(s_Mutex);
-                continue;
-            }
-            if (block->IsDirty())
-            {
-                block->SetFlushRequested(true);
-                s_FlushingRequestConditionVar.WakeupAll();
-                s_FlushingDoneConditionVar.Wait(s_Mutex);
-                continue;
-            }
-            s_MRUList.Remove(block);
-            auto i = m_BlockMap.find(block->m_bufferNumber);
-            if (i != m_BlockMap.end()) {
-                m_BlockMap.erase(i);
-            }
-        }
-        else
-        {
             kernel_log<PLogSeverity::ERROR>(LogCatKernel_BlockCache, "KBlockCache::GetBlock() all cache blocks locked!");
             PERROR_THROW_CODE(PErrorCode::AGAIN);
         }
-        kassert(block != nullptr);
-        if (block == nullptr) {
-            PERROR_THROW_CODE(PErrorCode::AGAIN);
+        // Announce the waiter before scanning use counts, so a concurrent
+        // RemoveRef() either is seen by the scan or wakes us up.
+        s_BlockWaiterCount++;
+        // The first pass only evicts buffers of the requested size, since
+        // they can be reused directly. If that fails, buffers of any size are
+        // evicted until a page is released and can be re-split.
+        for (int pass = 0; pass < 2 && block == nullptr; ++pass)
+        {
+            s_ReplacementPolicy.ForEachVictimCandidate([this, pass, &block](KCacheBlockHeader* candidate)
+                {
+                    // Register hits made while the lock was busy, giving the
+                    // block a second chance.
+                    if (candidate->m_Referenced)
+                    {
+                        candidate->m_Referenced = false;
+                        s_ReplacementPolicy.Touch(candidate, false);
+                        return false;
+                    }
+                    if (candidate->m_UseCount != 0 || candidate->IsFlushing()) {
+                        return false;
+                    }
+                    if (pass == 0 && candidate->m_BufferSize != m_BufferSize) {
+                        return false;
+                    }
+                    if (candidate->IsDirty())
+                    {
+                        candidate->SetFlushRequested(true);
+                        return false;
+                    }
+                    if (TryEvictBlock(this, candidate))
+                    {
+                        PushFreeBlock(candidate);
+                        block = PopFreeBlock(m_BufferSizeClass);
+                    }
+                    return block != nullptr;
+                }
+            );
         }
-        PScopeFail contextCleanup([&block]() { s_FreeList.Append(block); });
-        if (doLoad)
+        if (block != nullptr || !mayWait)
         {
-            const ssize_t bytesRead = kpread_trw(m_Device, block->m_Buffer, BUFFER_BLOCK_SIZE, bufferNum * BUFFER_BLOCK_SIZE);
-            if (bytesRead != BUFFER_BLOCK_SIZE) {
-                PERROR_THROW_CODE(PErrorCode::IO);
-            }
+            s_BlockWaiterCount--;
+            return block;
         }
-        s_MRUList.Append(block);
-        block->m_UseCount     = 1;
-        block->m_Flags        = 0;
-        block->m_Device       = m_Device;
-        block->m_bufferNumber = bufferNum;
-        m_BlockMap[bufferNum] = block;
-                
-//                kernel_log<PLogSeverity::ERROR>(LogCatKernel_BlockCache, "Block {} read.", bufferNum);
-                
-        return KCacheBlockDesc(block, blockOffset);
+        s_FlushingRequestConditionVar.WakeupAll();
+        s_FlushingDoneConditionVar.Wait(s_Mutex);
+        s_BlockWaiterCount--;
     }
     kernel_log<PLogSeverity::ERROR>(LogCatKernel_BlockCache, "KBlockCache::GetBlock() to many retries. All blocks stuck in busy state.");
     PERROR_THROW_CODE(PErrorCode::AGAIN);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Remove an unused block from its owner's map and the replacement policy. Blocks
+/// owned by another device are only taken if that device's lock is free,
+/// since the lock order doesn't allow waiting for it here.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool KBlockCache::TryEvictBlock(KBlockCache* requester, KCacheBlockHeader* block)
+{
+    kassert(s_Mutex.IsLocked());
+
+    KBlockCache* owner = requester;
+    if (block->m_Device != requester->m_Device)
+    {
+        auto i = s_DeviceMap.find(block->m_Device);
+        owner = (i != s_DeviceMap.end()) ? i->second : nullptr;
+    }
+    if (owner == requester || owner == nullptr)
+    {
+        if (owner != nullptr) {
+            owner->m_BlockMap.Remove(block);
+            owner->ReadAheadBlockEvicted(block);
+            owner->m_Evictions++;
+        }
+        block->m_IsReadAhead = false;
+        s_ReplacementPolicy.Remove(block, GetPolicyKey(block));
+        return true;
+    }
+    if (owner->m_Mutex.TryLock() != PErrorCode::Success) {
+        return false;
+    }
+    // Recheck now that the owner can't hand out new references.
+    const bool isUnused = block->m_UseCount == 0;
+    if (isUnused)
+    {
+        owner->m_BlockMap.Remove(block);
+        owner->ReadAheadBlockEvicted(block);
+        owner->m_Evictions++;
+        s_ReplacementPolicy.Remove(block, GetPolicyKey(block));
+    }
+    owner->m_Mutex.Unlock();
+    return isUnused;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
 bool KBlockCache::MarkBlockDirty(off64_t blockNum)
 {
-    CRITICAL_SCOPE(s_Mutex);
+    CRITICAL_SCOPE(m_Mutex);
 
     off64_t bufferNum   = blockNum >> m_BlockToBufferShift;
 //    size_t  blockOffset = (blockNum & m_BufferOffsetMask) * m_BlockSize;
     
-    auto i = m_BlockMap.find(bufferNum);
-    if (i != m_BlockMap.end())
+    KCacheBlockHeader* block = m_BlockMap.Find(bufferNum);
+    if (block != nullptr)
     {
-        KCacheBlockHeader* block = i->second;
+        CRITICAL_SCOPE(s_Mutex);
         block->SetDirty(true);
         return true;
     }
@@ -324,10 +966,14 @@ bool KBlockCache::MarkBlockDirty(off64_t blockNum)
 
 void KBlockCache::CachedRead_trw(off64_t blockNum, void* buffer, size_t blockCount)
 {
-    for (size_t i = 0 ; i < blockCount ; ++i)
+    for (size_t i = 0 ; i < blockCount ; )
     {
-        KCacheBlockDesc block = GetBlock_trw(blockNum + i, true);
-        memcpy(reinterpret_cast<uint8_t*>(buffer) + i * m_BlockSize, block.m_Buffer, m_BlockSize);
+        // A loaded buffer is completely valid, so copy all requested blocks it hold at once.
+        const off64_t   curBlock  = blockNum + i;
+        const size_t    curCount  = std::min(blockCount - i, size_t(m_BlocksPerBuffer - (curBlock & m_BufferOffsetMask)));
+        KCacheBlockDesc block     = GetBlock_trw(curBlock, true);
+        memcpy(reinterpret_cast<uint8_t*>(buffer) + i * m_BlockSize, block.m_Buffer, curCount * m_BlockSize);
+        i += curCount;
     }
 }
 
@@ -347,25 +993,90 @@ void KBlockCache::CachedWrite_trw(off64_t blockNum, const void* buffer, size_t b
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Read "blockCount" blocks straight from the device into "buffer", without
+/// allocating cache blocks. Blocks that are cached might be newer than the
+/// device, so valid cached blocks are copied over the device data. The
+/// device lock is held across the read so none of them can be flushed and
+/// evicted in between.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KBlockCache::DirectRead_trw(off64_t blockNum, void* buffer, size_t blockCount)
+{
+    CRITICAL_SCOPE(m_Mutex);
+
+    const size_t length = blockCount * m_BlockSize;
+    if (kpread_trw(m_Device, buffer, length, blockNum * m_BlockSize) != length) {
+        PERROR_THROW_CODE(PErrorCode::IO);
+    }
+    m_DirectReadBlocks += uint32_t(blockCount);
+
+    if (m_BlockMap.GetCount() == 0) {
+        return;
+    }
+    CRITICAL_SCOPE(s_Mutex);
+    ForEachCachedBlockInRange(blockNum, blockCount, [this, blockNum, buffer](KCacheBlockHeader* block, uint32_t blockIndex, off64_t curBlock)
+        {
+            if (block->m_ValidMask & (1u << blockIndex)) {
+                memcpy(static_cast<uint8_t*>(buffer) + (curBlock - blockNum) * m_BlockSize, static_cast<const uint8_t*>(block->m_Buffer) + blockIndex * m_BlockSize, m_BlockSize);
+            }
+        }
+    );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Write "blockCount" blocks from "buffer" straight to the device. Valid
+/// cached copies of the blocks are updated to match. Dirty ones are
+/// re-flagged as dirty, so a flush of the old content racing with the
+/// write is followed by another flush. The same goes for clean blocks that
+/// are being flushed, since the flusher writes clean buffers to bridge gaps
+/// between dirty ones without holding the device lock.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KBlockCache::DirectWrite_trw(off64_t blockNum, const void* buffer, size_t blockCount)
+{
+    CRITICAL_SCOPE(m_Mutex);
+
+    const size_t length = blockCount * m_BlockSize;
+    if (kpwrite_trw(m_Device, buffer, length, blockNum * m_BlockSize) != length) {
+        PERROR_THROW_CODE(PErrorCode::IO);
+    }
+    m_DirectWriteBlocks += uint32_t(blockCount);
+
+    if (m_BlockMap.GetCount() == 0) {
+        return;
+    }
+    CRITICAL_SCOPE(s_Mutex);
+    ForEachCachedBlockInRange(blockNum, blockCount, [this, blockNum, buffer](KCacheBlockHeader* block, uint32_t blockIndex, off64_t curBlock)
+        {
+            if (block->m_ValidMask & (1u << blockIndex))
+            {
+                memcpy(static_cast<uint8_t*>(block->m_Buffer) + blockIndex * m_BlockSize, static_cast<const uint8_t*>(buffer) + (curBlock - blockNum) * m_BlockSize, m_BlockSize);
+                if (block->IsDirty() || block->IsFlushing()) {
+                    block->SetDirty(true);
+                }
+            }
+        }
+    );
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-bool KBlockCache::FlushInternal()
+void KBlockCache::FlushInternal()
 {
     kassert(s_Mutex.IsLocked());
 
     if (s_DirtyBlockCount != 0)
     {
-        for (auto block : s_MRUList)
-        {
-            if (block->IsDirty() /*&& !block->IsFlushing()*/) {
-                block->SetFlushRequested(true);
-            }
+        for (auto& device : s_DeviceMap) {
+            device.second->m_DirtyTree.ForEach([](KCacheBlockHeader* block) { block->SetFlushRequested(true); });
         }
         s_FlushingRequestConditionVar.WakeupAll();
     }
-    return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -376,10 +1087,13 @@ bool KBlockCache::Flush()
 {
     CRITICAL_SCOPE(KBlockCache::s_Mutex);
 
-    return FlushInternal();
+    FlushInternal();
+    return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
+/// Request a flush of all dirty blocks, and wait until this device has no
+/// dirty blocks left.
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -387,11 +1101,9 @@ bool KBlockCache::Sync()
 {
     CRITICAL_SCOPE(KBlockCache::s_Mutex);
 
-    if (!FlushInternal()) {
-        return false;
-    }
-
-    if (s_DirtyBlockCount != 0) {
+    while (m_DirtyTree.GetCount() != 0)
+    {
+        FlushInternal();
         s_FlushingDoneConditionVar.Wait(s_Mutex);
     }
     return true;
@@ -401,9 +1113,79 @@ bool KBlockCache::Sync()
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
+KBlockCacheStats KBlockCache::GetStats() const
+{
+    KBlockCacheStats stats;
+    CRITICAL_SCOPE(s_Mutex);
+    FillStats(stats, kget_monotonic_time());
+    return stats;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Get statistics for up to "maxCount" registered devices. Returns the
+/// number of registered devices, which might be more than "maxCount".
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t KBlockCache::GetAllStats(KBlockCacheStats* outStats, size_t maxCount)
+{
+    const TimeValNanos curTime = kget_monotonic_time();
+
+    CRITICAL_SCOPE(s_Mutex);
+
+    size_t count = 0;
+    for (auto i = s_DeviceMap.begin(); i != s_DeviceMap.end(); ++i, ++count)
+    {
+        if (count < maxCount) {
+            i->second->FillStats(outStats[count], curTime);
+        }
+    }
+    return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// The counters are read without locking. s_Mutex must be held to find the
+/// oldest dirty block.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KBlockCache::FillStats(KBlockCacheStats& stats, TimeValNanos curTime) const
+{
+    kassert(s_Mutex.IsLocked());
+
+    TimeValNanos oldestDirtyTime = curTime;
+    m_DirtyTree.ForEach([&oldestDirtyTime](KCacheBlockHeader* block) { oldestDirtyTime = std::min(oldestDirtyTime, block->m_DirtyTime); });
+
+    stats.Device              = m_Device;
+    stats.BufferSize          = uint32_t(m_BufferSize);
+    stats.CachedBuffers       = uint32_t(m_BlockMap.GetCount());
+    stats.Lookups             = m_Lookups;
+    stats.Hits                = m_Hits;
+    stats.LoadedBuffers       = m_LoadedBuffers;
+    stats.Evictions           = m_Evictions;
+    stats.ReadAheadWindow     = m_ReadAheadWindow;
+    stats.ReadAheadBlocks     = m_ReadAheadBlocks;
+    stats.ReadAheadHits       = m_ReadAheadHits;
+    stats.ReadAheadWasted     = m_ReadAheadWasted;
+    stats.DirectReadBlocks    = m_DirectReadBlocks;
+    stats.DirectWriteBlocks   = m_DirectWriteBlocks;
+    stats.DirtyBlocks         = uint32_t(m_DirtyTree.GetCount());
+    stats.OldestDirtyAge      = uint32_t((curTime - oldestDirtyTime).AsMilliseconds());
+    stats.FlushWrites         = m_FlushWrites;
+    stats.FlushedBuffers      = m_FlushedBuffers;
+    stats.FlushedDirtyBuffers = m_FlushedDirtyBuffers;
+    stats.FlushedDirtyAge     = m_FlushedDirtyAge;
+    stats.MaxFlushedDirtyAge  = m_MaxFlushedDirtyAge;
+    stats.FlushTime           = m_FlushTime;
+    stats.MaxFlushTime        = m_MaxFlushTime;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
 void KCacheBlockHeader::AddRef()
 {
-    kassert(KBlockCache::s_Mutex.IsLocked());
     m_UseCount++;
 }
 
@@ -413,10 +1195,18 @@ void KCacheBlockHeader::AddRef()
 
 void KCacheBlockHeader::RemoveRef()
 {
-    kassert(KBlockCache::s_Mutex.IsLocked());
-    m_UseCount--;
-    if (m_UseCount == 0) {
-        KBlockCache::s_FlushingDoneConditionVar.WakeupAll();
+    // Only take the global lock if someone is waiting for a free block.
+    if (--m_UseCount == 0 && KBlockCache::s_BlockWaiterCount != 0)
+    {
+        if (KBlockCache::s_Mutex.IsLocked())
+        {
+            KBlockCache::s_FlushingDoneConditionVar.WakeupAll();
+        }
+        else
+        {
+            CRITICAL_SCOPE(KBlockCache::s_Mutex);
+            KBlockCache::s_FlushingDoneConditionVar.WakeupAll();
+        }
     }
 }
 
@@ -434,6 +1224,11 @@ void KCacheBlockHeader::SetDirty(bool isDirty)
             m_Flags |= BCF_DIRTY;
             KBlockCache::s_DirtyBlockCount++;
 
+            auto device = KBlockCache::s_DeviceMap.find(m_Device);
+            if (device != KBlockCache::s_DeviceMap.end()) {
+                device->second->m_DirtyTree.Insert(this);
+            }
+
             m_DirtyTime = kget_monotonic_time();
             if (KBlockCache::s_DirtyBlockCount == 1) {
                 kernel_log<PLogSeverity::INFO_HIGH_VOL>(LogCatKernel_BlockCache, "Cache dirty.");
@@ -454,6 +1249,13 @@ void KCacheBlockHeader::SetDirty(bool isDirty)
         {
             m_Flags &= ~BCF_DIRTY;
             KBlockCache::s_DirtyBlockCount--;
+
+            if (m_Flags & BCF_IN_DIRTY_TREE)
+            {
+                auto device = KBlockCache::s_DeviceMap.find(m_Device);
+                kassert(device != KBlockCache::s_DeviceMap.end());
+                device->second->m_DirtyTree.Remove(this);
+            }
             if (KBlockCache::s_DirtyBlockCount == 0) {
                 kernel_log<PLogSeverity::INFO_HIGH_VOL>(LogCatKernel_BlockCache, "Cache clean.");
             }
@@ -467,9 +1269,7 @@ void KCacheBlockHeader::SetDirty(bool isDirty)
 
 KCacheBlockDesc::~KCacheBlockDesc()
 {
-    if (m_Block != nullptr)
-    {
-        CRITICAL_SCOPE(KBlockCache::s_Mutex);
+    if (m_Block != nullptr) {
         m_Block->RemoveRef();
     }
 }
@@ -480,9 +1280,7 @@ KCacheBlockDesc::~KCacheBlockDesc()
 
 KCacheBlockDesc& KCacheBlockDesc::operator=(KCacheBlockDesc&& src)
 {
-    if (m_Block != nullptr)
-    {
-        CRITICAL_SCOPE(KBlockCache::s_Mutex);
+    if (m_Block != nullptr) {
         m_Block->RemoveRef();
     }
     m_Block = src.m_Block;
@@ -513,113 +1311,285 @@ void KCacheBlockDesc::Reset()
 {
     if (m_Block != nullptr)
     {
-        CRITICAL_SCOPE(KBlockCache::s_Mutex);
         m_Block->RemoveRef();
         m_Block = nullptr;
     }        
 }
 
 ///////////////////////////////////////////////////////////////////////////////
+/// Check that "cache" is still attached to a device. Used after s_Mutex has
+/// been released, so "cache" is only compared, never dereferenced.
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-bool KBlockCache::FlushBlockList_trw(KCacheBlockHeader** blockList, size_t blockCount)
+bool KBlockCache::IsRegisteredCache(const KBlockCache* cache)
 {
-#ifdef PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
-    return FlushBlockListWithDiagnostics_trw(blockList, blockCount);
-#endif // PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
+    kassert(s_Mutex.IsLocked());
+    return std::any_of(s_DeviceMap.begin(), s_DeviceMap.end(), [cache](const std::pair<const int, KBlockCache*>& device) { return device.second == cache; });
+}
 
-    kernel_log<PLogSeverity::INFO_HIGH_VOL>(LogCatKernel_BlockCache, "KBlockCache::FlushBlockList() flushing {} blocks.", blockCount);
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
 
-    std::sort(blockList, blockList + blockCount, [](const KCacheBlockHeader* lhs, const KCacheBlockHeader* rhs) { return std::tie(lhs->m_Device, lhs->m_bufferNumber) < std::tie(rhs->m_Device, rhs->m_bufferNumber); });
+bool KBlockCache::IsUnderWritePressure()
+{
+    return size_t(s_DirtyBlockCount) >= MIN_FLUSH_WAKEUP_BLOCK_COUNT || s_BlockWaiterCount != 0;
+}
 
-    static iovec_t segments[MAX_FLUSH_BLOCK_COUNT];
+///////////////////////////////////////////////////////////////////////////////
+/// One elevator sweep over the dirty blocks of the device, starting at the
+/// flush cursor and wrapping around to it once. Each run is written if:
+/// - It contains a block someone is waiting for (sync, eviction).
+/// - It contains a block that has been dirty for FLUSH_PERIOD.
+/// - The cache is under pressure (too many dirty blocks, or threads waiting
+///   for a free block).
+/// - It is at least MIN_FLUSH_BLOCK_COUNT buffers long.
+/// Returns true if anything was written. Called with s_Mutex held, which is
+/// released during writes.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
 
-//    kernel_log<PLogSeverity::INFO_HIGH_VOL>(LogCatKernel_BlockCache, "Flush {} blocks.", blockCount);
+bool KBlockCache::FlushSweep_trw(TimeValNanos curTime)
+{
+    kassert(s_Mutex.IsLocked());
 
-    TimeValNanos curTime = kget_monotonic_time();
+    static KCacheBlockHeader* runBlocks[MAX_FLUSH_BLOCK_COUNT];
 
-    size_t start = 0;
-    bool    requiredSegment = false;
-    bool    hasTimedOutBlocks = false;
+    bool          underPressure   = IsUnderWritePressure();
+    bool          anythingFlushed = false;
+    bool          hasWrapped      = false;
+    const off64_t sweepStart      = m_FlushCursor;
 
-    bool anythingFlushed = false;
-    for (size_t i = 0; i <= blockCount; ++i)
+    for (;;)
     {
-//        if (i < blockCount)
-//        {
-//            kernel_log<PLogSeverity::INFO_HIGH_VOL>(LogCatKernel_BlockCache, "    {}", blockList[i]->m_bufferNumber);
-//        }
-
-        if (i < blockCount)
+        KCacheBlockHeader* first = m_DirtyTree.FindFirstAtOrAfter(m_FlushCursor);
+        while (first != nullptr && first->IsFlushing()) {
+            first = m_DirtyTree.FindFirstAtOrAfter(first->m_bufferNumber + 1);
+        }
+        if (first != nullptr && hasWrapped && first->m_bufferNumber >= sweepStart) {
+            first = nullptr;
+        }
+        if (first == nullptr)
         {
-            if (!requiredSegment && blockList[i]->IsFlushRequested()) {
-                requiredSegment = true;
-            }
-            if (!requiredSegment && (curTime - blockList[i]->m_DirtyTime) >= FLUSH_PERIOD) {
-                hasTimedOutBlocks = true;
+            if (hasWrapped || sweepStart == 0) {
+                break;
             }
+            hasWrapped    = true;
+            m_FlushCursor = 0;
+            continue;
+        }
+        size_t dirtyCount;
+        bool   isDue;
+        const size_t runLength = CollectFlushRun(first, runBlocks, curTime, dirtyCount, isDue);
+        m_FlushCursor = runBlocks[runLength - 1]->m_bufferNumber + 1;
+
+        if (!isDue && !underPressure && runLength < MIN_FLUSH_BLOCK_COUNT) {
+            continue;
+        }
+        WriteRun_trw(runBlocks, runLength, dirtyCount);
+        anythingFlushed = true;
+
+        s_FlushingDoneConditionVar.WakeupAll();
+
+        if (!IsRegisteredCache(this)) {
+            break; // Detached while the lock was released.
+        }
+        if (underPressure && size_t(s_DirtyBlockCount) <= MAX_DIRTY_AFTER_PRESSURE_FLUSH && s_BlockWaiterCount == 0) {
+            underPressure = false;
+        }
+    }
+    return anythingFlushed;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Collect the longest run of buffers starting at the dirty block "first"
+/// that can be written with one request. Later dirty blocks are added as long
+/// as they follow directly, or the gap is at most MAX_FLUSH_GAP_BUFFERS
+/// cached clean buffers that can be written along with them. Partially valid
+/// buffers are always written alone.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t KBlockCache::CollectFlushRun(KCacheBlockHeader* first, KCacheBlockHeader** run, TimeValNanos curTime, size_t& outDirtyCount, bool& outIsDue) const
+{
+    size_t runLength = 0;
+
+    outDirtyCount = 0;
+    outIsDue      = false;
+
+    auto addDirtyBlock = [run, curTime, &runLength, &outDirtyCount, &outIsDue](KCacheBlockHeader* block)
+    {
+        run[runLength++] = block;
+        outDirtyCount++;
+        if (block->IsFlushRequested() || (curTime - block->m_DirtyTime) >= FLUSH_PERIOD) {
+            outIsDue = true;
+        }
+    };
+    addDirtyBlock(first);
+
+    if (!first->IsFullyValid()) {
+        return runLength;
+    }
+    for (KCacheBlockHeader* next = m_DirtyTree.FindFirstAtOrAfter(first->m_bufferNumber + 1); next != nullptr; next = m_DirtyTree.FindFirstAtOrAfter(next->m_bufferNumber + 1))
+    {
+        if (next->IsFlushing() || !next->IsFullyValid()) {
+            break;
         }
-        if (i == blockCount || (i > start && (blockList[i-1]->m_Device != blockList[i]->m_Device || (blockList[i-1]->m_bufferNumber + 1) != blockList[i]->m_bufferNumber)))
+        const off64_t lastBuffer = run[runLength - 1]->m_bufferNumber;
+        const off64_t gap        = next->m_bufferNumber - lastBuffer - 1;
+        if (gap > MAX_FLUSH_GAP_BUFFERS || runLength + size_t(gap) + 1 > MAX_FLUSH_BLOCK_COUNT) {
+            break;
+        }
+        // The tree holds all dirty blocks, so buffers in the gap are clean.
+        bool canBridge = true;
+        for (off64_t i = 1; i <= gap && canBridge; ++i)
         {
-            const size_t segmentCount = i - start;
-            if (requiredSegment || hasTimedOutBlocks || segmentCount >= MIN_FLUSH_BLOCK_COUNT)
-            {
-                for (size_t blockIndex = start; blockIndex < i; ++blockIndex) {
-                    blockList[blockIndex]->ClearDirtyPending();
-                }
+            const KCacheBlockHeader* gapBlock = m_BlockMap.Find(lastBuffer + i);
+            canBridge = gapBlock != nullptr && !gapBlock->IsFlushing() && gapBlock->IsFullyValid();
+        }
+        if (!canBridge) {
+            break;
+        }
+        for (off64_t i = 1; i <= gap; ++i) {
+            run[runLength++] = m_BlockMap.Find(lastBuffer + i);
+        }
+        addDirtyBlock(next);
+    }
+    return runLength;
+}
 
-//                kernel_log<PLogSeverity::INFO_HIGH_VOL>(LogCatKernel_BlockCache, "  {}:{}", blockList[start]->m_bufferNumber, segmentCount);
+///////////////////////////////////////////////////////////////////////////////
+/// Write a run collected by CollectFlushRun(). Blocks that were dirty and
+/// not modified during the write are marked clean. Called with s_Mutex
+/// held, which is released during the write. The flush time statistics are
+/// only updated if the cache is still registered when the lock is retaken.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
 
-                s_Mutex.Unlock();
-                try
-                {
-                    kpwritev_trw(
-                        blockList[start]->m_Device,
-                        segments,
-                        segmentCount,
-                        blockList[start]->m_bufferNumber * KBlockCache::BUFFER_BLOCK_SIZE);
-                    anythingFlushed = true;
-                }
-                PERROR_CATCH(([&blockList, &start, &segmentCount](PErrorCode error)
-                    {
-                        kernel_log<PLogSeverity::CRITICAL>(LogCatKernel_BlockCache, "Failed to flush block {}:{} from device {}", blockList[start]->m_bufferNumber, segmentCount, blockList[start]->m_Device);
-                    }
-                ));
-                s_Mutex.Lock();
+void KBlockCache::WriteRun_trw(KCacheBlockHeader** run, size_t runLength, size_t dirtyCount)
+{
+    kassert(s_Mutex.IsLocked());
 
-                for (size_t blockIndex = start; blockIndex < i; ++blockIndex)
-                {
-                    if (!blockList[blockIndex]->IsDirtyPending())
-                    {
-                        blockList[blockIndex]->SetDirty(false);
-                        blockList[blockIndex]->SetFlushRequested(false);
-                        blockList[blockIndex]->SetIsFlushing(false);
-                    }
-                }
+    static iovec_t segments[MAX_FLUSH_BLOCK_COUNT];
+    static bool    wasDirty[MAX_FLUSH_BLOCK_COUNT];
 
-                if (requiredSegment) {
-                    s_FlushingDoneConditionVar.WakeupAll();
-                }
-            }
-            start = i;
-            requiredSegment = false;
-            hasTimedOutBlocks = false;
+    const TimeValNanos startTime = kget_monotonic_time();
+
+    for (size_t i = 0; i < runLength; ++i)
+    {
+        KCacheBlockHeader* block = run[i];
+        block->SetIsFlushing(true);
+        block->ClearDirtyPending();
+        wasDirty[i] = block->IsDirty();
+        segments[i].iov_base = block->m_Buffer;
+        segments[i].iov_len  = block->m_BufferSize;
+        if (wasDirty[i])
+        {
+            const uint32_t dirtyAge = uint32_t((startTime - block->m_DirtyTime).AsMilliseconds());
+            m_FlushedDirtyAge += dirtyAge;
+            m_MaxFlushedDirtyAge = std::max(m_MaxFlushedDirtyAge.load(), dirtyAge);
+        }
+    }
+    m_FlushWrites++;
+    m_FlushedBuffers      += uint32_t(runLength);
+    m_FlushedDirtyBuffers += uint32_t(dirtyCount);
+
+    kernel_log<PLogSeverity::INFO_HIGH_VOL>(LogCatKernel_BlockCache, "KBlockCache::WriteRun_trw() flushing {}:{} ({} dirty) on device {}.", run[0]->m_bufferNumber, runLength, dirtyCount, run[0]->m_Device);
+
+#ifdef PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
+    for (size_t i = 0; i < runLength; ++i) {
+        run[i]->SetFlushRequested(true);
+    }
+    FlushBlockListWithDiagnostics_trw(run, runLength);
+    const bool isRegistered = IsRegisteredCache(this);
+#else // PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
+    KCacheBlockHeader* const firstBlock = run[0];
+    const uint32_t           validMask  = firstBlock->m_ValidMask;
+    const bool               isPartial  = !firstBlock->IsFullyValid();
+
+    s_Mutex.Unlock();
+    try
+    {
+        if (isPartial) {
+            WritePartialBlock_trw(firstBlock, validMask);
+        } else {
+            kpwritev_trw(firstBlock->m_Device, segments, runLength, firstBlock->m_bufferNumber * firstBlock->m_BufferSize);
+        }
+    }
+    PERROR_CATCH(([firstBlock, runLength](PErrorCode error)
+        {
+            kernel_log<PLogSeverity::CRITICAL>(LogCatKernel_BlockCache, "Failed to flush block {}:{} from device {}", firstBlock->m_bufferNumber, runLength, firstBlock->m_Device);
         }
-        if (i < blockCount)
+    ));
+    s_Mutex.Lock();
+
+    // The cache might have been detached and deleted while s_Mutex was
+    // released. The blocks are owned by the global replacement queues and
+    // are still valid, but "this" must not be touched unless registered.
+    const bool isRegistered = IsRegisteredCache(this);
+
+    for (size_t i = 0; i < runLength; ++i)
+    {
+        KCacheBlockHeader* block = run[i];
+        if (wasDirty[i] && !block->IsDirtyPending())
         {
-            segments[i - start].iov_base = blockList[i]->m_Buffer;
-            segments[i - start].iov_len = KBlockCache::BUFFER_BLOCK_SIZE;
+            block->SetDirty(false);
+            block->SetFlushRequested(false);
         }
     }
-    return anythingFlushed;
+#endif // PADOS_OPT_DEBUG_BLOCK_CACHE_DIAGNOSTICS
+    for (size_t i = 0; i < runLength; ++i) {
+        run[i]->SetIsFlushing(false);
+    }
+    if (!isRegistered) {
+        return;
+    }
+    const uint32_t writeTime = uint32_t((kget_monotonic_time() - startTime).AsMicroseconds());
+    m_FlushTime += writeTime;
+    m_MaxFlushTime = std::max(m_MaxFlushTime.load(), writeTime);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Write each run of valid blocks in "validMask" from a partially valid
+/// buffer. Called without s_Mutex held, while the block is flagged as
+/// flushing.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KBlockCache::WritePartialBlock_trw(KCacheBlockHeader* block, uint32_t validMask)
+{
+    const int     blocksPerBuffer = 1 << block->m_BlockShift;
+    const size_t  blockSize       = block->m_BufferSize >> block->m_BlockShift;
+    const off64_t position        = block->m_bufferNumber * block->m_BufferSize;
+
+    for (int first = 0; first < blocksPerBuffer; )
+    {
+        if ((validMask & (1u << first)) == 0)
+        {
+            first++;
+            continue;
+        }
+        int end = first + 1;
+        while (end < blocksPerBuffer && (validMask & (1u << end)) != 0) {
+            end++;
+        }
+        const size_t offset = first * blockSize;
+        kpwrite_trw(block->m_Device, static_cast<const uint8_t*>(block->m_Buffer) + offset, (end - first) * blockSize, position + offset);
+        first = end;
+    }
 }
 ///////////////////////////////////////////////////////////////////////////////
+/// Write-back thread. Each round sweeps every device with dirty blocks once
+/// (see FlushSweep_trw()). It sleeps when a round writes nothing, and is
+/// woken early by flush requests and dirty block pressure.
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
 void* KBlockCache::DiskCacheFlusher(void* arg)
 {
+    static constexpr size_t MAX_FLUSH_DEVICES = 16;
+
     for (;;)
     {
         KVFSManager::FlushInodes();
@@ -627,38 +1597,29 @@ void* KBlockCache::DiskCacheFlusher(void* arg)
         {
             try
             {
+                bool anythingFlushed = false;
                 if (s_DirtyBlockCount > 0)
                 {
-                    static KCacheBlockHeader* blockList[MAX_FLUSH_BLOCK_COUNT];
-                    size_t blocksFlushed = 0;
-                    int deviceID = -1;
-                    for (auto block = s_MRUList.begin(); block != s_MRUList.end() && blocksFlushed < MAX_FLUSH_BLOCK_COUNT && s_DirtyBlockCount > 0; ++block)
+                    // The device map can change while s_Mutex is released for
+                    // writing, so sweep a snapshot of the devices.
+                    KBlockCache* caches[MAX_FLUSH_DEVICES];
+                    size_t       cacheCount = 0;
+                    for (auto i = s_DeviceMap.begin(); i != s_DeviceMap.end() && cacheCount < MAX_FLUSH_DEVICES; ++i)
                     {
-                        if (block->IsDirty() && !block->IsFlushing())
-                        {
-                            if (deviceID == -1) deviceID = block->m_Device;
-                            if (block->m_Device == deviceID)
-                            {
-                                block->SetIsFlushing(true);
-                                blockList[blocksFlushed++] = *block;
-                            }
+                        if (i->second->m_DirtyTree.GetCount() != 0) {
+                            caches[cacheCount++] = i->second;
                         }
                     }
-                    const bool anythingFlushed = FlushBlockList_trw(blockList, blocksFlushed);
-                    for (size_t i = 0; i < blocksFlushed; ++i)
+                    const TimeValNanos curTime = kget_monotonic_time();
+                    for (size_t i = 0; i < cacheCount; ++i)
                     {
-                        KCacheBlockHeader* block = blockList[i];
-                        block->SetIsFlushing(false);
-                    }
-                    if (anythingFlushed) {
-                        s_FlushingDoneConditionVar.WakeupAll();
-                    } else {
-                        s_FlushingRequestConditionVar.WaitTimeout(s_Mutex, FLUSH_PERIOD);
+                        if (IsRegisteredCache(caches[i]) && caches[i]->FlushSweep_trw(curTime)) {
+                            anythingFlushed = true;
+                        }
                     }
                 }
-                else
-                {
-                    s_FlushingRequestConditionVar.WaitTimeout(s_Mutex, FLUSH_PERIOD);
+                if (!anythingFlushed) {
+                    s_FlushingRequestConditionVar.WaitTimeout(s_Mutex, (s_DirtyBlockCount > 0) ? FLUSH_CHECK_PERIOD : FLUSH_PERIOD);
                 }
             }
             PERROR_CATCH(([](PErrorCode error) { kernel_log<PLogSeverity::CRITICAL>(LogCatKernel_BlockCache, "Exception caught during disk cache flushing."); }));
@@ -106,15 +106,15 @@ void KBlockCache::ValidateFlushBlockList(KCacheBlockHeader** blockList, size_t b
             continue;
         }
 
-        const auto mapping = cache->m_BlockMap.find(block->m_bufferNumber);
-        if (mapping == cache->m_BlockMap.end() || mapping->second != block)
+        const KCacheBlockHeader* mapping = cache->m_BlockMap.Find(block->m_bufferNumber);
+        if (mapping != block)
         {
             kernel_log<PLogSeverity::CRITICAL>(
                 LogCatKernel_BlockCache,
                 "Dirty block {} for device {} is not mapped to its flush-list header.",
                 block->m_bufferNumber,
                 block->m_Device);
-            kassert(mapping != cache->m_BlockMap.end() && mapping->second == block);
+            kassert(mapping == block);
         }
 
         if (blockIndex != 0)
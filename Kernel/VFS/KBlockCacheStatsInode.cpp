@@ -0,0 +1,84 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 17.10.2026 09:00
+
+#include <limits>
+#include <sys/stat.h>
+
+#include <Kernel/KAddressValidation.h>
+#include <Kernel/VFS/KBlockCache.h>
+#include <Kernel/VFS/KBlockCacheStatsInode.h>
+#include <Kernel/VFS/KDriverManager.h>
+#include <System/ExceptionHandling.h>
+
+
+namespace kernel
+{
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KBlockCacheStatsInode::Initialize()
+{
+    kregister_device_root_trw("bcache/stats", ptr_new<KBlockCacheStatsInode>());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KBlockCacheStatsInode::KBlockCacheStatsInode()
+    : KInode(nullptr, nullptr, this, S_IFCHR | S_IRUSR | S_IRGRP | S_IROTH)
+{
+    m_DeviceControlDispatcher.AddHandler(&PBlockCacheStatsControl::GetDeviceStats, this, &KBlockCacheStatsInode::GetDeviceStats);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KBlockCacheStatsInode::ReadStat(Ptr<KFSVolume> volume, Ptr<KInode> inode, struct stat* statBuf)
+{
+    KFilesystemFileOps::ReadStat(volume, inode, statBuf);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KBlockCacheStatsInode::DeviceControl(Ptr<KFileNode> file, int request, const void* inData, size_t inDataLength, void* outData, size_t outDataLength)
+{
+    m_DeviceControlDispatcher.Dispatch(request, inData, inDataLength, outData, outDataLength);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t KBlockCacheStatsInode::GetDeviceStats(PBlockCacheStats* outStats, size_t maxCount) const
+{
+    if (maxCount > std::numeric_limits<size_t>::max() / sizeof(PBlockCacheStats)) {
+        PERROR_THROW_CODE(PErrorCode::INVAL);
+    }
+    validate_user_write_pointer_trw(outStats, maxCount * sizeof(PBlockCacheStats));
+
+    return KBlockCache::GetAllStats(outStats, maxCount);
+}
+
+} // namespace kernel
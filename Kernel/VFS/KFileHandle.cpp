@@ -64,6 +64,18 @@ size_t KDirectoryNode::ReadDirectory(void* buffer, size_t bufferSize)
     return inode->m_FileOps->ReadDirectory(inode->m_Volume, ptr_tmp_cast(this), buffer, bufferSize);
 }
 
+size_t KDirectoryNode::ReadDirectoryPlus(void* buffer, size_t bufferSize)
+{
+    Ptr<KInode> inode = GetInode();
+    if (inode == nullptr) {
+        PERROR_THROW_CODE(PErrorCode::BADF);
+    }
+    if (!inode->IsActive()) {
+        PERROR_THROW_CODE(PErrorCode(ENODEV));
+    }
+    return inode->m_FileOps->ReadDirectoryPlus(inode->m_Volume, ptr_tmp_cast(this), buffer, bufferSize);
+}
+
 void KDirectoryNode::RewindDirectory()
 {
     Ptr<KInode> inode = GetInode();
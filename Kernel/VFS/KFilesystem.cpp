@@ -21,12 +21,15 @@
 
 #include <sys/uio.h>
 #include <sys/types.h>
+#include <string.h>
 
 #include <Kernel/VFS/KFilesystem.h>
 #include <Kernel/VFS/KFSVolume.h>
 #include <Kernel/VFS/KInode.h>
 #include <Kernel/VFS/KFileHandle.h>
 #include <Kernel/VFS/FileIO.h>
+#include <Kernel/VFS/KVFSManager.h>
+#include <Storage/DirectoryEntry.h>
 #include <System/System.h>
 #include <System/ExceptionHandling.h>
 
@@ -97,6 +100,20 @@ Ptr<KInode> KFilesystem::LocateInode(Ptr<KFSVolume> volume, Ptr<KInode> parent,
     PERROR_THROW_CODE(PErrorCode::NOSYS);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Return true if the results from LocateInode() can be kept in the VFS
+/// name cache. The filesystem must then only change its namespace through
+/// the VFS create, rename, unlink and remove directory operations, and
+/// must return the same inode object for a name as long as it is
+/// referenced.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool KFilesystem::SupportsNameCache() const
+{
+    return false;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -290,6 +307,65 @@ size_t KFilesystemFileOps::ReadDirectory(Ptr<KFSVolume> volume, Ptr<KDirectoryNo
     PERROR_THROW_CODE(PErrorCode::NOSYS);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Generic implementation for filesystems that can't do better: read plain
+/// records with ReadDirectory() into the end of the buffer, then move them
+/// to the front one by one while adding the stat of each entry. The plain
+/// read is sized so that the growth of the records never catches up with
+/// the ones not yet moved.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+size_t KFilesystemFileOps::ReadDirectoryPlus(Ptr<KFSVolume> volume, Ptr<KDirectoryNode> directory, void* buffer, size_t bufferSize)
+{
+    if (buffer == nullptr || (reinterpret_cast<uintptr_t>(buffer) & (P_DIR_ENTRY_PLUS_ALIGNMENT - 1)) != 0) {
+        PERROR_THROW_CODE(PErrorCode::INVAL);
+    }
+    constexpr size_t minRecordSize = PGetDirEntryRecordSize(1);
+    const size_t     maxReadSize   = bufferSize / (minRecordSize + P_DIR_ENTRY_PLUS_MAX_GROWTH) * minRecordSize;
+    const size_t     readOffset    = (bufferSize - maxReadSize + P_DIR_ENTRY_PLUS_ALIGNMENT - 1) & ~(P_DIR_ENTRY_PLUS_ALIGNMENT - 1);
+
+    if (readOffset >= bufferSize || bufferSize - readOffset < PGetDirEntryRecordSize(0)) {
+        PERROR_THROW_CODE(PErrorCode::INVAL);
+    }
+    uint8_t* const outBuffer  = static_cast<uint8_t*>(buffer);
+    uint8_t* const readBuffer = outBuffer + readOffset;
+    const size_t   bytesRead  = ReadDirectory(volume, directory, readBuffer, bufferSize - readOffset);
+
+    size_t bytesWritten = 0;
+    for (PDirEntryIterator iterator(readBuffer, bytesRead); iterator; )
+    {
+        const dirent_t* sourceEntry = &*iterator;
+        const size_t    nameLength  = sourceEntry->d_namlen;
+        const size_t    recordSize  = PGetDirEntryPlusRecordSize(nameLength);
+        if (recordSize == 0) {
+            PERROR_THROW_CODE(PErrorCode::NAMETOOLONG);
+        }
+        // Step past the source record before it is overwritten. The new
+        // record may overlap it, but never the records after it.
+        ++iterator;
+
+        uint8_t* const recordBuffer = outBuffer + bytesWritten;
+        memmove(recordBuffer, sourceEntry, P_DIR_ENTRY_HEADER_SIZE + nameLength);
+        memset(recordBuffer + P_DIR_ENTRY_HEADER_SIZE + nameLength, 0, recordSize - P_DIR_ENTRY_HEADER_SIZE - nameLength);
+
+        dirent_t* entry = reinterpret_cast<dirent_t*>(recordBuffer);
+        entry->d_reclen = static_cast<decltype(entry->d_reclen)>(recordSize);
+        bytesWritten += recordSize;
+
+        try
+        {
+            Ptr<KInode> inode = KVFSManager::GetInode_trw(entry->d_volumeid, entry->d_ino, false);
+            kread_stat_trw(inode, PDirEntryWriter::GetStat(entry));
+        }
+        catch (const std::exception&)
+        {
+            *PDirEntryWriter::GetStat(entry) = {}; // Leave it to the caller to stat() the entry.
+        }
+    }
+    return bytesWritten;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -352,4 +428,13 @@ void KFilesystemFileOps::Sync(Ptr<KFileNode> file)
     PERROR_THROW_CODE(PErrorCode::NOSYS);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KFilesystemFileOps::Allocate(Ptr<KFileNode> file, int mode, off64_t offset, off64_t length)
+{
+    PERROR_THROW_CODE(PErrorCode::NOSYS);
+}
+
 } // namespace kernel
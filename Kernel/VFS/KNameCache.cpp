@@ -0,0 +1,369 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 18.10.2026 10:00
+
+#include "System/Platform.h"
+
+#include <string.h>
+
+#include <Kernel/KMutex.h>
+#include <Kernel/KSlabCache.h>
+#include <Kernel/VFS/KNameCache.h>
+#include <Kernel/VFS/KInode.h>
+#include <Utils/IntrusiveList.h>
+#include <Utils/String.h>
+
+
+namespace kernel
+{
+
+static constexpr size_t NAME_CACHE_HASH_SIZE = 64; // Must be a power of 2.
+
+struct KNameCacheEntry
+{
+    PIntrusiveListNode<KNameCacheEntry> m_LRUNode;
+    PIntrusiveListNode<KNameCacheEntry> m_HashNode;
+    Ptr<KInode>                         m_Parent;
+    Ptr<KInode>                         m_Inode;    // nullptr for negative entries.
+    uint32_t                            m_Hash = 0;
+    uint8_t                             m_NameLength = 0;
+    char                                m_Name[KNameCache::MAX_NAME_LENGTH];
+};
+
+using KNameCacheLRUList  = PIntrusiveList<KNameCacheEntry, &KNameCacheEntry::m_LRUNode>;
+using KNameCacheHashList = PIntrusiveList<KNameCacheEntry, &KNameCacheEntry::m_HashNode>;
+
+static KMutex                           kg_NameCacheMutex("name_cache", PEMutexRecursionMode_RaiseError);
+static KObjectCache<KNameCacheEntry>    kg_NameCacheEntries("name_cache_entry");
+static KNameCacheLRUList                kg_NameCacheLRU;
+static KNameCacheHashList               kg_NameCacheHash[NAME_CACHE_HASH_SIZE];
+static uint32_t                         kg_NameCacheGeneration = 0;
+static size_t                           kg_NameCacheNegativeCount = 0;
+static KNameCacheStats                  kg_NameCacheStats;
+
+///////////////////////////////////////////////////////////////////////////////
+/// FNV-1a hash of the name, mixed with the parent pointer.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+static uint32_t CalculateNameHash(const KInode* parent, const char* name, size_t nameLength)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < nameLength; ++i)
+    {
+        hash ^= uint8_t(name[i]);
+        hash *= 16777619u;
+    }
+    return hash ^ (uint32_t(uintptr_t(parent) >> 3) * 2654435761u);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+static KNameCacheHashList& GetHashList(uint32_t hash)
+{
+    return kg_NameCacheHash[hash & (NAME_CACHE_HASH_SIZE - 1)];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Must be called with kg_NameCacheMutex locked.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+static KNameCacheEntry* FindEntry(const KInode* parent, const char* name, size_t nameLength, uint32_t hash)
+{
+    for (KNameCacheEntry* entry : GetHashList(hash))
+    {
+        if (entry->m_Hash == hash && ptr_raw_pointer_cast(entry->m_Parent) == parent && entry->m_NameLength == nameLength && memcmp(entry->m_Name, name, nameLength) == 0) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Unlink the entry from the cache and move it to "releaseList". The entries
+/// hold inode references, so they must not be destroyed until the cache
+/// mutex is released. Dropping the last reference to an inode can call into
+/// the VFS manager and the filesystem.
+/// Must be called with kg_NameCacheMutex locked.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+static void RemoveEntry(KNameCacheEntry* entry, KNameCacheLRUList& releaseList)
+{
+    GetHashList(entry->m_Hash).Remove(entry);
+    kg_NameCacheLRU.Remove(entry);
+    if (entry->m_Inode == nullptr) {
+        kg_NameCacheNegativeCount--;
+    }
+    releaseList.Append(entry);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Must be called without kg_NameCacheMutex locked.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+static void DestroyEntries(KNameCacheLRUList& releaseList)
+{
+    while (KNameCacheEntry* entry = releaseList.GetFirst())
+    {
+        releaseList.Remove(entry);
+        kg_NameCacheEntries.Destroy(entry);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Remove all entries matching "filter", and start a new generation so
+/// lookups that started before the namespace changed are not inserted.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+template<typename TFilter>
+static void InvalidateEntries(TFilter&& filter)
+{
+    KNameCacheLRUList releaseList;
+    {
+        CRITICAL_SCOPE(kg_NameCacheMutex);
+
+        kg_NameCacheGeneration++;
+        kg_NameCacheStats.Invalidations++;
+
+        for (auto i = kg_NameCacheLRU.begin(); i != kg_NameCacheLRU.end(); )
+        {
+            KNameCacheEntry* entry = *i;
+            ++i;
+            if (filter(entry)) {
+                RemoveEntry(entry, releaseList);
+            }
+        }
+    }
+    DestroyEntries(releaseList);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Look up "name" in "parent". Return false if the name is not cached. On a
+/// hit "outInode" is set to the cached inode, or to nullptr if the entry is
+/// negative (the name is known to not exist).
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool KNameCache::Lookup(const Ptr<KInode>& parent, const char* name, size_t nameLength, Ptr<KInode>& outInode)
+{
+    if (nameLength > MAX_NAME_LENGTH) {
+        return false;
+    }
+    const uint32_t hash = CalculateNameHash(ptr_raw_pointer_cast(parent), name, nameLength);
+
+    KNameCacheLRUList releaseList;
+    {
+        CRITICAL_SCOPE(kg_NameCacheMutex);
+
+        KNameCacheEntry* entry = FindEntry(ptr_raw_pointer_cast(parent), name, nameLength, hash);
+        if (entry != nullptr && parent->IsDeleted())
+        {
+            // The directory has been removed. Drop the entry so it doesn't
+            // keep the directory alive.
+            RemoveEntry(entry, releaseList);
+            entry = nullptr;
+        }
+        if (entry != nullptr)
+        {
+            kg_NameCacheLRU.Remove(entry);
+            kg_NameCacheLRU.Append(entry);
+
+            if (entry->m_Inode != nullptr) {
+                kg_NameCacheStats.Hits++;
+            } else {
+                kg_NameCacheStats.NegativeHits++;
+            }
+            outInode = entry->m_Inode;
+            return true;
+        }
+        kg_NameCacheStats.Misses++;
+    }
+    DestroyEntries(releaseList);
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Sample the generation before asking the filesystem, and pass it to
+/// Insert() with the result.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t KNameCache::GetGeneration()
+{
+    CRITICAL_SCOPE(kg_NameCacheMutex);
+    return kg_NameCacheGeneration;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Add the result of a filesystem lookup. "inode" is nullptr if the name
+/// was not found. The entry is dropped if the cache has been invalidated
+/// since "generation" was sampled.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KNameCache::Insert(const Ptr<KInode>& parent, const char* name, size_t nameLength, const Ptr<KInode>& inode, uint32_t generation)
+{
+    if (parent == nullptr || nameLength == 0 || nameLength > MAX_NAME_LENGTH || PString::is_dot(name, nameLength) || PString::is_dot_dot(name, nameLength)) {
+        return;
+    }
+    if (parent->IsDeleted() || (inode != nullptr && (inode->IsDeleted() || inode->GetDontCache()))) {
+        return;
+    }
+    const uint32_t hash = CalculateNameHash(ptr_raw_pointer_cast(parent), name, nameLength);
+
+    KNameCacheLRUList releaseList;
+    {
+        CRITICAL_SCOPE(kg_NameCacheMutex);
+
+        if (generation != kg_NameCacheGeneration) {
+            return;
+        }
+        KNameCacheEntry* entry = FindEntry(ptr_raw_pointer_cast(parent), name, nameLength, hash);
+        if (entry != nullptr) {
+            RemoveEntry(entry, releaseList);
+        }
+        if (kg_NameCacheLRU.GetCount() >= MAX_ENTRY_COUNT)
+        {
+            RemoveEntry(kg_NameCacheLRU.GetFirst(), releaseList);
+            kg_NameCacheStats.Evictions++;
+        }
+        entry = kg_NameCacheEntries.Construct();
+        if (entry != nullptr)
+        {
+            entry->m_Parent     = parent;
+            entry->m_Inode      = inode;
+            entry->m_Hash       = hash;
+            entry->m_NameLength = uint8_t(nameLength);
+            memcpy(entry->m_Name, name, nameLength);
+
+            GetHashList(hash).Append(entry);
+            kg_NameCacheLRU.Append(entry);
+            if (inode == nullptr) {
+                kg_NameCacheNegativeCount++;
+            }
+            kg_NameCacheStats.Inserts++;
+        }
+    }
+    DestroyEntries(releaseList);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Drop the negative entries of a directory. Must be called after a name
+/// has been added to the directory. Filesystems might compare names case
+/// insensitively, so the new name can make negative entries of other
+/// spellings stale too.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KNameCache::InvalidateNegative(const KInode* parent)
+{
+    InvalidateEntries([parent](const KNameCacheEntry* entry) { return entry->m_Inode == nullptr && ptr_raw_pointer_cast(entry->m_Parent) == parent; });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Drop all entries of a directory. Must be called after a name has been
+/// removed from, or renamed in, the directory. Entries in, or pointing to,
+/// inodes that have been deleted are dropped too. The removed name might
+/// have been a directory with entries of its own, and those would
+/// otherwise keep it alive until they are evicted, delaying the release of
+/// its storage.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KNameCache::InvalidateDirectory(const KInode* parent)
+{
+    InvalidateEntries([parent](const KNameCacheEntry* entry)
+        {
+            return ptr_raw_pointer_cast(entry->m_Parent) == parent || entry->m_Parent->IsDeleted() || (entry->m_Inode != nullptr && entry->m_Inode->IsDeleted());
+        }
+    );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Drop all entries of directories on "volume". Called before the volume
+/// is detached so the cache don't keep the inodes alive.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KNameCache::InvalidateVolume(const KFSVolume* volume)
+{
+    InvalidateEntries([volume](const KNameCacheEntry* entry) { return ptr_raw_pointer_cast(entry->m_Parent->m_Volume) == volume; });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Drop the positive entries that hold the last reference to their inode.
+/// Inodes only reach the VFS manager's unused-inode list, and through it
+/// the filesystem's ReleaseInode() which writes back changed metadata, when
+/// the last reference is gone. Called periodically by
+/// KVFSManager::FlushInodes(), so an inode that is no longer in use is
+/// released a sweep later instead of when the entry is evicted.
+/// Directories that are parents of other entries stay cached until those
+/// entries are dropped.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KNameCache::ReleaseUnusedInodes()
+{
+    KNameCacheLRUList releaseList;
+    {
+        CRITICAL_SCOPE(kg_NameCacheMutex);
+
+        for (auto i = kg_NameCacheLRU.begin(); i != kg_NameCacheLRU.end(); )
+        {
+            KNameCacheEntry* entry = *i;
+            ++i;
+            if (entry->m_Inode != nullptr && entry->m_Inode->GetPtrCount() == 1)
+            {
+                RemoveEntry(entry, releaseList);
+                kg_NameCacheStats.Evictions++;
+            }
+        }
+    }
+    DestroyEntries(releaseList);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+void KNameCache::Flush()
+{
+    InvalidateEntries([](const KNameCacheEntry* entry) { return true; });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KNameCacheStats KNameCache::GetStats()
+{
+    CRITICAL_SCOPE(kg_NameCacheMutex);
+
+    KNameCacheStats stats = kg_NameCacheStats;
+    stats.EntryCount    = kg_NameCacheLRU.GetCount();
+    stats.NegativeCount = kg_NameCacheNegativeCount;
+    return stats;
+}
+
+} // namespace kernel
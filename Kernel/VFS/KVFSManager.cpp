@@ -31,6 +31,7 @@
 #include <Kernel/VFS/KVFSManager.h>
 #include <Kernel/VFS/KFSVolume.h>
 #include <Kernel/VFS/KInode.h>
+#include <Kernel/VFS/KNameCache.h>
 
 namespace kernel
 {
@@ -274,6 +275,10 @@ void KVFSManager::DetachVolume_trw(Ptr<KFSVolume> volume)
         PERROR_THROW_CODE(PErrorCode::INVAL);
     }
 
+    // Let the name cache release its references to the volume's inodes
+    // while the filesystem is still attached.
+    KNameCache::InvalidateVolume(ptr_raw_pointer_cast(volume));
+
     std::vector<Ptr<KInode>> volumeInodes;
     const Ptr<KInode> rootNode = volume->m_RootNode;
     {
@@ -473,6 +478,30 @@ Ptr<KInode> KVFSManager::GetInode_trw(fs_id volumeID, ino_t inodeID, bool crossM
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Call "visitor" with the inode if it is already in memory, without loading
+/// it or taking a reference. The visitor runs with the inode map locked, so
+/// it must not block or touch other inodes. Used by filesystems that hold
+/// their volume lock and need the in-memory state of an inode that may have
+/// changes not yet written to disk.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+KLoadedInodeState KVFSManager::VisitLoadedInode(fs_id volumeID, ino_t inodeID, const std::function<void(KInode* inode)>& visitor)
+{
+    KScopedLock inodeMapLock(s_InodeMapMutex);
+
+    auto i = s_InodeMap.find(std::make_pair(volumeID, inodeID));
+    if (i == s_InodeMap.end()) {
+        return KLoadedInodeState::NotLoaded;
+    }
+    if (i->second == PENDING_INODE) {
+        return KLoadedInodeState::Busy;
+    }
+    visitor(i->second);
+    return KLoadedInodeState::Loaded;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -505,6 +534,9 @@ void KVFSManager::InodeReleased(KInode* inode)
 
 void KVFSManager::FlushInodes()
 {
+    // Let inodes only kept alive by the name cache reach the unused list.
+    KNameCache::ReleaseUnusedInodes();
+
     if (s_InodeMRUList.GetFirst() != nullptr)
     {
         CRITICAL_SCOPE(s_InodeMapMutex);
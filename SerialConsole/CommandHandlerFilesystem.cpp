@@ -33,8 +33,6 @@
 #include <Storage/DirectoryEntry.h>
 #include <Utils/HashCalculator.h>
 #include <Kernel/VFS/FileIO.h>
-#include <Kernel/VFS/KVFSManager.h>
-#include <Kernel/VFS/KINode.h>
 #include <SerialConsole/SerialCommandHandler.h>
 #include <SerialConsole/CommandHandlerFilesystem.h>
 #include <SerialConsole/FilesystemMessages.h>
@@ -88,24 +86,6 @@ SerialProtocol::FilesystemError FilesystemErrorFromPErrorCode(PErrorCode error)
     return FilesystemErrorFromErrno(std::to_underlying(error));
 }
 
-bool TryReadStatFromDirectoryEntry(const dirent_t& entry, struct stat* statResult)
-{
-    bool result = false;
-    try
-    {
-        Ptr<KInode> inode = KVFSManager::GetInode_trw(entry.d_volumeid, entry.d_ino, false);
-        if (inode != nullptr)
-        {
-            kread_stat_trw(inode, statResult);
-            result = true;
-        }
-    }
-    catch (const std::exception&)
-    {
-    }
-    return result;
-}
-
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -305,11 +285,10 @@ void CommandHandlerFilesystem::HandleGetDirectory(const SerialProtocol::GetDirec
         PDirEntryBuffer directoryEntryBuffer;
         for (;;)
         {
-            const ssize_t readResult = posix_getdents(
+            const ssize_t readResult = kread_directory_plus(
                 dir,
                 directoryEntryBuffer.GetBuffer(),
-                directoryEntryBuffer.GetSize(),
-                0);
+                directoryEntryBuffer.GetSize());
             if (readResult <= 0) {
                 break;
             }
@@ -322,7 +301,12 @@ void CommandHandlerFilesystem::HandleGetDirectory(const SerialProtocol::GetDirec
                 }
 
                 struct stat statResult;
-                if (!TryReadStatFromDirectoryEntry(dirEntry, &statResult))
+                const struct stat* entryStat = PGetDirEntryStat(dirEntry);
+                if (entryStat != nullptr)
+                {
+                    statResult = *entryStat;
+                }
+                else
                 {
                     PString path = packet.m_Path;
                     path += "/";
@@ -19,6 +19,9 @@
 
 #include "System/Platform.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <PadOS/Time.h>
 #include <Threads/Looper.h>
 #include <Threads/EventHandler.h>
@@ -52,6 +55,7 @@ PLooper::PLooper(const PString& name, int portSize, size_t receiveBufferSize) :
         s_LooperList.push_back(this);
     } CRITICAL_END;
 #endif
+    m_PortControl.SetDeviceFD(open(PMESSAGE_PORT_CONTROL_PATH, O_RDONLY));
     SetReceiveBufferSize(receiveBufferSize);
 
     m_WaitGroup.AddObject(m_Port);
@@ -68,6 +72,9 @@ PLooper::~PLooper()
     {
         i.second->m_Looper = nullptr;
     }
+    if (m_PortControl.GetDeviceFD() != -1) {
+        close(m_PortControl.GetDeviceFD());
+    }
 #if DEBUG_LOOPER_LIST
     CRITICAL_BEGIN(GetLooperListMutex()) {
         s_LooperList.erase(std::find(s_LooperList.begin(), s_LooperList.end(), this));
@@ -118,10 +125,27 @@ bool PLooper::WaitForReply(handler_id replyHandler, int32_t replyCode)
     bool stillWaiting = true;
     do
     {
-        handler_id targetHandler;
-        int32_t    code;
-        
-        ssize_t msgLength = m_Port.ReceiveMessage(&targetHandler, &code, m_ReceiveBuffer.data(), m_ReceiveBuffer.size());
+        handler_id  targetHandler;
+        int32_t     code;
+        const void* data;
+        ssize_t     msgLength;
+
+        // Messages already taken from the port by ProcessMessageBatch() are
+        // older than anything still in the port, and the reply might be
+        // among them, so they must be consumed first.
+        if (m_BatchNext < m_BatchCount)
+        {
+            const PMessagePortBatchEntry& entry = m_BatchEntries[m_BatchNext++];
+            targetHandler = entry.TargetHandler;
+            code          = entry.Code;
+            data          = m_BatchBuffer.data() + entry.Offset;
+            msgLength     = entry.Length;
+        }
+        else
+        {
+            msgLength = m_Port.ReceiveMessage(&targetHandler, &code, m_ReceiveBuffer.data(), m_ReceiveBuffer.size());
+            data      = m_ReceiveBuffer.data();
+        }
         if (msgLength >= 0)
         {
             if (!m_WaitingCodes.empty() && code == m_WaitingCodes[0].first)
@@ -132,7 +156,7 @@ bool PLooper::WaitForReply(handler_id replyHandler, int32_t replyCode)
 //                    return true;
 //                }
             }
-            ProcessMessage(targetHandler, code, msgLength);
+            ProcessMessage(targetHandler, code, data, msgLength);
             stillWaiting = false;
             for (auto i = m_WaitingCodes.begin(); i != m_WaitingCodes.end(); ++i)
             {
@@ -310,29 +334,73 @@ bool PLooper::Tick()
         RunTimers();
         for (;;)
         {
-            handler_id targetHandler;
-            int32_t    code;
-
-            ssize_t msgLength = m_Port.ReceiveMessageTimeout(&targetHandler, &code, m_ReceiveBuffer.data(), m_ReceiveBuffer.size(), TimeValNanos::zero);
-            if (msgLength >= 0)
+            if (m_PortControl.GetDeviceFD() != -1)
             {
-                ProcessMessage(targetHandler, code, msgLength);
+                if (ProcessMessageBatch()) {
+                    continue;
+                }
             }
             else
             {
-                Idle();
-                break;
+                handler_id targetHandler;
+                int32_t    code;
+
+                ssize_t msgLength = m_Port.ReceiveMessageTimeout(&targetHandler, &code, m_ReceiveBuffer.data(), m_ReceiveBuffer.size(), TimeValNanos::zero);
+                if (msgLength >= 0)
+                {
+                    ProcessMessage(targetHandler, code, m_ReceiveBuffer.data(), msgLength);
+                    continue;
+                }
             }
+            Idle();
+            break;
         }
     }
     return m_DoRun;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Drain up to MAX_BATCH_SIZE pending messages with a single kernel call and
+/// dispatch them in order. The batch is received into m_BatchBuffer rather
+/// than m_ReceiveBuffer since handlers may call SetReceiveBufferSize() while
+/// the batch is being dispatched. A handler calling WaitForReply() consumes
+/// the remaining entries of the batch before reading more from the port, so
+/// m_BatchNext is advanced before each message is dispatched.
+/// Returns false if no message was pending.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+bool PLooper::ProcessMessageBatch()
+{
+    if (m_BatchBuffer.size() < m_ReceiveBuffer.size())
+    {
+        try {
+            m_BatchBuffer.resize(m_ReceiveBuffer.size() * 2);
+        } catch (const std::bad_alloc&) {
+            return false;
+        }
+    }
+    const ssize_t count = m_Port.ReceiveMultipleDeadline(m_PortControl, m_BatchEntries, MAX_BATCH_SIZE, m_BatchBuffer.data(), m_BatchBuffer.size(), TimeValNanos::zero);
+    if (count <= 0) {
+        return false;
+    }
+    m_BatchCount = size_t(count);
+    m_BatchNext  = 0;
+    while (m_BatchNext < m_BatchCount)
+    {
+        const PMessagePortBatchEntry& entry = m_BatchEntries[m_BatchNext++];
+        ProcessMessage(entry.TargetHandler, entry.Code, m_BatchBuffer.data() + entry.Offset, entry.Length);
+    }
+    m_BatchCount = 0;
+    m_BatchNext  = 0;
+    return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
 
-void PLooper::ProcessMessage(handler_id targetHandler, int32_t code, ssize_t msgLength)
+void PLooper::ProcessMessage(handler_id targetHandler, int32_t code, const void* data, size_t length)
 {
     assert(!IsRunning() || m_Mutex.IsLocked());
     if (PMessageID(code) == PMessageID::QUIT)
@@ -340,15 +408,15 @@ void PLooper::ProcessMessage(handler_id targetHandler, int32_t code, ssize_t msg
         QuitRequested();
         Stop();
     }
-    bool wasHandled = HandleMessage(targetHandler, code, m_ReceiveBuffer.data(), msgLength);
+    bool wasHandled = HandleMessage(targetHandler, code, data, length);
     if (!wasHandled && targetHandler == INVALID_HANDLE) {
-        wasHandled = m_RemoteSignalRegistry.Dispatch(code, m_ReceiveBuffer.data(), msgLength);
+        wasHandled = m_RemoteSignalRegistry.Dispatch(code, data, length);
     }
     if (!wasHandled && targetHandler != INVALID_HANDLE)
     {
         auto iterator = m_HandlerMap.find(targetHandler);
         if (iterator != m_HandlerMap.end()) {
-            iterator->second->HandleMessage(code, m_ReceiveBuffer.data(), msgLength);
+            iterator->second->HandleMessage(code, data, length);
         }
     }
 }
@@ -18,6 +18,7 @@
 // Created: 13.03.2018 21:00:23
 
 #include "Utils/MessagePort.h"
+#include "System/ExceptionHandling.h"
 
 bool PMessagePort::SendMessage(handler_id targetHandler, int32_t code, const void* data, size_t length) const
 {
@@ -33,3 +34,19 @@ bool PMessagePort::SendMessageDeadline(handler_id targetHandler, int32_t code, c
 {
     return ParseResult(message_port_send_deadline_ns(m_Handle, targetHandler, code, data, length, deadline.AsNanoseconds()));
 }
+
+///////////////////////////////////////////////////////////////////////////////
+/// Receive up to "maxCount" queued messages in one call through the message
+/// port control device. Returns the number of messages received, 0 if the
+/// deadline passed before any message arrived, or -1 with errno set.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+ssize_t PMessagePort::ReceiveMultipleDeadline(const PMessagePortControl& control, PMessagePortBatchEntry* entries, size_t maxCount, void* buffer, size_t bufferSize, TimeValNanos deadline) const
+{
+    try
+    {
+        return ssize_t(control.ReceiveMultiple(m_Handle, entries, maxCount, buffer, bufferSize, deadline.AsNanoseconds()));
+    }
+    PERROR_CATCH_SET_ERRNO(-1);
+}
@@ -320,3 +320,31 @@ bool unicode_case_fold_contains(const char* sourceBegin, const char* sourceEnd,
     const PUnicodeCaseFoldIterator tokenIteratorEnd(tokenEnd, tokenEnd);
     return std::search(sourceIteratorBegin, sourceIteratorEnd, tokenIteratorBegin, tokenIteratorEnd) != sourceIteratorEnd;
 }
+
+///////////////////////////////////////////////////////////////////////////////
+/// FNV-1a hash of the case folded code points.
+/// \author Kurt Skauen
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t unicode_case_fold_hash(const char* begin, const char* end) noexcept
+{
+    uint32_t hash = 2166136261u;
+    auto addCharacter = [&hash](uint32_t character)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            hash ^= (character >> (i * 8)) & 0xff;
+            hash *= 16777619u;
+        }
+    };
+
+    const char* position = begin;
+    for (; position != end && uint8_t(position[0]) < 0x80; ++position) {
+        addCharacter(unicode_case_fold_ascii_character(uint8_t(position[0])));
+    }
+    const PUnicodeCaseFoldIterator iteratorEnd(end, end);
+    for (PUnicodeCaseFoldIterator iterator(position, end); iterator != iteratorEnd; ++iterator) {
+        addCharacter(*iterator);
+    }
+    return hash;
+}
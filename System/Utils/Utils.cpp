@@ -58,6 +58,8 @@ void* _sbrk(ptrdiff_t size)
     return prev_heap;
 }
 
+#ifndef PADOS_OPT_TLSF_HEAP
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \author Kurt Skauen
 ///////////////////////////////////////////////////////////////////////////////
@@ -76,4 +78,6 @@ size_t get_max_heap_size()
     return HEAP_END - HEAP_START;
 }
 
+#endif // PADOS_OPT_TLSF_HEAP
+
 } // extern "C"
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+
+"""Compare two JSON result files written by the FAT benchmark suite."""
+
+import argparse
+import json
+import sys
+from pathlib import Path
+
+
+# Units where a smaller value is an improvement. All others are rates.
+LOWER_IS_BETTER_UNITS = {"us/lookup", "ms", "us"}
+
+
+def load_results(path: Path) -> tuple[dict, dict[str, tuple[float, str]]]:
+    document = json.loads(path.read_text(encoding="utf-8"))
+    results = {entry["name"]: (float(entry["value"]), entry["unit"]) for entry in document["results"]}
+    return document.get("config", {}), results
+
+
+def main() -> int:
+    argument_parser = argparse.ArgumentParser(description=__doc__)
+    argument_parser.add_argument("baseline", type=Path, help="results from the reference build")
+    argument_parser.add_argument("current", type=Path, help="results from the build being tested")
+    argument_parser.add_argument("--threshold", type=float, default=5.0, help="percent change reported as a regression (default: 5)")
+    arguments = argument_parser.parse_args()
+
+    baseline_config, baseline_results = load_results(arguments.baseline)
+    current_config, current_results = load_results(arguments.current)
+
+    if baseline_config != current_config:
+        print(f"warning: configurations differ: {baseline_config} vs {current_config}")
+
+    regressions = 0
+    print(f"{'benchmark':<28} {'baseline':>12} {'current':>12} {'change':>9}  unit")
+    for name in sorted(baseline_results.keys() | current_results.keys()):
+        if name not in current_results:
+            print(f"{name:<28} {baseline_results[name][0]:>12.2f} {'-':>12} {'':>9}  {baseline_results[name][1]}")
+            continue
+        if name not in baseline_results:
+            print(f"{name:<28} {'-':>12} {current_results[name][0]:>12.2f} {'':>9}  {current_results[name][1]}")
+            continue
+        baseline_value, unit = baseline_results[name]
+        current_value, _ = current_results[name]
+        change = (current_value - baseline_value) * 100.0 / baseline_value if baseline_value != 0.0 else 0.0
+        improvement = -change if unit in LOWER_IS_BETTER_UNITS else change
+        marker = ""
+        if improvement < -arguments.threshold:
+            marker = "  REGRESSION"
+            regressions += 1
+        print(f"{name:<28} {baseline_value:>12.2f} {current_value:>12.2f} {change:>+8.1f}%  {unit}{marker}")
+
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
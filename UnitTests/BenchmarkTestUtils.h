@@ -0,0 +1,152 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Helpers shared by the benchmark tests in UnitTests and Kernel/UnitTests.
+//
+// Build notes:
+//  - FATBENCH_DIRECTORY must point at a writable directory on a FAT volume.
+//    Tests using FATBenchFixture are skipped if it doesn't exist.
+
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifndef FATBENCH_DIRECTORY
+#  define FATBENCH_DIRECTORY "/sdcard"
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+/// Print a benchmark result, prefixed so it lines up with the gtest output
+/// and can be picked out of a test log with grep.
+///////////////////////////////////////////////////////////////////////////////
+
+inline void BenchPrintf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+inline void BenchPrintf(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fputs("[ BENCH    ] ", stdout);
+    vprintf(format, args);
+    fputc('\n', stdout);
+    va_end(args);
+}
+
+inline double BenchMBPerSecond(size_t bytes, double seconds)
+{
+    return double(bytes) / (1024.0 * 1024.0) / seconds;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Wall clock time since construction or the last Restart().
+///////////////////////////////////////////////////////////////////////////////
+
+class BenchTimer
+{
+public:
+    BenchTimer() : m_StartTime(std::chrono::steady_clock::now()) {}
+
+    void    Restart() { m_StartTime = std::chrono::steady_clock::now(); }
+    double  GetSeconds() const      { return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_StartTime).count(); }
+    double  GetMilliseconds() const { return GetSeconds() * 1.0e3; }
+    double  GetNanoseconds() const  { return GetSeconds() * 1.0e9; }
+
+private:
+    std::chrono::steady_clock::time_point m_StartTime;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// Base fixture for tests running on the FAT volume at FATBENCH_DIRECTORY.
+/// Each test gets an empty directory with the name given by the subclass,
+/// which is removed together with everything in it when the test ends.
+/// Subclasses overriding SetUp() must call this one first, and return if
+/// IsSkipped() or HasFatalFailure().
+///////////////////////////////////////////////////////////////////////////////
+
+class FATBenchFixture : public ::testing::Test
+{
+protected:
+    FATBenchFixture(const char* directoryName) : m_Directory(std::string(FATBENCH_DIRECTORY) + "/" + directoryName) {}
+
+    void SetUp() override
+    {
+        struct stat statBuf;
+        if (stat(FATBENCH_DIRECTORY, &statBuf) != 0 || !S_ISDIR(statBuf.st_mode)) {
+            GTEST_SKIP() << "No FAT volume at " FATBENCH_DIRECTORY ".";
+        }
+        RemoveTree(m_Directory);
+        ASSERT_EQ(mkdir(m_Directory.c_str(), 0777), 0) << m_Directory;
+    }
+    void TearDown() override
+    {
+        RemoveTree(m_Directory);
+    }
+
+    std::string Path(const std::string& name) const
+    {
+        return m_Directory + "/" + name;
+    }
+    // Path of a numbered file, with the number formatted by "format".
+    std::string IndexedPath(const char* format, int index) const
+    {
+        char name[NAME_MAX + 1];
+        snprintf(name, sizeof(name), format, index);
+        return Path(name);
+    }
+
+    static void RemoveTree(const std::string& path)
+    {
+        DIR* dir = opendir(path.c_str());
+        if (dir == nullptr) {
+            return;
+        }
+        // Collect the names first, so the directory isn't modified while
+        // it is being read.
+        std::vector<std::string> names;
+        for (struct dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir))
+        {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                names.push_back(entry->d_name);
+            }
+        }
+        closedir(dir);
+
+        for (const std::string& name : names)
+        {
+            const std::string entryPath = path + "/" + name;
+            struct stat statBuf;
+            if (lstat(entryPath.c_str(), &statBuf) == 0 && S_ISDIR(statBuf.st_mode)) {
+                RemoveTree(entryPath);
+            } else {
+                unlink(entryPath.c_str());
+            }
+        }
+        rmdir(path.c_str());
+    }
+
+    const std::string m_Directory;
+};
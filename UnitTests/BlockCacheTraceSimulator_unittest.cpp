@@ -0,0 +1,331 @@
+// block_cache_trace_simulator_tests.cpp
+// Trace-driven comparison of the block cache replacement policies. Each
+// trace is replayed through a plain LRU and through PTwoQueueCachePolicy
+// (the policy used by KBlockCache) at a few cache sizes, and the hit ratios
+// are printed. Only the cache-resident set is simulated, not I/O.
+//
+// Two synthetic traces are always run. Recorded traces are read from
+// BCTRACE_DIRECTORY if it exists. Each line of a trace file is one access:
+//
+//   <device> <buffer number> [m]
+//
+// where "m" flags metadata (FAT table and directory blocks). Empty lines
+// and lines starting with '#' are ignored.
+//
+// Build notes:
+//  - BCTRACE_DIRECTORY can point at a directory with *.trace files.
+//  - BCTRACE_CACHE_SIZES lists the simulated cache sizes in buffers.
+
+#include <gtest/gtest.h>
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Utils/IntrusiveList.h>
+#include <Utils/TwoQueueCachePolicy.h>
+#include <UnitTests/BenchmarkTestUtils.h>
+
+#ifndef BCTRACE_DIRECTORY
+#  define BCTRACE_DIRECTORY "/sdcard/bctrace"
+#endif
+#ifndef BCTRACE_CACHE_SIZES
+#  define BCTRACE_CACHE_SIZES 256, 1024, 4096
+#endif
+
+namespace BlockCacheTraceSimulator
+{
+
+struct TraceEntry
+{
+    uint64_t    Key;
+    bool        IsMetadata;
+};
+
+struct SimulatedBlock : PIntrusiveListNode<SimulatedBlock>
+{
+    uint64_t Key = 0;
+};
+
+struct SimulationResult
+{
+    size_t Accesses         = 0;
+    size_t Hits             = 0;
+    size_t MetadataAccesses = 0;
+    size_t MetadataHits     = 0;
+
+    double GetHitRatio() const          { return (Accesses != 0) ? double(Hits) / double(Accesses) : 0.0; }
+    double GetMetadataHitRatio() const  { return (MetadataAccesses != 0) ? double(MetadataHits) / double(MetadataAccesses) : 0.0; }
+};
+
+static uint64_t MakeKey(int device, uint64_t bufferNumber)
+{
+    return (uint64_t(device) << 48) ^ bufferNumber;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Fixed-size pool of simulated cache blocks indexed by key. The policy
+// classes only decide which block to evict.
+///////////////////////////////////////////////////////////////////////////////
+
+class SimulatedCache
+{
+public:
+    explicit SimulatedCache(size_t size) : m_Blocks(size) {}
+
+    SimulatedBlock* Find(uint64_t key)
+    {
+        auto i = m_Index.find(key);
+        return (i != m_Index.end()) ? i->second : nullptr;
+    }
+    SimulatedBlock* AllocateUnused()
+    {
+        return (m_UsedCount < m_Blocks.size()) ? &m_Blocks[m_UsedCount++] : nullptr;
+    }
+    void Map(SimulatedBlock* block, uint64_t key)   { block->Key = key; m_Index[key] = block; }
+    void Unmap(SimulatedBlock* block)               { m_Index.erase(block->Key); }
+
+private:
+    std::vector<SimulatedBlock>                     m_Blocks;
+    std::unordered_map<uint64_t, SimulatedBlock*>   m_Index;
+    size_t                                          m_UsedCount = 0;
+};
+
+class LRUSimulator
+{
+public:
+    explicit LRUSimulator(size_t size) : m_Cache(size) {}
+
+    bool Access(const TraceEntry& entry)
+    {
+        SimulatedBlock* block = m_Cache.Find(entry.Key);
+        if (block != nullptr)
+        {
+            m_MRUList.Remove(block);
+            m_MRUList.Append(block);
+            return true;
+        }
+        block = m_Cache.AllocateUnused();
+        if (block == nullptr)
+        {
+            block = m_MRUList.GetFirst();
+            m_MRUList.Remove(block);
+            m_Cache.Unmap(block);
+        }
+        m_Cache.Map(block, entry.Key);
+        m_MRUList.Append(block);
+        return false;
+    }
+private:
+    SimulatedCache                  m_Cache;
+    PIntrusiveList<SimulatedBlock>  m_MRUList;
+};
+
+class TwoQueueSimulator
+{
+public:
+    explicit TwoQueueSimulator(size_t size) : m_Cache(size) {}
+
+    bool Access(const TraceEntry& entry)
+    {
+        SimulatedBlock* block = m_Cache.Find(entry.Key);
+        if (block != nullptr)
+        {
+            m_Policy.Touch(block, entry.IsMetadata);
+            return true;
+        }
+        block = m_Cache.AllocateUnused();
+        if (block == nullptr)
+        {
+            m_Policy.ForEachVictimCandidate([this, &block](SimulatedBlock* candidate)
+                {
+                    m_Policy.Remove(candidate, candidate->Key);
+                    m_Cache.Unmap(candidate);
+                    block = candidate;
+                    return true;
+                }
+            );
+        }
+        m_Cache.Map(block, entry.Key);
+        m_Policy.Insert(block, entry.Key, entry.IsMetadata);
+        return false;
+    }
+private:
+    SimulatedCache                          m_Cache;
+    PTwoQueueCachePolicy<SimulatedBlock>    m_Policy;
+};
+
+template<typename TSimulator>
+static SimulationResult Replay(const std::vector<TraceEntry>& trace, size_t cacheSize)
+{
+    std::unique_ptr<TSimulator> simulator = std::make_unique<TSimulator>(cacheSize);
+    SimulationResult result;
+    for (const TraceEntry& entry : trace)
+    {
+        const bool isHit = simulator->Access(entry);
+        result.Accesses++;
+        if (isHit) result.Hits++;
+        if (entry.IsMetadata)
+        {
+            result.MetadataAccesses++;
+            if (isHit) result.MetadataHits++;
+        }
+    }
+    return result;
+}
+
+static void PrintComparison(const char* traceName, size_t cacheSize, const SimulationResult& lru, const SimulationResult& twoQueue)
+{
+    BenchPrintf("%-24s %5zu buffers: LRU %5.1f%% (meta %5.1f%%)  2Q %5.1f%% (meta %5.1f%%)",
+        traceName, cacheSize,
+        lru.GetHitRatio() * 100.0, lru.GetMetadataHitRatio() * 100.0,
+        twoQueue.GetHitRatio() * 100.0, twoQueue.GetMetadataHitRatio() * 100.0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Synthetic traces.
+///////////////////////////////////////////////////////////////////////////////
+
+// Metadata and small-file working set, interrupted by sequential reads of
+// files larger than the cache (firmware copy, "grep -r").
+static std::vector<TraceEntry> MakeScanTrace()
+{
+    static constexpr uint64_t METADATA_BLOCKS   = 192;
+    static constexpr uint64_t HOT_DATA_BLOCKS   = 384;
+    static constexpr uint64_t SCAN_BLOCKS       = 8192;
+    static constexpr uint64_t DATA_START        = 100000;
+
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<uint64_t> metadataDist(0, METADATA_BLOCKS - 1);
+    std::uniform_int_distribution<uint64_t> hotDataDist(0, HOT_DATA_BLOCKS - 1);
+
+    std::vector<TraceEntry> trace;
+    uint64_t scanStart = DATA_START + HOT_DATA_BLOCKS;
+    for (int round = 0; round < 8; ++round)
+    {
+        for (int i = 0; i < 4000; ++i)
+        {
+            if (i % 3 == 0) {
+                trace.push_back({ MakeKey(0, metadataDist(random)), true });
+            } else {
+                trace.push_back({ MakeKey(0, DATA_START + hotDataDist(random)), false });
+            }
+        }
+        for (uint64_t i = 0; i < SCAN_BLOCKS; ++i)
+        {
+            // The FAT is consulted once per cluster while streaming.
+            if (i % 8 == 0) {
+                trace.push_back({ MakeKey(0, (scanStart + i) / 1024 % METADATA_BLOCKS), true });
+            }
+            trace.push_back({ MakeKey(0, scanStart + i), false });
+        }
+        scanStart += SCAN_BLOCKS;
+    }
+    return trace;
+}
+
+// Random access with a skewed distribution and no scans. The 2Q policy
+// should be close to LRU here.
+static std::vector<TraceEntry> MakeSkewedTrace()
+{
+    std::mt19937 random(4321);
+    std::exponential_distribution<double> blockDist(1.0 / 600.0);
+
+    std::vector<TraceEntry> trace;
+    for (int i = 0; i < 100000; ++i)
+    {
+        const uint64_t blockNum = uint64_t(blockDist(random));
+        trace.push_back({ MakeKey(0, blockNum), blockNum < 64 });
+    }
+    return trace;
+}
+
+static bool LoadTrace(const std::string& path, std::vector<TraceEntry>& outTrace)
+{
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return false;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+            continue;
+        }
+        int                 device;
+        unsigned long long  bufferNumber;
+        char                flag = 0;
+        const int fieldCount = sscanf(line, "%d %llu %c", &device, &bufferNumber, &flag);
+        if (fieldCount < 2) {
+            continue;
+        }
+        outTrace.push_back({ MakeKey(device, bufferNumber), fieldCount == 3 && flag == 'm' });
+    }
+    fclose(file);
+    return true;
+}
+
+static const size_t g_CacheSizes[] = { BCTRACE_CACHE_SIZES };
+
+} // namespace BlockCacheTraceSimulator
+
+using namespace BlockCacheTraceSimulator;
+
+TEST(BlockCacheTraceSimulator, ScanDoesNotFlushMetadata)
+{
+    const std::vector<TraceEntry> trace = MakeScanTrace();
+    for (size_t cacheSize : g_CacheSizes)
+    {
+        const SimulationResult lru      = Replay<LRUSimulator>(trace, cacheSize);
+        const SimulationResult twoQueue = Replay<TwoQueueSimulator>(trace, cacheSize);
+        PrintComparison("sequential scans", cacheSize, lru, twoQueue);
+
+        EXPECT_GE(twoQueue.GetMetadataHitRatio(), lru.GetMetadataHitRatio());
+        EXPECT_GE(twoQueue.GetHitRatio(), lru.GetHitRatio());
+    }
+}
+
+TEST(BlockCacheTraceSimulator, SkewedRandomAccess)
+{
+    const std::vector<TraceEntry> trace = MakeSkewedTrace();
+    for (size_t cacheSize : g_CacheSizes)
+    {
+        const SimulationResult lru      = Replay<LRUSimulator>(trace, cacheSize);
+        const SimulationResult twoQueue = Replay<TwoQueueSimulator>(trace, cacheSize);
+        PrintComparison("skewed random", cacheSize, lru, twoQueue);
+
+        EXPECT_GE(twoQueue.GetHitRatio(), lru.GetHitRatio() * 0.9);
+    }
+}
+
+TEST(BlockCacheTraceSimulator, RecordedTraces)
+{
+    DIR* dir = opendir(BCTRACE_DIRECTORY);
+    if (dir == nullptr) {
+        GTEST_SKIP() << "No traces in " BCTRACE_DIRECTORY ".";
+    }
+    size_t traceCount = 0;
+    for (struct dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir))
+    {
+        const std::string name = entry->d_name;
+        if (name.size() < 6 || name.compare(name.size() - 6, 6, ".trace") != 0) {
+            continue;
+        }
+        std::vector<TraceEntry> trace;
+        ASSERT_TRUE(LoadTrace(std::string(BCTRACE_DIRECTORY) + "/" + name, trace)) << name;
+        for (size_t cacheSize : g_CacheSizes) {
+            PrintComparison(name.c_str(), cacheSize, Replay<LRUSimulator>(trace, cacheSize), Replay<TwoQueueSimulator>(trace, cacheSize));
+        }
+        traceCount++;
+    }
+    closedir(dir);
+    if (traceCount == 0) {
+        GTEST_SKIP() << "No traces in " BCTRACE_DIRECTORY ".";
+    }
+}
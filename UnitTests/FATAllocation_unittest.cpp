@@ -0,0 +1,150 @@
+// fat_allocation_tests.cpp
+// Cluster allocation on a mounted FAT volume. Fragments the free space by
+// deleting every other file in a set of small files, then writes a file
+// large enough to need both the freed holes and contiguous space, and
+// checks that the data reads back intact. Also covers file_allocate().
+//
+// Build notes:
+//  - FATBENCH_DIRECTORY must point at a writable directory on a FAT volume.
+//    The tests are skipped if it doesn't exist.
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <DeviceControl/FileAllocation.h>
+#include <UnitTests/BenchmarkTestUtils.h>
+
+#ifndef FATALLOC_HOLE_COUNT
+#  define FATALLOC_HOLE_COUNT 64
+#endif
+#ifndef FATALLOC_HOLE_SIZE
+#  define FATALLOC_HOLE_SIZE (8 * 1024)
+#endif
+#ifndef FATALLOC_FILE_SIZE
+#  define FATALLOC_FILE_SIZE (1024 * 1024)
+#endif
+
+static void FATAllocFill(std::vector<uint8_t>& buffer, size_t position)
+{
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        buffer[i] = uint8_t((position + i) * 13 + ((position + i) >> 11));
+    }
+}
+
+class FATAllocation : public FATBenchFixture
+{
+protected:
+    FATAllocation() : FATBenchFixture("fatalloc") {}
+
+    std::string HolePath(int index) const
+    {
+        return IndexedPath("hole%03d.bin", index);
+    }
+
+    const std::string m_LargePath = Path("large.bin");
+};
+
+TEST_F(FATAllocation, FragmentedFreeSpace)
+{
+    std::vector<uint8_t> buffer(FATALLOC_HOLE_SIZE);
+    for (int i = 0; i < FATALLOC_HOLE_COUNT; ++i)
+    {
+        const int file = open(HolePath(i).c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+        ASSERT_GE(file, 0) << HolePath(i);
+        FATAllocFill(buffer, i);
+        EXPECT_EQ(write(file, buffer.data(), buffer.size()), ssize_t(buffer.size()));
+        EXPECT_EQ(close(file), 0);
+    }
+    for (int i = 0; i < FATALLOC_HOLE_COUNT; i += 2) {
+        ASSERT_EQ(unlink(HolePath(i).c_str()), 0);
+    }
+
+    BenchTimer timer;
+    int file = open(m_LargePath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    ASSERT_GE(file, 0);
+    for (size_t position = 0; position < FATALLOC_FILE_SIZE; position += buffer.size())
+    {
+        FATAllocFill(buffer, position);
+        ASSERT_EQ(write(file, buffer.data(), buffer.size()), ssize_t(buffer.size()));
+    }
+    EXPECT_EQ(fsync(file), 0);
+    EXPECT_EQ(close(file), 0);
+    BenchPrintf("fragmented write %8.2f MB/s", BenchMBPerSecond(FATALLOC_FILE_SIZE, timer.GetSeconds()));
+
+    std::vector<uint8_t> expected(buffer.size());
+    file = open(m_LargePath.c_str(), O_RDONLY);
+    ASSERT_GE(file, 0);
+    for (size_t position = 0; position < FATALLOC_FILE_SIZE; position += buffer.size())
+    {
+        FATAllocFill(expected, position);
+        ASSERT_EQ(read(file, buffer.data(), buffer.size()), ssize_t(buffer.size()));
+        ASSERT_EQ(buffer, expected) << "at offset " << position;
+    }
+    EXPECT_EQ(close(file), 0);
+
+    // The surviving small files must not have been touched.
+    for (int i = 1; i < FATALLOC_HOLE_COUNT; i += 2)
+    {
+        file = open(HolePath(i).c_str(), O_RDONLY);
+        ASSERT_GE(file, 0) << HolePath(i);
+        FATAllocFill(expected, i);
+        ASSERT_EQ(read(file, buffer.data(), buffer.size()), ssize_t(buffer.size()));
+        EXPECT_EQ(buffer, expected) << HolePath(i);
+        EXPECT_EQ(close(file), 0);
+    }
+}
+
+TEST_F(FATAllocation, FileAllocate)
+{
+    const std::string path = Path("reserved.bin");
+
+    const int file = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+    ASSERT_GE(file, 0);
+
+    // Reserving space must not change the size.
+    struct stat statBuf;
+    ASSERT_EQ(file_allocate(file, FALLOC_FL_KEEP_SIZE, 0, FATALLOC_FILE_SIZE), PErrorCode::Success);
+    ASSERT_EQ(fstat(file, &statBuf), 0);
+    EXPECT_EQ(statBuf.st_size, 0);
+
+    // Extending the file makes the new range read back as zeros.
+    std::vector<uint8_t> buffer(FATALLOC_HOLE_SIZE);
+    FATAllocFill(buffer, 0);
+    ASSERT_EQ(write(file, buffer.data(), buffer.size()), ssize_t(buffer.size()));
+    ASSERT_EQ(file_allocate(file, 0, 0, FATALLOC_FILE_SIZE / 2), PErrorCode::Success);
+    ASSERT_EQ(fstat(file, &statBuf), 0);
+    EXPECT_EQ(statBuf.st_size, FATALLOC_FILE_SIZE / 2);
+
+    std::vector<uint8_t> expected(buffer.size());
+    for (size_t position = 0; position < FATALLOC_FILE_SIZE / 2; position += buffer.size())
+    {
+        if (position == 0) {
+            FATAllocFill(expected, 0);
+        } else {
+            std::fill(expected.begin(), expected.end(), 0);
+        }
+        ASSERT_EQ(pread(file, buffer.data(), buffer.size(), position), ssize_t(buffer.size()));
+        ASSERT_EQ(buffer, expected) << "at offset " << position;
+    }
+
+    EXPECT_EQ(file_allocate(file, 0, -1, 1), PErrorCode::INVAL);
+    EXPECT_EQ(file_allocate(file, 0, 0, 0), PErrorCode::INVAL);
+    EXPECT_EQ(file_allocate(file, 0x100, 0, 1), PErrorCode::INVAL);
+    EXPECT_EQ(close(file), 0);
+
+    // The reservation past the end of the file is released on close, which
+    // must leave the size alone.
+    ASSERT_EQ(stat(path.c_str(), &statBuf), 0);
+    EXPECT_EQ(statBuf.st_size, FATALLOC_FILE_SIZE / 2);
+
+    const int readOnlyFile = open(path.c_str(), O_RDONLY);
+    ASSERT_GE(readOnlyFile, 0);
+    EXPECT_EQ(file_allocate(readOnlyFile, 0, 0, 1), PErrorCode::BADF);
+    EXPECT_EQ(close(readOnlyFile), 0);
+}
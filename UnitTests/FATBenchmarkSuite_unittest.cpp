@@ -0,0 +1,266 @@
+// fat_benchmark_suite_tests.cpp
+// Filesystem throughput suite for comparing builds. Covers sequential
+// read/write, small file create/delete, directory lookup and writing into
+// fragmented free space. Each result is printed, and when the suite is done
+// all results are written as JSON to FATSUITE_RESULTS_PATH, so that runs
+// from two releases can be compared with Tools/compare_benchmark_results.py.
+// Only the data read back is checked; the timings are not.
+//
+// The suite runs on the target against the volume at FATBENCH_DIRECTORY.
+// There is no host build of the kernel VFS and FAT driver yet, so changes
+// to them still have to be measured on hardware. Running it on a
+// development host would measure the host's FAT driver, not ours.
+//
+// Build notes:
+//  - FATBENCH_DIRECTORY must point at a writable directory on a FAT volume.
+//    The tests are skipped if it doesn't exist.
+//  - FATSUITE_RESULTS_PATH is where the JSON results are written.
+
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <UnitTests/BenchmarkTestUtils.h>
+
+#ifndef FATSUITE_RESULTS_PATH
+#  define FATSUITE_RESULTS_PATH FATBENCH_DIRECTORY "/fatsuite_results.json"
+#endif
+#ifndef FATSUITE_FILE_SIZE
+#  define FATSUITE_FILE_SIZE (4 * 1024 * 1024)
+#endif
+#ifndef FATSUITE_CHUNK_SIZE
+#  define FATSUITE_CHUNK_SIZE (16 * 1024)
+#endif
+#ifndef FATSUITE_SMALL_FILE_COUNT
+#  define FATSUITE_SMALL_FILE_COUNT 256
+#endif
+#ifndef FATSUITE_SMALL_FILE_SIZE
+#  define FATSUITE_SMALL_FILE_SIZE 2048
+#endif
+#ifndef FATSUITE_LOOKUP_COUNT
+#  define FATSUITE_LOOKUP_COUNT 2000
+#endif
+
+static void FATSuiteFill(std::vector<uint8_t>& buffer, size_t position)
+{
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        buffer[i] = uint8_t((position + i) * 29 + ((position + i) >> 10));
+    }
+}
+
+struct FATSuiteResult
+{
+    std::string Name;
+    double      Value;
+    const char* Unit;
+};
+
+class FATBenchmarkSuite : public FATBenchFixture
+{
+public:
+    static void TearDownTestSuite()
+    {
+        if (s_Results.empty()) {
+            return;
+        }
+        FILE* file = fopen(FATSUITE_RESULTS_PATH, "w");
+        if (file == nullptr)
+        {
+            BenchPrintf("failed to write %s: %s", FATSUITE_RESULTS_PATH, strerror(errno));
+            return;
+        }
+        fprintf(file, "{\n");
+        fprintf(file, "  \"suite\": \"fat_benchmark_suite\",\n");
+        fprintf(file, "  \"config\": {\n");
+        fprintf(file, "    \"file_size\": %d,\n", FATSUITE_FILE_SIZE);
+        fprintf(file, "    \"chunk_size\": %d,\n", FATSUITE_CHUNK_SIZE);
+        fprintf(file, "    \"small_file_count\": %d,\n", FATSUITE_SMALL_FILE_COUNT);
+        fprintf(file, "    \"small_file_size\": %d,\n", FATSUITE_SMALL_FILE_SIZE);
+        fprintf(file, "    \"lookup_count\": %d\n", FATSUITE_LOOKUP_COUNT);
+        fprintf(file, "  },\n");
+        fprintf(file, "  \"results\": [\n");
+        for (size_t i = 0; i < s_Results.size(); ++i)
+        {
+            const FATSuiteResult& result = s_Results[i];
+            fprintf(file, "    { \"name\": \"%s\", \"value\": %.3f, \"unit\": \"%s\" }%s\n", result.Name.c_str(), result.Value, result.Unit, (i + 1 < s_Results.size()) ? "," : "");
+        }
+        fprintf(file, "  ]\n");
+        fprintf(file, "}\n");
+        fclose(file);
+        BenchPrintf("results written to %s", FATSUITE_RESULTS_PATH);
+        s_Results.clear();
+    }
+
+protected:
+    FATBenchmarkSuite() : FATBenchFixture("fatsuite") {}
+
+    std::string SmallFilePath(int index) const
+    {
+        return IndexedPath("Small file %04d.dat", index);
+    }
+
+    static void AddResult(const char* name, double value, const char* unit)
+    {
+        BenchPrintf("%-28s %10.2f %s", name, value, unit);
+        s_Results.push_back(FATSuiteResult{ name, value, unit });
+    }
+
+    void CreateSmallFiles()
+    {
+        std::vector<uint8_t> buffer(FATSUITE_SMALL_FILE_SIZE);
+        for (int i = 0; i < FATSUITE_SMALL_FILE_COUNT; ++i)
+        {
+            const int file = open(SmallFilePath(i).c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+            ASSERT_GE(file, 0) << SmallFilePath(i);
+            FATSuiteFill(buffer, size_t(i));
+            ASSERT_EQ(write(file, buffer.data(), buffer.size()), ssize_t(buffer.size()));
+            ASSERT_EQ(close(file), 0);
+        }
+    }
+
+    // Write FATSUITE_FILE_SIZE bytes to the large file, and return the time
+    // it took including fsync().
+    double WriteLargeFile()
+    {
+        std::vector<uint8_t> chunk(FATSUITE_CHUNK_SIZE);
+        const BenchTimer timer;
+        const int file = open(m_LargePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        EXPECT_GE(file, 0);
+        if (file < 0) {
+            return 0.0;
+        }
+        for (size_t position = 0; position < FATSUITE_FILE_SIZE; position += chunk.size())
+        {
+            FATSuiteFill(chunk, position);
+            if (write(file, chunk.data(), chunk.size()) != ssize_t(chunk.size()))
+            {
+                ADD_FAILURE() << "write failed at " << position << ": " << strerror(errno);
+                break;
+            }
+        }
+        EXPECT_EQ(fsync(file), 0);
+        EXPECT_EQ(close(file), 0);
+        return timer.GetSeconds();
+    }
+
+    // Read back and verify the large file, and return the time it took.
+    double ReadLargeFile()
+    {
+        std::vector<uint8_t> chunk(FATSUITE_CHUNK_SIZE);
+        std::vector<uint8_t> expected(FATSUITE_CHUNK_SIZE);
+        const BenchTimer timer;
+        const int file = open(m_LargePath.c_str(), O_RDONLY);
+        EXPECT_GE(file, 0);
+        if (file < 0) {
+            return 0.0;
+        }
+        for (size_t position = 0; position < FATSUITE_FILE_SIZE; position += chunk.size())
+        {
+            if (read(file, chunk.data(), chunk.size()) != ssize_t(chunk.size()))
+            {
+                ADD_FAILURE() << "read failed at " << position << ": " << strerror(errno);
+                break;
+            }
+            FATSuiteFill(expected, position);
+            if (chunk != expected)
+            {
+                ADD_FAILURE() << "mismatch in chunk at " << position;
+                break;
+            }
+        }
+        EXPECT_EQ(close(file), 0);
+        return timer.GetSeconds();
+    }
+
+    const std::string m_LargePath = Path("large.bin");
+
+    static std::vector<FATSuiteResult> s_Results;
+};
+
+std::vector<FATSuiteResult> FATBenchmarkSuite::s_Results;
+
+TEST_F(FATBenchmarkSuite, SequentialReadWrite)
+{
+    AddResult("sequential_write", BenchMBPerSecond(FATSUITE_FILE_SIZE, WriteLargeFile()), "MB/s");
+    AddResult("sequential_read", BenchMBPerSecond(FATSUITE_FILE_SIZE, ReadLargeFile()), "MB/s");
+
+    // Overwrite in place, which needs no allocation.
+    AddResult("sequential_overwrite", BenchMBPerSecond(FATSUITE_FILE_SIZE, WriteLargeFile()), "MB/s");
+}
+
+TEST_F(FATBenchmarkSuite, SmallFileCreateDelete)
+{
+    BenchTimer timer;
+    CreateSmallFiles();
+    sync();
+    const double createSeconds = timer.GetSeconds();
+
+    timer.Restart();
+    for (int i = 0; i < FATSUITE_SMALL_FILE_COUNT; ++i) {
+        ASSERT_EQ(unlink(SmallFilePath(i).c_str()), 0) << SmallFilePath(i);
+    }
+    sync();
+    const double deleteSeconds = timer.GetSeconds();
+
+    AddResult("small_file_create", FATSUITE_SMALL_FILE_COUNT / createSeconds, "files/s");
+    AddResult("small_file_delete", FATSUITE_SMALL_FILE_COUNT / deleteSeconds, "files/s");
+}
+
+TEST_F(FATBenchmarkSuite, DirectoryLookup)
+{
+    CreateSmallFiles();
+
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<int> indexDistribution(0, FATSUITE_SMALL_FILE_COUNT - 1);
+
+    struct stat statBuf;
+    BenchTimer timer;
+    for (int i = 0; i < FATSUITE_LOOKUP_COUNT; ++i) {
+        ASSERT_EQ(stat(SmallFilePath(indexDistribution(random)).c_str(), &statBuf), 0);
+    }
+    const double hitSeconds = timer.GetSeconds();
+
+    // Names that don't exist must scan (or hash) the whole directory.
+    timer.Restart();
+    for (int i = 0; i < FATSUITE_LOOKUP_COUNT; ++i) {
+        ASSERT_NE(stat(SmallFilePath(FATSUITE_SMALL_FILE_COUNT + indexDistribution(random)).c_str(), &statBuf), 0);
+    }
+    const double missSeconds = timer.GetSeconds();
+
+    AddResult("directory_lookup_hit", hitSeconds * 1.0e6 / FATSUITE_LOOKUP_COUNT, "us/lookup");
+    AddResult("directory_lookup_miss", missSeconds * 1.0e6 / FATSUITE_LOOKUP_COUNT, "us/lookup");
+}
+
+TEST_F(FATBenchmarkSuite, FragmentedWrite)
+{
+    // Punch holes in the free space by deleting every other small file.
+    CreateSmallFiles();
+    for (int i = 0; i < FATSUITE_SMALL_FILE_COUNT; i += 2) {
+        ASSERT_EQ(unlink(SmallFilePath(i).c_str()), 0);
+    }
+    sync();
+
+    AddResult("fragmented_write", BenchMBPerSecond(FATSUITE_FILE_SIZE, WriteLargeFile()), "MB/s");
+    AddResult("fragmented_read", BenchMBPerSecond(FATSUITE_FILE_SIZE, ReadLargeFile()), "MB/s");
+
+    // The remaining small files must not have been touched.
+    std::vector<uint8_t> buffer(FATSUITE_SMALL_FILE_SIZE);
+    std::vector<uint8_t> expected(FATSUITE_SMALL_FILE_SIZE);
+    for (int i = 1; i < FATSUITE_SMALL_FILE_COUNT; i += 2)
+    {
+        const int file = open(SmallFilePath(i).c_str(), O_RDONLY);
+        ASSERT_GE(file, 0) << SmallFilePath(i);
+        FATSuiteFill(expected, size_t(i));
+        ASSERT_EQ(read(file, buffer.data(), buffer.size()), ssize_t(buffer.size()));
+        EXPECT_EQ(buffer, expected) << SmallFilePath(i);
+        EXPECT_EQ(close(file), 0);
+    }
+}
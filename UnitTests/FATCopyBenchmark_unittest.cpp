@@ -0,0 +1,133 @@
+// fat_copy_benchmark_tests.cpp
+// Sequential write, read and copy throughput of a file on a mounted FAT
+// volume. Useful for comparing block cache buffer sizes between builds.
+// Also reads the file backwards to measure seek cost. The assertions only
+// check that the data read matches what was written.
+//
+// Build notes:
+//  - FATBENCH_DIRECTORY must point at a writable directory on a FAT volume.
+//    The tests are skipped if it doesn't exist.
+//  - Adjust FATBENCH_FILE_SIZE to trade accuracy for test time.
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include <UnitTests/BenchmarkTestUtils.h>
+
+#ifndef FATBENCH_FILE_SIZE
+#  define FATBENCH_FILE_SIZE (2 * 1024 * 1024)
+#endif
+#ifndef FATBENCH_CHUNK_SIZE
+#  define FATBENCH_CHUNK_SIZE (16 * 1024)
+#endif
+
+static void FillChunk(std::vector<uint8_t>& chunk, size_t position)
+{
+    for (size_t i = 0; i < chunk.size(); ++i) {
+        chunk[i] = uint8_t((position + i) * 31 + ((position + i) >> 9));
+    }
+}
+
+static void PrintResult(const char* name, double seconds)
+{
+    BenchPrintf("%-20s %8.2f MB/s", name, BenchMBPerSecond(FATBENCH_FILE_SIZE, seconds));
+}
+
+class FATCopyBenchmark : public FATBenchFixture
+{
+protected:
+    FATCopyBenchmark() : FATBenchFixture("fatbench") {}
+
+    void SetUp() override
+    {
+        FATBenchFixture::SetUp();
+        m_Chunk.resize(FATBENCH_CHUNK_SIZE);
+    }
+
+    const std::string    m_SourcePath = Path("fatbench_src.bin");
+    const std::string    m_CopyPath   = Path("fatbench_dst.bin");
+    std::vector<uint8_t> m_Chunk;
+};
+
+TEST_F(FATCopyBenchmark, WriteReadCopy)
+{
+    // Write.
+    BenchTimer timer;
+    int source = open(m_SourcePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    ASSERT_GE(source, 0);
+    for (size_t position = 0; position < FATBENCH_FILE_SIZE; position += m_Chunk.size())
+    {
+        FillChunk(m_Chunk, position);
+        ASSERT_EQ(write(source, m_Chunk.data(), m_Chunk.size()), ssize_t(m_Chunk.size()));
+    }
+    EXPECT_EQ(fsync(source), 0);
+    EXPECT_EQ(close(source), 0);
+    PrintResult("FAT write", timer.GetSeconds());
+
+    // Copy.
+    timer.Restart();
+    source = open(m_SourcePath.c_str(), O_RDONLY);
+    ASSERT_GE(source, 0);
+    int destination = open(m_CopyPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    ASSERT_GE(destination, 0);
+    for (;;)
+    {
+        const ssize_t length = read(source, m_Chunk.data(), m_Chunk.size());
+        ASSERT_GE(length, 0);
+        if (length == 0) {
+            break;
+        }
+        ASSERT_EQ(write(destination, m_Chunk.data(), length), length);
+    }
+    EXPECT_EQ(fsync(destination), 0);
+    EXPECT_EQ(close(destination), 0);
+    EXPECT_EQ(close(source), 0);
+    PrintResult("FAT copy", timer.GetSeconds());
+
+    // Read back and verify.
+    std::vector<uint8_t> expected(m_Chunk.size());
+    timer.Restart();
+    destination = open(m_CopyPath.c_str(), O_RDONLY);
+    ASSERT_GE(destination, 0);
+    for (size_t position = 0; position < FATBENCH_FILE_SIZE; position += m_Chunk.size())
+    {
+        ASSERT_EQ(read(destination, m_Chunk.data(), m_Chunk.size()), ssize_t(m_Chunk.size()));
+        FillChunk(expected, position);
+        ASSERT_EQ(memcmp(m_Chunk.data(), expected.data(), m_Chunk.size()), 0) << "Mismatch in chunk at " << position;
+    }
+    EXPECT_EQ(close(destination), 0);
+    PrintResult("FAT read", timer.GetSeconds());
+}
+
+TEST_F(FATCopyBenchmark, RandomRead)
+{
+    int source = open(m_SourcePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    ASSERT_GE(source, 0);
+    for (size_t position = 0; position < FATBENCH_FILE_SIZE; position += m_Chunk.size())
+    {
+        FillChunk(m_Chunk, position);
+        ASSERT_EQ(write(source, m_Chunk.data(), m_Chunk.size()), ssize_t(m_Chunk.size()));
+    }
+    EXPECT_EQ(close(source), 0);
+
+    // Read the chunks backwards, so every read seeks behind the previous one.
+    const size_t chunkCount = FATBENCH_FILE_SIZE / FATBENCH_CHUNK_SIZE;
+    std::vector<uint8_t> expected(m_Chunk.size());
+    BenchTimer timer;
+    source = open(m_SourcePath.c_str(), O_RDONLY);
+    ASSERT_GE(source, 0);
+    for (size_t i = chunkCount; i > 0; --i)
+    {
+        const size_t position = (i - 1) * m_Chunk.size();
+        ASSERT_EQ(pread(source, m_Chunk.data(), m_Chunk.size(), off_t(position)), ssize_t(m_Chunk.size()));
+        FillChunk(expected, position);
+        ASSERT_EQ(memcmp(m_Chunk.data(), expected.data(), m_Chunk.size()), 0) << "Mismatch in chunk at " << position;
+    }
+    EXPECT_EQ(close(source), 0);
+    PrintResult("FAT backward read", timer.GetSeconds());
+}
@@ -0,0 +1,96 @@
+// fat_directory_index_tests.cpp
+// Name lookups in a large FAT directory. Exercises the directory hash
+// index through create, lookup, rename and unlink, and prints the average
+// lookup time.
+//
+// Build notes:
+//  - FATBENCH_DIRECTORY must point at a writable directory on a FAT volume.
+//    The tests are skipped if it doesn't exist.
+
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+
+#include <UnitTests/BenchmarkTestUtils.h>
+
+#ifndef FATINDEX_FILE_COUNT
+#  define FATINDEX_FILE_COUNT 500
+#endif
+
+static bool FATIndexExists(const std::string& path)
+{
+    struct stat statBuf;
+    return stat(path.c_str(), &statBuf) == 0;
+}
+
+class FATDirectoryLookup : public FATBenchFixture
+{
+protected:
+    FATDirectoryLookup() : FATBenchFixture("fatindex") {}
+
+    void SetUp() override
+    {
+        FATBenchFixture::SetUp();
+        if (IsSkipped() || HasFatalFailure()) {
+            return;
+        }
+        for (int i = 0; i < FATINDEX_FILE_COUNT; ++i)
+        {
+            const int file = open(FilePath(i).c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+            ASSERT_GE(file, 0) << FilePath(i);
+            EXPECT_EQ(close(file), 0);
+        }
+    }
+    std::string FilePath(int index) const
+    {
+        return IndexedPath("Long file name %04d.txt", index);
+    }
+};
+
+TEST_F(FATDirectoryLookup, Lookup)
+{
+    BenchTimer timer;
+    for (int i = FATINDEX_FILE_COUNT - 1; i >= 0; --i) {
+        EXPECT_TRUE(FATIndexExists(FilePath(i))) << FilePath(i);
+    }
+    const double seconds = timer.GetSeconds();
+    BenchPrintf("%d lookups, %.1f us/lookup", FATINDEX_FILE_COUNT, seconds * 1.0e6 / FATINDEX_FILE_COUNT);
+
+    // Path lookup is case sensitive, but creating names is not.
+    EXPECT_FALSE(FATIndexExists(Path("LONG FILE NAME 0007.TXT")));
+    EXPECT_FALSE(FATIndexExists(Path("missing.txt")));
+
+    errno = 0;
+    EXPECT_LT(open(Path("LONG FILE NAME 0007.TXT").c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666), 0);
+    EXPECT_EQ(errno, EEXIST);
+}
+
+TEST_F(FATDirectoryLookup, CreateRenameAndUnlink)
+{
+    const int file = open(Path("short.txt").c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    ASSERT_GE(file, 0);
+    EXPECT_EQ(close(file), 0);
+    EXPECT_TRUE(FATIndexExists(Path("short.txt")));
+
+    ASSERT_EQ(rename(FilePath(10).c_str(), Path("renamed.txt").c_str()), 0);
+    EXPECT_FALSE(FATIndexExists(FilePath(10)));
+    EXPECT_TRUE(FATIndexExists(Path("renamed.txt")));
+
+    // The freed slots are reused by the next file created.
+    const int reused = open(FilePath(10).c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    ASSERT_GE(reused, 0);
+    EXPECT_EQ(close(reused), 0);
+    EXPECT_TRUE(FATIndexExists(FilePath(10)));
+
+    for (int i = 0; i < FATINDEX_FILE_COUNT; i += 2) {
+        ASSERT_EQ(unlink(FilePath(i).c_str()), 0);
+    }
+    for (int i = 0; i < FATINDEX_FILE_COUNT; ++i) {
+        EXPECT_EQ(FATIndexExists(FilePath(i)), (i & 1) != 0) << FilePath(i);
+    }
+    EXPECT_TRUE(FATIndexExists(Path("renamed.txt")));
+}
@@ -0,0 +1,177 @@
+// fat_read_directory_plus_tests.cpp
+// Directory listing with stat on a FAT volume. Checks that the stats from
+// read_directory_plus() match stat() of each entry, including a file that
+// is still open with unflushed changes, and prints the time for listing
+// the directory with read_directory_plus() and with getdents() + stat().
+//
+// Build notes:
+//  - FATBENCH_DIRECTORY must point at a writable directory on a FAT volume.
+//    The tests are skipped if it doesn't exist.
+
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <DeviceControl/ReadDirectoryPlus.h>
+#include <Storage/DirectoryEntry.h>
+#include <UnitTests/BenchmarkTestUtils.h>
+
+#ifndef FATDIRPLUS_FILE_COUNT
+#  define FATDIRPLUS_FILE_COUNT 200
+#endif
+
+class FATReadDirectoryPlus : public FATBenchFixture
+{
+protected:
+    FATReadDirectoryPlus() : FATBenchFixture("fatdirplus") {}
+
+    void SetUp() override
+    {
+        FATBenchFixture::SetUp();
+        if (IsSkipped() || HasFatalFailure()) {
+            return;
+        }
+        ASSERT_EQ(mkdir(m_SubdirPath.c_str(), 0777), 0);
+
+        std::vector<uint8_t> buffer(FATDIRPLUS_FILE_COUNT, 0x55);
+        for (int i = 0; i < FATDIRPLUS_FILE_COUNT; ++i)
+        {
+            const int file = open(FilePath(i).c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+            ASSERT_GE(file, 0) << FilePath(i);
+            EXPECT_EQ(write(file, buffer.data(), size_t(i)), ssize_t(i));
+            EXPECT_EQ(close(file), 0);
+        }
+    }
+    std::string FilePath(int index) const
+    {
+        return IndexedPath("Listed file %04d.bin", index);
+    }
+
+    const std::string m_OpenPath   = Path("open file.bin");
+    const std::string m_SubdirPath = Path("subdir");
+};
+
+TEST_F(FATReadDirectoryPlus, StatMatchesStat)
+{
+    // The size of an open file is only in the inode until it is flushed.
+    const int openFile = open(m_OpenPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    ASSERT_GE(openFile, 0);
+    std::vector<uint8_t> buffer(12345, 0xaa);
+    ASSERT_EQ(write(openFile, buffer.data(), buffer.size()), ssize_t(buffer.size()));
+
+    const int directory = open(m_Directory.c_str(), O_RDONLY | O_DIRECTORY);
+    ASSERT_GE(directory, 0);
+
+    std::map<std::string, struct stat> entries;
+    PDirEntryBuffer entryBuffer;
+    for (;;)
+    {
+        const ssize_t readResult = read_directory_plus(directory, entryBuffer.GetBuffer(), entryBuffer.GetSize());
+        ASSERT_GE(readResult, 0) << strerror(errno);
+        if (readResult == 0) {
+            break;
+        }
+        for (PDirEntryIterator iterator(entryBuffer.GetBuffer(), size_t(readResult)); iterator; ++iterator)
+        {
+            const struct stat* entryStat = PGetDirEntryStat(*iterator);
+            if (entryStat != nullptr) {
+                entries[std::string(iterator->d_name, iterator->d_namlen)] = *entryStat;
+            }
+        }
+    }
+    EXPECT_EQ(close(directory), 0);
+
+    // All but ".." are in the directory itself, so all but that must have
+    // a stat.
+    EXPECT_GE(entries.size(), size_t(FATDIRPLUS_FILE_COUNT + 3));
+
+    for (const auto& [name, entryStat] : entries)
+    {
+        if (name == "..") {
+            continue;
+        }
+        struct stat statBuf;
+        ASSERT_EQ(stat(Path(name).c_str(), &statBuf), 0) << name;
+        EXPECT_EQ(entryStat.st_ino, statBuf.st_ino) << name;
+        EXPECT_EQ(entryStat.st_dev, statBuf.st_dev) << name;
+        EXPECT_EQ(entryStat.st_mode, statBuf.st_mode) << name;
+        EXPECT_EQ(entryStat.st_size, statBuf.st_size) << name;
+        EXPECT_EQ(entryStat.st_mtim.tv_sec, statBuf.st_mtim.tv_sec) << name;
+        EXPECT_EQ(entryStat.st_mtim.tv_nsec, statBuf.st_mtim.tv_nsec) << name;
+        EXPECT_EQ(entryStat.st_ctim.tv_sec, statBuf.st_ctim.tv_sec) << name;
+    }
+    ASSERT_EQ(entries.count("open file.bin"), 1u);
+    EXPECT_EQ(entries["open file.bin"].st_size, off_t(buffer.size()));
+    ASSERT_EQ(entries.count("subdir"), 1u);
+    EXPECT_TRUE(S_ISDIR(entries["subdir"].st_mode));
+
+    EXPECT_EQ(close(openFile), 0);
+}
+
+TEST_F(FATReadDirectoryPlus, RejectsFiles)
+{
+    const int file = open(FilePath(1).c_str(), O_RDONLY);
+    ASSERT_GE(file, 0);
+    PDirEntryBuffer entryBuffer;
+    EXPECT_EQ(read_directory_plus(file, entryBuffer.GetBuffer(), entryBuffer.GetSize()), -1);
+    EXPECT_EQ(close(file), 0);
+}
+
+TEST_F(FATReadDirectoryPlus, ListingBenchmark)
+{
+    PDirEntryBuffer entryBuffer;
+
+    BenchTimer timer;
+    size_t plusCount = 0;
+    {
+        const int directory = open(m_Directory.c_str(), O_RDONLY | O_DIRECTORY);
+        ASSERT_GE(directory, 0);
+        for (;;)
+        {
+            const ssize_t readResult = read_directory_plus(directory, entryBuffer.GetBuffer(), entryBuffer.GetSize());
+            ASSERT_GE(readResult, 0);
+            if (readResult == 0) {
+                break;
+            }
+            for (PDirEntryIterator iterator(entryBuffer.GetBuffer(), size_t(readResult)); iterator; ++iterator) {
+                plusCount++;
+            }
+        }
+        EXPECT_EQ(close(directory), 0);
+    }
+    const double plusSeconds = timer.GetSeconds();
+
+    timer.Restart();
+    size_t statCount = 0;
+    {
+        const int directory = open(m_Directory.c_str(), O_RDONLY | O_DIRECTORY);
+        ASSERT_GE(directory, 0);
+        for (;;)
+        {
+            const ssize_t readResult = posix_getdents(directory, entryBuffer.GetBuffer(), entryBuffer.GetSize(), 0);
+            ASSERT_GE(readResult, 0);
+            if (readResult == 0) {
+                break;
+            }
+            for (PDirEntryIterator iterator(entryBuffer.GetBuffer(), size_t(readResult)); iterator; ++iterator)
+            {
+                struct stat statBuf;
+                if (fstatat(directory, iterator->d_name, &statBuf, 0) == 0) {
+                    statCount++;
+                }
+            }
+        }
+        EXPECT_EQ(close(directory), 0);
+    }
+    const double statSeconds = timer.GetSeconds();
+
+    EXPECT_EQ(plusCount, statCount);
+    BenchPrintf("%zu entries: read_directory_plus %.2f ms, getdents + stat %.2f ms", plusCount, plusSeconds * 1000.0, statSeconds * 1000.0);
+}
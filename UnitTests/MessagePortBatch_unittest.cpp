@@ -0,0 +1,149 @@
+// This file is part of PadOS.
+//
+// Copyright (C) 2026 Kurt Skauen <http://kavionic.com/>
+//
+// PadOS is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// PadOS is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with PadOS. If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////////
+// Created: 17.10.2026
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <vector>
+
+#include <Threads/Looper.h>
+#include <Utils/MessagePort.h>
+
+namespace message_port_batch_tests
+{
+
+class MessagePortBatch : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        m_ControlFD = open(PMESSAGE_PORT_CONTROL_PATH, O_RDONLY);
+        ASSERT_GE(m_ControlFD, 0);
+        m_Control.SetDeviceFD(m_ControlFD);
+    }
+    void TearDown() override
+    {
+        if (m_ControlFD != -1) {
+            close(m_ControlFD);
+        }
+    }
+
+    int                 m_ControlFD = -1;
+    PMessagePortControl m_Control;
+};
+
+TEST_F(MessagePortBatch, ReceivesQueuedMessagesInOrder)
+{
+    PMessagePort port("batch_test", 16);
+    ASSERT_NE(port.GetHandle(), INVALID_HANDLE);
+
+    for (int i = 0; i < 5; ++i)
+    {
+        std::vector<uint8_t> payload(i * 3 + 1, uint8_t(i));
+        ASSERT_TRUE(port.SendMessage(100 + i, i, payload.data(), payload.size()));
+    }
+    PMessagePortBatchEntry  entries[8];
+    std::vector<uint8_t>    buffer(256);
+
+    const ssize_t count = port.ReceiveMultipleDeadline(m_Control, entries, 8, buffer.data(), buffer.size(), TimeValNanos::zero);
+    ASSERT_EQ(count, 5);
+    for (int i = 0; i < 5; ++i)
+    {
+        EXPECT_EQ(entries[i].TargetHandler, 100 + i);
+        EXPECT_EQ(entries[i].Code, i);
+        EXPECT_EQ(entries[i].Length, uint32_t(i * 3 + 1));
+        EXPECT_EQ(entries[i].Offset % PMESSAGE_PORT_BATCH_ALIGNMENT, 0u);
+        for (uint32_t j = 0; j < entries[i].Length; ++j) {
+            EXPECT_EQ(buffer[entries[i].Offset + j], uint8_t(i));
+        }
+    }
+    EXPECT_EQ(port.ReceiveMultipleDeadline(m_Control, entries, 8, buffer.data(), buffer.size(), TimeValNanos::zero), 0);
+}
+
+TEST_F(MessagePortBatch, StopsAtEntryAndBufferLimits)
+{
+    PMessagePort port("batch_test", 16);
+    ASSERT_NE(port.GetHandle(), INVALID_HANDLE);
+
+    uint8_t payload[40] = {};
+    for (int i = 0; i < 6; ++i) {
+        ASSERT_TRUE(port.SendMessage(INVALID_HANDLE, i, payload, sizeof(payload)));
+    }
+    PMessagePortBatchEntry  entries[8];
+    std::vector<uint8_t>    buffer(100);
+
+    // Two 40 byte messages fit in 100 bytes, the third is left in the queue.
+    EXPECT_EQ(port.ReceiveMultipleDeadline(m_Control, entries, 8, buffer.data(), buffer.size(), TimeValNanos::zero), 2);
+    EXPECT_EQ(entries[1].Offset, 40u);
+
+    EXPECT_EQ(port.ReceiveMultipleDeadline(m_Control, entries, 1, buffer.data(), buffer.size(), TimeValNanos::zero), 1);
+    EXPECT_EQ(entries[0].Code, 2);
+
+    // A message larger than the buffer is truncated when it is first in the batch.
+    EXPECT_EQ(port.ReceiveMultipleDeadline(m_Control, entries, 8, buffer.data(), 16, TimeValNanos::zero), 1);
+    EXPECT_EQ(entries[0].Code, 3);
+    EXPECT_EQ(entries[0].Length, 16u);
+}
+
+// Calls WaitForReply() from the handler of the first message, and records
+// the order messages are dispatched in.
+class ReplyWaitingLooper : public PLooper
+{
+public:
+    static constexpr int32_t CODE_REQUEST   = 1;
+    static constexpr int32_t CODE_REPLY     = 2;
+    static constexpr int32_t CODE_OTHER     = 3;
+
+    ReplyWaitingLooper() : PLooper("batch_reply_test", 16) {}
+
+    virtual bool HandleMessage(handler_id targetHandler, int32_t code, const void* data, size_t length) override
+    {
+        m_DispatchOrder.push_back(code);
+        if (code == CODE_REQUEST) {
+            m_ReplyReceived = WaitForReply(INVALID_HANDLE, CODE_REPLY);
+        }
+        return true;
+    }
+
+    std::vector<int32_t>    m_DispatchOrder;
+    bool                    m_ReplyReceived = false;
+};
+
+TEST_F(MessagePortBatch, LooperWaitForReplyConsumesBatch)
+{
+    ReplyWaitingLooper looper;
+
+    // All three messages are taken from the port in one batch, so the reply
+    // is already in the batch when the request handler starts waiting.
+    ASSERT_TRUE(looper.GetPort().SendMessage(INVALID_HANDLE, ReplyWaitingLooper::CODE_REQUEST, nullptr, 0));
+    ASSERT_TRUE(looper.GetPort().SendMessage(INVALID_HANDLE, ReplyWaitingLooper::CODE_OTHER, nullptr, 0));
+    ASSERT_TRUE(looper.GetPort().SendMessage(INVALID_HANDLE, ReplyWaitingLooper::CODE_REPLY, nullptr, 0));
+
+    CRITICAL_SCOPE(looper.GetMutex());
+    looper.Tick();
+
+    EXPECT_TRUE(looper.m_ReplyReceived);
+    const std::vector<int32_t> expectedOrder = { ReplyWaitingLooper::CODE_REQUEST, ReplyWaitingLooper::CODE_OTHER, ReplyWaitingLooper::CODE_REPLY };
+    EXPECT_EQ(looper.m_DispatchOrder, expectedOrder);
+}
+
+} // namespace message_port_batch_tests
@@ -0,0 +1,129 @@
+// mutex_benchmark_tests.cpp
+// Throughput of kernel mutex and semaphore lock/unlock pairs, uncontended
+// and with several threads hammering the same object. The numbers are
+// printed for comparison between builds; the assertions only check that
+// the objects stay consistent.
+//
+// Build notes:
+//  - Adjust MUTEXBENCH_DURATION_MS to trade accuracy for test time.
+
+#include <gtest/gtest.h>
+
+#include <semaphore.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <Threads/Mutex.h>
+#include <UnitTests/BenchmarkTestUtils.h>
+
+using namespace std::chrono;
+
+#ifndef MUTEXBENCH_DURATION_MS
+#  define MUTEXBENCH_DURATION_MS 250
+#endif
+#ifndef MUTEXBENCH_THREADS
+#  define MUTEXBENCH_THREADS 4
+#endif
+
+static constexpr milliseconds MutexBench_kDuration(MUTEXBENCH_DURATION_MS);
+
+// Run "lockUnlock" in a loop on "threadCount" threads for the benchmark
+// duration and return the total number of lock/unlock pairs per second.
+template<typename TLockUnlock>
+static double MeasurePairsPerSecond(int threadCount, TLockUnlock&& lockUnlock)
+{
+    std::atomic<bool>     start{false};
+    std::atomic<bool>     stop{false};
+    std::atomic<uint64_t> totalPairs{0};
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadCount; ++i)
+    {
+        threads.emplace_back([&]()
+            {
+                while (!start.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                uint64_t pairs = 0;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    lockUnlock();
+                    ++pairs;
+                }
+                totalPairs.fetch_add(pairs, std::memory_order_relaxed);
+            }
+        );
+    }
+    const auto startTime = steady_clock::now();
+    start.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(MutexBench_kDuration);
+    stop.store(true, std::memory_order_relaxed);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const double seconds = duration<double>(steady_clock::now() - startTime).count();
+    return double(totalPairs.load()) / seconds;
+}
+
+static void PrintResult(const char* name, int threadCount, double pairsPerSecond)
+{
+    BenchPrintf("%-28s threads=%d %10.0f pairs/s", name, threadCount, pairsPerSecond);
+}
+
+TEST(MutexBenchmark, PMutexUncontended)
+{
+    PMutex mutex("bench_uncontended", PEMutexRecursionMode_RaiseError);
+    const double rate = MeasurePairsPerSecond(1, [&mutex]() { mutex.Lock(); mutex.Unlock(); });
+    PrintResult("PMutex uncontended", 1, rate);
+    EXPECT_GT(rate, 0.0);
+    EXPECT_FALSE(mutex.IsLocked());
+}
+
+TEST(MutexBenchmark, PMutexContended)
+{
+    PMutex   mutex("bench_contended", PEMutexRecursionMode_RaiseError);
+    uint64_t counter = 0;
+    uint64_t pairs = 0;
+
+    const double rate = MeasurePairsPerSecond(MUTEXBENCH_THREADS, [&]()
+        {
+            mutex.Lock();
+            ++counter;
+            ++pairs;
+            mutex.Unlock();
+        }
+    );
+    PrintResult("PMutex contended", MUTEXBENCH_THREADS, rate);
+    EXPECT_GT(rate, 0.0);
+    EXPECT_EQ(counter, pairs);
+}
+
+TEST(MutexBenchmark, SemaphoreUncontended)
+{
+    sem_t semaphore;
+    ASSERT_EQ(sem_init(&semaphore, 0, 1), 0);
+    const double rate = MeasurePairsPerSecond(1, [&semaphore]() { sem_wait(&semaphore); sem_post(&semaphore); });
+    PrintResult("sem_t uncontended", 1, rate);
+    EXPECT_GT(rate, 0.0);
+
+    int value = -1;
+    EXPECT_EQ(sem_getvalue(&semaphore, &value), 0);
+    EXPECT_EQ(value, 1);
+    EXPECT_EQ(sem_destroy(&semaphore), 0);
+}
+
+TEST(MutexBenchmark, SemaphoreContended)
+{
+    sem_t semaphore;
+    ASSERT_EQ(sem_init(&semaphore, 0, 1), 0);
+    const double rate = MeasurePairsPerSecond(MUTEXBENCH_THREADS, [&semaphore]() { sem_wait(&semaphore); sem_post(&semaphore); });
+    PrintResult("sem_t contended", MUTEXBENCH_THREADS, rate);
+    EXPECT_GT(rate, 0.0);
+
+    int value = -1;
+    EXPECT_EQ(sem_getvalue(&semaphore, &value), 0);
+    EXPECT_EQ(value, 1);
+    EXPECT_EQ(sem_destroy(&semaphore), 0);
+}
@@ -168,6 +168,22 @@ TEST(PosixSem, PostOverflowIfAtMax) {
 #endif
 }
 
+TEST(PosixSem, CountIsLimitedToSysconfMax) {
+    const long maxValue = sysconf(_SC_SEM_VALUE_MAX);
+    ASSERT_GT(maxValue, 0);
+
+    sem_t s;
+    ASSERT_EQ(sem_init(&s, 0, unsigned(maxValue)), 0);
+    errno = 0;
+    EXPECT_EQ(sem_post(&s), -1);
+    EXPECT_EQ(errno, EOVERFLOW);
+    EXPECT_EQ(sem_destroy(&s), 0);
+
+    errno = 0;
+    EXPECT_EQ(sem_init(&s, 0, unsigned(maxValue) + 1), -1);
+    EXPECT_EQ(errno, EINVAL);
+}
+
 TEST(PosixSem, PostWakesExactlyOneWaiter) {
     sem_t s;
     ASSERT_EQ(sem_init(&s, 0, 0), 0);
@@ -1,12 +1,14 @@
 #include <gtest/gtest.h>
 
 #include <cstdint>
+#include <cstring>
 #include <limits>
 #include <string>
 #include <sys/stat.h>
 #include <vector>
 
 #include <Utils/String.h>
+#include <Utils/UnicodeCaseFolding.h>
 #include <Utils/UTF8Utils.h>
 
 namespace {
@@ -121,6 +123,18 @@ TEST(PStringUnicode, NoCaseComparisonUsesFullUnicodeCaseFolding)
     EXPECT_EQ(PString("\xf0\x90\x90\x80").compare_nocase("\xf0\x90\x90\xa8"), 0);
 }
 
+TEST(PStringUnicode, CaseFoldHashMatchesNoCaseComparison)
+{
+    auto hash = [](const char* text) { return unicode_case_fold_hash(text, text + strlen(text)); };
+
+    EXPECT_EQ(hash("ASCII"), hash("ascii"));
+    EXPECT_EQ(hash("\xc3\x98"), hash("\xc3\xb8"));
+    EXPECT_EQ(hash("\xce\xa3"), hash("\xcf\x82"));
+    EXPECT_EQ(hash("Stra\xc3\x9f" "e"), hash("STRASSE"));
+    EXPECT_EQ(hash("\xef\xac\x83"), hash("ffi"));
+    EXPECT_NE(hash("file1.txt"), hash("file2.txt"));
+}
+
 TEST(PStringUnicode, NoCaseComparisonUsesDefaultNonTurkicFolding)
 {
     EXPECT_EQ(PString("\xc4\xb0").compare_nocase("i\xcc\x87"), 0);